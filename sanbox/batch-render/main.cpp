@@ -0,0 +1,429 @@
+#include <donut/app/ApplicationBase.h>
+#include <donut/app/Camera.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/core/log.h>
+#include <donut/core/math/math.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/View.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/render/ForwardShadingPass.h>
+#include <donut/shaders/light_types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CachedScene.h"
+#include "CulledDrawStrategy.h"
+#include "ImageWriteQueue.h"
+#include "StressScene.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace {
+
+struct BatchParameters {
+    std::filesystem::path sceneFileName;
+    std::filesystem::path posesFileName;
+    std::filesystem::path outputDirectory = "batch-output";
+    // png or ppm from an sRGB target, exr from a linear half-float one.
+    std::string format = "png";
+    uint32_t width = 512;
+    uint32_t height = 512;
+    float verticalFovDegrees = 60.f;
+    // Views rendered into the slices of one target array and submitted together.
+    uint32_t batchSize = 8;
+    // Batches whose readback has not been taken yet; the GPU works on the later ones meanwhile.
+    uint32_t batchesInFlight = 3;
+    uint32_t writerThreads = 0;
+    std::string adapterName;
+    bool sceneCache = true;
+};
+
+struct CameraPose {
+    float3 position = 0.f;
+    float3 target = 0.f;
+};
+
+// One "px py pz tx ty tz" pose per line; empty lines and lines that start with # are skipped.
+bool LoadCameraPoses(const std::filesystem::path& fileName, std::vector<CameraPose>& poses) {
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        log::error("Cannot open camera poses '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    std::string line;
+    for (uint32_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+        const size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') {
+            continue;
+        }
+        CameraPose pose;
+        std::istringstream stream(line);
+        if (!(stream >> pose.position.x >> pose.position.y >> pose.position.z >> pose.target.x >> pose.target.y >> pose.target.z)) {
+            log::error("%s:%u: expected 'px py pz tx ty tz'", fileName.generic_string().c_str(), lineNumber);
+            return false;
+        }
+        poses.push_back(pose);
+    }
+    return true;
+}
+
+// Renders the poses of a file in batches: every view of a batch draws into its own slice of the target
+// arrays, and the batch is recorded and submitted as one command list. The views share the BVH of the
+// culler, which is brought up to date once per batch. Each batch copies its slices to a staging array of
+// its own; it is only read back when its slot comes around again, and the images are encoded and written
+// by an ImageWriteQueue, so that the GPU is kept busy while the CPU waits on the disk.
+class BatchRenderer {
+public:
+    BatchRenderer(nvrhi::IDevice* device, const BatchParameters& params)
+        : m_Device(device)
+        , m_Params(params)
+        , m_Hdr(params.format == "exr") {
+    }
+
+    bool Init() {
+        std::filesystem::path frameworkShaderPath
+            = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(m_Device->getGraphicsAPI());
+        auto rootFS = std::make_shared<vfs::RootFileSystem>();
+        rootFS->mount("/shaders/donut", frameworkShaderPath);
+
+        m_ShaderFactory = std::make_shared<engine::ShaderFactory>(m_Device, rootFS, "/shaders");
+        m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(m_Device, m_ShaderFactory);
+
+        if (!LoadScene()) {
+            return false;
+        }
+
+        // Every view of every batch in flight writes its own version of the view constants.
+        render::ForwardShadingPass::CreateParameters forwardParams;
+        forwardParams.numConstantBufferVersions = (m_Params.batchSize + 1) * (m_Params.batchesInFlight + 1);
+        m_ForwardShadingPass = std::make_unique<render::ForwardShadingPass>(m_Device, m_CommonPasses);
+        m_ForwardShadingPass->Init(*m_ShaderFactory, forwardParams);
+        m_DrawStrategy = std::make_unique<sanbox::CulledDrawStrategy>();
+
+        CreateTargets();
+        m_CommandList = m_Device->createCommandList();
+        return true;
+    }
+
+    // Returns the number of images that could not be read back or written.
+    uint64_t Run(const std::vector<CameraPose>& poses) {
+        std::error_code error;
+        std::filesystem::create_directories(m_Params.outputDirectory, error);
+
+        sanbox::ImageWriteQueue writer(m_Params.writerThreads, m_Params.batchSize * m_Params.batchesInFlight);
+        log::info("Rendering %zu poses at %ux%u, %u views per batch, %u batches in flight, %u writer threads", poses.size(), m_Params.width,
+            m_Params.height, m_Params.batchSize, m_Params.batchesInFlight, writer.GetThreadCount());
+
+        const auto startTime = std::chrono::steady_clock::now();
+        uint32_t batchIndex = 0;
+        for (uint32_t first = 0; first < uint32_t(poses.size()); first += m_Params.batchSize, batchIndex++) {
+            ReadbackSlot& slot = m_Slots[batchIndex % m_Slots.size()];
+            if (slot.pending) {
+                RetireBatch(slot, writer);
+            }
+            RenderBatch(slot, poses, first, std::min(m_Params.batchSize, uint32_t(poses.size()) - first));
+        }
+        for (uint32_t i = 0; i < uint32_t(m_Slots.size()); i++) {
+            ReadbackSlot& slot = m_Slots[(batchIndex + i) % m_Slots.size()];
+            if (slot.pending) {
+                RetireBatch(slot, writer);
+            }
+        }
+        writer.Flush();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+        const sanbox::ImageWriteStatistics stats = writer.GetStatistics();
+        log::info("%llu images in %.2f s: %.1f images/s, %u batches, %.1f MB written", (unsigned long long)stats.images, seconds,
+            double(stats.images) / std::max(seconds, 1e-6), batchIndex, double(stats.bytes) / double(1 << 20));
+        log::info("Waited %.0f ms for the GPU and %.0f ms for the writers; encoding took %.1f ms per image", m_GpuWaitMs, stats.blockedMs,
+            stats.encodeMs / double(std::max<uint64_t>(stats.images + stats.failures, 1)));
+        if (m_ReadbackFailures > 0) {
+            log::error("%llu images could not be read back", (unsigned long long)m_ReadbackFailures);
+        }
+        return stats.failures + m_ReadbackFailures;
+    }
+
+private:
+    struct ReadbackSlot {
+        nvrhi::StagingTextureHandle staging;
+        nvrhi::EventQueryHandle query;
+        uint32_t firstPose = 0;
+        uint32_t viewCount = 0;
+        bool pending = false;
+    };
+
+    bool LoadScene() {
+        auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
+        m_TextureCache = std::make_shared<engine::TextureCache>(m_Device, nativeFS, nullptr);
+
+        std::filesystem::path cacheDirectory;
+        if (m_Params.sceneCache) {
+            cacheDirectory = app::GetDirectoryWithExecutable() / "scene-cache";
+        }
+        m_Scene = std::make_unique<sanbox::CachedScene>(m_Device, *m_ShaderFactory, nativeFS, m_TextureCache, cacheDirectory);
+        if (!m_Scene->Load(m_Params.sceneFileName)) {
+            log::error("Cannot load scene '%s'", m_Params.sceneFileName.generic_string().c_str());
+            return false;
+        }
+        m_TextureCache->ProcessRenderingThreadCommands(*m_CommonPasses, 0.f);
+        m_TextureCache->LoadingFinished();
+        m_Scene->FinishedLoading(0);
+
+        engine::SceneGraph& sceneGraph = *m_Scene->GetSceneGraph();
+        const auto hasDirectionalLight = [&] {
+            for (const auto& light : sceneGraph.GetLights()) {
+                if (light->GetLightType() == LightType_Directional) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        if (!hasDirectionalLight()) {
+            sanbox::AddSunLight(sceneGraph);
+            m_Scene->RefreshSceneGraph(0);
+        }
+        log::info("Scene loaded in %.0f ms, %zu mesh instances", m_Scene->GetLoadStatistics().loadMs, sceneGraph.GetMeshInstances().size());
+        return true;
+    }
+
+    void CreateTargets() {
+        const nvrhi::Format colorFormat = m_Hdr ? nvrhi::Format::RGBA16_FLOAT : nvrhi::Format::SRGBA8_UNORM;
+        auto textureDesc = nvrhi::TextureDesc()
+                               .setDimension(nvrhi::TextureDimension::Texture2DArray)
+                               .setWidth(m_Params.width)
+                               .setHeight(m_Params.height)
+                               .setArraySize(m_Params.batchSize)
+                               .setClearValue(nvrhi::Color(0.f))
+                               .setIsRenderTarget(true)
+                               .setKeepInitialState(true);
+        m_ColorTarget = m_Device->createTexture(
+            textureDesc.setFormat(colorFormat).setInitialState(nvrhi::ResourceStates::RenderTarget).setDebugName("BatchColor"));
+        m_DepthTarget = m_Device->createTexture(
+            textureDesc.setFormat(nvrhi::Format::D32).setInitialState(nvrhi::ResourceStates::DepthWrite).setDebugName("BatchDepth"));
+
+        m_Framebuffer = std::make_unique<engine::FramebufferFactory>(m_Device);
+        m_Framebuffer->RenderTargets = {m_ColorTarget};
+        m_Framebuffer->DepthTarget = m_DepthTarget;
+
+        auto stagingDesc = nvrhi::TextureDesc()
+                               .setDimension(nvrhi::TextureDimension::Texture2DArray)
+                               .setWidth(m_Params.width)
+                               .setHeight(m_Params.height)
+                               .setArraySize(m_Params.batchSize)
+                               .setFormat(colorFormat)
+                               .setInitialState(nvrhi::ResourceStates::CopyDest)
+                               .setKeepInitialState(true)
+                               .setDebugName("BatchReadback");
+        m_Slots.resize(m_Params.batchesInFlight);
+        for (ReadbackSlot& slot : m_Slots) {
+            slot.staging = m_Device->createStagingTexture(stagingDesc, nvrhi::CpuAccessMode::Read);
+            slot.query = m_Device->createEventQuery();
+        }
+
+        const float aspect = float(m_Params.width) / float(m_Params.height);
+        for (uint32_t i = 0; i < m_Params.batchSize; i++) {
+            auto view = std::make_shared<engine::PlanarView>();
+            view->SetViewport(nvrhi::Viewport(float(m_Params.width), float(m_Params.height)));
+            view->SetArraySlice(int(i));
+            view->SetMatrices(affine3::identity(), perspProjD3DStyleReverse(radians(m_Params.verticalFovDegrees), aspect, 0.1f));
+            m_Views.push_back(view);
+        }
+    }
+
+    void RenderBatch(ReadbackSlot& slot, const std::vector<CameraPose>& poses, uint32_t firstPose, uint32_t viewCount) {
+        m_BatchView.ClearViews();
+        for (uint32_t i = 0; i < viewCount; i++) {
+            app::FirstPersonCamera camera;
+            camera.LookAt(poses[firstPose + i].position, poses[firstPose + i].target);
+            engine::PlanarView& view = *m_Views[i];
+            view.SetMatrices(camera.GetWorldToViewMatrix(), view.GetProjectionMatrix(false));
+            view.UpdateCache();
+            m_BatchView.AddView(m_Views[i]);
+        }
+
+        m_CommandList->open();
+        m_CommandList->clearTextureFloat(m_ColorTarget, nvrhi::AllSubresources, nvrhi::Color(0.f));
+        m_CommandList->clearDepthStencilTexture(m_DepthTarget, nvrhi::AllSubresources, true, 0.f, false, 0);
+
+        render::ForwardShadingPass::Context context;
+        m_ForwardShadingPass->PrepareLights(context, m_CommandList, m_Scene->GetSceneGraph()->GetLights(), 1.0f, 0.3f, {});
+        m_DrawStrategy->SyncInstances(*m_Scene->GetSceneGraph(), viewCount);
+        render::RenderCompositeView(m_CommandList, &m_BatchView, &m_BatchView, *m_Framebuffer, m_Scene->GetSceneGraph()->GetRootNode(),
+            *m_DrawStrategy, *m_ForwardShadingPass, context, "BatchViews");
+
+        for (uint32_t i = 0; i < viewCount; i++) {
+            const nvrhi::TextureSlice slice = nvrhi::TextureSlice().setArraySlice(i);
+            m_CommandList->copyTexture(slot.staging, slice, m_ColorTarget, slice);
+        }
+        m_CommandList->close();
+        m_Device->executeCommandList(m_CommandList);
+        m_Device->setEventQuery(slot.query, nvrhi::CommandQueue::Graphics);
+        m_Device->runGarbageCollection();
+
+        slot.firstPose = firstPose;
+        slot.viewCount = viewCount;
+        slot.pending = true;
+    }
+
+    void RetireBatch(ReadbackSlot& slot, sanbox::ImageWriteQueue& writer) {
+        const auto waitStart = std::chrono::steady_clock::now();
+        m_Device->waitEventQuery(slot.query);
+        m_GpuWaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+
+        const size_t rowBytes = size_t(m_Params.width) * (m_Hdr ? 8 : 4);
+        for (uint32_t i = 0; i < slot.viewCount; i++) {
+            const nvrhi::TextureSlice slice = nvrhi::TextureSlice().setArraySlice(i);
+            size_t rowPitch = 0;
+            const auto* data = static_cast<const uint8_t*>(m_Device->mapStagingTexture(slot.staging, slice, nvrhi::CpuAccessMode::Read, &rowPitch));
+            if (!data) {
+                log::error("Cannot map the readback of pose %u", slot.firstPose + i);
+                m_ReadbackFailures++;
+                continue;
+            }
+
+            std::vector<uint8_t> pixels(rowBytes * m_Params.height);
+            for (uint32_t y = 0; y < m_Params.height; y++) {
+                memcpy(pixels.data() + y * rowBytes, data + y * rowPitch, rowBytes);
+            }
+            m_Device->unmapStagingTexture(slot.staging);
+
+            char name[32];
+            snprintf(name, sizeof(name), "%06u.%s", slot.firstPose + i, m_Params.format.c_str());
+            const std::filesystem::path fileName = m_Params.outputDirectory / name;
+            if (m_Hdr) {
+                sanbox::ImageRgba16F image;
+                image.width = m_Params.width;
+                image.height = m_Params.height;
+                image.pixels.resize(pixels.size() / sizeof(uint16_t));
+                memcpy(image.pixels.data(), pixels.data(), pixels.size());
+                writer.Push(fileName, std::move(image));
+            } else {
+                sanbox::ImageRgba8 image;
+                image.width = m_Params.width;
+                image.height = m_Params.height;
+                image.pixels = std::move(pixels);
+                writer.Push(fileName, std::move(image));
+            }
+        }
+        slot.pending = false;
+    }
+
+    nvrhi::DeviceHandle m_Device;
+    BatchParameters m_Params;
+    bool m_Hdr;
+
+    std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
+    std::shared_ptr<engine::CommonRenderPasses> m_CommonPasses;
+    std::shared_ptr<engine::TextureCache> m_TextureCache;
+    std::unique_ptr<sanbox::CachedScene> m_Scene;
+    std::unique_ptr<render::ForwardShadingPass> m_ForwardShadingPass;
+    std::unique_ptr<sanbox::CulledDrawStrategy> m_DrawStrategy;
+
+    nvrhi::TextureHandle m_ColorTarget;
+    nvrhi::TextureHandle m_DepthTarget;
+    std::unique_ptr<engine::FramebufferFactory> m_Framebuffer;
+    std::vector<std::shared_ptr<engine::PlanarView>> m_Views;
+    engine::CompositeView m_BatchView;
+    nvrhi::CommandListHandle m_CommandList;
+    std::vector<ReadbackSlot> m_Slots;
+    double m_GpuWaitMs = 0.0;
+    uint64_t m_ReadbackFailures = 0;
+};
+
+} // namespace
+
+// Renders the camera poses of a file to images without a window, loading the scene once.
+// Options: --poses FILE --output DIR --format png|exr|ppm --width N --height N --fov DEGREES --scene FILE
+//   --batch-size N --batches-in-flight N --writer-threads N --adapter NAME --no-scene-cache, and the graphics
+//   API options of donut. On lavapipe: -vk --adapter llvmpipe.
+int main(int argc, const char** argv) {
+    BatchParameters params;
+    params.sceneFileName = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Assets/Models/Sponza/glTF/Sponza.gltf";
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!strcmp(arg, "--poses") && hasValue) {
+            params.posesFileName = argv[++i];
+        } else if (!strcmp(arg, "--output") && hasValue) {
+            params.outputDirectory = argv[++i];
+        } else if (!strcmp(arg, "--format") && hasValue) {
+            params.format = argv[++i];
+        } else if (!strcmp(arg, "--width") && hasValue) {
+            params.width = uint32_t(std::max(1, atoi(argv[++i])));
+        } else if (!strcmp(arg, "--height") && hasValue) {
+            params.height = uint32_t(std::max(1, atoi(argv[++i])));
+        } else if (!strcmp(arg, "--fov") && hasValue) {
+            params.verticalFovDegrees = std::clamp(float(atof(argv[++i])), 1.f, 170.f);
+        } else if (!strcmp(arg, "--scene") && hasValue) {
+            params.sceneFileName = argv[++i];
+        } else if (!strcmp(arg, "--batch-size") && hasValue) {
+            params.batchSize = uint32_t(std::clamp(atoi(argv[++i]), 1, 64));
+        } else if (!strcmp(arg, "--batches-in-flight") && hasValue) {
+            params.batchesInFlight = uint32_t(std::clamp(atoi(argv[++i]), 1, 8));
+        } else if (!strcmp(arg, "--writer-threads") && hasValue) {
+            params.writerThreads = uint32_t(std::max(0, atoi(argv[++i])));
+        } else if (!strcmp(arg, "--adapter") && hasValue) {
+            params.adapterName = argv[++i];
+        } else if (!strcmp(arg, "--no-scene-cache")) {
+            params.sceneCache = false;
+        }
+    }
+
+    if (params.format != "png" && params.format != "exr" && params.format != "ppm") {
+        log::error("Unknown image format '%s'; expected png, exr or ppm", params.format.c_str());
+        return 1;
+    }
+    if (params.posesFileName.empty()) {
+        log::error("No camera poses; pass them with --poses FILE");
+        return 1;
+    }
+    std::vector<CameraPose> poses;
+    if (!LoadCameraPoses(params.posesFileName, poses)) {
+        return 1;
+    }
+
+    const nvrhi::GraphicsAPI api = app::GetGraphicsAPIFromCommandLine(argc, argv);
+    app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
+
+    app::DeviceCreationParameters deviceParams;
+    deviceParams.backBufferWidth = params.width;
+    deviceParams.backBufferHeight = params.height;
+    deviceParams.adapterNameSubstring = std::wstring(params.adapterName.begin(), params.adapterName.end());
+#ifdef _DEBUG
+    deviceParams.enableDebugRuntime = true;
+    deviceParams.enableNvrhiValidationLayer = true;
+#endif
+
+    if (!deviceManager->CreateHeadlessDevice(deviceParams)) {
+        log::fatal("Cannot initialize a graphics device with the requested parameters");
+        return 1;
+    }
+
+    int exitCode = 0;
+    {
+        BatchRenderer renderer(deviceManager->GetDevice(), params);
+        if (!renderer.Init()) {
+            exitCode = 1;
+        } else if (renderer.Run(poses) != 0) {
+            exitCode = 2;
+        }
+    }
+
+    deviceManager->Shutdown();
+    delete deviceManager;
+    return exitCode;
+}
@@ -0,0 +1,799 @@
+#include "Benchmark.h"
+
+#include <donut/core/log.h>
+#include <json/json.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+#include "ImageUtils.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+BenchmarkParameters ParseBenchmarkCommandLine(int argc, const char* const* argv) {
+    BenchmarkParameters params;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+        auto takeValue = [&]() -> const char* {
+            if (!value) {
+                log::warning("Missing value for command line option '%s'", arg);
+                return nullptr;
+            }
+            i++;
+            return value;
+        };
+
+        if (!strcmp(arg, "--headless")) {
+            params.headless = true;
+        } else if (!strcmp(arg, "--width")) {
+            if (const char* v = takeValue()) {
+                params.width = uint32_t(std::max(1, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--height")) {
+            if (const char* v = takeValue()) {
+                params.height = uint32_t(std::max(1, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--frames")) {
+            if (const char* v = takeValue()) {
+                params.frameCount = uint32_t(std::max(1, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--warmup")) {
+            if (const char* v = takeValue()) {
+                params.warmupFrames = uint32_t(std::max(0, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--adapter")) {
+            if (const char* v = takeValue()) {
+                params.adapterName = v;
+            }
+        } else if (!strcmp(arg, "--camera-path")) {
+            if (const char* v = takeValue()) {
+                params.cameraPath = v;
+            }
+        } else if (!strcmp(arg, "--record-camera-path")) {
+            if (const char* v = takeValue()) {
+                params.recordCameraPath = v;
+            }
+        } else if (!strcmp(arg, "--benchmark-json")) {
+            if (const char* v = takeValue()) {
+                params.jsonOutput = v;
+            }
+        } else if (!strcmp(arg, "--benchmark-csv")) {
+            if (const char* v = takeValue()) {
+                params.csvOutput = v;
+            }
+        } else if (!strcmp(arg, "--baseline")) {
+            if (const char* v = takeValue()) {
+                params.baseline = v;
+            }
+        } else if (!strcmp(arg, "--regression-threshold")) {
+            if (const char* v = takeValue()) {
+                params.regressionThreshold = float(atof(v));
+            }
+        } else if (!strcmp(arg, "--profile-trace")) {
+            if (const char* v = takeValue()) {
+                params.traceOutput = v;
+            }
+        } else if (!strcmp(arg, "--no-profiler-overlay")) {
+            params.profilerOverlay = false;
+        } else if (!strcmp(arg, "--frames-in-flight")) {
+            if (const char* v = takeValue()) {
+                params.framesInFlight = uint32_t(std::max(1, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--recording-threads")) {
+            if (const char* v = takeValue()) {
+                params.recordingThreads = uint32_t(std::max(0, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--no-bvh-culling")) {
+            params.bvhCulling = false;
+        } else if (!strcmp(arg, "--gpu-driven")) {
+            params.gpuDriven = true;
+        } else if (!strcmp(arg, "--occlusion-culling")) {
+            params.gpuDriven = true;
+            params.occlusionCulling = true;
+        } else if (!strcmp(arg, "--stress-lights")) {
+            if (const char* v = takeValue()) {
+                params.stressLights = uint32_t(std::max(0, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--naive-light-loop")) {
+            params.naiveLightLoop = true;
+        } else if (!strcmp(arg, "--tiled-lighting")) {
+            params.tiledLighting = true;
+        } else if (!strcmp(arg, "--compact-gbuffer")) {
+            params.compactGBuffer = true;
+        } else if (!strcmp(arg, "--no-scene-cache")) {
+            params.sceneCache = false;
+        } else if (!strcmp(arg, "--rebuild-scene-cache")) {
+            params.rebuildSceneCache = true;
+        } else if (!strcmp(arg, "--no-pipeline-cache")) {
+            params.pipelineCache = false;
+        } else if (!strcmp(arg, "--sync-loading")) {
+            params.asyncLoading = false;
+        } else if (!strcmp(arg, "--texture-upload-budget")) {
+            if (const char* v = takeValue()) {
+                params.textureUploadBudgetMs = std::max(0.f, float(atof(v)));
+            }
+        } else if (!strcmp(arg, "--texture-streaming")) {
+            params.textureStreaming = true;
+        } else if (!strcmp(arg, "--texture-budget")) {
+            if (const char* v = takeValue()) {
+                params.textureBudgetMB = uint32_t(std::max(1, atoi(v)));
+            }
+        } else if (!strcmp(arg, "--optimize-meshes")) {
+            params.meshOptimization = true;
+        } else if (!strcmp(arg, "--quantize-vertices")) {
+            params.vertexQuantization = true;
+        } else if (!strcmp(arg, "--mesh-lods")) {
+            params.meshLods = true;
+        } else if (!strcmp(arg, "--lod-error-pixels")) {
+            if (const char* v = takeValue()) {
+                params.lodErrorPixels = std::max(0.01f, float(atof(v)));
+            }
+        } else if (!strcmp(arg, "--instance-grid")) {
+            if (const char* v = takeValue()) {
+                unsigned columns = 0, rows = 0;
+                if (sscanf(v, "%ux%u", &columns, &rows) == 2) {
+                    params.gridColumns = columns;
+                    params.gridRows = rows;
+                } else {
+                    log::warning("Expected COLUMNSxROWS for --instance-grid, got '%s'", v);
+                }
+            }
+        } else if (!strcmp(arg, "--animate-grid")) {
+            params.animateGrid = true;
+        } else if (!strcmp(arg, "--soa-transforms")) {
+            params.soaTransforms = true;
+        } else if (!strcmp(arg, "--bindless-materials")) {
+            params.bindlessMaterials = true;
+        } else if (!strcmp(arg, "--target-frame-ms")) {
+            if (const char* v = takeValue()) {
+                params.targetFrameMs = std::max(0.f, float(atof(v)));
+            }
+        } else if (!strcmp(arg, "--min-render-scale")) {
+            if (const char* v = takeValue()) {
+                params.minRenderScale = std::clamp(float(atof(v)), 0.1f, 1.f);
+            }
+        } else if (!strcmp(arg, "--max-render-scale")) {
+            if (const char* v = takeValue()) {
+                params.maxRenderScale = std::clamp(float(atof(v)), 0.1f, 1.f);
+            }
+        } else if (!strcmp(arg, "--upscale-sharpness")) {
+            if (const char* v = takeValue()) {
+                params.upscaleSharpness = std::clamp(float(atof(v)), 0.f, 1.f);
+            }
+        } else if (!strcmp(arg, "--shadows")) {
+            params.shadows = true;
+        } else if (!strcmp(arg, "--shadow-map-size")) {
+            if (const char* v = takeValue()) {
+                params.shadowMapSize = uint32_t(std::clamp(atoi(v), 256, 8192));
+            }
+        } else if (!strcmp(arg, "--no-shadow-cache")) {
+            params.shadowCache = false;
+        } else if (!strcmp(arg, "--decoupled-update")) {
+            params.decoupledUpdate = true;
+        } else if (!strcmp(arg, "--update-rate")) {
+            if (const char* v = takeValue()) {
+                params.updateRate = std::clamp(float(atof(v)), 1.f, 1000.f);
+            }
+        } else if (!strcmp(arg, "--screenshot")) {
+            if (const char* v = takeValue()) {
+                params.screenshot = v;
+            }
+        } else if (!strcmp(arg, "--reference-image")) {
+            if (const char* v = takeValue()) {
+                params.referenceImage = v;
+            }
+        } else if (!strcmp(arg, "--image-tolerance")) {
+            if (const char* v = takeValue()) {
+                params.imageTolerance = float(atof(v));
+            }
+        }
+    }
+
+    return params;
+}
+
+bool CameraPath::Load(const std::filesystem::path& fileName) {
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        log::error("Cannot open camera path '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    m_Keyframes.clear();
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::istringstream stream(line);
+        CameraKeyframe keyframe;
+        stream >> keyframe.time >> keyframe.position.x >> keyframe.position.y >> keyframe.position.z >> keyframe.target.x >> keyframe.target.y
+            >> keyframe.target.z;
+        if (stream.fail()) {
+            log::warning("Skipping malformed camera keyframe '%s'", line.c_str());
+            continue;
+        }
+        AddKeyframe(keyframe);
+    }
+
+    return !m_Keyframes.empty();
+}
+
+bool CameraPath::Save(const std::filesystem::path& fileName) const {
+    std::ofstream file(fileName);
+    if (!file.is_open()) {
+        log::error("Cannot write camera path '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    file << "# time position.xyz target.xyz\n";
+    for (const CameraKeyframe& keyframe : m_Keyframes) {
+        file << keyframe.time << ' ' << keyframe.position.x << ' ' << keyframe.position.y << ' ' << keyframe.position.z << ' ' << keyframe.target.x
+             << ' ' << keyframe.target.y << ' ' << keyframe.target.z << '\n';
+    }
+
+    return true;
+}
+
+void CameraPath::AddKeyframe(const CameraKeyframe& keyframe) {
+    auto it = std::upper_bound(m_Keyframes.begin(), m_Keyframes.end(), keyframe.time,
+        [](float time, const CameraKeyframe& other) { return time < other.time; });
+    m_Keyframes.insert(it, keyframe);
+}
+
+void CameraPath::Evaluate(float time, float3& position, float3& target) const {
+    if (m_Keyframes.empty()) {
+        return;
+    }
+
+    if (time <= m_Keyframes.front().time) {
+        position = m_Keyframes.front().position;
+        target = m_Keyframes.front().target;
+        return;
+    }
+
+    if (time >= m_Keyframes.back().time) {
+        position = m_Keyframes.back().position;
+        target = m_Keyframes.back().target;
+        return;
+    }
+
+    auto next = std::upper_bound(
+        m_Keyframes.begin(), m_Keyframes.end(), time, [](float t, const CameraKeyframe& other) { return t < other.time; });
+    auto prev = next - 1;
+
+    float span = next->time - prev->time;
+    float t = span > 0.f ? (time - prev->time) / span : 0.f;
+    position = lerp(prev->position, next->position, t);
+    target = lerp(prev->target, next->target, t);
+}
+
+float CameraPath::GetDuration() const {
+    return m_Keyframes.empty() ? 0.f : m_Keyframes.back().time;
+}
+
+CameraPath CameraPath::CreateDefaultSponzaPath() {
+    // Walks down the nave, turns around under the far arch and comes back along the side aisle.
+    CameraPath path;
+    path.AddKeyframe({0.f, float3(-10.f, 1.8f, 0.f), float3(10.f, 1.8f, 0.f)});
+    path.AddKeyframe({4.f, float3(0.f, 1.8f, 0.f), float3(10.f, 2.5f, 0.f)});
+    path.AddKeyframe({8.f, float3(9.f, 1.8f, 0.f), float3(9.f, 1.8f, 10.f)});
+    path.AddKeyframe({10.f, float3(9.f, 1.8f, 3.5f), float3(-10.f, 1.8f, 3.5f)});
+    path.AddKeyframe({16.f, float3(-9.f, 1.8f, 3.5f), float3(0.f, 8.f, 0.f)});
+    path.AddKeyframe({20.f, float3(-10.f, 1.8f, 0.f), float3(10.f, 1.8f, 0.f)});
+    return path;
+}
+
+CameraPathRecorder::CameraPathRecorder(std::filesystem::path fileName, float interval)
+    : m_FileName(std::move(fileName))
+    , m_Interval(interval) {
+}
+
+CameraPathRecorder::~CameraPathRecorder() {
+    if (!m_Path.IsEmpty()) {
+        m_Path.Save(m_FileName);
+    }
+}
+
+void CameraPathRecorder::Animate(float elapsedTimeSeconds, const app::BaseCamera& camera) {
+    m_Time += elapsedTimeSeconds;
+    if (m_Time < m_NextSample) {
+        return;
+    }
+
+    m_NextSample = m_Time + m_Interval;
+    m_Path.AddKeyframe({m_Time, camera.GetPosition(), camera.GetPosition() + camera.GetDir()});
+}
+
+FrameTimer::FrameTimer(nvrhi::IDevice* device, uint32_t queryLatency)
+    : m_Device(device) {
+    m_Slots.resize(std::max(queryLatency, 2u));
+    for (Slot& slot : m_Slots) {
+        slot.query = m_Device->createTimerQuery();
+        slot.completion = m_Device->createEventQuery();
+    }
+    m_Resolved.reserve(m_Slots.size());
+    m_Completions.reserve(m_Slots.size());
+}
+
+void FrameTimer::BeginFrame(nvrhi::ICommandList* commandList) {
+    Slot& slot = m_Slots[m_FrameNumber % m_Slots.size()];
+    if (slot.pending) {
+        // The ring is full: the oldest query has to be consumed before it can be reused.
+        m_Resolved.emplace_back(slot.frameNumber, double(m_Device->getTimerQueryTime(slot.query)) * 1000.0);
+        m_Device->resetTimerQuery(slot.query);
+    }
+    if (slot.completionPending) {
+        ObserveCompletions(slot.frameNumber + 1);
+    }
+
+    slot.frameNumber = m_FrameNumber;
+    slot.pending = true;
+    slot.hasInputTime = false;
+    commandList->beginTimerQuery(slot.query);
+}
+
+void FrameTimer::SetInputTime(Clock::time_point inputTime) {
+    Slot& slot = m_Slots[m_FrameNumber % m_Slots.size()];
+    slot.inputTime = inputTime;
+    slot.hasInputTime = true;
+}
+
+void FrameTimer::EndFrame(nvrhi::ICommandList* commandList) {
+    commandList->endTimerQuery(m_Slots[m_FrameNumber % m_Slots.size()].query);
+    m_FrameNumber++;
+}
+
+void FrameTimer::BeginSubmit() {
+    m_SubmitStart = std::chrono::high_resolution_clock::now();
+}
+
+void FrameTimer::EndSubmit() {
+    auto now = std::chrono::high_resolution_clock::now();
+    m_LastSubmitMs = std::chrono::duration<double, std::milli>(now - m_SubmitStart).count();
+
+    // Behind everything the frame submitted, whichever lists it was spread over.
+    if (m_FrameNumber > 0) {
+        Slot& slot = m_Slots[(m_FrameNumber - 1) % m_Slots.size()];
+        if (!slot.completionPending) {
+            m_Device->setEventQuery(slot.completion, nvrhi::CommandQueue::Graphics);
+            slot.completionPending = true;
+        }
+    }
+}
+
+void FrameTimer::BeginFenceWait() {
+    m_FenceWaitStart = std::chrono::high_resolution_clock::now();
+}
+
+void FrameTimer::EndFenceWait() {
+    auto now = std::chrono::high_resolution_clock::now();
+    m_LastFenceWaitMs = std::chrono::duration<double, std::milli>(now - m_FenceWaitStart).count();
+
+    // A frame that the wait was for has just completed, which is when the completions are seen the soonest.
+    ObserveCompletions(0);
+}
+
+void FrameTimer::ObserveCompletions(uint64_t waitFrameNumber) {
+    // The ring is in frame order from the slot of the next frame, and the queue finishes frames in order.
+    for (size_t i = 0; i < m_Slots.size(); i++) {
+        Slot& slot = m_Slots[(m_FrameNumber + i) % m_Slots.size()];
+        if (!slot.completionPending) {
+            continue;
+        }
+        if (slot.frameNumber < waitFrameNumber) {
+            m_Device->waitEventQuery(slot.completion);
+        } else if (!m_Device->pollEventQuery(slot.completion)) {
+            break;
+        }
+
+        const Clock::time_point now = Clock::now();
+        FrameCompletion& completion = m_Completions.emplace_back();
+        completion.frameNumber = slot.frameNumber;
+        if (slot.hasInputTime) {
+            completion.inputLatencyMs = std::chrono::duration<double, std::milli>(now - slot.inputTime).count();
+        }
+        if (m_HasCompletion) {
+            completion.completionIntervalMs = std::chrono::duration<double, std::milli>(now - m_LastCompletion).count();
+        }
+        m_LastCompletion = now;
+        m_HasCompletion = true;
+
+        m_Device->resetEventQuery(slot.completion);
+        slot.completionPending = false;
+    }
+}
+
+TimingStatistics TimingStatistics::Compute(std::vector<double> values) {
+    TimingStatistics stats;
+    if (values.empty()) {
+        return stats;
+    }
+
+    std::sort(values.begin(), values.end());
+
+    auto percentile = [&values](double p) {
+        size_t rank = size_t(std::ceil(p * double(values.size())));
+        return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+    };
+
+    stats.mean = std::accumulate(values.begin(), values.end(), 0.0) / double(values.size());
+    stats.min = values.front();
+    stats.max = values.back();
+    stats.p50 = percentile(0.50);
+    stats.p95 = percentile(0.95);
+    stats.p99 = percentile(0.99);
+    return stats;
+}
+
+void BenchmarkRecorder::AddFrame(const FrameTimingSample& sample) {
+    m_Frames.push_back(sample);
+}
+
+void BenchmarkRecorder::SetGpuTime(uint64_t frame, double gpuMs) {
+    for (auto it = m_Frames.rbegin(); it != m_Frames.rend(); ++it) {
+        if (it->frame == frame) {
+            it->gpuMs = gpuMs;
+            return;
+        }
+    }
+}
+
+void BenchmarkRecorder::SetCompletion(const FrameCompletion& completion) {
+    for (auto it = m_Frames.rbegin(); it != m_Frames.rend(); ++it) {
+        if (it->frame == completion.frameNumber) {
+            it->inputLatencyMs = completion.inputLatencyMs;
+            it->completionIntervalMs = completion.completionIntervalMs;
+            return;
+        }
+    }
+}
+
+void BenchmarkRecorder::SetMetric(const std::string& name, double value) {
+    for (auto& metric : m_Metrics) {
+        if (metric.first == name) {
+            metric.second = value;
+            return;
+        }
+    }
+    m_Metrics.emplace_back(name, value);
+}
+
+namespace {
+
+struct MetricColumn {
+    const char* name;
+    double FrameTimingSample::*field;
+};
+
+const MetricColumn c_MetricColumns[] = {
+    {"cpuFrameMs", &FrameTimingSample::cpuFrameMs},
+    {"submitMs", &FrameTimingSample::submitMs},
+    {"fenceWaitMs", &FrameTimingSample::fenceWaitMs},
+    {"frameIntervalMs", &FrameTimingSample::frameIntervalMs},
+    {"gpuMs", &FrameTimingSample::gpuMs},
+    {"inputLatencyMs", &FrameTimingSample::inputLatencyMs},
+    {"completionIntervalMs", &FrameTimingSample::completionIntervalMs},
+};
+
+std::vector<double> GatherMetric(const std::vector<FrameTimingSample>& frames, double FrameTimingSample::*field) {
+    std::vector<double> values;
+    values.reserve(frames.size());
+    for (const FrameTimingSample& frame : frames) {
+        if (frame.*field >= 0.0) {
+            values.push_back(frame.*field);
+        }
+    }
+    return values;
+}
+
+Json::Value StatisticsToJson(const TimingStatistics& stats) {
+    Json::Value node;
+    node["mean"] = stats.mean;
+    node["min"] = stats.min;
+    node["max"] = stats.max;
+    node["p50"] = stats.p50;
+    node["p95"] = stats.p95;
+    node["p99"] = stats.p99;
+    return node;
+}
+
+} // namespace
+
+bool BenchmarkRecorder::WriteJson(const std::filesystem::path& fileName, const std::string& sampleName) const {
+    Json::Value root;
+    root["sample"] = sampleName;
+    root["frameCount"] = Json::UInt64(m_Frames.size());
+
+    Json::Value& summary = root["summary"];
+    for (const MetricColumn& column : c_MetricColumns) {
+        summary[column.name] = StatisticsToJson(TimingStatistics::Compute(GatherMetric(m_Frames, column.field)));
+    }
+
+    Json::Value& metrics = root["metrics"];
+    metrics = Json::objectValue;
+    for (const auto& metric : m_Metrics) {
+        metrics[metric.first] = metric.second;
+    }
+
+    Json::Value& frames = root["frames"];
+    frames = Json::arrayValue;
+    for (const FrameTimingSample& frame : m_Frames) {
+        Json::Value node;
+        node["frame"] = Json::UInt64(frame.frame);
+        for (const MetricColumn& column : c_MetricColumns) {
+            node[column.name] = frame.*column.field;
+        }
+        frames.append(node);
+    }
+
+    std::ofstream file(fileName);
+    if (!file.is_open()) {
+        log::error("Cannot write benchmark results to '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
+    writer->write(root, &file);
+    return true;
+}
+
+bool BenchmarkRecorder::WriteCsv(const std::filesystem::path& fileName) const {
+    std::ofstream file(fileName);
+    if (!file.is_open()) {
+        log::error("Cannot write benchmark results to '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    file << "frame";
+    for (const MetricColumn& column : c_MetricColumns) {
+        file << ',' << column.name;
+    }
+    file << '\n';
+
+    for (const FrameTimingSample& frame : m_Frames) {
+        file << frame.frame;
+        for (const MetricColumn& column : c_MetricColumns) {
+            file << ',' << frame.*column.field;
+        }
+        file << '\n';
+    }
+
+    return true;
+}
+
+bool BenchmarkRecorder::CompareWithBaseline(const std::filesystem::path& fileName, float threshold) const {
+    std::ifstream file(fileName);
+    if (!file.is_open()) {
+        log::error("Cannot open benchmark baseline '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    Json::CharReaderBuilder builder;
+    Json::Value baseline;
+    std::string errors;
+    if (!Json::parseFromStream(builder, file, &baseline, &errors)) {
+        log::error("Cannot parse benchmark baseline '%s': %s", fileName.generic_string().c_str(), errors.c_str());
+        return false;
+    }
+
+    bool passed = true;
+    for (const MetricColumn& column : c_MetricColumns) {
+        if (column.field == &FrameTimingSample::fenceWaitMs) {
+            // Waiting less on the GPU is not a regression, and more waiting shows up in the other columns.
+            continue;
+        }
+
+        const Json::Value& reference = baseline["summary"][column.name];
+        if (!reference.isObject()) {
+            continue;
+        }
+
+        TimingStatistics current = TimingStatistics::Compute(GatherMetric(m_Frames, column.field));
+        for (auto [percentileName, value] : {std::make_pair("p50", current.p50), std::make_pair("p95", current.p95)}) {
+            double expected = reference[percentileName].asDouble();
+            if (expected <= 0.0) {
+                continue;
+            }
+
+            double ratio = value / expected;
+            if (ratio > 1.0 + double(threshold)) {
+                log::error("Regression in %s.%s: %.3f ms vs. baseline %.3f ms (+%.1f%%)", column.name, percentileName, value, expected,
+                    (ratio - 1.0) * 100.0);
+                passed = false;
+            } else {
+                log::info("%s.%s: %.3f ms vs. baseline %.3f ms", column.name, percentileName, value, expected);
+            }
+        }
+    }
+
+    return passed;
+}
+
+void ReportProfilerMetrics(const Profiler& profiler, BenchmarkRecorder& recorder) {
+    for (const ProfilerScopeStatistics& scope : profiler.GetLatestScopes()) {
+        recorder.SetMetric("gpu." + scope.name, scope.meanGpuMs);
+        recorder.SetMetric("cpu." + scope.name, scope.meanCpuMs);
+    }
+    for (const ProfilerCounter& counter : profiler.GetCounters()) {
+        recorder.SetMetric("counter." + counter.name, counter.mean);
+    }
+}
+
+int RunHeadlessBenchmark(app::DeviceManager* deviceManager, app::IRenderPass& renderPass, IBenchmarkTarget& target,
+    const BenchmarkParameters& params, const char* sampleName) {
+    nvrhi::IDevice* device = deviceManager->GetDevice();
+
+    auto colorDesc = nvrhi::TextureDesc()
+                         .setDimension(nvrhi::TextureDimension::Texture2D)
+                         .setWidth(params.width)
+                         .setHeight(params.height)
+                         .setFormat(nvrhi::Format::SRGBA8_UNORM)
+                         .setIsRenderTarget(true)
+                         .setInitialState(nvrhi::ResourceStates::RenderTarget)
+                         .setKeepInitialState(true)
+                         .setClearValue(nvrhi::Color(0.f))
+                         .setDebugName("HeadlessBackBuffer");
+    nvrhi::TextureHandle colorBuffer = device->createTexture(colorDesc);
+    nvrhi::FramebufferHandle framebuffer = device->createFramebuffer(nvrhi::FramebufferDesc().addColorAttachment(colorBuffer));
+
+    renderPass.BackBufferResized(params.width, params.height, 1);
+
+    CameraPath path;
+    if (params.cameraPath.empty() || !path.Load(params.cameraPath)) {
+        path = CameraPath::CreateDefaultSponzaPath();
+    }
+
+    const uint32_t totalFrames = params.warmupFrames + params.frameCount;
+    const float pathTimeStep = path.GetDuration() / float(std::max(params.frameCount, 1u));
+
+    BenchmarkRecorder recorder;
+    FrameTimer* frameTimer = target.GetFrameTimer();
+
+    log::info("Rendering %u frames (%u warm-up) at %ux%u, %u frames in flight", params.frameCount, params.warmupFrames, params.width, params.height,
+        params.framesInFlight);
+
+    while (target.IsLoading()) {
+        renderPass.Animate(params.frameTimeStep);
+        renderPass.Render(framebuffer);
+    }
+    if (target.HasLoadingFailed()) {
+        log::error("Loading failed; there is nothing to benchmark");
+        return 1;
+    }
+
+    auto gpuTimeCallback = [&recorder](uint64_t frame, double gpuMs) { recorder.SetGpuTime(frame, gpuMs); };
+    auto completionCallback = [&recorder](const FrameCompletion& completion) { recorder.SetCompletion(completion); };
+    auto previousFrameStart = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t frameIndex = 0; frameIndex < totalFrames; frameIndex++) {
+        bool measured = frameIndex >= params.warmupFrames;
+        float pathTime = measured ? float(frameIndex - params.warmupFrames) * pathTimeStep : 0.f;
+
+        float3 position, lookAt;
+        path.Evaluate(pathTime, position, lookAt);
+
+        uint64_t timerFrame = frameTimer->GetFrameNumber();
+        auto frameStart = std::chrono::high_resolution_clock::now();
+
+        renderPass.Animate(params.frameTimeStep);
+        target.SetCameraPose(position, lookAt);
+        renderPass.Render(framebuffer);
+
+        auto frameEnd = std::chrono::high_resolution_clock::now();
+
+        if (measured) {
+            FrameTimingSample sample;
+            sample.frame = timerFrame;
+            sample.cpuFrameMs = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+            sample.submitMs = frameTimer->GetLastSubmitTime();
+            sample.fenceWaitMs = frameTimer->GetLastFenceWaitTime();
+            sample.frameIntervalMs = std::chrono::duration<double, std::milli>(frameStart - previousFrameStart).count();
+            recorder.AddFrame(sample);
+        }
+        previousFrameStart = frameStart;
+
+        // No per-frame wait: the sample's frame pipeline throttles the CPU on its own fences.
+        device->runGarbageCollection();
+        frameTimer->Resolve(false, gpuTimeCallback);
+        frameTimer->ResolveCompletions(false, completionCallback);
+    }
+
+    device->waitForIdle();
+    frameTimer->Resolve(true, gpuTimeCallback);
+    frameTimer->ResolveCompletions(true, completionCallback);
+
+    bool imageMatches = true;
+    if (!params.screenshot.empty() || !params.referenceImage.empty()) {
+        ImageRgba8 image;
+        if (!ReadbackTexture(device, colorBuffer, nvrhi::ResourceStates::RenderTarget, image)) {
+            imageMatches = false;
+        } else {
+            if (!params.screenshot.empty()) {
+                WriteImagePpm(params.screenshot, image);
+            }
+
+            ImageRgba8 reference;
+            ImageDifference difference;
+            if (!params.referenceImage.empty()) {
+                if (!ReadImagePpm(params.referenceImage, reference) || !CompareImages(image, reference, difference)) {
+                    log::error("Cannot compare the last frame with '%s'", params.referenceImage.generic_string().c_str());
+                    imageMatches = false;
+                } else {
+                    imageMatches = difference.rmse <= params.imageTolerance;
+                    if (imageMatches) {
+                        log::info("Image difference: RMSE %.5f, max %.3f, %llu pixels differ", difference.rmse, difference.maxError,
+                            (unsigned long long)difference.differingPixels);
+                    } else {
+                        log::error("Image difference: RMSE %.5f exceeds the tolerance of %.5f (max %.3f, %llu pixels differ)", difference.rmse,
+                            params.imageTolerance, difference.maxError, (unsigned long long)difference.differingPixels);
+                    }
+                    recorder.SetMetric("imageRmse", difference.rmse);
+                }
+            }
+        }
+    }
+
+    // Fraction of the shorter of CPU recording and GPU execution that was hidden behind the other one.
+    double overlapSum = 0.0;
+    uint32_t overlapFrames = 0;
+    for (const FrameTimingSample& frame : recorder.GetFrames()) {
+        double cpuMs = frame.cpuFrameMs - frame.fenceWaitMs;
+        double shorter = std::min(cpuMs, frame.gpuMs);
+        if (frame.gpuMs < 0.0 || frame.frameIntervalMs <= 0.0 || shorter <= 0.0) {
+            continue;
+        }
+        overlapSum += std::clamp((cpuMs + frame.gpuMs - frame.frameIntervalMs) / shorter, 0.0, 1.0);
+        overlapFrames++;
+    }
+    recorder.SetMetric("framesInFlight", double(params.framesInFlight));
+    recorder.SetMetric("cpuGpuOverlap", overlapFrames ? overlapSum / double(overlapFrames) : 0.0);
+
+    // Frame pacing: how far the time between completed frames strays from its mean.
+    const std::vector<double> intervals = GatherMetric(recorder.GetFrames(), &FrameTimingSample::completionIntervalMs);
+    if (!intervals.empty()) {
+        const double mean = std::accumulate(intervals.begin(), intervals.end(), 0.0) / double(intervals.size());
+        double variance = 0.0;
+        for (double interval : intervals) {
+            variance += (interval - mean) * (interval - mean);
+        }
+        recorder.SetMetric("framePacingStdDevMs", std::sqrt(variance / double(intervals.size())));
+    }
+
+    target.ReportMetrics(recorder);
+
+    for (const MetricColumn& column : c_MetricColumns) {
+        TimingStatistics stats = TimingStatistics::Compute(GatherMetric(recorder.GetFrames(), column.field));
+        log::info("%-10s p50 %7.3f ms  p95 %7.3f ms  p99 %7.3f ms", column.name, stats.p50, stats.p95, stats.p99);
+    }
+
+    if (!params.jsonOutput.empty()) {
+        recorder.WriteJson(params.jsonOutput, sampleName);
+    }
+    if (!params.csvOutput.empty()) {
+        recorder.WriteCsv(params.csvOutput);
+    }
+
+    if (!params.baseline.empty() && !recorder.CompareWithBaseline(params.baseline, params.regressionThreshold)) {
+        return 2;
+    }
+
+    return imageMatches ? 0 : 3;
+}
+
+} // namespace sanbox
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <donut/app/ApplicationBase.h>
+#include <donut/app/Camera.h>
+#include <donut/app/DeviceManager.h>
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Profiler.h"
+
+namespace sanbox {
+
+struct BenchmarkParameters {
+    bool headless = false;
+    uint32_t width = 1024;
+    uint32_t height = 1024;
+    uint32_t warmupFrames = 16;
+    uint32_t frameCount = 600;
+    float frameTimeStep = 1.f / 60.f;
+    std::string adapterName;
+    std::filesystem::path cameraPath;
+    std::filesystem::path recordCameraPath;
+    std::filesystem::path jsonOutput;
+    std::filesystem::path csvOutput;
+    std::filesystem::path baseline;
+    float regressionThreshold = 0.1f;
+    std::filesystem::path traceOutput;
+    bool profilerOverlay = true;
+    uint32_t framesInFlight = 2;
+    // Threads that record the main geometry pass; 0 picks one per core, 1 records on the frame's command list.
+    uint32_t recordingThreads = 0;
+    // Cull with the SIMD BVH culler; otherwise use donut's InstancedOpaqueDrawStrategy.
+    bool bvhCulling = true;
+    // Cull on the GPU and draw with indirect arguments.
+    bool gpuDriven = false;
+    // Two-phase Hi-Z occlusion culling on top of gpuDriven, in the samples that have a depth buffer to build it from.
+    bool occlusionCulling = false;
+    // Point lights added to the scene for the lighting stress test.
+    uint32_t stressLights = 0;
+    // Shade every point and spot light at every pixel instead of only those of the pixel's light cluster.
+    bool naiveLightLoop = false;
+    // Start the deferred sample with tiled light culling; it can be toggled at runtime with T.
+    bool tiledLighting = false;
+    // Load the scene from a binary package next to the executable when it matches the source files. A run
+    // that has to build the package reports the cold load time in sceneLoadMs, later runs the warm one.
+    bool sceneCache = true;
+    bool rebuildSceneCache = false;
+    // The pipelines created by the last run, recreated at startup; off for a cold start.
+    bool pipelineCache = true;
+    // Load the scene on a background thread and show it progressively; headless runs still wait for the
+    // whole scene before the warm-up frames. Texture uploads take at most the budget per frame.
+    bool asyncLoading = true;
+    float textureUploadBudgetMs = 2.f;
+    // Stream the material mips in and out on demand, keeping at most the budget resident.
+    bool textureStreaming = false;
+    uint32_t textureBudgetMB = 256;
+    // Reorder the indices and vertices of the static meshes for the post-transform cache, overdraw and
+    // vertex fetch before they are uploaded, and draw them from quantized vertex buffers.
+    bool meshOptimization = false;
+    bool vertexQuantization = false;
+    // Simplified index lists per mesh, cached next to the scene package, drawn when their projected error
+    // is below the threshold. Only the CPU-culled draw path selects LODs.
+    bool meshLods = false;
+    float lodErrorPixels = 1.f;
+    // Copies of the scene on a grid of columns x rows cells, the original in the first; 0 leaves the scene
+    // alone. The copies bob and sway when animated, and the SoA hierarchy updates their transforms
+    // instead of the donut scene graph.
+    uint32_t gridColumns = 0;
+    uint32_t gridRows = 0;
+    bool animateGrid = false;
+    bool soaTransforms = false;
+    // Bind every material of the scene once per pass from a descriptor table, instead of a binding set
+    // per material. The CPU draw paths only.
+    bool bindlessMaterials = false;
+    // Render into a part of the targets sized to keep the GPU time of a frame under the target, and upscale
+    // it to the window with sharpening; 0 renders at the full size. Scales are per axis.
+    float targetFrameMs = 0.f;
+    float minRenderScale = 0.5f;
+    float maxRenderScale = 1.f;
+    float upscaleSharpness = 0.5f;
+    // Cascaded shadow maps for the directional light, one is added to scenes without. The static casters of
+    // a cascade are kept from frame to frame unless caching is off; cascades are square, of the given size.
+    // Not drawn from quantized vertices.
+    bool shadows = false;
+    uint32_t shadowMapSize = 2048;
+    bool shadowCache = true;
+    // Animate the camera and the SoA hierarchy on a simulation thread at the update rate, which hands the
+    // render thread a snapshot of each update. Without SoA transforms the grid stays on the render thread.
+    bool decoupledUpdate = false;
+    float updateRate = 120.f;
+    // Deferred sample: the G-buffer layout with octahedral normals, metal-rough parameters and an R11G11B10 lit
+    // image instead of donut's. It is lit with tiled lighting only.
+    bool compactGBuffer = false;
+    // The last headless frame can be saved, and compared against a reference to validate a render path.
+    std::filesystem::path screenshot;
+    std::filesystem::path referenceImage;
+    float imageTolerance = 0.01f;
+};
+
+// Recognized options:
+//   --headless --width N --height N --frames N --warmup N --adapter NAME
+//   --camera-path FILE --record-camera-path FILE
+//   --benchmark-json FILE --benchmark-csv FILE --baseline FILE --regression-threshold F
+//   --profile-trace FILE --no-profiler-overlay --frames-in-flight N --recording-threads N
+//   --no-bvh-culling --gpu-driven --occlusion-culling --screenshot FILE --reference-image FILE --image-tolerance F
+//   --stress-lights N --naive-light-loop --tiled-lighting --no-scene-cache --rebuild-scene-cache --no-pipeline-cache
+//   --sync-loading --texture-upload-budget MS --texture-streaming --texture-budget MB
+//   --optimize-meshes --quantize-vertices --mesh-lods --lod-error-pixels F
+//   --instance-grid CxR --animate-grid --soa-transforms --bindless-materials
+//   --target-frame-ms MS --min-render-scale F --max-render-scale F --upscale-sharpness F
+//   --shadows --shadow-map-size N --no-shadow-cache --decoupled-update --update-rate HZ --compact-gbuffer
+BenchmarkParameters ParseBenchmarkCommandLine(int argc, const char* const* argv);
+
+struct CameraKeyframe {
+    float time = 0.f;
+    dm::float3 position = 0.f;
+    dm::float3 target = 0.f;
+};
+
+// Piecewise-linear camera path stored as one "time px py pz tx ty tz" keyframe per line.
+class CameraPath {
+public:
+    bool Load(const std::filesystem::path& fileName);
+    bool Save(const std::filesystem::path& fileName) const;
+
+    void AddKeyframe(const CameraKeyframe& keyframe);
+    void Evaluate(float time, dm::float3& position, dm::float3& target) const;
+
+    [[nodiscard]] float GetDuration() const;
+    [[nodiscard]] bool IsEmpty() const {
+        return m_Keyframes.empty();
+    }
+
+    static CameraPath CreateDefaultSponzaPath();
+
+private:
+    std::vector<CameraKeyframe> m_Keyframes;
+};
+
+// Samples the camera of a windowed run at a fixed interval and writes the path on destruction.
+class CameraPathRecorder {
+public:
+    CameraPathRecorder(std::filesystem::path fileName, float interval = 0.1f);
+    ~CameraPathRecorder();
+
+    void Animate(float elapsedTimeSeconds, const donut::app::BaseCamera& camera);
+
+private:
+    std::filesystem::path m_FileName;
+    CameraPath m_Path;
+    float m_Interval;
+    float m_Time = 0.f;
+    float m_NextSample = 0.f;
+};
+
+struct FrameCompletion {
+    uint64_t frameNumber = 0;
+    // From the input time of the frame to when its completion was seen; negative without an input time.
+    double inputLatencyMs = -1.0;
+    // Since the completion of the frame before; negative for the first frame.
+    double completionIntervalMs = -1.0;
+};
+
+// Measures the GPU duration of a frame with a ring of timer queries, and the CPU cost of its submission
+// and of waiting for a free frame slot. The ring must be longer than the number of frames in flight.
+// An event query behind each submission tells when the frame finished on the GPU, which stands in for
+// its presentation. Completions are seen when the fence wait returns and whenever the timer is resolved,
+// so when the CPU does not wait on the GPU they are late by up to the time between those calls.
+class FrameTimer {
+public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    FrameTimer(nvrhi::IDevice* device, uint32_t queryLatency);
+
+    void BeginFrame(nvrhi::ICommandList* commandList);
+    // When the input shown by the frame that is being recorded was sampled.
+    void SetInputTime(Clock::time_point inputTime);
+    void EndFrame(nvrhi::ICommandList* commandList);
+
+    void BeginSubmit();
+    void EndSubmit();
+
+    void BeginFenceWait();
+    void EndFenceWait();
+
+    // Collects GPU times that are available without waiting; with wait = true, blocks for all of them.
+    template <typename Callback>
+    void Resolve(bool wait, Callback&& callback);
+    // Collects the frames seen to have completed, in order; with wait = true, blocks for all of them.
+    template <typename Callback>
+    void ResolveCompletions(bool wait, Callback&& callback);
+
+    [[nodiscard]] uint64_t GetFrameNumber() const {
+        return m_FrameNumber;
+    }
+    [[nodiscard]] double GetLastSubmitTime() const {
+        return m_LastSubmitMs;
+    }
+    [[nodiscard]] double GetLastFenceWaitTime() const {
+        return m_LastFenceWaitMs;
+    }
+
+private:
+    struct Slot {
+        nvrhi::TimerQueryHandle query;
+        nvrhi::EventQueryHandle completion;
+        uint64_t frameNumber = 0;
+        Clock::time_point inputTime;
+        bool pending = false;
+        bool hasInputTime = false;
+        bool completionPending = false;
+    };
+
+    // Waits for the frames before waitFrameNumber and polls the others, oldest first.
+    void ObserveCompletions(uint64_t waitFrameNumber);
+
+    nvrhi::DeviceHandle m_Device;
+    std::vector<Slot> m_Slots;
+    std::vector<std::pair<uint64_t, double>> m_Resolved;
+    std::vector<FrameCompletion> m_Completions;
+    uint64_t m_FrameNumber = 0;
+    double m_LastSubmitMs = 0.0;
+    double m_LastFenceWaitMs = 0.0;
+    Clock::time_point m_SubmitStart;
+    Clock::time_point m_FenceWaitStart;
+    Clock::time_point m_LastCompletion;
+    bool m_HasCompletion = false;
+};
+
+template <typename Callback>
+void FrameTimer::Resolve(bool wait, Callback&& callback) {
+    for (const auto& [frameNumber, gpuMs] : m_Resolved) {
+        callback(frameNumber, gpuMs);
+    }
+    m_Resolved.clear();
+
+    for (Slot& slot : m_Slots) {
+        if (!slot.pending) {
+            continue;
+        }
+        if (!wait && !m_Device->pollTimerQuery(slot.query)) {
+            continue;
+        }
+        callback(slot.frameNumber, double(m_Device->getTimerQueryTime(slot.query)) * 1000.0);
+        m_Device->resetTimerQuery(slot.query);
+        slot.pending = false;
+    }
+}
+
+template <typename Callback>
+void FrameTimer::ResolveCompletions(bool wait, Callback&& callback) {
+    ObserveCompletions(wait ? m_FrameNumber : 0);
+    for (const FrameCompletion& completion : m_Completions) {
+        callback(completion);
+    }
+    m_Completions.clear();
+}
+
+struct TimingStatistics {
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+
+    static TimingStatistics Compute(std::vector<double> values);
+};
+
+struct FrameTimingSample {
+    uint64_t frame = 0;
+    double cpuFrameMs = 0.0;
+    double submitMs = 0.0;
+    double fenceWaitMs = 0.0;
+    double frameIntervalMs = 0.0;
+    double gpuMs = -1.0;
+    // See FrameCompletion.
+    double inputLatencyMs = -1.0;
+    double completionIntervalMs = -1.0;
+};
+
+class BenchmarkRecorder {
+public:
+    void AddFrame(const FrameTimingSample& sample);
+    void SetGpuTime(uint64_t frame, double gpuMs);
+    void SetCompletion(const FrameCompletion& completion);
+
+    [[nodiscard]] const std::vector<FrameTimingSample>& GetFrames() const {
+        return m_Frames;
+    }
+
+    // Extra scalar results that a sample wants to publish next to the frame timings.
+    void SetMetric(const std::string& name, double value);
+
+    bool WriteJson(const std::filesystem::path& fileName, const std::string& sampleName) const;
+    bool WriteCsv(const std::filesystem::path& fileName) const;
+
+    // Returns false if any p50/p95 metric exceeds the baseline by more than the threshold.
+    bool CompareWithBaseline(const std::filesystem::path& fileName, float threshold) const;
+
+private:
+    std::vector<FrameTimingSample> m_Frames;
+    std::vector<std::pair<std::string, double>> m_Metrics;
+};
+
+// Publishes the whole-run mean of every profiler scope as "gpu.<scope>" and "cpu.<scope>" metrics,
+// and of every counter as "counter.<name>".
+void ReportProfilerMetrics(const Profiler& profiler, BenchmarkRecorder& recorder);
+
+class IBenchmarkTarget {
+public:
+    virtual ~IBenchmarkTarget() = default;
+
+    virtual void SetCameraPose(const dm::float3& position, const dm::float3& target) = 0;
+    virtual FrameTimer* GetFrameTimer() = 0;
+    // Frames are rendered, untimed, until this returns false.
+    virtual bool IsLoading() const {
+        return false;
+    }
+    // Loading stopped without a scene; the run exits with 1, as when Init fails.
+    virtual bool HasLoadingFailed() const {
+        return false;
+    }
+    virtual void ReportMetrics([[maybe_unused]] BenchmarkRecorder& recorder) {
+    }
+};
+
+// Renders a fixed number of frames into an offscreen framebuffer, replaying a camera path,
+// and writes the timings requested by the parameters. Returns the process exit code: 1 if loading failed,
+// 2 for a timing regression against the baseline, 3 if the last frame does not match the reference image.
+int RunHeadlessBenchmark(donut::app::DeviceManager* deviceManager, donut::app::IRenderPass& renderPass, IBenchmarkTarget& target,
+    const BenchmarkParameters& params, const char* sampleName);
+
+} // namespace sanbox
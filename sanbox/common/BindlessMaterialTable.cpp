@@ -0,0 +1,151 @@
+#include "BindlessMaterialTable.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+
+using namespace donut;
+using namespace donut::math;
+
+#include <donut/shaders/material_cb.h>
+
+#include "shaders/bindless_material_cb.h"
+
+namespace sanbox {
+
+namespace {
+
+struct MaterialTextureSlot {
+    std::shared_ptr<engine::LoadedTexture> engine::Material::*texture;
+    int MaterialConstants::*index;
+    int flag;
+};
+
+const MaterialTextureSlot c_TextureSlots[] = {
+    {&engine::Material::baseOrDiffuseTexture, &MaterialConstants::baseOrDiffuseTextureIndex, MaterialFlags_UseBaseOrDiffuseTexture},
+    {&engine::Material::metalRoughOrSpecularTexture, &MaterialConstants::metalRoughOrSpecularTextureIndex,
+        MaterialFlags_UseMetalRoughOrSpecularTexture},
+    {&engine::Material::normalTexture, &MaterialConstants::normalTextureIndex, MaterialFlags_UseNormalTexture},
+    {&engine::Material::emissiveTexture, &MaterialConstants::emissiveTextureIndex, MaterialFlags_UseEmissiveTexture},
+    {&engine::Material::occlusionTexture, &MaterialConstants::occlusionTextureIndex, MaterialFlags_UseOcclusionTexture},
+    {&engine::Material::transmissionTexture, &MaterialConstants::transmissionTextureIndex, MaterialFlags_UseTransmissionTexture},
+    {&engine::Material::opacityTexture, &MaterialConstants::opacityTextureIndex, MaterialFlags_UseOpacityTexture},
+};
+
+} // namespace
+
+BindlessMaterialTable::BindlessMaterialTable(nvrhi::IDevice* device, nvrhi::ISampler* sampler)
+    : m_Device(device)
+    , m_Sampler(sampler) {
+    nvrhi::BindlessLayoutDesc layoutDesc;
+    layoutDesc.setVisibility(nvrhi::ShaderType::Pixel)
+        .setMaxCapacity(c_MaxDescriptors)
+        .addRegisterSpace(nvrhi::BindingLayoutItem::Texture_SRV(BINDLESS_FORWARD_TEXTURE_SPACE))
+        .addRegisterSpace(nvrhi::BindingLayoutItem::Texture_SRV(BINDLESS_GBUFFER_TEXTURE_SPACE));
+    m_Layout = device->createBindlessLayout(layoutDesc);
+
+    m_DescriptorTable = device->createDescriptorTable(m_Layout);
+    device->resizeDescriptorTable(m_DescriptorTable, c_InitialCapacity, false);
+    m_Statistics.descriptorCapacity = c_InitialCapacity;
+}
+
+BindlessMaterialTable::~BindlessMaterialTable() = default;
+
+void BindlessMaterialTable::Update(nvrhi::ICommandList* commandList, const engine::SceneGraph& sceneGraph, uint64_t frameIndex) {
+    const uint32_t update = ++m_Statistics.updates;
+    m_Statistics.writtenDescriptors = 0;
+
+    // What the frames in flight may read has retired once they have.
+    auto retired = std::stable_partition(m_Retired.begin(), m_Retired.end(),
+        [frameIndex](const RetiredDescriptor& descriptor) { return descriptor.frameIndex + c_RetireFrames > frameIndex; });
+    for (auto it = retired; it != m_Retired.end(); ++it) {
+        m_FreeDescriptors.push_back(it->index);
+    }
+    m_Retired.erase(retired, m_Retired.end());
+
+    const auto& materials = sceneGraph.GetMaterials();
+    m_MaterialIndices.clear();
+    m_MaterialConstants.resize(materials.size());
+    for (size_t index = 0; index < materials.size(); index++) {
+        const engine::Material& material = *materials[index];
+        m_MaterialIndices.emplace(&material, uint32_t(index));
+
+        MaterialConstants& constants = m_MaterialConstants[index];
+        material.FillConstantBuffer(constants);
+        for (const MaterialTextureSlot& slot : c_TextureSlots) {
+            constants.*slot.index = GetTextureIndex(material.*slot.texture, update);
+            if (constants.*slot.index < 0) {
+                constants.flags &= ~slot.flag;
+            }
+        }
+    }
+
+    for (auto it = m_Descriptors.begin(); it != m_Descriptors.end();) {
+        if (it->second.usedByUpdate != update) {
+            m_Retired.push_back({it->second.texture, it->second.index, frameIndex});
+            it = m_Descriptors.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (materials.size() > m_MaterialCapacity) {
+        m_MaterialCapacity = std::max(uint32_t(materials.size()), m_MaterialCapacity * 2);
+        m_MaterialBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                      .setByteSize(size_t(m_MaterialCapacity) * sizeof(MaterialConstants))
+                                                      .setStructStride(sizeof(MaterialConstants))
+                                                      .setDebugName("BindlessMaterials")
+                                                      .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                                      .setKeepInitialState(true));
+    }
+    if (!m_MaterialConstants.empty()) {
+        commandList->writeBuffer(m_MaterialBuffer, m_MaterialConstants.data(), m_MaterialConstants.size() * sizeof(MaterialConstants));
+    }
+
+    m_Statistics.materials = uint32_t(materials.size());
+    m_Statistics.textures = uint32_t(m_Descriptors.size());
+}
+
+uint32_t BindlessMaterialTable::GetMaterialIndex(const engine::Material* material) const {
+    auto it = m_MaterialIndices.find(material);
+    return it != m_MaterialIndices.end() ? it->second : ~0u;
+}
+
+int32_t BindlessMaterialTable::GetTextureIndex(const std::shared_ptr<engine::LoadedTexture>& texture, uint32_t update) {
+    if (!texture || !texture->texture) {
+        return -1;
+    }
+
+    auto it = m_Descriptors.find(texture->texture);
+    if (it == m_Descriptors.end()) {
+        const uint32_t index = AllocateDescriptor();
+        if (index == ~0u) {
+            return -1;
+        }
+        m_Device->writeDescriptorTable(m_DescriptorTable, nvrhi::BindingSetItem::Texture_SRV(index, texture->texture));
+        m_Statistics.writtenDescriptors++;
+        it = m_Descriptors.emplace(texture->texture.Get(), Descriptor{texture->texture, index, 0}).first;
+    }
+    it->second.usedByUpdate = update;
+    return int32_t(it->second.index);
+}
+
+uint32_t BindlessMaterialTable::AllocateDescriptor() {
+    if (!m_FreeDescriptors.empty()) {
+        const uint32_t index = m_FreeDescriptors.back();
+        m_FreeDescriptors.pop_back();
+        return index;
+    }
+
+    if (m_DescriptorCount == c_MaxDescriptors) {
+        log::warning("The bindless material table is full; textures beyond %u are not sampled", c_MaxDescriptors);
+        return ~0u;
+    }
+    if (m_DescriptorCount == m_Statistics.descriptorCapacity) {
+        m_Statistics.descriptorCapacity = std::min(m_Statistics.descriptorCapacity * 2, c_MaxDescriptors);
+        m_Device->resizeDescriptorTable(m_DescriptorTable, m_Statistics.descriptorCapacity, true);
+    }
+    return m_DescriptorCount++;
+}
+
+} // namespace sanbox
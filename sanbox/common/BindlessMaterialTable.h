@@ -0,0 +1,100 @@
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct MaterialConstants;
+
+namespace sanbox {
+
+struct BindlessMaterialStatistics {
+    uint32_t materials = 0;
+    uint32_t textures = 0;
+    uint32_t descriptorCapacity = 0;
+    // Descriptors written by the last Update, for textures that had none.
+    uint32_t writtenDescriptors = 0;
+    uint32_t updates = 0;
+};
+
+// The materials of a scene in a form that passes bind once per pass: the constants of every material in
+// one structured buffer, and every texture they use in one descriptor table. Draws select their material
+// by index, and the constants hold the texture indices in the table.
+// A texture keeps its descriptor for as long as a material uses it. Loading and streaming replace texture
+// objects, so Update has to run whenever material textures change; the descriptors of the replaced textures
+// are reused only once the frames that may still read them have retired.
+class BindlessMaterialTable {
+public:
+    static constexpr uint32_t c_InitialCapacity = 1024;
+    // Upper bound of the table, which the descriptor layout has to declare up front.
+    static constexpr uint32_t c_MaxDescriptors = 64 * 1024;
+    // Longer than any frame pipeline keeps frames in flight.
+    static constexpr uint64_t c_RetireFrames = 4;
+
+    // All material textures are read with the one sampler.
+    BindlessMaterialTable(nvrhi::IDevice* device, nvrhi::ISampler* sampler);
+    // Out of line, since MaterialConstants comes from a shader header that only the source file includes.
+    ~BindlessMaterialTable();
+
+    void Update(nvrhi::ICommandList* commandList, const donut::engine::SceneGraph& sceneGraph, uint64_t frameIndex);
+
+    // ~0u for materials the last Update has not seen.
+    [[nodiscard]] uint32_t GetMaterialIndex(const donut::engine::Material* material) const;
+
+    // Lists the table at BINDLESS_FORWARD_TEXTURE_SPACE and BINDLESS_GBUFFER_TEXTURE_SPACE.
+    [[nodiscard]] nvrhi::IBindingLayout* GetLayout() const {
+        return m_Layout;
+    }
+    [[nodiscard]] nvrhi::IDescriptorTable* GetDescriptorTable() const {
+        return m_DescriptorTable;
+    }
+    // Recreated when the scene has more materials than it holds, after which the passes need new sets.
+    [[nodiscard]] nvrhi::IBuffer* GetMaterialBuffer() const {
+        return m_MaterialBuffer;
+    }
+    [[nodiscard]] nvrhi::ISampler* GetSampler() const {
+        return m_Sampler;
+    }
+    [[nodiscard]] const BindlessMaterialStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    struct Descriptor {
+        nvrhi::TextureHandle texture;
+        uint32_t index = 0;
+        uint32_t usedByUpdate = 0;
+    };
+    struct RetiredDescriptor {
+        // Frames in flight read the texture through the table, which does not hold it.
+        nvrhi::TextureHandle texture;
+        uint32_t index = 0;
+        uint64_t frameIndex = 0;
+    };
+
+    int32_t GetTextureIndex(const std::shared_ptr<donut::engine::LoadedTexture>& texture, uint32_t update);
+    uint32_t AllocateDescriptor();
+
+    nvrhi::DeviceHandle m_Device;
+    nvrhi::SamplerHandle m_Sampler;
+    nvrhi::BindingLayoutHandle m_Layout;
+    nvrhi::DescriptorTableHandle m_DescriptorTable;
+    nvrhi::BufferHandle m_MaterialBuffer;
+    uint32_t m_MaterialCapacity = 0;
+
+    std::unordered_map<nvrhi::ITexture*, Descriptor> m_Descriptors;
+    std::vector<RetiredDescriptor> m_Retired;
+    std::vector<uint32_t> m_FreeDescriptors;
+    uint32_t m_DescriptorCount = 0;
+
+    std::unordered_map<const donut::engine::Material*, uint32_t> m_MaterialIndices;
+    std::vector<MaterialConstants> m_MaterialConstants;
+    BindlessMaterialStatistics m_Statistics;
+};
+
+} // namespace sanbox
@@ -0,0 +1,631 @@
+#include "CachedScene.h"
+
+#include <donut/core/log.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/TextureCache.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "ContentHash.h"
+#include "MappedFile.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+namespace {
+
+constexpr uint32_t c_PackageMagic = 0x43534253; // "SBSC"
+constexpr uint32_t c_PackageVersion = 1;
+constexpr uint32_t c_None = ~0u;
+constexpr size_t c_SectionAlignment = 16;
+
+enum MaterialTexture : uint32_t {
+    MaterialTexture_BaseOrDiffuse,
+    MaterialTexture_MetalRoughOrSpecular,
+    MaterialTexture_Normal,
+    MaterialTexture_Emissive,
+    MaterialTexture_Occlusion,
+    MaterialTexture_Transmission,
+    MaterialTexture_Opacity,
+    MaterialTexture_Count
+};
+
+enum MaterialFlags : uint32_t {
+    MaterialFlags_UseSpecularGlossModel = 1u << 0,
+    MaterialFlags_DoubleSided = 1u << 1,
+    // Followed by one "enable" bit per MaterialTexture.
+    MaterialFlags_FirstTextureEnable = 1u << 2,
+};
+
+// Offset from the start of the package and element count.
+struct Section {
+    uint64_t offset = 0;
+    uint64_t count = 0;
+};
+
+struct StringRef {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+struct PackageHeader {
+    uint32_t magic = c_PackageMagic;
+    uint32_t version = c_PackageVersion;
+    uint64_t contentHash = 0;
+    uint64_t packageSize = 0;
+    Section strings;
+    Section materials;
+    Section bufferGroups;
+    Section meshes;
+    Section geometries;
+    Section nodes;
+};
+
+struct MaterialRecord {
+    StringRef name;
+    StringRef textures[MaterialTexture_Count];
+    uint32_t domain = 0;
+    uint32_t flags = 0;
+    float3 baseOrDiffuseColor;
+    float3 specularColor;
+    float3 emissiveColor;
+    float emissiveIntensity = 0.f;
+    float metalness = 0.f;
+    float roughness = 0.f;
+    float opacity = 0.f;
+    float alphaCutoff = 0.f;
+    float normalTextureScale = 0.f;
+    float occlusionStrength = 0.f;
+    float transmissionFactor = 0.f;
+};
+
+// Each stream is a section of the vertex or index type that BufferGroup stores.
+struct BufferGroupRecord {
+    Section indices;
+    Section positions;
+    Section texcoords1;
+    Section texcoords2;
+    Section normals;
+    Section tangents;
+};
+
+struct MeshRecord {
+    StringRef name;
+    uint32_t bufferGroup = 0;
+    uint32_t firstGeometry = 0;
+    uint32_t geometryCount = 0;
+    uint32_t indexOffset = 0;
+    uint32_t vertexOffset = 0;
+    uint32_t totalIndices = 0;
+    uint32_t totalVertices = 0;
+    box3 bounds;
+};
+
+struct GeometryRecord {
+    uint32_t material = c_None;
+    uint32_t indexOffsetInMesh = 0;
+    uint32_t vertexOffsetInMesh = 0;
+    uint32_t numIndices = 0;
+    uint32_t numVertices = 0;
+    box3 bounds;
+};
+
+// Nodes are stored parents first; the first node is the root.
+struct NodeRecord {
+    StringRef name;
+    uint32_t parent = c_None;
+    uint32_t mesh = c_None;
+    double3 translation;
+    double3 scaling;
+    // x, y, z, w
+    double rotation[4] = {};
+};
+
+// The scene file and the .bin buffers next to it define the geometry; images are not part of the package.
+bool HashSceneSources(const std::filesystem::path& sceneFileName, uint64_t& contentHash) {
+    std::vector<std::filesystem::path> sources = {sceneFileName};
+
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(sceneFileName.parent_path(), error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".bin") {
+            sources.push_back(entry.path());
+        }
+    }
+    std::sort(sources.begin() + 1, sources.end());
+
+    ContentHash hash;
+    hash.Add(&c_PackageVersion, sizeof(c_PackageVersion));
+    for (const std::filesystem::path& source : sources) {
+        MappedFile file;
+        if (!file.Open(source)) {
+            return false;
+        }
+        const std::string name = source.filename().generic_string();
+        hash.Add(name.data(), name.size());
+        hash.Add(file.GetData(), file.GetSize());
+    }
+
+    contentHash = hash.Get();
+    return true;
+}
+
+class PackageWriter {
+public:
+    PackageWriter() {
+        m_Data.resize(sizeof(PackageHeader));
+    }
+
+    template <typename T>
+    Section Append(const T* items, size_t count) {
+        m_Data.resize((m_Data.size() + c_SectionAlignment - 1) & ~(c_SectionAlignment - 1));
+        Section section{m_Data.size(), count};
+        if (count) {
+            const auto* bytes = reinterpret_cast<const uint8_t*>(items);
+            m_Data.insert(m_Data.end(), bytes, bytes + count * sizeof(T));
+        }
+        return section;
+    }
+
+    template <typename T>
+    Section Append(const std::vector<T>& items) {
+        return Append(items.data(), items.size());
+    }
+
+    StringRef AddString(const std::string& value) {
+        StringRef ref{uint32_t(m_Strings.size()), uint32_t(value.size())};
+        m_Strings += value;
+        return ref;
+    }
+
+    bool Write(const std::filesystem::path& fileName, PackageHeader header) {
+        header.strings = Append(m_Strings.data(), m_Strings.size());
+        header.packageSize = m_Data.size();
+        memcpy(m_Data.data(), &header, sizeof(header));
+
+        // Written next to the target and renamed, so a reader never maps a partial package.
+        std::filesystem::path temporaryFileName = fileName;
+        temporaryFileName += ".tmp";
+        {
+            std::ofstream file(temporaryFileName, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                return false;
+            }
+            file.write(reinterpret_cast<const char*>(m_Data.data()), std::streamsize(m_Data.size()));
+            if (!file.good()) {
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryFileName, fileName, error);
+        return !error;
+    }
+
+    [[nodiscard]] size_t GetSize() const {
+        return m_Data.size();
+    }
+
+private:
+    std::vector<uint8_t> m_Data;
+    std::string m_Strings;
+};
+
+class PackageReader {
+public:
+    explicit PackageReader(const MappedFile& file)
+        : m_File(file) {
+    }
+
+    // Null if the section does not lie within the package.
+    template <typename T>
+    const T* Get(const Section& section) const {
+        if (section.offset % alignof(T) != 0 || section.offset > m_File.GetSize()
+            || section.count > (m_File.GetSize() - section.offset) / sizeof(T)) {
+            return nullptr;
+        }
+        return reinterpret_cast<const T*>(m_File.GetData() + section.offset);
+    }
+
+    // Copies one stream out of the mapped pages; this is the only pass over the vertex data.
+    template <typename T>
+    bool Copy(const Section& section, std::vector<T>& destination) const {
+        const T* items = Get<T>(section);
+        if (!items) {
+            return false;
+        }
+        destination.assign(items, items + section.count);
+        return true;
+    }
+
+    void SetStrings(const char* strings, size_t size) {
+        m_Strings = strings;
+        m_StringsSize = size;
+    }
+
+    [[nodiscard]] std::string GetString(const StringRef& ref) const {
+        if (size_t(ref.offset) + ref.length > m_StringsSize) {
+            return std::string();
+        }
+        return std::string(m_Strings + ref.offset, ref.length);
+    }
+
+private:
+    const MappedFile& m_File;
+    const char* m_Strings = nullptr;
+    size_t m_StringsSize = 0;
+};
+
+template <typename T>
+uint32_t GetOrAddIndex(std::unordered_map<const T*, uint32_t>& indices, std::vector<const T*>& items, const T* item) {
+    auto [it, inserted] = indices.try_emplace(item, uint32_t(items.size()));
+    if (inserted) {
+        items.push_back(item);
+    }
+    return it->second;
+}
+
+} // namespace
+
+CachedScene::CachedScene(nvrhi::IDevice* device, engine::ShaderFactory& shaderFactory, std::shared_ptr<vfs::IFileSystem> fs,
+    std::shared_ptr<engine::TextureCache> textureCache, std::filesystem::path cacheDirectory, bool rebuild)
+    : Scene(device, shaderFactory, std::move(fs), textureCache, nullptr, nullptr)
+    , m_PackageTextureCache(std::move(textureCache))
+    , m_CacheDirectory(std::move(cacheDirectory))
+    , m_Rebuild(rebuild) {
+}
+
+bool CachedScene::Load(const std::filesystem::path& sceneFileName) {
+    using clock = std::chrono::high_resolution_clock;
+    const auto start = clock::now();
+    auto millisecondsSince = [](clock::time_point begin) {
+        return std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+    };
+
+    m_LoadStatistics = SceneLoadStatistics();
+    m_SceneFileName = sceneFileName;
+
+    uint64_t contentHash = 0;
+    const bool useCache = !m_CacheDirectory.empty() && HashSceneSources(sceneFileName, contentHash);
+    m_LoadStatistics.hashMs = useCache ? millisecondsSince(start) : 0.0;
+
+    const std::filesystem::path packageFileName = GetCacheFileName(".sbscene");
+    if (useCache && !m_Rebuild && LoadPackage(packageFileName, contentHash)) {
+        m_LoadStatistics.fromCache = true;
+        m_LoadStatistics.loadMs = millisecondsSince(start);
+        log::info("Loaded scene package '%s' in %.1f ms", packageFileName.generic_string().c_str(), m_LoadStatistics.loadMs);
+        return true;
+    }
+
+    if (!Scene::Load(sceneFileName)) {
+        return false;
+    }
+
+    if (useCache) {
+        std::error_code error;
+        std::filesystem::create_directories(m_CacheDirectory, error);
+        m_LoadStatistics.packageWritten = WritePackage(packageFileName, contentHash);
+    }
+
+    m_LoadStatistics.loadMs = millisecondsSince(start);
+    log::info("Loaded scene '%s' in %.1f ms", sceneFileName.generic_string().c_str(), m_LoadStatistics.loadMs);
+    return true;
+}
+
+bool CachedScene::WritePackage(const std::filesystem::path& packageFileName, uint64_t contentHash) const {
+    const std::shared_ptr<engine::SceneGraphNode>& root = m_SceneGraph ? m_SceneGraph->GetRootNode() : nullptr;
+    if (!root || !m_SceneGraph->GetAnimations().empty()) {
+        log::info("Scene has animations, not writing a package");
+        return false;
+    }
+
+    PackageWriter writer;
+    PackageHeader header;
+    header.contentHash = contentHash;
+
+    std::unordered_map<const engine::SceneGraphNode*, uint32_t> nodeIndices;
+    std::unordered_map<const engine::MeshInfo*, uint32_t> meshIndices;
+    std::vector<const engine::MeshInfo*> meshes;
+    std::vector<NodeRecord> nodeRecords;
+
+    for (engine::SceneGraphWalker walker(root.get()); walker; walker.Next(true)) {
+        engine::SceneGraphNode* node = walker.Get();
+
+        NodeRecord& record = nodeRecords.emplace_back();
+        record.name = writer.AddString(node->GetName());
+        record.parent = node == root.get() ? c_None : nodeIndices.at(node->GetParent());
+        record.translation = node->GetTranslation();
+        record.scaling = node->GetScaling();
+        const dquat& rotation = node->GetRotation();
+        record.rotation[0] = rotation.x;
+        record.rotation[1] = rotation.y;
+        record.rotation[2] = rotation.z;
+        record.rotation[3] = rotation.w;
+        nodeIndices[node] = uint32_t(nodeRecords.size() - 1);
+
+        if (const std::shared_ptr<engine::SceneGraphLeaf>& leaf = node->GetLeaf()) {
+            auto meshInstance = std::dynamic_pointer_cast<engine::MeshInstance>(leaf);
+            const engine::MeshInfo* mesh = meshInstance ? meshInstance->GetMesh().get() : nullptr;
+            if (!mesh || mesh->type != engine::MeshType::Triangles || mesh->skinPrototype || mesh->isMorphTargetAnimationMesh) {
+                log::info("Scene node '%s' is not a static triangle mesh, not writing a package", node->GetName().c_str());
+                return false;
+            }
+            record.mesh = GetOrAddIndex(meshIndices, meshes, mesh);
+        }
+    }
+
+    std::unordered_map<const engine::BufferGroup*, uint32_t> bufferGroupIndices;
+    std::unordered_map<const engine::Material*, uint32_t> materialIndices;
+    std::vector<const engine::BufferGroup*> bufferGroups;
+    std::vector<const engine::Material*> materials;
+    std::vector<MeshRecord> meshRecords;
+    std::vector<GeometryRecord> geometryRecords;
+
+    for (const engine::MeshInfo* mesh : meshes) {
+        MeshRecord& record = meshRecords.emplace_back();
+        record.name = writer.AddString(mesh->name);
+        record.bufferGroup = GetOrAddIndex(bufferGroupIndices, bufferGroups, mesh->buffers.get());
+        record.firstGeometry = uint32_t(geometryRecords.size());
+        record.geometryCount = uint32_t(mesh->geometries.size());
+        record.indexOffset = mesh->indexOffset;
+        record.vertexOffset = mesh->vertexOffset;
+        record.totalIndices = mesh->totalIndices;
+        record.totalVertices = mesh->totalVertices;
+        record.bounds = mesh->objectSpaceBounds;
+
+        for (const auto& geometry : mesh->geometries) {
+            if (geometry->type != engine::MeshGeometryPrimitiveType::Triangles) {
+                log::info("Mesh '%s' is not made of triangles, not writing a package", mesh->name.c_str());
+                return false;
+            }
+
+            GeometryRecord& geometryRecord = geometryRecords.emplace_back();
+            geometryRecord.material = geometry->material ? GetOrAddIndex(materialIndices, materials, geometry->material.get()) : c_None;
+            geometryRecord.indexOffsetInMesh = geometry->indexOffsetInMesh;
+            geometryRecord.vertexOffsetInMesh = geometry->vertexOffsetInMesh;
+            geometryRecord.numIndices = geometry->numIndices;
+            geometryRecord.numVertices = geometry->numVertices;
+            geometryRecord.bounds = geometry->objectSpaceBounds;
+        }
+    }
+
+    std::vector<BufferGroupRecord> bufferGroupRecords;
+    for (const engine::BufferGroup* buffers : bufferGroups) {
+        if (!buffers->jointData.empty() || !buffers->weightData.empty() || !buffers->radiusData.empty()) {
+            log::info("Scene has skinned or curve geometry, not writing a package");
+            return false;
+        }
+
+        BufferGroupRecord& record = bufferGroupRecords.emplace_back();
+        record.indices = writer.Append(buffers->indexData);
+        record.positions = writer.Append(buffers->positionData);
+        record.texcoords1 = writer.Append(buffers->texcoord1Data);
+        record.texcoords2 = writer.Append(buffers->texcoord2Data);
+        record.normals = writer.Append(buffers->normalData);
+        record.tangents = writer.Append(buffers->tangentData);
+    }
+
+    std::vector<MaterialRecord> materialRecords;
+    for (const engine::Material* material : materials) {
+        MaterialRecord& record = materialRecords.emplace_back();
+        record.name = writer.AddString(material->name);
+
+        const std::shared_ptr<engine::LoadedTexture>* textures[MaterialTexture_Count] = {&material->baseOrDiffuseTexture,
+            &material->metalRoughOrSpecularTexture, &material->normalTexture, &material->emissiveTexture, &material->occlusionTexture,
+            &material->transmissionTexture, &material->opacityTexture};
+        const bool enabled[MaterialTexture_Count] = {material->enableBaseOrDiffuseTexture, material->enableMetalRoughOrSpecularTexture,
+            material->enableNormalTexture, material->enableEmissiveTexture, material->enableOcclusionTexture,
+            material->enableTransmissionTexture, material->enableOpacityTexture};
+        for (uint32_t texture = 0; texture < MaterialTexture_Count; texture++) {
+            if (*textures[texture]) {
+                record.textures[texture] = writer.AddString((*textures[texture])->path);
+            }
+            if (enabled[texture]) {
+                record.flags |= MaterialFlags_FirstTextureEnable << texture;
+            }
+        }
+
+        record.domain = uint32_t(material->domain);
+        if (material->useSpecularGlossModel) {
+            record.flags |= MaterialFlags_UseSpecularGlossModel;
+        }
+        if (material->doubleSided) {
+            record.flags |= MaterialFlags_DoubleSided;
+        }
+        record.baseOrDiffuseColor = material->baseOrDiffuseColor;
+        record.specularColor = material->specularColor;
+        record.emissiveColor = material->emissiveColor;
+        record.emissiveIntensity = material->emissiveIntensity;
+        record.metalness = material->metalness;
+        record.roughness = material->roughness;
+        record.opacity = material->opacity;
+        record.alphaCutoff = material->alphaCutoff;
+        record.normalTextureScale = material->normalTextureScale;
+        record.occlusionStrength = material->occlusionStrength;
+        record.transmissionFactor = material->transmissionFactor;
+    }
+
+    header.materials = writer.Append(materialRecords);
+    header.bufferGroups = writer.Append(bufferGroupRecords);
+    header.meshes = writer.Append(meshRecords);
+    header.geometries = writer.Append(geometryRecords);
+    header.nodes = writer.Append(nodeRecords);
+
+    if (!writer.Write(packageFileName, header)) {
+        log::warning("Cannot write scene package '%s'", packageFileName.generic_string().c_str());
+        return false;
+    }
+
+    log::info("Wrote scene package '%s' (%.1f MB)", packageFileName.generic_string().c_str(), double(writer.GetSize()) / (1024.0 * 1024.0));
+    return true;
+}
+
+std::filesystem::path CachedScene::GetCacheFileName(const char* extension) const {
+    if (m_CacheDirectory.empty()) {
+        return {};
+    }
+    return m_CacheDirectory / (m_SceneFileName.stem().string() + extension);
+}
+
+bool CachedScene::LoadPackage(const std::filesystem::path& packageFileName, uint64_t contentHash) {
+    MappedFile file;
+    if (!file.Open(packageFileName) || file.GetSize() < sizeof(PackageHeader)) {
+        return false;
+    }
+
+    PackageHeader header;
+    memcpy(&header, file.GetData(), sizeof(header));
+    if (header.magic != c_PackageMagic || header.version != c_PackageVersion || header.packageSize != file.GetSize()) {
+        log::info("Scene package '%s' is from another version, rebuilding it", packageFileName.generic_string().c_str());
+        return false;
+    }
+    if (header.contentHash != contentHash) {
+        log::info("Scene package '%s' is out of date, rebuilding it", packageFileName.generic_string().c_str());
+        return false;
+    }
+
+    PackageReader reader(file);
+    const char* strings = reader.Get<char>(header.strings);
+    const auto* materialRecords = reader.Get<MaterialRecord>(header.materials);
+    const auto* bufferGroupRecords = reader.Get<BufferGroupRecord>(header.bufferGroups);
+    const auto* meshRecords = reader.Get<MeshRecord>(header.meshes);
+    const auto* geometryRecords = reader.Get<GeometryRecord>(header.geometries);
+    const auto* nodeRecords = reader.Get<NodeRecord>(header.nodes);
+    if (!strings || !materialRecords || !bufferGroupRecords || !meshRecords || !geometryRecords || !nodeRecords || header.nodes.count == 0) {
+        log::warning("Scene package '%s' is damaged", packageFileName.generic_string().c_str());
+        return false;
+    }
+    reader.SetStrings(strings, header.strings.count);
+
+    std::vector<std::shared_ptr<engine::Material>> materials;
+    for (uint64_t index = 0; index < header.materials.count; index++) {
+        const MaterialRecord& record = materialRecords[index];
+        auto material = std::make_shared<engine::Material>();
+        material->name = reader.GetString(record.name);
+        material->modelFileName = packageFileName.generic_string();
+        material->materialIndexInModel = int(index);
+
+        const TextureSlot slots[MaterialTexture_Count] = {&engine::Material::baseOrDiffuseTexture, &engine::Material::metalRoughOrSpecularTexture,
+            &engine::Material::normalTexture, &engine::Material::emissiveTexture, &engine::Material::occlusionTexture,
+            &engine::Material::transmissionTexture, &engine::Material::opacityTexture};
+        bool* enabled[MaterialTexture_Count] = {&material->enableBaseOrDiffuseTexture, &material->enableMetalRoughOrSpecularTexture,
+            &material->enableNormalTexture, &material->enableEmissiveTexture, &material->enableOcclusionTexture,
+            &material->enableTransmissionTexture, &material->enableOpacityTexture};
+        for (uint32_t texture = 0; texture < MaterialTexture_Count; texture++) {
+            if (record.textures[texture].length) {
+                // Color textures are sRGB, as the glTF importer loads them.
+                const bool sRGB = texture == MaterialTexture_BaseOrDiffuse || texture == MaterialTexture_Emissive;
+                const std::string path = reader.GetString(record.textures[texture]);
+                if (m_TextureRequestHandler) {
+                    m_TextureRequestHandler(material, slots[texture], path, sRGB);
+                } else {
+                    (*material).*slots[texture] = m_PackageTextureCache->LoadTextureFromFileDeferred(path, sRGB);
+                }
+            }
+            *enabled[texture] = (record.flags & (MaterialFlags_FirstTextureEnable << texture)) != 0;
+        }
+
+        material->domain = engine::MaterialDomain(record.domain);
+        material->useSpecularGlossModel = (record.flags & MaterialFlags_UseSpecularGlossModel) != 0;
+        material->doubleSided = (record.flags & MaterialFlags_DoubleSided) != 0;
+        material->baseOrDiffuseColor = record.baseOrDiffuseColor;
+        material->specularColor = record.specularColor;
+        material->emissiveColor = record.emissiveColor;
+        material->emissiveIntensity = record.emissiveIntensity;
+        material->metalness = record.metalness;
+        material->roughness = record.roughness;
+        material->opacity = record.opacity;
+        material->alphaCutoff = record.alphaCutoff;
+        material->normalTextureScale = record.normalTextureScale;
+        material->occlusionStrength = record.occlusionStrength;
+        material->transmissionFactor = record.transmissionFactor;
+        materials.push_back(std::move(material));
+    }
+
+    std::vector<std::shared_ptr<engine::BufferGroup>> bufferGroups;
+    for (uint64_t index = 0; index < header.bufferGroups.count; index++) {
+        const BufferGroupRecord& record = bufferGroupRecords[index];
+        auto buffers = std::make_shared<engine::BufferGroup>();
+        if (!reader.Copy(record.indices, buffers->indexData) || !reader.Copy(record.positions, buffers->positionData)
+            || !reader.Copy(record.texcoords1, buffers->texcoord1Data) || !reader.Copy(record.texcoords2, buffers->texcoord2Data)
+            || !reader.Copy(record.normals, buffers->normalData) || !reader.Copy(record.tangents, buffers->tangentData)) {
+            log::warning("Scene package '%s' is damaged", packageFileName.generic_string().c_str());
+            return false;
+        }
+        bufferGroups.push_back(std::move(buffers));
+    }
+
+    std::vector<std::shared_ptr<engine::MeshInfo>> meshes;
+    for (uint64_t index = 0; index < header.meshes.count; index++) {
+        const MeshRecord& record = meshRecords[index];
+        if (record.bufferGroup >= bufferGroups.size() || uint64_t(record.firstGeometry) + record.geometryCount > header.geometries.count) {
+            log::warning("Scene package '%s' is damaged", packageFileName.generic_string().c_str());
+            return false;
+        }
+
+        auto mesh = std::make_shared<engine::MeshInfo>();
+        mesh->name = reader.GetString(record.name);
+        mesh->buffers = bufferGroups[record.bufferGroup];
+        mesh->indexOffset = record.indexOffset;
+        mesh->vertexOffset = record.vertexOffset;
+        mesh->totalIndices = record.totalIndices;
+        mesh->totalVertices = record.totalVertices;
+        mesh->objectSpaceBounds = record.bounds;
+
+        for (uint32_t geometryIndex = 0; geometryIndex < record.geometryCount; geometryIndex++) {
+            const GeometryRecord& geometryRecord = geometryRecords[record.firstGeometry + geometryIndex];
+            auto geometry = std::make_shared<engine::MeshGeometry>();
+            if (geometryRecord.material < materials.size()) {
+                geometry->material = materials[geometryRecord.material];
+            }
+            geometry->indexOffsetInMesh = geometryRecord.indexOffsetInMesh;
+            geometry->vertexOffsetInMesh = geometryRecord.vertexOffsetInMesh;
+            geometry->numIndices = geometryRecord.numIndices;
+            geometry->numVertices = geometryRecord.numVertices;
+            geometry->objectSpaceBounds = geometryRecord.bounds;
+            mesh->geometries.push_back(std::move(geometry));
+        }
+        meshes.push_back(std::move(mesh));
+    }
+
+    auto sceneGraph = std::make_shared<engine::SceneGraph>();
+    std::vector<std::shared_ptr<engine::SceneGraphNode>> nodes;
+    nodes.reserve(header.nodes.count);
+    for (uint64_t index = 0; index < header.nodes.count; index++) {
+        const NodeRecord& record = nodeRecords[index];
+        if ((index == 0) != (record.parent == c_None) || (index > 0 && record.parent >= index)
+            || (record.mesh != c_None && record.mesh >= meshes.size())) {
+            log::warning("Scene package '%s' is damaged", packageFileName.generic_string().c_str());
+            return false;
+        }
+
+        auto node = std::make_shared<engine::SceneGraphNode>();
+        node->SetName(reader.GetString(record.name));
+        const dquat rotation(record.rotation[3], record.rotation[0], record.rotation[1], record.rotation[2]);
+        node->SetTransform(&record.translation, &rotation, &record.scaling);
+        if (record.mesh != c_None) {
+            node->SetLeaf(std::make_shared<engine::MeshInstance>(meshes[record.mesh]));
+        }
+
+        if (index == 0) {
+            sceneGraph->SetRootNode(node);
+        } else {
+            sceneGraph->Attach(nodes[record.parent], node);
+        }
+        nodes.push_back(std::move(node));
+    }
+
+    m_SceneGraph = std::move(sceneGraph);
+    m_LoadStatistics.packageBytes = file.GetSize();
+    return true;
+}
+
+} // namespace sanbox
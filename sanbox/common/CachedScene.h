@@ -0,0 +1,70 @@
+#pragma once
+
+#include <donut/engine/Scene.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace sanbox {
+
+struct SceneLoadStatistics {
+    // The scene was built from the package instead of the source file.
+    bool fromCache = false;
+    bool packageWritten = false;
+    // Hashing the source files is part of every load that uses the cache.
+    double hashMs = 0.0;
+    double loadMs = 0.0;
+    uint64_t packageBytes = 0;
+};
+
+// Scene that keeps a binary package of what the glTF importer produced: the vertex and index streams laid
+// out as donut's BufferGroup stores them, the node hierarchy as a flat array with parent indices, and the
+// material table with texture paths. The package is memory-mapped on load and only trusted if its version
+// and the hash of the source .gltf and .bin files match; otherwise the source is loaded and the package
+// rewritten. Scenes with leaves other than static triangle meshes, such as lights, cameras, skinning or
+// animations, are not packaged and always load from the source.
+// Textures are still read through the TextureCache, so DDS files next to the images are used as they are.
+class CachedScene : public donut::engine::Scene {
+public:
+    using TextureSlot = std::shared_ptr<donut::engine::LoadedTexture> donut::engine::Material::*;
+    using TextureRequestHandler
+        = std::function<void(const std::shared_ptr<donut::engine::Material>& material, TextureSlot slot, const std::string& path, bool sRGB)>;
+
+    // An empty cache directory disables the package; rebuild ignores an existing package and rewrites it.
+    CachedScene(nvrhi::IDevice* device, donut::engine::ShaderFactory& shaderFactory, std::shared_ptr<donut::vfs::IFileSystem> fs,
+        std::shared_ptr<donut::engine::TextureCache> textureCache, std::filesystem::path cacheDirectory, bool rebuild = false);
+
+    bool Load(const std::filesystem::path& sceneFileName) override;
+
+    // With a handler, a scene loaded from its package leaves the material textures empty and passes each
+    // of them to the handler instead, so that they can be loaded after the geometry. Called from Load.
+    void SetTextureRequestHandler(TextureRequestHandler handler) {
+        m_TextureRequestHandler = std::move(handler);
+    }
+    [[nodiscard]] bool HasTextureRequestHandler() const {
+        return bool(m_TextureRequestHandler);
+    }
+
+    [[nodiscard]] const SceneLoadStatistics& GetLoadStatistics() const {
+        return m_LoadStatistics;
+    }
+    // A file next to the package for data derived from the loaded scene, named after it; empty when the
+    // cache is disabled.
+    [[nodiscard]] std::filesystem::path GetCacheFileName(const char* extension) const;
+
+private:
+    bool LoadPackage(const std::filesystem::path& packageFileName, uint64_t contentHash);
+    bool WritePackage(const std::filesystem::path& packageFileName, uint64_t contentHash) const;
+
+    std::shared_ptr<donut::engine::TextureCache> m_PackageTextureCache;
+    std::filesystem::path m_CacheDirectory;
+    std::filesystem::path m_SceneFileName;
+    bool m_Rebuild;
+    TextureRequestHandler m_TextureRequestHandler;
+    SceneLoadStatistics m_LoadStatistics;
+};
+
+} // namespace sanbox
@@ -0,0 +1,260 @@
+#include "CachedShadowMap.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "TransformHierarchy.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+CachedShadowMap::CachedShadowMap(nvrhi::IDevice* device, std::shared_ptr<engine::CommonRenderPasses> commonPasses, uint32_t resolution)
+    : m_Device(device)
+    , m_CommonPasses(std::move(commonPasses))
+    , m_Resolution(resolution) {
+}
+
+void CachedShadowMap::Init(engine::ShaderFactory& shaderFactory, uint32_t framesInFlight) {
+    m_ShadowMap = std::make_shared<render::CascadedShadowMap>(m_Device, int(m_Resolution), c_CascadeCount, 0, nvrhi::Format::D32);
+    m_ShadowMap->SetLitOutOfBounds(true);
+
+    nvrhi::TextureDesc cacheDesc = m_ShadowMap->GetTexture()->getDesc();
+    cacheDesc.debugName = "StaticShadowCache";
+    m_StaticCache = m_Device->createTexture(cacheDesc);
+
+    m_ShadowFramebuffer = std::make_unique<engine::FramebufferFactory>(m_Device);
+    m_ShadowFramebuffer->DepthTarget = m_ShadowMap->GetTexture();
+    m_CacheFramebuffer = std::make_unique<engine::FramebufferFactory>(m_Device);
+    m_CacheFramebuffer->DepthTarget = m_StaticCache;
+
+    render::DepthPass::CreateParameters params;
+    params.depthBias = 100;
+    params.slopeScaledDepthBias = 4.f;
+    params.numConstantBufferVersions = 2 * c_CascadeCount * std::max(framesInFlight, 1u);
+    m_DepthPass = std::make_unique<render::DepthPass>(m_Device, m_CommonPasses);
+    m_DepthPass->Init(shaderFactory, params);
+}
+
+void CachedShadowMap::SetDynamicNodes(std::vector<const engine::SceneGraphNode*> nodes) {
+    m_DynamicNodes = std::unordered_set<const engine::SceneGraphNode*>(nodes.begin(), nodes.end());
+    Invalidate();
+}
+
+void CachedShadowMap::SetCachingEnabled(bool enabled) {
+    m_CachingEnabled = enabled;
+    Invalidate();
+}
+
+void CachedShadowMap::Invalidate() {
+    m_CastersValid = false;
+    for (Cascade& cascade : m_Cascades) {
+        cascade.stale = true;
+    }
+}
+
+void CachedShadowMap::ResetBindingCache() {
+    if (m_DepthPass) {
+        m_DepthPass->ResetBindingCache();
+    }
+}
+
+bool CachedShadowMap::IsDynamic(const engine::SceneGraphNode* node) const {
+    for (; node; node = node->GetParent()) {
+        if (m_DynamicNodes.count(node)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CachedShadowMap::CollectCasters(const engine::SceneGraph& sceneGraph) {
+    const auto& meshInstances = sceneGraph.GetMeshInstances();
+    m_StaticCasters.clear();
+    m_DynamicCasters.clear();
+
+    for (size_t i = 0; i < meshInstances.size(); i++) {
+        const engine::MeshInstance* instance = meshInstances[i].get();
+        Caster caster;
+        caster.instance = instance;
+        caster.instanceIndex = uint32_t(i);
+        caster.bounds = instance->GetMesh()->objectSpaceBounds * instance->GetNode()->GetLocalToWorldTransformFloat();
+        (IsDynamic(instance->GetNode()) ? m_DynamicCasters : m_StaticCasters).push_back(caster);
+    }
+
+    // The cascades reach across the whole scene, and so does the light-space depth range on either side of
+    // them, so that casters outside the view still shadow what is in it.
+    const box3 sceneBounds = sceneGraph.GetRootNode()->GetGlobalBoundingBox();
+    m_MaxShadowDistance = std::max(length(sceneBounds.diagonal()), 1.f);
+    m_LightSpaceDepth = m_MaxShadowDistance;
+
+    m_SceneGraph = &sceneGraph;
+    m_InstanceCount = meshInstances.size();
+    m_CastersValid = true;
+    for (Cascade& cascade : m_Cascades) {
+        cascade.stale = true;
+    }
+}
+
+void CachedShadowMap::UpdateDynamicBounds() {
+    // The scene graph transforms of the moving nodes are not refreshed when a hierarchy moves them.
+    const bool useHierarchy = m_Hierarchy && m_Hierarchy->GetInstanceCount() == m_InstanceCount;
+    for (Caster& caster : m_DynamicCasters) {
+        if (useHierarchy) {
+            caster.bounds = m_Hierarchy->GetInstanceBounds(caster.instanceIndex);
+        } else {
+            caster.bounds = caster.instance->GetMesh()->objectSpaceBounds * caster.instance->GetNode()->GetLocalToWorldTransformFloat();
+        }
+    }
+}
+
+void CachedShadowMap::AppendItems(const Caster& caster, std::vector<engine::DrawItem>& items) {
+    const engine::MeshInfo* mesh = caster.instance->GetMesh().get();
+    for (const auto& geometry : mesh->geometries) {
+        const engine::Material* material = geometry->material.get();
+        if (!material || (material->domain != engine::MaterialDomain::Opaque && material->domain != engine::MaterialDomain::AlphaTested)) {
+            continue;
+        }
+        if (geometry->numIndices == 0) {
+            continue;
+        }
+
+        engine::DrawItem& item = items.emplace_back();
+        item.instance = caster.instance;
+        item.mesh = mesh;
+        item.geometry = geometry.get();
+        item.material = material;
+        item.buffers = mesh->buffers.get();
+        item.cullMode = material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+    }
+}
+
+void CachedShadowMap::SortItems(std::vector<engine::DrawItem>& items) {
+    // Stable, so that the instances of a geometry stay in scene order and merge into instanced draws.
+    std::stable_sort(items.begin(), items.end(), [](const engine::DrawItem& a, const engine::DrawItem& b) {
+        if (a.material != b.material) {
+            return a.material < b.material;
+        }
+        if (a.buffers != b.buffers) {
+            return a.buffers < b.buffers;
+        }
+        if (a.mesh != b.mesh) {
+            return a.mesh < b.mesh;
+        }
+        return a.geometry < b.geometry;
+    });
+}
+
+void CachedShadowMap::Update(const engine::SceneGraph& sceneGraph, const engine::DirectionalLight& light, const engine::IView& view) {
+    m_Statistics = ShadowStatistics();
+    if (!m_CastersValid || m_SceneGraph != &sceneGraph || m_InstanceCount != sceneGraph.GetMeshInstances().size()) {
+        CollectCasters(sceneGraph);
+    }
+    UpdateDynamicBounds();
+
+    m_ShadowMap->SetupForPlanarViewStable(
+        light, view.GetProjectionFrustum(), view.GetInverseViewMatrix(), m_MaxShadowDistance, m_LightSpaceDepth, m_LightSpaceDepth);
+    m_ActiveCascades = std::min(m_ShadowMap->GetNumberOfCascades(), c_CascadeCount);
+
+    for (int i = 0; i < m_ActiveCascades; i++) {
+        Cascade& cascade = m_Cascades[i];
+        const engine::PlanarView& cascadeView = *m_ShadowMap->GetCascade(i)->GetPlanarView();
+
+        // The projection takes in the light direction as well as the snapped cascade origin, so any change
+        // to either is a change to it.
+        const float4x4 viewProjection = cascadeView.GetViewProjectionMatrix();
+        if (!m_CachingEnabled || memcmp(&viewProjection, &cascade.viewProjection, sizeof(viewProjection)) != 0) {
+            cascade.stale = true;
+            cascade.viewProjection = viewProjection;
+        }
+
+        const frustum& cascadeFrustum = cascadeView.GetViewFrustum();
+        if (cascade.stale) {
+            cascade.staticItems.clear();
+            for (const Caster& caster : m_StaticCasters) {
+                if (cascadeFrustum.intersectsWith(caster.bounds)) {
+                    AppendItems(caster, cascade.staticItems);
+                }
+            }
+            SortItems(cascade.staticItems);
+        }
+
+        cascade.dynamicItems.clear();
+        for (const Caster& caster : m_DynamicCasters) {
+            if (cascadeFrustum.intersectsWith(caster.bounds)) {
+                AppendItems(caster, cascade.dynamicItems);
+            }
+        }
+        SortItems(cascade.dynamicItems);
+    }
+
+    m_Statistics.staticCasters = uint32_t(m_StaticCasters.size());
+    m_Statistics.dynamicCasters = uint32_t(m_DynamicCasters.size());
+}
+
+void CachedShadowMap::ClearSlice(nvrhi::ICommandList* commandList, nvrhi::ITexture* texture, int cascade) {
+    const engine::PlanarView& cascadeView = *m_ShadowMap->GetCascade(cascade)->GetPlanarView();
+    commandList->clearDepthStencilTexture(
+        texture, nvrhi::TextureSubresourceSet(0, 1, uint32_t(cascade), 1), true, cascadeView.IsReverseDepth() ? 0.f : 1.f, false, 0);
+}
+
+uint32_t CachedShadowMap::DrawItems(nvrhi::ICommandList* commandList, const std::vector<engine::DrawItem>& items, int cascade,
+    engine::FramebufferFactory& framebuffer) {
+    if (items.empty()) {
+        return 0;
+    }
+
+    const engine::PlanarView& cascadeView = *m_ShadowMap->GetCascade(cascade)->GetPlanarView();
+    m_DrawStrategy.SetData(items.data(), items.size());
+
+    render::DepthPass::Context context;
+    DrawSubmissionStatistics statistics;
+    RenderDrawItems(
+        commandList, &cascadeView, &cascadeView, framebuffer.GetFramebuffer(cascadeView), m_DrawStrategy, *m_DepthPass, context, statistics);
+    return statistics.draws;
+}
+
+void CachedShadowMap::RenderStatic(nvrhi::ICommandList* commandList) {
+    const bool cached = UsesCacheTexture();
+    nvrhi::ITexture* target = cached ? m_StaticCache.Get() : m_ShadowMap->GetTexture();
+    engine::FramebufferFactory& framebuffer = cached ? *m_CacheFramebuffer : *m_ShadowFramebuffer;
+
+    for (int i = 0; i < m_ActiveCascades; i++) {
+        Cascade& cascade = m_Cascades[i];
+        if (!cascade.stale) {
+            continue;
+        }
+
+        ClearSlice(commandList, target, i);
+        m_Statistics.staticDraws += DrawItems(commandList, cascade.staticItems, i, framebuffer);
+        m_Statistics.staticCascadesRendered++;
+        cascade.stale = false;
+        cascade.liveDiffers = cached;
+    }
+}
+
+void CachedShadowMap::RenderDynamic(nvrhi::ICommandList* commandList) {
+    const bool cached = UsesCacheTexture();
+
+    for (int i = 0; i < m_ActiveCascades; i++) {
+        Cascade& cascade = m_Cascades[i];
+        if (cached && cascade.liveDiffers) {
+            const nvrhi::TextureSlice slice = nvrhi::TextureSlice().setArraySlice(uint32_t(i));
+            commandList->copyTexture(m_ShadowMap->GetTexture(), slice, m_StaticCache, slice);
+            m_Statistics.cascadeCopies++;
+            cascade.liveDiffers = false;
+        }
+
+        if (!cascade.dynamicItems.empty()) {
+            m_Statistics.dynamicDraws += DrawItems(commandList, cascade.dynamicItems, i, *m_ShadowFramebuffer);
+            cascade.liveDiffers = cached;
+        }
+    }
+
+    // Passes that record without automatic barriers, like the parallel draws, find it ready to sample.
+    commandList->setTextureState(m_ShadowMap->GetTexture(), nvrhi::AllSubresources, nvrhi::ResourceStates::ShaderResource);
+    commandList->commitBarriers();
+}
+
+} // namespace sanbox
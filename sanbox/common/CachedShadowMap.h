@@ -0,0 +1,145 @@
+#pragma once
+
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/FramebufferFactory.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/View.h>
+#include <donut/render/CascadedShadowMap.h>
+#include <donut/render/DepthPass.h>
+#include <donut/render/DrawStrategy.h>
+#include <nvrhi/nvrhi.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+#include "DrawSubmission.h"
+
+namespace sanbox {
+
+class TransformHierarchy;
+
+struct ShadowStatistics {
+    // Cascades whose static casters were drawn this frame, because the light moved or their texel snapping
+    // crossed a texel.
+    uint32_t staticCascadesRendered = 0;
+    uint32_t staticDraws = 0;
+    uint32_t dynamicDraws = 0;
+    // Cascades restored from the static cache before their dynamic casters were drawn.
+    uint32_t cascadeCopies = 0;
+    uint32_t staticCasters = 0;
+    uint32_t dynamicCasters = 0;
+};
+
+// Cascaded shadow map of one directional light that draws its static casters only when a cascade's
+// projection changes. The cascades are fitted with donut's stable setup, which snaps them to whole texels,
+// so a cascade keeps its projection while the camera moves within a texel and the light stays put.
+// The static casters of each cascade are kept in a texture array of their own; every frame the cascades that
+// have dynamic casters are restored from it and the dynamic casters drawn on top. Without dynamic nodes the
+// static casters go straight to the shadow map and nothing is copied.
+class CachedShadowMap {
+public:
+    static constexpr int c_CascadeCount = 4;
+
+    CachedShadowMap(nvrhi::IDevice* device, std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses, uint32_t resolution);
+
+    // Sizes the depth pass's constant buffer for the two passes per cascade of each frame in flight.
+    void Init(donut::engine::ShaderFactory& shaderFactory, uint32_t framesInFlight);
+
+    // Mesh instances below these nodes are drawn every frame; all others are static. Invalidates the cache.
+    void SetDynamicNodes(std::vector<const donut::engine::SceneGraphNode*> nodes);
+    // Takes the bounds of the dynamic instances from the hierarchy instead of the scene graph. Null goes back
+    // to the scene graph.
+    void SetTransformHierarchy(const TransformHierarchy* hierarchy) {
+        m_Hierarchy = hierarchy;
+    }
+    // Draws every caster of every cascade each frame, for comparison.
+    void SetCachingEnabled(bool enabled);
+
+    // Whenever the static casters or what they look like changed: the scene's meshes or their textures.
+    void Invalidate();
+
+    // Fits the cascades to the view and finds the casters to draw into each. Call once per frame before
+    // RenderStatic and RenderDynamic.
+    void Update(const donut::engine::SceneGraph& sceneGraph, const donut::engine::DirectionalLight& light, const donut::engine::IView& view);
+    void RenderStatic(nvrhi::ICommandList* commandList);
+    // Leaves the shadow map in the shader resource state.
+    void RenderDynamic(nvrhi::ICommandList* commandList);
+
+    // Drops the depth pass's binding sets, which reference the material textures.
+    void ResetBindingCache();
+
+    // For DirectionalLight::shadowMap.
+    [[nodiscard]] const std::shared_ptr<donut::render::CascadedShadowMap>& GetShadowMap() const {
+        return m_ShadowMap;
+    }
+    [[nodiscard]] const ShadowStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    struct Caster {
+        const donut::engine::MeshInstance* instance = nullptr;
+        uint32_t instanceIndex = 0;
+        dm::box3 bounds;
+    };
+
+    struct Cascade {
+        dm::float4x4 viewProjection;
+        // Set when the static casters have to be drawn again.
+        bool stale = true;
+        // Set while the shadow map slice differs from the static cache, because it holds dynamic casters or the
+        // cache was drawn again.
+        bool liveDiffers = false;
+        std::vector<donut::engine::DrawItem> staticItems;
+        std::vector<donut::engine::DrawItem> dynamicItems;
+    };
+
+    void CollectCasters(const donut::engine::SceneGraph& sceneGraph);
+    [[nodiscard]] bool IsDynamic(const donut::engine::SceneGraphNode* node) const;
+    void UpdateDynamicBounds();
+    static void AppendItems(const Caster& caster, std::vector<donut::engine::DrawItem>& items);
+    static void SortItems(std::vector<donut::engine::DrawItem>& items);
+    void ClearSlice(nvrhi::ICommandList* commandList, nvrhi::ITexture* texture, int cascade);
+    uint32_t DrawItems(nvrhi::ICommandList* commandList, const std::vector<donut::engine::DrawItem>& items, int cascade,
+        donut::engine::FramebufferFactory& framebuffer);
+    [[nodiscard]] bool UsesCacheTexture() const {
+        return m_CachingEnabled && !m_DynamicCasters.empty();
+    }
+
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::CommonRenderPasses> m_CommonPasses;
+    uint32_t m_Resolution = 0;
+
+    std::shared_ptr<donut::render::CascadedShadowMap> m_ShadowMap;
+    nvrhi::TextureHandle m_StaticCache;
+    std::unique_ptr<donut::engine::FramebufferFactory> m_ShadowFramebuffer;
+    std::unique_ptr<donut::engine::FramebufferFactory> m_CacheFramebuffer;
+    std::unique_ptr<donut::render::DepthPass> m_DepthPass;
+    donut::render::PassthroughDrawStrategy m_DrawStrategy;
+
+    std::unordered_set<const donut::engine::SceneGraphNode*> m_DynamicNodes;
+    const TransformHierarchy* m_Hierarchy = nullptr;
+    bool m_CachingEnabled = true;
+
+    // Rebuilt by the first Update after Invalidate.
+    bool m_CastersValid = false;
+    const donut::engine::SceneGraph* m_SceneGraph = nullptr;
+    size_t m_InstanceCount = 0;
+    std::vector<Caster> m_StaticCasters;
+    std::vector<Caster> m_DynamicCasters;
+    // Fixed with the casters, so that the light-space depth range and the cascade distances only change
+    // when the scene does.
+    float m_MaxShadowDistance = 0.f;
+    float m_LightSpaceDepth = 0.f;
+
+    std::array<Cascade, c_CascadeCount> m_Cascades;
+    int m_ActiveCascades = 0;
+    ShadowStatistics m_Statistics;
+};
+
+} // namespace sanbox
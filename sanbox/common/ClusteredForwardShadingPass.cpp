@@ -0,0 +1,401 @@
+#include "ClusteredForwardShadingPass.h"
+
+#include <donut/core/log.h>
+#include <donut/engine/MaterialBindingCache.h>
+#include <nvrhi/utils.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+
+using namespace donut;
+using namespace donut::math;
+
+#include <donut/shaders/forward_cb.h>
+#include <donut/shaders/light_cb.h>
+#include <donut/shaders/light_types.h>
+
+#include "VertexQuantizer.h"
+#include "shaders/bindless_material_cb.h"
+#include "shaders/clustered_lighting_cb.h"
+#include "shaders/mesh_quantization_cb.h"
+
+namespace sanbox {
+
+namespace {
+
+// The vertex shaders read the draw constants of the bindless push constants as donut's.
+static_assert(offsetof(BindlessForwardPushConstants, materialIndex) == sizeof(ForwardPushConstants));
+
+constexpr uint32_t c_MinLightCapacity = 256;
+constexpr uint32_t c_MinLightIndexCapacity = 16 * 1024;
+
+uint32_t GrowCapacity(uint32_t capacity, uint32_t required) {
+    while (capacity < required) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+} // namespace
+
+ClusteredForwardShadingPass::ClusteredForwardShadingPass(nvrhi::IDevice* device, std::shared_ptr<engine::CommonRenderPasses> commonPasses)
+    : ForwardShadingPass(device, std::move(commonPasses)) {
+    auto constantsDesc = nvrhi::utils::CreateStaticConstantBufferDesc(sizeof(ClusteredLightingConstants), "ClusteredLightingConstants");
+    m_ClusterConstants = device->createBuffer(constantsDesc.setInitialState(nvrhi::ResourceStates::ConstantBuffer).setKeepInitialState(true));
+
+    m_ClusterRanges = device->createBuffer(nvrhi::BufferDesc()
+                                               .setByteSize(LightClusterGrid::c_ClusterCount * sizeof(uint2))
+                                               .setStructStride(sizeof(uint2))
+                                               .setDebugName("ClusterRanges")
+                                               .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                               .setKeepInitialState(true));
+
+    ReserveBuffers(c_MinLightCapacity, c_MinLightIndexCapacity);
+}
+
+ClusteredForwardShadingPass::~ClusteredForwardShadingPass() = default;
+
+nvrhi::ShaderHandle ClusteredForwardShadingPass::CreateVertexShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params) {
+    if (!m_VertexQuantization) {
+        return ForwardShadingPass::CreateVertexShader(shaderFactory, params);
+    }
+    const char* entryName = params.useInputAssembler ? "input_assembler" : "buffer_loads";
+    return shaderFactory.CreateShader("sanbox/quantized_forward_vs.hlsl", entryName, nullptr, nvrhi::ShaderType::Vertex);
+}
+
+nvrhi::InputLayoutHandle ClusteredForwardShadingPass::CreateInputLayout(nvrhi::IShader* vertexShader, const CreateParameters& params) {
+    if (!m_VertexQuantization) {
+        return ForwardShadingPass::CreateInputLayout(vertexShader, params);
+    }
+    m_QuantizedInputAssembler = params.useInputAssembler;
+    return params.useInputAssembler ? VertexQuantizer::CreateInputLayout(m_Device, vertexShader) : nullptr;
+}
+
+nvrhi::ShaderHandle ClusteredForwardShadingPass::CreatePixelShader(
+    engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool transmissiveMaterial) {
+    if (transmissiveMaterial) {
+        return ForwardShadingPass::CreatePixelShader(shaderFactory, params, transmissiveMaterial);
+    }
+    // The base pass's pipelines are created with this one; the bindless ones are derived from them.
+    if (m_BindlessMaterials) {
+        std::vector<engine::ShaderMacro> bindlessMacros = {engine::ShaderMacro("BINDLESS_MATERIALS", "1")};
+        m_BindlessPixelShader = shaderFactory.CreateShader("sanbox/clustered_forward_ps.hlsl", "main", &bindlessMacros, nvrhi::ShaderType::Pixel);
+    }
+    std::vector<engine::ShaderMacro> macros = {engine::ShaderMacro("BINDLESS_MATERIALS", "0")};
+    return shaderFactory.CreateShader("sanbox/clustered_forward_ps.hlsl", "main", &macros, nvrhi::ShaderType::Pixel);
+}
+
+nvrhi::BindingLayoutHandle ClusteredForwardShadingPass::CreateViewBindingLayout() {
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::All;
+    layoutDesc.registerSpace = FORWARD_SPACE_VIEW;
+    layoutDesc.registerSpaceIsDescriptorSet = true;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(FORWARD_BINDING_VIEW_CONSTANTS),
+        nvrhi::BindingLayoutItem::ConstantBuffer(CLUSTERED_BINDING_CONSTANTS),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(CLUSTERED_BINDING_LIGHTS),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(CLUSTERED_BINDING_CLUSTER_RANGES),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(CLUSTERED_BINDING_LIGHT_INDICES),
+    };
+    if (m_VertexQuantization) {
+        layoutDesc.bindings.push_back(nvrhi::BindingLayoutItem::StructuredBuffer_SRV(MESH_QUANTIZATION_BINDING));
+    }
+    return m_Device->createBindingLayout(layoutDesc);
+}
+
+nvrhi::BindingSetHandle ClusteredForwardShadingPass::CreateViewBindingSet() {
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(FORWARD_BINDING_VIEW_CONSTANTS, m_ForwardViewCB),
+        nvrhi::BindingSetItem::ConstantBuffer(CLUSTERED_BINDING_CONSTANTS, m_ClusterConstants),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(CLUSTERED_BINDING_LIGHTS, m_Lights),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(CLUSTERED_BINDING_CLUSTER_RANGES, m_ClusterRanges),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(CLUSTERED_BINDING_LIGHT_INDICES, m_LightIndices),
+    };
+    if (m_VertexQuantization) {
+        // Nothing is drawn before the scene is quantized, but the set needs a buffer until then.
+        if (!m_QuantizedMeshes) {
+            m_QuantizedMeshes = VertexQuantizer::CreateMeshDataBuffer(m_Device, 1);
+        }
+        bindingSetDesc.bindings.push_back(nvrhi::BindingSetItem::StructuredBuffer_SRV(MESH_QUANTIZATION_BINDING, m_QuantizedMeshes));
+    }
+    bindingSetDesc.trackLiveness = m_TrackLiveness;
+    return m_Device->createBindingSet(bindingSetDesc, m_ViewBindingLayout);
+}
+
+nvrhi::BindingLayoutHandle ClusteredForwardShadingPass::CreateInputBindingLayout() {
+    if (!m_BindlessMaterials) {
+        return ForwardShadingPass::CreateInputBindingLayout();
+    }
+
+    // The base pass's input space, with push constants that have room for the material index.
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Vertex | nvrhi::ShaderType::Pixel;
+    layoutDesc.registerSpace = FORWARD_SPACE_INPUT;
+    layoutDesc.registerSpaceIsDescriptorSet = true;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(FORWARD_BINDING_INSTANCE_BUFFER),
+        nvrhi::BindingLayoutItem::RawBuffer_SRV(FORWARD_BINDING_VERTEX_BUFFER),
+        nvrhi::BindingLayoutItem::PushConstants(FORWARD_BINDING_PUSH_CONSTANTS, sizeof(BindlessForwardPushConstants)),
+    };
+    return m_Device->createBindingLayout(layoutDesc);
+}
+
+nvrhi::BindingSetHandle ClusteredForwardShadingPass::CreateInputBindingSet(const engine::BufferGroup* bufferGroup) {
+    if (!m_BindlessMaterials) {
+        return ForwardShadingPass::CreateInputBindingSet(bufferGroup);
+    }
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(FORWARD_BINDING_INSTANCE_BUFFER, bufferGroup->instanceBuffer),
+        nvrhi::BindingSetItem::RawBuffer_SRV(FORWARD_BINDING_VERTEX_BUFFER, bufferGroup->vertexBuffer),
+        nvrhi::BindingSetItem::PushConstants(FORWARD_BINDING_PUSH_CONSTANTS, sizeof(BindlessForwardPushConstants)),
+    };
+    bindingSetDesc.trackLiveness = m_TrackLiveness;
+    return m_Device->createBindingSet(bindingSetDesc, m_InputBindingLayout);
+}
+
+nvrhi::GraphicsPipelineHandle ClusteredForwardShadingPass::CreateGraphicsPipeline(PipelineKey key, nvrhi::IFramebuffer* framebuffer) {
+    const auto startTime = std::chrono::steady_clock::now();
+    nvrhi::GraphicsPipelineHandle pipeline = CreatePipelineVariant(key, framebuffer);
+    if (m_PipelineCache && pipeline) {
+        const double createMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        m_PipelineCache->Record(c_PipelineCacheName, key.value, framebuffer->getFramebufferInfo(), pipeline->getDesc(), createMs);
+    }
+    return pipeline;
+}
+
+void ClusteredForwardShadingPass::PrecreatePipelines(nvrhi::IFramebuffer* framebuffer) {
+    if (!m_PipelineCache) {
+        return;
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    uint32_t created = 0;
+    for (uint32_t keyValue : m_PipelineCache->GetRecordedKeys(c_PipelineCacheName, framebuffer->getFramebufferInfo())) {
+        if (keyValue >= PipelineKey::Count || m_Pipelines[keyValue]) {
+            continue;
+        }
+        PipelineKey key;
+        key.value = keyValue;
+        m_Pipelines[keyValue] = CreateGraphicsPipeline(key, framebuffer);
+        created += m_Pipelines[keyValue] ? 1 : 0;
+    }
+    m_PipelineCache->RecordPrecreated(created, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+nvrhi::GraphicsPipelineHandle ClusteredForwardShadingPass::CreatePipelineVariant(PipelineKey key, nvrhi::IFramebuffer* framebuffer) {
+    nvrhi::GraphicsPipelineHandle pipeline = ForwardShadingPass::CreateGraphicsPipeline(key, framebuffer);
+    if (!m_BindlessMaterials || !pipeline || !IsBindlessDomain(key.bits.domain)) {
+        return pipeline;
+    }
+
+    // The base pass's states, with the material space replaced and the texture table in the space after the last.
+    nvrhi::GraphicsPipelineDesc pipelineDesc = pipeline->getDesc();
+    pipelineDesc.PS = m_BindlessPixelShader;
+    for (nvrhi::BindingLayoutHandle& layout : pipelineDesc.bindingLayouts) {
+        if (layout == m_MaterialBindings->GetLayout()) {
+            layout = m_BindlessMaterialLayout;
+        }
+    }
+    pipelineDesc.bindingLayouts.push_back(m_MaterialTable->GetLayout());
+    return m_Device->createGraphicsPipeline(pipelineDesc, framebuffer);
+}
+
+bool ClusteredForwardShadingPass::IsBindlessDomain(engine::MaterialDomain domain) {
+    return domain == engine::MaterialDomain::Opaque || domain == engine::MaterialDomain::AlphaTested;
+}
+
+void ClusteredForwardShadingPass::Init(engine::ShaderFactory& shaderFactory, const CreateParameters& params) {
+    if (m_BindlessMaterials && params.useInputAssembler) {
+        log::warning("Bindless materials need the buffer-load path; the forward pass keeps a binding set per material");
+        m_BindlessMaterials = false;
+    }
+
+    if (m_BindlessMaterials) {
+        nvrhi::BindingLayoutDesc layoutDesc;
+        layoutDesc.visibility = nvrhi::ShaderType::Pixel;
+        layoutDesc.registerSpace = FORWARD_SPACE_MATERIAL;
+        layoutDesc.registerSpaceIsDescriptorSet = true;
+        layoutDesc.bindings = {
+            nvrhi::BindingLayoutItem::StructuredBuffer_SRV(BINDLESS_MATERIAL_BINDING_MATERIALS),
+            nvrhi::BindingLayoutItem::Sampler(BINDLESS_MATERIAL_BINDING_SAMPLER),
+        };
+        m_BindlessMaterialLayout = m_Device->createBindingLayout(layoutDesc);
+    }
+
+    ForwardShadingPass::Init(shaderFactory, params);
+}
+
+void ClusteredForwardShadingPass::SetMaterialTable(const BindlessMaterialTable* table) {
+    m_MaterialTable = table;
+    if (!m_BindlessMaterials || !table) {
+        return;
+    }
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(BINDLESS_MATERIAL_BINDING_MATERIALS, table->GetMaterialBuffer()),
+        nvrhi::BindingSetItem::Sampler(BINDLESS_MATERIAL_BINDING_SAMPLER, table->GetSampler()),
+    };
+    bindingSetDesc.trackLiveness = m_TrackLiveness;
+    m_BindlessMaterialSet = m_Device->createBindingSet(bindingSetDesc, m_BindlessMaterialLayout);
+}
+
+bool ClusteredForwardShadingPass::SetupMaterial(
+    render::GeometryPassContext& abstractContext, const engine::Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state) {
+    if (!m_BindlessMaterials || !IsBindlessDomain(material->domain)) {
+        return ForwardShadingPass::SetupMaterial(abstractContext, material, cullMode, state);
+    }
+
+    auto& context = static_cast<Context&>(abstractContext);
+    context.materialIndex = m_MaterialTable ? m_MaterialTable->GetMaterialIndex(material) : ~0u;
+    if (context.materialIndex == ~0u) {
+        return false;
+    }
+
+    PipelineKey key = context.keyTemplate;
+    key.bits.cullMode = cullMode;
+    key.bits.domain = material->domain;
+
+    nvrhi::GraphicsPipelineHandle& pipeline = m_Pipelines[key.value];
+    if (!pipeline) {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        if (!pipeline) {
+            pipeline = CreateGraphicsPipeline(key, state.framebuffer);
+        }
+        if (!pipeline) {
+            return false;
+        }
+    }
+
+    // The same for every material of a domain, so that the draw loop sets the state only when the
+    // pipeline changes. In the order of the pipeline's layouts, which is that of their register spaces.
+    state.pipeline = pipeline;
+    state.bindings = {
+        m_BindlessMaterialSet, context.inputBindingSet, m_ViewBindingSet, context.shadingBindingSet, m_MaterialTable->GetDescriptorTable()};
+    return true;
+}
+
+void ClusteredForwardShadingPass::SetPushConstants(
+    render::GeometryPassContext& abstractContext, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) {
+    if (!m_BindlessMaterials) {
+        ForwardShadingPass::SetPushConstants(abstractContext, commandList, state, args);
+        return;
+    }
+
+    auto& context = static_cast<Context&>(abstractContext);
+    BindlessForwardPushConstants constants = {};
+    constants.startInstanceLocation = args.startInstanceLocation;
+    constants.startVertexLocation = args.startVertexLocation;
+    constants.positionOffset = context.positionOffset;
+    constants.texCoordOffset = context.texCoordOffset;
+    constants.normalOffset = context.normalOffset;
+    constants.tangentOffset = context.tangentOffset;
+    constants.materialIndex = context.materialIndex;
+    commandList->setPushConstants(&constants, sizeof(constants));
+
+    args.startInstanceLocation = 0;
+    args.startVertexLocation = 0;
+}
+
+void ClusteredForwardShadingPass::SetQuantizedMeshBuffer(nvrhi::IBuffer* buffer) {
+    m_QuantizedMeshes = buffer;
+    if (m_ViewBindingLayout) {
+        m_ViewBindingSet = CreateViewBindingSet();
+    }
+}
+
+void ClusteredForwardShadingPass::SetupInputBuffers(
+    render::GeometryPassContext& context, const engine::BufferGroup* buffers, nvrhi::GraphicsState& state) {
+    if (m_QuantizedInputAssembler) {
+        VertexQuantizer::SetupInputBuffers(buffers, state);
+        return;
+    }
+    ForwardShadingPass::SetupInputBuffers(context, buffers, state);
+}
+
+void ClusteredForwardShadingPass::ReserveBuffers(uint32_t lightCount, uint32_t lightIndexCount) {
+    bool recreated = false;
+
+    if (lightCount > m_LightCapacity) {
+        m_LightCapacity = GrowCapacity(std::max(m_LightCapacity, c_MinLightCapacity), lightCount);
+        m_Lights = m_Device->createBuffer(nvrhi::BufferDesc()
+                                              .setByteSize(size_t(m_LightCapacity) * sizeof(LightConstants))
+                                              .setStructStride(sizeof(LightConstants))
+                                              .setDebugName("ClusteredLights")
+                                              .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                              .setKeepInitialState(true));
+        recreated = true;
+    }
+
+    if (lightIndexCount > m_LightIndexCapacity) {
+        m_LightIndexCapacity = GrowCapacity(std::max(m_LightIndexCapacity, c_MinLightIndexCapacity), lightIndexCount);
+        m_LightIndices = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                    .setByteSize(size_t(m_LightIndexCapacity) * sizeof(uint32_t))
+                                                    .setStructStride(sizeof(uint32_t))
+                                                    .setDebugName("ClusterLightIndices")
+                                                    .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                                    .setKeepInitialState(true));
+        recreated = true;
+    }
+
+    // Before Init there is no layout yet, and Init creates the set itself.
+    if (recreated && m_ViewBindingLayout) {
+        m_ViewBindingSet = CreateViewBindingSet();
+    }
+}
+
+void ClusteredForwardShadingPass::PrepareClusters(
+    nvrhi::ICommandList* commandList, const engine::IView& view, const std::vector<std::shared_ptr<engine::Light>>& lights) {
+    m_LightConstants.clear();
+    m_LightSpheres.clear();
+
+    for (const auto& light : lights) {
+        const int lightType = light->GetLightType();
+        if (lightType != LightType_Point && lightType != LightType_Spot) {
+            continue;
+        }
+
+        LightConstants& constants = m_LightConstants.emplace_back();
+        light->FillLightConstants(constants);
+
+        // A spot light is bounded by the sphere of its range; lights without a range reach every cluster.
+        const float range = constants.angularSizeOrInvRange > 0.f ? 1.f / constants.angularSizeOrInvRange : 0.f;
+        m_LightSpheres.push_back(float4(constants.position, range));
+    }
+
+    m_Clusters.Build(view, m_LightSpheres);
+
+    const std::vector<uint2>& clusterRanges = m_Clusters.GetClusterRanges();
+    const std::vector<uint32_t>& lightIndices = m_Clusters.GetLightIndices();
+    ReserveBuffers(uint32_t(m_LightConstants.size()), uint32_t(lightIndices.size()));
+
+    if (!m_LightConstants.empty()) {
+        commandList->writeBuffer(m_Lights, m_LightConstants.data(), m_LightConstants.size() * sizeof(LightConstants));
+    }
+    if (!lightIndices.empty()) {
+        commandList->writeBuffer(m_LightIndices, lightIndices.data(), lightIndices.size() * sizeof(uint32_t));
+    }
+    commandList->writeBuffer(m_ClusterRanges, clusterRanges.data(), clusterRanges.size() * sizeof(uint2));
+
+    const nvrhi::Rect extent = view.GetViewExtent();
+    const float sliceScale = float(LightClusterGrid::c_Slices) / std::log2(m_Clusters.GetFarDepth() / m_Clusters.GetNearDepth());
+
+    ClusteredLightingConstants constants = {};
+    constants.viewDepthPlane = m_Clusters.GetViewDepthPlane();
+    constants.viewportOrigin = float2(float(extent.minX), float(extent.minY));
+    constants.tilesPerPixel = float2(float(LightClusterGrid::c_TilesX) / float(std::max(extent.width(), 1)),
+        float(LightClusterGrid::c_TilesY) / float(std::max(extent.height(), 1)));
+    constants.nearDepth = m_Clusters.GetNearDepth();
+    constants.sliceScale = sliceScale;
+    constants.sliceBias = -std::log2(m_Clusters.GetNearDepth()) * sliceScale;
+    constants.naiveLightLoop = m_NaiveLightLoop ? 1 : 0;
+    constants.lightCount = uint32_t(m_LightConstants.size());
+    commandList->writeBuffer(m_ClusterConstants, &constants, sizeof(constants));
+}
+
+} // namespace sanbox
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/View.h>
+#include <donut/render/ForwardShadingPass.h>
+#include <nvrhi/nvrhi.h>
+
+#include <memory>
+#include <vector>
+
+#include "BindlessMaterialTable.h"
+#include "LightClusterGrid.h"
+#include "PipelineCache.h"
+
+struct LightConstants;
+
+namespace sanbox {
+
+// Forward shading that reads point and spot lights from a light cluster grid instead of the fixed-size
+// light array of donut's ForwardShadingPass. The grid, the light data and the cluster lists are bound in the
+// pass's view binding space, so draws and pipelines are set up exactly as in the base pass.
+// Only opaque and alpha-tested materials use the clustered shader; transmissive ones keep donut's.
+// With vertex quantization enabled, the pass draws the vertex buffers written by VertexQuantizer instead.
+// With bindless materials, the opaque and alpha-tested materials come from a BindlessMaterialTable that is
+// bound once per pass, and draws select theirs by an index in the push constants.
+class ClusteredForwardShadingPass : public donut::render::ForwardShadingPass {
+public:
+    // The index of the material that SetupMaterial set up, for the push constants of the draws.
+    class Context : public donut::render::ForwardShadingPass::Context {
+    public:
+        uint32_t materialIndex = 0;
+    };
+
+    ClusteredForwardShadingPass(nvrhi::IDevice* device, std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses);
+    ~ClusteredForwardShadingPass() override;
+
+    // Assigns the point and spot lights to the clusters of the view and uploads them. Call once per frame
+    // before any command list records the pass. Directional lights still go through PrepareLights.
+    void PrepareClusters(nvrhi::ICommandList* commandList, const donut::engine::IView& view,
+        const std::vector<std::shared_ptr<donut::engine::Light>>& lights);
+
+    // Shades every point and spot light at every pixel, for comparison with the clustered loop.
+    void SetNaiveLightLoop(bool enabled) {
+        m_NaiveLightLoop = enabled;
+    }
+
+    // Decode the vertices of VertexQuantizer; every mesh drawn with the pass must be quantized. Call before Init.
+    void SetVertexQuantization(bool enabled) {
+        m_VertexQuantization = enabled;
+    }
+    // VertexQuantizer::GetMeshDataBuffer, once the scene has been quantized.
+    void SetQuantizedMeshBuffer(nvrhi::IBuffer* buffer);
+
+    // Draws must then use the pass's Context. Only for the buffer-load path; call before Init.
+    void SetBindlessMaterials(bool enabled) {
+        m_BindlessMaterials = enabled;
+    }
+    // After every BindlessMaterialTable::Update, since the table may have a new material buffer.
+    void SetMaterialTable(const BindlessMaterialTable* table);
+
+    // Pipelines created from then on are timed and recorded in the cache.
+    void SetPipelineCache(PipelineCache* cache) {
+        m_PipelineCache = cache;
+    }
+    // Creates the pipelines that the cache recorded for the framebuffer's formats, so that the first frames
+    // do not. With bindless materials, call after SetMaterialTable.
+    void PrecreatePipelines(nvrhi::IFramebuffer* framebuffer);
+
+    void Init(donut::engine::ShaderFactory& shaderFactory, const CreateParameters& params) override;
+    bool SetupMaterial(donut::render::GeometryPassContext& context, const donut::engine::Material* material, nvrhi::RasterCullMode cullMode,
+        nvrhi::GraphicsState& state) override;
+    void SetupInputBuffers(donut::render::GeometryPassContext& context, const donut::engine::BufferGroup* buffers,
+        nvrhi::GraphicsState& state) override;
+    void SetPushConstants(donut::render::GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state,
+        nvrhi::DrawArguments& args) override;
+
+    [[nodiscard]] const LightClusterStatistics& GetStatistics() const {
+        return m_Clusters.GetStatistics();
+    }
+
+protected:
+    nvrhi::ShaderHandle CreateVertexShader(donut::engine::ShaderFactory& shaderFactory, const CreateParameters& params) override;
+    nvrhi::InputLayoutHandle CreateInputLayout(nvrhi::IShader* vertexShader, const CreateParameters& params) override;
+    nvrhi::ShaderHandle CreatePixelShader(
+        donut::engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool transmissiveMaterial) override;
+    nvrhi::BindingLayoutHandle CreateViewBindingLayout() override;
+    nvrhi::BindingSetHandle CreateViewBindingSet() override;
+    nvrhi::BindingLayoutHandle CreateInputBindingLayout() override;
+    nvrhi::BindingSetHandle CreateInputBindingSet(const donut::engine::BufferGroup* bufferGroup) override;
+    nvrhi::GraphicsPipelineHandle CreateGraphicsPipeline(PipelineKey key, nvrhi::IFramebuffer* framebuffer) override;
+
+private:
+    static constexpr const char* c_PipelineCacheName = "ClusteredForward";
+
+    nvrhi::GraphicsPipelineHandle CreatePipelineVariant(PipelineKey key, nvrhi::IFramebuffer* framebuffer);
+    static bool IsBindlessDomain(donut::engine::MaterialDomain domain);
+    void ReserveBuffers(uint32_t lightCount, uint32_t lightIndexCount);
+
+    LightClusterGrid m_Clusters;
+    bool m_NaiveLightLoop = false;
+    bool m_VertexQuantization = false;
+    bool m_QuantizedInputAssembler = false;
+    nvrhi::BufferHandle m_QuantizedMeshes;
+
+    bool m_BindlessMaterials = false;
+    const BindlessMaterialTable* m_MaterialTable = nullptr;
+    nvrhi::ShaderHandle m_BindlessPixelShader;
+    nvrhi::BindingLayoutHandle m_BindlessMaterialLayout;
+    nvrhi::BindingSetHandle m_BindlessMaterialSet;
+    PipelineCache* m_PipelineCache = nullptr;
+
+    nvrhi::BufferHandle m_ClusterConstants;
+    nvrhi::BufferHandle m_ClusterRanges;
+    nvrhi::BufferHandle m_Lights;
+    nvrhi::BufferHandle m_LightIndices;
+    uint32_t m_LightCapacity = 0;
+    uint32_t m_LightIndexCapacity = 0;
+
+    std::vector<LightConstants> m_LightConstants;
+    std::vector<dm::float4> m_LightSpheres;
+};
+
+} // namespace sanbox
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace sanbox {
+
+// 64-bit FNV-1a over 8-byte words, with a final avalanche so that nearby inputs spread over all bits.
+class ContentHash {
+public:
+    void Add(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        size_t offset = 0;
+        for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, bytes + offset, sizeof(word));
+            m_Hash = (m_Hash ^ word) * c_Prime;
+        }
+        for (; offset < size; offset++) {
+            m_Hash = (m_Hash ^ bytes[offset]) * c_Prime;
+        }
+    }
+
+    [[nodiscard]] uint64_t Get() const {
+        uint64_t hash = m_Hash;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+private:
+    static constexpr uint64_t c_Prime = 0x100000001b3ull;
+    uint64_t m_Hash = 0xcbf29ce484222325ull;
+};
+
+} // namespace sanbox
@@ -0,0 +1,207 @@
+#include "CulledDrawStrategy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+namespace {
+
+// Largest scale factor of the transform, which bounds how much it enlarges object-space errors.
+float GetMaxScale(const affine3& transform) {
+    return std::max({length(transform.m_linear.row(0)), length(transform.m_linear.row(1)), length(transform.m_linear.row(2))});
+}
+
+} // namespace
+
+void CulledDrawStrategy::SetLods(MeshLodSet* lods, float errorPixels) {
+    m_Lods = lods;
+    m_LodErrorPixels = errorPixels;
+    std::fill(m_InstanceLevels.begin(), m_InstanceLevels.end(), uint8_t(0));
+}
+
+void CulledDrawStrategy::SetTransformHierarchy(const TransformHierarchy* hierarchy) {
+    m_Hierarchy = hierarchy;
+    m_SceneGraph = nullptr;
+}
+
+bool CulledDrawStrategy::UsesHierarchy() const {
+    return m_Hierarchy && m_Hierarchy->GetInstanceCount() == m_Instances.size();
+}
+
+void CulledDrawStrategy::SyncInstances(const engine::SceneGraph& sceneGraph, uint32_t viewCount) {
+    const auto& meshInstances = sceneGraph.GetMeshInstances();
+    m_SyncedViews = std::max(viewCount, 1u);
+
+    bool rebuild = m_SceneGraph != &sceneGraph || m_Instances.size() != meshInstances.size();
+    for (size_t i = 0; i < meshInstances.size() && !rebuild; i++) {
+        rebuild = m_Instances[i] != meshInstances[i].get();
+    }
+
+    if (rebuild) {
+        m_SceneGraph = &sceneGraph;
+        m_Instances.resize(meshInstances.size());
+        m_Transforms.resize(meshInstances.size());
+        m_WorldBounds.resize(meshInstances.size());
+        m_InstanceLevels.assign(meshInstances.size(), 0);
+
+        const bool useHierarchy = UsesHierarchy();
+        for (size_t i = 0; i < meshInstances.size(); i++) {
+            const engine::MeshInstance* instance = meshInstances[i].get();
+            m_Instances[i] = instance;
+            if (useHierarchy) {
+                m_Transforms[i] = m_Hierarchy->GetInstanceTransform(uint32_t(i));
+                m_WorldBounds[i] = m_Hierarchy->GetInstanceBounds(uint32_t(i));
+            } else {
+                m_Transforms[i] = instance->GetNode()->GetLocalToWorldTransformFloat();
+                m_WorldBounds[i] = instance->GetMesh()->objectSpaceBounds * m_Transforms[i];
+            }
+        }
+        if (useHierarchy) {
+            m_HierarchyUpdateCount = m_Hierarchy->GetUpdateCount();
+        }
+
+        m_Culler.Build(m_WorldBounds);
+        return;
+    }
+
+    // The hierarchy lists the instances that moved in its last update; if updates were missed, all of
+    // them are taken over.
+    if (UsesHierarchy()) {
+        const uint64_t updateCount = m_Hierarchy->GetUpdateCount();
+        if (updateCount == m_HierarchyUpdateCount + 1) {
+            for (uint32_t i : m_Hierarchy->GetMovedInstances()) {
+                m_Transforms[i] = m_Hierarchy->GetInstanceTransform(i);
+                m_WorldBounds[i] = m_Hierarchy->GetInstanceBounds(i);
+                m_Culler.UpdateBounds(i, m_WorldBounds[i]);
+            }
+        } else if (updateCount != m_HierarchyUpdateCount) {
+            for (uint32_t i = 0; i < uint32_t(m_Instances.size()); i++) {
+                m_Transforms[i] = m_Hierarchy->GetInstanceTransform(i);
+                m_WorldBounds[i] = m_Hierarchy->GetInstanceBounds(i);
+                m_Culler.UpdateBounds(i, m_WorldBounds[i]);
+            }
+        }
+        m_HierarchyUpdateCount = updateCount;
+        m_Culler.Refit();
+        return;
+    }
+
+    // The scene graph clears its dirty flags when it refreshes, so moved instances are found by
+    // comparing transforms; only their leaves and ancestors are refit.
+    for (size_t i = 0; i < m_Instances.size(); i++) {
+        const dm::affine3 transform = m_Instances[i]->GetNode()->GetLocalToWorldTransformFloat();
+        if (memcmp(&transform, &m_Transforms[i], sizeof(transform)) != 0) {
+            m_Transforms[i] = transform;
+            m_WorldBounds[i] = m_Instances[i]->GetMesh()->objectSpaceBounds * transform;
+            m_Culler.UpdateBounds(uint32_t(i), m_WorldBounds[i]);
+        }
+    }
+    m_Culler.Refit();
+}
+
+void CulledDrawStrategy::PrepareForView(const std::shared_ptr<engine::SceneGraphNode>& rootNode, const engine::IView& view) {
+    m_Items.clear();
+    m_ReadIndex = 0;
+
+    std::shared_ptr<engine::SceneGraph> sceneGraph = rootNode ? rootNode->GetGraph() : nullptr;
+    if (!sceneGraph) {
+        return;
+    }
+
+    if (m_SyncedViews == 0 || m_SceneGraph != sceneGraph.get()) {
+        SyncInstances(*sceneGraph);
+    }
+    m_SyncedViews--;
+
+    m_VisibleInstances.clear();
+    m_Culler.Cull(view.GetViewFrustum(), m_VisibleInstances);
+
+    m_LodStatistics = LodSelectionStatistics();
+    if (m_Lods) {
+        m_Lods->SyncBuffers();
+    }
+
+    // Pixels that one world unit covers at unit distance from a perspective camera, or at any distance
+    // from an orthographic one.
+    const float3 viewOrigin = view.GetViewOrigin();
+    const bool orthographic = view.IsOrthographicProjection();
+    const float viewPixelsPerUnit = 0.5f * float(view.GetViewExtent().height()) * std::abs(view.GetProjectionMatrix(false)[1][1]);
+
+    for (uint32_t index : m_VisibleInstances) {
+        const engine::MeshInstance* instance = m_Instances[index];
+        const engine::MeshInfo* sourceMesh = instance->GetMesh().get();
+        const engine::MeshInfo* mesh = sourceMesh;
+
+        if (const std::vector<MeshLodLevel>* levels = m_Lods ? m_Lods->GetLevels(*sourceMesh) : nullptr) {
+            // The error is projected at the point of the bounds nearest to the camera; from inside them
+            // nothing but the source mesh is safe.
+            const box3& bounds = m_WorldBounds[index];
+            const float distance = length(max(max(bounds.m_mins - viewOrigin, viewOrigin - bounds.m_maxs), float3(0.f)));
+            float pixelsPerUnit = viewPixelsPerUnit * GetMaxScale(m_Transforms[index]);
+            if (!orthographic) {
+                pixelsPerUnit = distance > 0.f ? pixelsPerUnit / distance : std::numeric_limits<float>::infinity();
+            }
+
+            const uint32_t level = MeshLodSet::SelectLevel(*levels, pixelsPerUnit, m_LodErrorPixels, m_InstanceLevels[index]);
+            if (level != m_InstanceLevels[index]) {
+                m_InstanceLevels[index] = uint8_t(level);
+                m_LodStatistics.lodSwitches++;
+            }
+            m_LodStatistics.coarseInstances += level > 0 ? 1 : 0;
+            mesh = (*levels)[level].mesh;
+        }
+
+        for (size_t geometryIndex = 0; geometryIndex < mesh->geometries.size(); geometryIndex++) {
+            const engine::MeshGeometry* geometry = mesh->geometries[geometryIndex].get();
+            const engine::Material* material = geometry->material.get();
+            if (!material || (material->domain != engine::MaterialDomain::Opaque && material->domain != engine::MaterialDomain::AlphaTested)) {
+                continue;
+            }
+            m_LodStatistics.fullDetailTriangles += sourceMesh->geometries[geometryIndex]->numIndices / 3;
+            m_LodStatistics.drawnTriangles += geometry->numIndices / 3;
+            if (geometry->numIndices == 0) {
+                continue;
+            }
+
+            engine::DrawItem& item = m_Items.emplace_back();
+            item.instance = instance;
+            item.mesh = mesh;
+            item.geometry = geometry;
+            item.material = material;
+            item.buffers = mesh->buffers.get();
+            item.cullMode = material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back;
+        }
+    }
+
+    std::sort(m_Items.begin(), m_Items.end(), [](const engine::DrawItem& a, const engine::DrawItem& b) {
+        if (a.material != b.material) {
+            return a.material < b.material;
+        }
+        if (a.buffers != b.buffers) {
+            return a.buffers < b.buffers;
+        }
+        if (a.mesh != b.mesh) {
+            return a.mesh < b.mesh;
+        }
+        if (a.geometry != b.geometry) {
+            return a.geometry < b.geometry;
+        }
+        // Consecutive instance indices are merged into one instanced draw.
+        return a.instance->GetInstanceIndex() < b.instance->GetInstanceIndex();
+    });
+}
+
+const engine::DrawItem* CulledDrawStrategy::GetNextItem() {
+    if (m_ReadIndex < m_Items.size()) {
+        return &m_Items[m_ReadIndex++];
+    }
+    return nullptr;
+}
+
+} // namespace sanbox
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/View.h>
+#include <donut/render/DrawStrategy.h>
+
+#include <memory>
+#include <vector>
+
+#include "FrustumCuller.h"
+#include "MeshLods.h"
+#include "TransformHierarchy.h"
+
+namespace sanbox {
+
+// Opaque and alpha-tested draws of the mesh instances that pass FrustumCuller, sorted so that
+// consecutive items share material, buffers and geometry for instancing. Culls every instance of
+// the scene graph that owns the root node passed to PrepareForView. With LODs, every visible instance is
+// drawn with the coarsest level whose error projects to less than the threshold in the view.
+class CulledDrawStrategy : public donut::render::IDrawStrategy {
+public:
+    void PrepareForView(const std::shared_ptr<donut::engine::SceneGraphNode>& rootNode, const donut::engine::IView& view) override;
+    const donut::engine::DrawItem* GetNextItem() override;
+
+    [[nodiscard]] const FrustumCullStatistics& GetStatistics() const {
+        return m_Culler.GetStatistics();
+    }
+    [[nodiscard]] const LodSelectionStatistics& GetLodStatistics() const {
+        return m_LodStatistics;
+    }
+
+    // Null draws the source meshes. The level of each instance is kept from frame to frame for the
+    // hysteresis, so LOD selection expects one view per frame.
+    void SetLods(MeshLodSet* lods, float errorPixels);
+    [[nodiscard]] MeshLodSet* GetLods() const {
+        return m_Lods;
+    }
+
+    // Takes the transforms and bounds of the moved instances from the hierarchy instead of comparing the
+    // transforms of every scene graph node. Null goes back to the scene graph.
+    void SetTransformHierarchy(const TransformHierarchy* hierarchy);
+
+    // Brings the BVH up to date with the instances of the graph. PrepareForView does it unless the owner
+    // did for this frame, which keeps the refit apart from the draw in profiles. The next viewCount views
+    // are culled against the BVH as it is, so that the views of a batch share one sync.
+    void SyncInstances(const donut::engine::SceneGraph& sceneGraph, uint32_t viewCount = 1);
+
+private:
+    [[nodiscard]] bool UsesHierarchy() const;
+
+    FrustumCuller m_Culler;
+    const donut::engine::SceneGraph* m_SceneGraph = nullptr;
+    std::vector<const donut::engine::MeshInstance*> m_Instances;
+    std::vector<dm::affine3> m_Transforms;
+    std::vector<dm::box3> m_WorldBounds;
+    const TransformHierarchy* m_Hierarchy = nullptr;
+    uint64_t m_HierarchyUpdateCount = 0;
+    uint32_t m_SyncedViews = 0;
+
+    MeshLodSet* m_Lods = nullptr;
+    float m_LodErrorPixels = 1.f;
+    std::vector<uint8_t> m_InstanceLevels;
+    LodSelectionStatistics m_LodStatistics;
+
+    std::vector<uint32_t> m_VisibleInstances;
+    std::vector<donut::engine::DrawItem> m_Items;
+    size_t m_ReadIndex = 0;
+};
+
+} // namespace sanbox
@@ -0,0 +1,123 @@
+#include "DrawSubmission.h"
+
+#include <donut/engine/SceneGraph.h>
+
+#include <algorithm>
+
+using namespace donut;
+
+namespace sanbox {
+
+namespace {
+
+// The parts of the state that SetupMaterial and SetupInputBuffers write; the rest is fixed for the pass.
+bool HasSameBindings(const nvrhi::GraphicsState& a, const nvrhi::GraphicsState& b) {
+    return a.pipeline == b.pipeline && a.indexBuffer == b.indexBuffer &&
+           std::equal(a.bindings.begin(), a.bindings.end(), b.bindings.begin(), b.bindings.end()) &&
+           std::equal(a.vertexBuffers.begin(), a.vertexBuffers.end(), b.vertexBuffers.begin(), b.vertexBuffers.end());
+}
+
+} // namespace
+
+uint32_t BindingSetTracker::Track(const nvrhi::BindingSetVector& bindings) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    uint32_t added = 0;
+    for (nvrhi::IBindingSet* bindingSet : bindings) {
+        if (bindingSet && m_Bound.insert(bindingSet).second) {
+            added++;
+        }
+    }
+    return added;
+}
+
+void BindingSetTracker::Reset() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Bound.clear();
+}
+
+void RenderDrawItems(nvrhi::ICommandList* commandList, const engine::IView* view, const engine::IView* viewPrev,
+    nvrhi::IFramebuffer* framebuffer, render::IDrawStrategy& drawStrategy, render::IGeometryPass& pass, render::GeometryPassContext& context,
+    DrawSubmissionStatistics& statistics, BindingSetTracker* bindingSets) {
+    pass.SetupView(context, commandList, view, viewPrev);
+
+    nvrhi::GraphicsState state;
+    state.framebuffer = framebuffer;
+    state.viewport = view->GetViewportState();
+    nvrhi::GraphicsState committedState;
+    bool stateCommitted = false;
+
+    const engine::Material* lastMaterial = nullptr;
+    const engine::BufferGroup* lastBuffers = nullptr;
+    nvrhi::RasterCullMode lastCullMode = nvrhi::RasterCullMode::Back;
+    bool drawMaterial = true;
+
+    nvrhi::DrawArguments currentDraw;
+    currentDraw.instanceCount = 0;
+
+    const auto flushDraw = [&]() {
+        if (currentDraw.instanceCount == 0) {
+            return;
+        }
+        if (drawMaterial) {
+            if (!stateCommitted || !HasSameBindings(state, committedState)) {
+                commandList->setGraphicsState(state);
+                committedState = state;
+                stateCommitted = true;
+                statistics.graphicsStateCalls++;
+                if (bindingSets) {
+                    statistics.bindingSetCreations += bindingSets->Track(state.bindings);
+                }
+            }
+            nvrhi::DrawArguments args = currentDraw;
+            pass.SetPushConstants(context, commandList, state, args);
+            commandList->drawIndexed(args);
+            statistics.draws++;
+        }
+        currentDraw.instanceCount = 0;
+    };
+
+    while (const engine::DrawItem* item = drawStrategy.GetNextItem()) {
+        if (!item->material) {
+            continue;
+        }
+
+        // SetupMaterial writes the bindings, which include the input buffers' set in the buffer-load passes.
+        const bool newBuffers = item->buffers != lastBuffers;
+        const bool newMaterial = newBuffers || item->material != lastMaterial || item->cullMode != lastCullMode;
+        if (newMaterial) {
+            flushDraw();
+        }
+        if (newBuffers) {
+            pass.SetupInputBuffers(context, item->buffers, state);
+            lastBuffers = item->buffers;
+        }
+        if (newMaterial) {
+            drawMaterial = pass.SetupMaterial(context, item->material, item->cullMode, state);
+            lastMaterial = item->material;
+            lastCullMode = item->cullMode;
+            statistics.materialChanges++;
+        }
+        if (!drawMaterial) {
+            continue;
+        }
+
+        const uint32_t startIndex = item->geometry->indexOffsetInMesh + item->mesh->indexOffset;
+        const uint32_t startVertex = item->geometry->vertexOffsetInMesh + item->mesh->vertexOffset;
+        const uint32_t instance = uint32_t(item->instance->GetInstanceIndex());
+        if (currentDraw.instanceCount > 0 && currentDraw.startIndexLocation == startIndex && currentDraw.startVertexLocation == startVertex &&
+            currentDraw.startInstanceLocation + currentDraw.instanceCount == instance) {
+            currentDraw.instanceCount++;
+            continue;
+        }
+
+        flushDraw();
+        currentDraw.startIndexLocation = startIndex;
+        currentDraw.startVertexLocation = startVertex;
+        currentDraw.startInstanceLocation = instance;
+        currentDraw.vertexCount = item->geometry->numIndices;
+        currentDraw.instanceCount = 1;
+    }
+    flushDraw();
+}
+
+} // namespace sanbox
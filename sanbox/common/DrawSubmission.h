@@ -0,0 +1,55 @@
+#pragma once
+
+#include <donut/engine/View.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/render/GeometryPasses.h>
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+
+namespace sanbox {
+
+struct DrawSubmissionStatistics {
+    uint32_t draws = 0;
+    // SetupMaterial calls, one per change of material, cull mode or buffer group.
+    uint32_t materialChanges = 0;
+    uint32_t graphicsStateCalls = 0;
+    // Binding sets that no draw had bound since the pass caches were last reset, which is when the passes
+    // create them.
+    uint32_t bindingSetCreations = 0;
+
+    DrawSubmissionStatistics& operator+=(const DrawSubmissionStatistics& other) {
+        draws += other.draws;
+        materialChanges += other.materialChanges;
+        graphicsStateCalls += other.graphicsStateCalls;
+        bindingSetCreations += other.bindingSetCreations;
+        return *this;
+    }
+};
+
+// The binding sets that draws have bound, so that a draw loop can count the sets that the passes create
+// lazily into caches of their own. Shared by the threads that record one pass.
+class BindingSetTracker {
+public:
+    // Returns how many of the sets have not been bound before.
+    uint32_t Track(const nvrhi::BindingSetVector& bindings);
+
+    // Whenever the pass caches are reset, since the sets they create next may reuse the old addresses.
+    void Reset();
+
+private:
+    std::mutex m_Mutex;
+    std::unordered_set<nvrhi::IBindingSet*> m_Bound;
+};
+
+// donut's RenderView, which sets the graphics state again after every SetupMaterial and SetupInputBuffers,
+// with the state set only when they changed it. Passes that bind their materials once per pass, such as
+// those with a BindlessMaterialTable, then set it a few times per pass rather than once per material.
+// Sets up the view and merges consecutive instances of a geometry into one draw, as RenderView does.
+void RenderDrawItems(nvrhi::ICommandList* commandList, const donut::engine::IView* view, const donut::engine::IView* viewPrev,
+    nvrhi::IFramebuffer* framebuffer, donut::render::IDrawStrategy& drawStrategy, donut::render::IGeometryPass& pass,
+    donut::render::GeometryPassContext& context, DrawSubmissionStatistics& statistics, BindingSetTracker* bindingSets = nullptr);
+
+} // namespace sanbox
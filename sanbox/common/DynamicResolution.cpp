@@ -0,0 +1,71 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace donut::math;
+
+namespace sanbox {
+
+DynamicResolution::DynamicResolution(const DynamicResolutionParameters& params)
+    : m_Params(params) {
+    m_Params.minScale = std::clamp(m_Params.minScale, c_ScaleStep, 1.f);
+    m_Params.maxScale = std::clamp(m_Params.maxScale, m_Params.minScale, 1.f);
+    m_Params.headroom = std::clamp(m_Params.headroom, 0.f, 0.9f);
+
+    m_Scale = m_Params.maxScale;
+    m_TargetScale = m_Params.maxScale;
+    m_Statistics.scale = m_Scale;
+    m_Statistics.lowestScale = m_Scale;
+}
+
+float DynamicResolution::BeginFrame(uint64_t frameNumber) {
+    FrameRecord& record = m_Frames[frameNumber % c_FrameRecords];
+    record.frameNumber = frameNumber;
+    record.scale = m_Scale;
+    return m_Scale;
+}
+
+void DynamicResolution::ReportGpuTime(uint64_t frameNumber, double gpuMs) {
+    if (frameNumber < m_NextReportedFrame) {
+        return;
+    }
+    m_NextReportedFrame = frameNumber + 1;
+
+    const FrameRecord& record = m_Frames[frameNumber % c_FrameRecords];
+    if (record.frameNumber != frameNumber || gpuMs <= 0.0) {
+        return;
+    }
+
+    m_Statistics.measuredFrames++;
+    m_Statistics.meanScale += (double(record.scale) - m_Statistics.meanScale) / double(m_Statistics.measuredFrames);
+    if (gpuMs > m_Params.targetFrameMs) {
+        m_Statistics.framesOverTarget++;
+    }
+
+    // GPU time is taken to grow with the number of pixels, so the scale that fits the budget is the frame's
+    // own scale times the square root of the ratio of the budget to its time.
+    const double budgetMs = m_Params.targetFrameMs * (1.0 - m_Params.headroom);
+    const float fittingScale = std::clamp(float(record.scale * std::sqrt(budgetMs / gpuMs)), m_Params.minScale, m_Params.maxScale);
+    if (fittingScale < m_TargetScale) {
+        m_TargetScale = fittingScale;
+    } else {
+        // By at least a tenth of a step, so that the scale reaches the fitting one rather than only approaching it.
+        m_TargetScale = std::min(fittingScale, m_TargetScale + std::max((fittingScale - m_TargetScale) * c_GrowthRate, c_ScaleStep * 0.1f));
+    }
+
+    const float scale = std::clamp(std::floor(m_TargetScale / c_ScaleStep) * c_ScaleStep, m_Params.minScale, m_Params.maxScale);
+    if (scale != m_Scale) {
+        m_Scale = scale;
+        m_Statistics.scaleChanges++;
+    }
+    m_Statistics.scale = m_Scale;
+    m_Statistics.lowestScale = std::min(m_Statistics.lowestScale, m_Scale);
+}
+
+uint2 DynamicResolution::GetRenderSize(uint2 fullSize) const {
+    return uint2(std::clamp(uint32_t(float(fullSize.x) * m_Scale + 0.5f), 1u, std::max(fullSize.x, 1u)),
+        std::clamp(uint32_t(float(fullSize.y) * m_Scale + 0.5f), 1u, std::max(fullSize.y, 1u)));
+}
+
+} // namespace sanbox
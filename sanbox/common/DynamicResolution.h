@@ -0,0 +1,76 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+
+#include <array>
+#include <cstdint>
+
+namespace sanbox {
+
+struct DynamicResolutionParameters {
+    double targetFrameMs = 16.6;
+    // Bounds of the render scale, per axis, relative to the full size of the targets.
+    float minScale = 0.5f;
+    float maxScale = 1.f;
+    // Part of the target kept free, so that frames slightly heavier than the measured ones still fit.
+    float headroom = 0.1f;
+};
+
+struct DynamicResolutionStatistics {
+    float scale = 1.f;
+    float lowestScale = 1.f;
+    double meanScale = 0.0;
+    uint32_t scaleChanges = 0;
+    // Measured frames whose GPU time was over the target.
+    uint32_t framesOverTarget = 0;
+    uint64_t measuredFrames = 0;
+};
+
+// Picks the render scale of every frame from the measured GPU time of earlier frames. GPU times arrive a few
+// frames late, so the scale each frame was rendered at is kept until its time is reported, and the time is
+// weighed against that scale rather than the current one. The scale drops at once when a frame would not fit
+// the target and grows back slowly, and moves in steps of c_ScaleStep so that small variations in frame time
+// do not change the render size every frame.
+class DynamicResolution {
+public:
+    static constexpr float c_ScaleStep = 1.f / 32.f;
+    // Fraction of the distance to the fitting scale that the scale grows by per measured frame.
+    static constexpr float c_GrowthRate = 0.05f;
+
+    explicit DynamicResolution(const DynamicResolutionParameters& params);
+
+    // Returns the scale of the frame about to be recorded and remembers it for ReportGpuTime.
+    float BeginFrame(uint64_t frameNumber);
+
+    // Frames may be reported more than once or not at all; only the first report of each counts.
+    void ReportGpuTime(uint64_t frameNumber, double gpuMs);
+
+    // The size of the region of targets of the full size that frames are currently rendered into.
+    [[nodiscard]] dm::uint2 GetRenderSize(dm::uint2 fullSize) const;
+
+    [[nodiscard]] float GetScale() const {
+        return m_Scale;
+    }
+    [[nodiscard]] const DynamicResolutionStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    struct FrameRecord {
+        uint64_t frameNumber = ~0ull;
+        float scale = 1.f;
+    };
+
+    // Longer than the latency of any timer query ring.
+    static constexpr size_t c_FrameRecords = 16;
+
+    DynamicResolutionParameters m_Params;
+    float m_Scale;
+    // The scale before quantization, which grows by fractions of a step.
+    float m_TargetScale;
+    uint64_t m_NextReportedFrame = 0;
+    std::array<FrameRecord, c_FrameRecords> m_Frames;
+    DynamicResolutionStatistics m_Statistics;
+};
+
+} // namespace sanbox
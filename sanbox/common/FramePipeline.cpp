@@ -0,0 +1,67 @@
+#include "FramePipeline.h"
+
+#include <algorithm>
+
+namespace sanbox {
+
+FramePipeline::FramePipeline(nvrhi::IDevice* device, uint32_t framesInFlight, size_t uploadChunkSize)
+    : m_Device(device) {
+    framesInFlight = std::clamp(framesInFlight, 1u, c_MaxFramesInFlight);
+
+    auto commandListParams = nvrhi::CommandListParameters().setUploadChunkSize(uploadChunkSize);
+
+    m_Frames.resize(framesInFlight);
+    for (FrameContext& frame : m_Frames) {
+        frame.commandList = m_Device->createCommandList(commandListParams);
+        frame.postCommandList = m_Device->createCommandList(commandListParams);
+        frame.fence = m_Device->createEventQuery();
+    }
+
+    m_SubmitList.reserve(64);
+}
+
+FrameContext& FramePipeline::BeginFrame() {
+    FrameContext& frame = m_Frames[m_FrameNumber % m_Frames.size()];
+
+    if (frame.submitted) {
+        m_Device->waitEventQuery(frame.fence);
+        m_Device->resetEventQuery(frame.fence);
+        frame.submitted = false;
+    }
+
+    frame.frameNumber = m_FrameNumber++;
+    return frame;
+}
+
+void FramePipeline::Submit(FrameContext& frame) {
+    m_SubmitList.clear();
+    m_SubmitList.push_back(frame.commandList);
+    Execute(frame);
+}
+
+void FramePipeline::Submit(FrameContext& frame, const std::vector<nvrhi::ICommandList*>& commandLists) {
+    m_SubmitList.clear();
+    m_SubmitList.push_back(frame.commandList);
+    m_SubmitList.insert(m_SubmitList.end(), commandLists.begin(), commandLists.end());
+    m_SubmitList.push_back(frame.postCommandList);
+    Execute(frame);
+}
+
+void FramePipeline::Execute(FrameContext& frame) {
+    m_Device->executeCommandLists(m_SubmitList.data(), m_SubmitList.size());
+    m_Device->setEventQuery(frame.fence, nvrhi::CommandQueue::Graphics);
+    frame.submitted = true;
+}
+
+void FramePipeline::WaitForIdle() {
+    m_Device->waitForIdle();
+
+    for (FrameContext& frame : m_Frames) {
+        if (frame.submitted) {
+            m_Device->resetEventQuery(frame.fence);
+            frame.submitted = false;
+        }
+    }
+}
+
+} // namespace sanbox
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+
+#include <vector>
+
+namespace sanbox {
+
+struct FrameContext {
+    nvrhi::CommandListHandle commandList;
+    // Recorded after the work that other threads put on their own command lists; see FramePipeline::Submit.
+    nvrhi::CommandListHandle postCommandList;
+    nvrhi::EventQueryHandle fence;
+    uint64_t frameNumber = 0;
+    bool submitted = false;
+};
+
+// A fixed ring of per-frame command lists. A slot is handed out again only after the GPU has signalled
+// the fence of the frame that last used it, so the CPU can record frame N+1 while frame N executes.
+// Each command list owns its upload chunks, which nvrhi recycles once that list's previous
+// submission retires; with the chunk size covering a whole frame there are no steady-state allocations.
+class FramePipeline {
+public:
+    static constexpr uint32_t c_MaxFramesInFlight = 8;
+    // Volatile constant buffer writes a pass may issue per frame; passes size their version rings from this.
+    static constexpr uint32_t c_ConstantBufferVersionsPerFrame = 16;
+
+    FramePipeline(nvrhi::IDevice* device, uint32_t framesInFlight, size_t uploadChunkSize = 4 * 1024 * 1024);
+
+    // Blocks until the slot for the next frame is free, then returns it. The command list is not opened.
+    FrameContext& BeginFrame();
+
+    // Executes the frame's command list and fences the slot.
+    void Submit(FrameContext& frame);
+    // Executes the frame's command list, then the given lists in order, then the post command list.
+    void Submit(FrameContext& frame, const std::vector<nvrhi::ICommandList*>& commandLists);
+
+    void WaitForIdle();
+
+    [[nodiscard]] uint32_t GetFramesInFlight() const {
+        return uint32_t(m_Frames.size());
+    }
+    [[nodiscard]] uint64_t GetFrameNumber() const {
+        return m_FrameNumber;
+    }
+
+private:
+    nvrhi::DeviceHandle m_Device;
+    std::vector<FrameContext> m_Frames;
+    void Execute(FrameContext& frame);
+
+    std::vector<nvrhi::ICommandList*> m_SubmitList;
+    uint64_t m_FrameNumber = 0;
+};
+
+} // namespace sanbox
@@ -0,0 +1,312 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SANBOX_CULL_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SANBOX_CULL_SSE 1
+#endif
+
+namespace sanbox {
+
+namespace {
+
+// Large enough to fail every plane test, small enough that multiplying by a zero normal component stays zero.
+constexpr float c_EmptyLane = 1e30f;
+
+enum class Containment { Outside, Intersecting, Inside };
+
+Containment ClassifyBox(const dm::frustum& frustum, const dm::box3& box) {
+    Containment result = Containment::Inside;
+
+    // Same plane convention as dm::frustum::intersectsWith: normals point out of the frustum.
+    for (const dm::plane& plane : frustum.planes) {
+        const dm::float3& n = plane.normal;
+        dm::float3 nearest(n.x > 0.f ? box.m_mins.x : box.m_maxs.x, n.y > 0.f ? box.m_mins.y : box.m_maxs.y,
+            n.z > 0.f ? box.m_mins.z : box.m_maxs.z);
+        dm::float3 farthest(n.x > 0.f ? box.m_maxs.x : box.m_mins.x, n.y > 0.f ? box.m_maxs.y : box.m_mins.y,
+            n.z > 0.f ? box.m_maxs.z : box.m_mins.z);
+
+        if (dm::dot(n, nearest) > plane.distance) {
+            return Containment::Outside;
+        }
+        if (dm::dot(n, farthest) > plane.distance) {
+            result = Containment::Intersecting;
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+const char* FrustumCuller::GetKernelName() {
+#if defined(SANBOX_CULL_AVX)
+    return "avx";
+#elif defined(SANBOX_CULL_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
+
+void FrustumCuller::Build(const std::vector<dm::box3>& bounds) {
+    const uint32_t instanceCount = uint32_t(bounds.size());
+    const uint32_t blockCount = (instanceCount + c_BlockSize - 1) / c_BlockSize;
+    const uint32_t laneCount = blockCount * c_BlockSize;
+
+    m_Nodes.clear();
+    m_DirtyNodes.clear();
+    m_BlockNodes.assign(blockCount, 0);
+    m_InstanceLanes.assign(instanceCount, 0);
+    m_LaneInstances.assign(laneCount, c_InvalidInstance);
+
+    for (std::vector<float>* component : {&m_MinX, &m_MinY, &m_MinZ}) {
+        component->assign(laneCount, c_EmptyLane);
+    }
+    for (std::vector<float>* component : {&m_MaxX, &m_MaxY, &m_MaxZ}) {
+        component->assign(laneCount, -c_EmptyLane);
+    }
+
+    m_Statistics = FrustumCullStatistics();
+    m_Statistics.totalInstances = instanceCount;
+
+    if (instanceCount == 0) {
+        return;
+    }
+
+    m_BuildOrder.resize(instanceCount);
+    for (uint32_t i = 0; i < instanceCount; i++) {
+        m_BuildOrder[i] = i;
+    }
+
+    m_Nodes.reserve(size_t(blockCount) * 2);
+    BuildRecursive(bounds, 0, instanceCount, ~0u);
+}
+
+uint32_t FrustumCuller::BuildRecursive(const std::vector<dm::box3>& bounds, uint32_t begin, uint32_t end, uint32_t parent) {
+    const uint32_t nodeIndex = uint32_t(m_Nodes.size());
+    m_Nodes.emplace_back();
+    m_Nodes[nodeIndex].parent = parent;
+    m_Nodes[nodeIndex].blockBegin = begin / c_BlockSize;
+
+    if (end - begin <= c_BlockSize) {
+        const uint32_t block = begin / c_BlockSize;
+        for (uint32_t i = begin; i < end; i++) {
+            const uint32_t instance = m_BuildOrder[i];
+            m_InstanceLanes[instance] = i;
+            m_LaneInstances[i] = instance;
+            WriteLane(i, bounds[instance]);
+        }
+
+        Node& node = m_Nodes[nodeIndex];
+        node.blockEnd = block + 1;
+        node.bounds = ComputeBlockBounds(block);
+        node.skip = nodeIndex + 1;
+        m_BlockNodes[block] = nodeIndex;
+        return nodeIndex;
+    }
+
+    dm::box3 centroidBounds = dm::box3::empty();
+    for (uint32_t i = begin; i < end; i++) {
+        centroidBounds = centroidBounds | bounds[m_BuildOrder[i]].center();
+    }
+
+    const dm::float3 extent = centroidBounds.diagonal();
+    const int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    // Split at the median, rounded so that every block except the last one is full.
+    const uint32_t half = (end - begin) / 2;
+    const uint32_t mid = std::min(begin + (half + c_BlockSize - 1) / c_BlockSize * c_BlockSize, end - 1);
+    std::nth_element(m_BuildOrder.begin() + begin, m_BuildOrder.begin() + mid, m_BuildOrder.begin() + end,
+        [&bounds, axis](uint32_t a, uint32_t b) { return bounds[a].center()[axis] < bounds[b].center()[axis]; });
+
+    BuildRecursive(bounds, begin, mid, nodeIndex);
+    const uint32_t right = BuildRecursive(bounds, mid, end, nodeIndex);
+
+    Node& node = m_Nodes[nodeIndex];
+    node.right = right;
+    node.skip = uint32_t(m_Nodes.size());
+    node.blockEnd = m_Nodes[right].blockEnd;
+    node.bounds = m_Nodes[nodeIndex + 1].bounds | m_Nodes[right].bounds;
+    return nodeIndex;
+}
+
+void FrustumCuller::WriteLane(uint32_t lane, const dm::box3& bounds) {
+    m_MinX[lane] = bounds.m_mins.x;
+    m_MinY[lane] = bounds.m_mins.y;
+    m_MinZ[lane] = bounds.m_mins.z;
+    m_MaxX[lane] = bounds.m_maxs.x;
+    m_MaxY[lane] = bounds.m_maxs.y;
+    m_MaxZ[lane] = bounds.m_maxs.z;
+}
+
+dm::box3 FrustumCuller::ComputeBlockBounds(uint32_t block) const {
+    dm::box3 result = dm::box3::empty();
+    for (uint32_t lane = block * c_BlockSize; lane < (block + 1) * c_BlockSize; lane++) {
+        if (m_LaneInstances[lane] != c_InvalidInstance) {
+            result |= dm::box3(dm::float3(m_MinX[lane], m_MinY[lane], m_MinZ[lane]), dm::float3(m_MaxX[lane], m_MaxY[lane], m_MaxZ[lane]));
+        }
+    }
+    return result;
+}
+
+void FrustumCuller::UpdateBounds(uint32_t instance, const dm::box3& bounds) {
+    const uint32_t lane = m_InstanceLanes[instance];
+    WriteLane(lane, bounds);
+
+    const uint32_t nodeIndex = m_BlockNodes[lane / c_BlockSize];
+    if (!m_Nodes[nodeIndex].dirty) {
+        m_Nodes[nodeIndex].dirty = true;
+        m_DirtyNodes.push_back(nodeIndex);
+    }
+}
+
+void FrustumCuller::RefitNode(Node& node) {
+    if (node.IsLeaf()) {
+        node.bounds = ComputeBlockBounds(node.blockBegin);
+    } else {
+        const uint32_t index = uint32_t(&node - m_Nodes.data());
+        node.bounds = m_Nodes[index + 1].bounds | m_Nodes[node.right].bounds;
+    }
+    node.dirty = false;
+}
+
+void FrustumCuller::Refit() {
+    if (m_DirtyNodes.empty()) {
+        return;
+    }
+
+    // Walking up from every dirty leaf costs O(depth) each; past a point a single bottom-up sweep is cheaper.
+    // Children always come after their parent in the flattened order, so a reverse sweep sees them first.
+    if (m_DirtyNodes.size() * 8 > m_Nodes.size()) {
+        for (size_t i = m_Nodes.size(); i-- > 0;) {
+            RefitNode(m_Nodes[i]);
+        }
+        m_DirtyNodes.clear();
+        return;
+    }
+
+    for (uint32_t nodeIndex : m_DirtyNodes) {
+        RefitNode(m_Nodes[nodeIndex]);
+    }
+
+    for (uint32_t nodeIndex : m_DirtyNodes) {
+        uint32_t parent = m_Nodes[nodeIndex].parent;
+        while (parent != ~0u) {
+            Node& node = m_Nodes[parent];
+            const dm::box3 previous = node.bounds;
+            RefitNode(node);
+            if (all(previous.m_mins == node.bounds.m_mins) && all(previous.m_maxs == node.bounds.m_maxs)) {
+                break;
+            }
+            parent = node.parent;
+        }
+    }
+    m_DirtyNodes.clear();
+}
+
+uint32_t FrustumCuller::TestBlock(const dm::frustum& frustum, uint32_t block) const {
+    const size_t first = size_t(block) * c_BlockSize;
+
+    // For each plane only the box corner nearest to the inside can prove the box is outside, and which corner
+    // that is depends only on the signs of the plane normal, so each plane reads min or max arrays per axis.
+#if defined(SANBOX_CULL_AVX)
+    __m256 outside = _mm256_setzero_ps();
+    for (const dm::plane& plane : frustum.planes) {
+        const dm::float3& n = plane.normal;
+        __m256 x = _mm256_loadu_ps((n.x > 0.f ? m_MinX.data() : m_MaxX.data()) + first);
+        __m256 y = _mm256_loadu_ps((n.y > 0.f ? m_MinY.data() : m_MaxY.data()) + first);
+        __m256 z = _mm256_loadu_ps((n.z > 0.f ? m_MinZ.data() : m_MaxZ.data()) + first);
+
+        __m256 distance = _mm256_mul_ps(x, _mm256_set1_ps(n.x));
+        distance = _mm256_add_ps(distance, _mm256_mul_ps(y, _mm256_set1_ps(n.y)));
+        distance = _mm256_add_ps(distance, _mm256_mul_ps(z, _mm256_set1_ps(n.z)));
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_set1_ps(plane.distance), _CMP_GT_OQ));
+    }
+    return ~uint32_t(_mm256_movemask_ps(outside)) & 0xffu;
+#elif defined(SANBOX_CULL_SSE)
+    __m128 outsideLo = _mm_setzero_ps();
+    __m128 outsideHi = _mm_setzero_ps();
+    for (const dm::plane& plane : frustum.planes) {
+        const dm::float3& n = plane.normal;
+        const float* xs = (n.x > 0.f ? m_MinX.data() : m_MaxX.data()) + first;
+        const float* ys = (n.y > 0.f ? m_MinY.data() : m_MaxY.data()) + first;
+        const float* zs = (n.z > 0.f ? m_MinZ.data() : m_MaxZ.data()) + first;
+        const __m128 nx = _mm_set1_ps(n.x);
+        const __m128 ny = _mm_set1_ps(n.y);
+        const __m128 nz = _mm_set1_ps(n.z);
+        const __m128 d = _mm_set1_ps(plane.distance);
+
+        __m128 lo = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(xs), nx), _mm_mul_ps(_mm_loadu_ps(ys), ny)), _mm_mul_ps(_mm_loadu_ps(zs), nz));
+        __m128 hi = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(xs + 4), nx), _mm_mul_ps(_mm_loadu_ps(ys + 4), ny)), _mm_mul_ps(_mm_loadu_ps(zs + 4), nz));
+        outsideLo = _mm_or_ps(outsideLo, _mm_cmpgt_ps(lo, d));
+        outsideHi = _mm_or_ps(outsideHi, _mm_cmpgt_ps(hi, d));
+    }
+    return ~uint32_t(_mm_movemask_ps(outsideLo) | (_mm_movemask_ps(outsideHi) << 4)) & 0xffu;
+#else
+    uint32_t visible = 0;
+    for (uint32_t i = 0; i < c_BlockSize; i++) {
+        const size_t lane = first + i;
+        bool outside = false;
+        for (const dm::plane& plane : frustum.planes) {
+            const dm::float3& n = plane.normal;
+            float x = n.x > 0.f ? m_MinX[lane] : m_MaxX[lane];
+            float y = n.y > 0.f ? m_MinY[lane] : m_MaxY[lane];
+            float z = n.z > 0.f ? m_MinZ[lane] : m_MaxZ[lane];
+            outside |= x * n.x + y * n.y + z * n.z > plane.distance;
+        }
+        visible |= outside ? 0u : (1u << i);
+    }
+    return visible;
+#endif
+}
+
+void FrustumCuller::EmitBlocks(uint32_t blockBegin, uint32_t blockEnd, std::vector<uint32_t>& visibleInstances) const {
+    for (uint32_t lane = blockBegin * c_BlockSize; lane < blockEnd * c_BlockSize; lane++) {
+        if (m_LaneInstances[lane] != c_InvalidInstance) {
+            visibleInstances.push_back(m_LaneInstances[lane]);
+        }
+    }
+}
+
+void FrustumCuller::Cull(const dm::frustum& frustum, std::vector<uint32_t>& visibleInstances) {
+    const size_t visibleBefore = visibleInstances.size();
+    m_Statistics.nodesVisited = 0;
+    m_Statistics.blocksTested = 0;
+
+    uint32_t nodeIndex = 0;
+    while (nodeIndex < m_Nodes.size()) {
+        const Node& node = m_Nodes[nodeIndex];
+        m_Statistics.nodesVisited++;
+
+        Containment containment = ClassifyBox(frustum, node.bounds);
+        if (containment == Containment::Inside) {
+            EmitBlocks(node.blockBegin, node.blockEnd, visibleInstances);
+        } else if (containment == Containment::Intersecting) {
+            if (!node.IsLeaf()) {
+                nodeIndex++;
+                continue;
+            }
+
+            m_Statistics.blocksTested++;
+            const uint32_t visible = TestBlock(frustum, node.blockBegin);
+            const uint32_t first = node.blockBegin * c_BlockSize;
+            for (uint32_t i = 0; i < c_BlockSize; i++) {
+                if (visible & (1u << i)) {
+                    visibleInstances.push_back(m_LaneInstances[first + i]);
+                }
+            }
+        }
+
+        nodeIndex = node.skip;
+    }
+
+    m_Statistics.visibleInstances = uint32_t(visibleInstances.size() - visibleBefore);
+}
+
+} // namespace sanbox
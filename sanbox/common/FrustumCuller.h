@@ -0,0 +1,84 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace sanbox {
+
+struct FrustumCullStatistics {
+    uint32_t totalInstances = 0;
+    uint32_t visibleInstances = 0;
+    uint32_t nodesVisited = 0;
+    uint32_t blocksTested = 0;
+};
+
+// Frustum culling of world-space instance bounds. The boxes are stored as structure-of-arrays in blocks of
+// c_BlockSize lanes, and a flattened BVH is built over the blocks so whole subtrees can be rejected or
+// accepted with one test. Leaves are tested c_BlockSize boxes at a time with AVX or SSE when available.
+// Moving instances only refits the nodes above them; the tree is rebuilt when instances are added or removed.
+class FrustumCuller {
+public:
+    static constexpr uint32_t c_BlockSize = 8;
+    static constexpr uint32_t c_InvalidInstance = ~0u;
+
+    void Build(const std::vector<dm::box3>& bounds);
+
+    // Updates the bounds of one instance; the change becomes visible to Cull after the next Refit.
+    void UpdateBounds(uint32_t instance, const dm::box3& bounds);
+    void Refit();
+
+    // Appends the indices of the instances that intersect the frustum, in BVH order.
+    void Cull(const dm::frustum& frustum, std::vector<uint32_t>& visibleInstances);
+
+    [[nodiscard]] uint32_t GetInstanceCount() const {
+        return uint32_t(m_InstanceLanes.size());
+    }
+    [[nodiscard]] const FrustumCullStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+    // Name of the leaf kernel compiled into this build: "avx", "sse" or "scalar".
+    static const char* GetKernelName();
+
+private:
+    struct Node {
+        dm::box3 bounds;
+        uint32_t parent = ~0u;
+        // Index of the right child for inner nodes; the left child always follows its parent.
+        uint32_t right = 0;
+        // Index of the first node after this subtree, used to skip it during traversal.
+        uint32_t skip = 0;
+        uint32_t blockBegin = 0;
+        uint32_t blockEnd = 0;
+        bool dirty = false;
+
+        [[nodiscard]] bool IsLeaf() const {
+            return right == 0;
+        }
+    };
+
+    uint32_t BuildRecursive(const std::vector<dm::box3>& bounds, uint32_t begin, uint32_t end, uint32_t parent);
+    void WriteLane(uint32_t lane, const dm::box3& bounds);
+    void RefitNode(Node& node);
+    dm::box3 ComputeBlockBounds(uint32_t block) const;
+    void EmitBlocks(uint32_t blockBegin, uint32_t blockEnd, std::vector<uint32_t>& visibleInstances) const;
+    uint32_t TestBlock(const dm::frustum& frustum, uint32_t block) const;
+
+    std::vector<Node> m_Nodes;
+    std::vector<uint32_t> m_BlockNodes;
+    std::vector<uint32_t> m_DirtyNodes;
+
+    std::vector<uint32_t> m_BuildOrder;
+    std::vector<uint32_t> m_InstanceLanes;
+    std::vector<uint32_t> m_LaneInstances;
+
+    // Structure-of-arrays bounds; unused lanes hold an inverted box that fails every plane test.
+    std::vector<float> m_MinX, m_MinY, m_MinZ;
+    std::vector<float> m_MaxX, m_MaxY, m_MaxZ;
+
+    FrustumCullStatistics m_Statistics;
+};
+
+} // namespace sanbox
@@ -0,0 +1,66 @@
+#include "GBufferLayout.h"
+
+#include <donut/core/log.h>
+
+using namespace donut;
+
+namespace sanbox {
+
+namespace {
+
+uint32_t GetBytesPerPixel(nvrhi::Format format) {
+    return nvrhi::getFormatInfo(format).bytesPerBlock;
+}
+
+} // namespace
+
+uint32_t GBufferLayout::GetBytesPerPixel() const {
+    uint32_t bytes = 0;
+    for (nvrhi::Format format : channels) {
+        bytes += sanbox::GetBytesPerPixel(format);
+    }
+    return bytes;
+}
+
+GBufferLayout GBufferLayout::Create(nvrhi::IDevice* device, bool compact) {
+    GBufferLayout layout;
+    layout.compact = compact;
+    if (!compact) {
+        layout.channels = {nvrhi::Format::SRGBA8_UNORM, nvrhi::Format::SRGBA8_UNORM, nvrhi::Format::RGBA16_SNORM, nvrhi::Format::RGBA16_FLOAT};
+        return layout;
+    }
+
+    layout.channels = {nvrhi::Format::SRGBA8_UNORM, nvrhi::Format::RG16_SNORM, nvrhi::Format::RG8_UNORM, nvrhi::Format::R11G11B10_FLOAT};
+    const nvrhi::FormatSupport support = device->queryFormatSupport(nvrhi::Format::R11G11B10_FLOAT);
+    if ((support & nvrhi::FormatSupport::ShaderUavStore) == nvrhi::FormatSupport::ShaderUavStore) {
+        layout.shadedColor = nvrhi::Format::R11G11B10_FLOAT;
+    }
+    return layout;
+}
+
+GBufferTraffic EstimateGBufferTraffic(const GBufferLayout& layout, dm::uint2 size) {
+    const uint32_t gbuffer = layout.GetBytesPerPixel();
+    const uint32_t depth = GetBytesPerPixel(layout.depth);
+    const uint32_t shaded = GetBytesPerPixel(layout.shadedColor);
+
+    GBufferTraffic traffic;
+    traffic.gbufferBytesPerPixel = gbuffer;
+    // Fill, then lighting.
+    traffic.bytesWrittenPerPixel = gbuffer + depth + shaded;
+    // Fill's depth test, lighting, then the blit.
+    traffic.bytesReadPerPixel = depth + gbuffer + depth + shaded;
+
+    const uint64_t pixels = uint64_t(size.x) * size.y;
+    traffic.bytesWritten = pixels * traffic.bytesWrittenPerPixel;
+    traffic.bytesRead = pixels * traffic.bytesReadPerPixel;
+    return traffic;
+}
+
+void LogGBufferTraffic(const GBufferLayout& layout, dm::uint2 size) {
+    const GBufferTraffic traffic = EstimateGBufferTraffic(layout, size);
+    log::info("G-buffer %s at %ux%u: %u bytes per pixel, lit image %s, %.1f MB written and %.1f MB read per frame", layout.GetName(), size.x,
+        size.y, traffic.gbufferBytesPerPixel, nvrhi::getFormatInfo(layout.shadedColor).name, double(traffic.bytesWritten) / (1024.0 * 1024.0),
+        double(traffic.bytesRead) / (1024.0 * 1024.0));
+}
+
+} // namespace sanbox
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <nvrhi/nvrhi.h>
+
+#include <array>
+#include <cstdint>
+
+namespace sanbox {
+
+// Formats of the deferred sample's G-buffer channels, depth and lit image. The channels hold what
+// shaders/gbuffer_packing.hlsli encodes for the layout.
+struct GBufferLayout {
+    static constexpr uint32_t c_ChannelCount = 4;
+
+    bool compact = false;
+    std::array<nvrhi::Format, c_ChannelCount> channels = {};
+    nvrhi::Format depth = nvrhi::Format::D32;
+    nvrhi::Format shadedColor = nvrhi::Format::RGBA16_FLOAT;
+
+    [[nodiscard]] const char* GetName() const {
+        return compact ? "compact" : "standard";
+    }
+    [[nodiscard]] uint32_t GetBytesPerPixel() const;
+
+    // donut's layout, or the compact one. The compact lit image is R11G11B10_FLOAT where the device can
+    // store to it from a compute shader, RGBA16_FLOAT elsewhere.
+    static GBufferLayout Create(nvrhi::IDevice* device, bool compact);
+};
+
+// Bytes that a frame moves through the G-buffer, depth and lit image, for a layout at a size: the fill
+// writes the channels and depth and tests against depth, lighting reads both and writes the lit image, and
+// the blit reads it. Every pixel is counted once, so overdraw, clears, caches and framebuffer compression
+// are left out; it compares layouts rather than predicting what the GPU sees.
+struct GBufferTraffic {
+    uint32_t gbufferBytesPerPixel = 0;
+    uint32_t bytesWrittenPerPixel = 0;
+    uint32_t bytesReadPerPixel = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t bytesRead = 0;
+};
+
+GBufferTraffic EstimateGBufferTraffic(const GBufferLayout& layout, dm::uint2 size);
+
+// Logs the traffic of the layout at the size.
+void LogGBufferTraffic(const GBufferLayout& layout, dm::uint2 size);
+
+} // namespace sanbox
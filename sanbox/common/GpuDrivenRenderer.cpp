@@ -0,0 +1,411 @@
+#include "GpuDrivenRenderer.h"
+
+#include <donut/core/log.h>
+#include <nvrhi/utils.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+#include "FramePipeline.h"
+#include "HiZPyramid.h"
+
+using namespace donut;
+using namespace donut::math;
+
+#include "shaders/gpu_culling_cb.h"
+
+namespace sanbox {
+
+GpuDrivenRenderer::GpuDrivenRenderer(nvrhi::IDevice* device, std::shared_ptr<engine::ShaderFactory> shaderFactory)
+    : m_Device(device)
+    , m_ShaderFactory(std::move(shaderFactory)) {
+    static_assert(sizeof(Record) == sizeof(GpuCullRecord));
+    static_assert(sizeof(nvrhi::DrawIndexedIndirectArguments) == DRAW_ARGUMENTS_STRIDE);
+    static_assert(sizeof(GpuCullStatistics) == GPU_CULL_STAT_COUNT * sizeof(uint32_t));
+    static_assert(uint32_t(CullPhase::Early) == GPU_CULL_PHASE_EARLY && uint32_t(CullPhase::Late) == GPU_CULL_PHASE_LATE);
+}
+
+bool GpuDrivenRenderer::Init() {
+    m_CullingShader = m_ShaderFactory->CreateShader("sanbox/gpu_culling_cs.hlsl", "main_cs", nullptr, nvrhi::ShaderType::Compute);
+    if (!m_CullingShader) {
+        return false;
+    }
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Compute;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(1),
+        nvrhi::BindingLayoutItem::Texture_SRV(2),
+        nvrhi::BindingLayoutItem::RawBuffer_UAV(0),
+        nvrhi::BindingLayoutItem::StructuredBuffer_UAV(1),
+        nvrhi::BindingLayoutItem::StructuredBuffer_UAV(2),
+        nvrhi::BindingLayoutItem::StructuredBuffer_UAV(3),
+    };
+    m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+    auto pipelineDesc = nvrhi::ComputePipelineDesc().setComputeShader(m_CullingShader).addBindingLayout(m_BindingLayout);
+    m_CullingPipeline = m_Device->createComputePipeline(pipelineDesc);
+
+    // Occlusion culling writes the constants twice per frame.
+    m_ConstantBuffer = m_Device->createBuffer(nvrhi::utils::CreateVolatileConstantBufferDesc(
+        sizeof(GpuCullingConstants), "GpuCullingConstants", FramePipeline::c_MaxFramesInFlight * 2));
+
+    m_StatisticsBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                    .setByteSize(sizeof(GpuCullStatistics))
+                                                    .setStructStride(sizeof(uint32_t))
+                                                    .setCanHaveUAVs(true)
+                                                    .setDebugName("GpuCullStatistics")
+                                                    .setInitialState(nvrhi::ResourceStates::UnorderedAccess)
+                                                    .setKeepInitialState(true));
+
+    // The statistics are copied out every frame and mapped when their slot comes around again, by which
+    // time the frame that wrote them has retired.
+    m_StatisticsReadback.resize(FramePipeline::c_MaxFramesInFlight + 1);
+    for (nvrhi::BufferHandle& buffer : m_StatisticsReadback) {
+        buffer = m_Device->createBuffer(nvrhi::BufferDesc()
+                                            .setByteSize(sizeof(GpuCullStatistics))
+                                            .setCpuAccess(nvrhi::CpuAccessMode::Read)
+                                            .setDebugName("GpuCullStatisticsReadback")
+                                            .setInitialState(nvrhi::ResourceStates::CopyDest)
+                                            .setKeepInitialState(true));
+    }
+
+    // Bound when culling without a pyramid, which the shader then ignores.
+    m_PlaceholderHiZ = m_Device->createTexture(nvrhi::TextureDesc()
+                                                   .setWidth(1)
+                                                   .setHeight(1)
+                                                   .setFormat(nvrhi::Format::R32_FLOAT)
+                                                   .setDebugName("HiZPlaceholder")
+                                                   .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                                   .setKeepInitialState(true));
+
+    return m_CullingPipeline != nullptr;
+}
+
+void GpuDrivenRenderer::Rebuild(nvrhi::ICommandList* commandList, const engine::SceneGraph& sceneGraph, nvrhi::IBuffer* instanceBuffer) {
+    const auto& meshInstances = sceneGraph.GetMeshInstances();
+
+    m_SceneGraph = &sceneGraph;
+    m_SceneInstanceBuffer = instanceBuffer;
+    m_Instances.clear();
+    m_Transforms.clear();
+    m_Records.clear();
+    m_RecordGeometries.clear();
+    m_InstanceFirstRecord.clear();
+    m_Batches.clear();
+
+    // One indirect draw per opaque geometry, shared by every instance of its mesh. Draws are ordered by
+    // buffers, material and cull mode so that each state change starts a new multi-draw batch.
+    using DrawKey = std::tuple<const engine::BufferGroup*, const engine::Material*, nvrhi::RasterCullMode, const engine::MeshGeometry*>;
+    std::map<DrawKey, uint32_t> drawInstanceCounts;
+    std::map<const engine::MeshGeometry*, const engine::MeshInfo*> geometryMeshes;
+
+    auto isDrawn = [](const engine::MeshGeometry& geometry) {
+        const engine::Material* material = geometry.material.get();
+        return material && (material->domain == engine::MaterialDomain::Opaque || material->domain == engine::MaterialDomain::AlphaTested);
+    };
+    auto makeKey = [](const engine::MeshInfo& mesh, const engine::MeshGeometry& geometry) {
+        const engine::Material* material = geometry.material.get();
+        return DrawKey(mesh.buffers.get(), material, material->doubleSided ? nvrhi::RasterCullMode::None : nvrhi::RasterCullMode::Back, &geometry);
+    };
+
+    for (const auto& instance : meshInstances) {
+        const engine::MeshInfo& mesh = *instance->GetMesh();
+        for (const auto& geometry : mesh.geometries) {
+            if (isDrawn(*geometry)) {
+                drawInstanceCounts[makeKey(mesh, *geometry)]++;
+                geometryMeshes[geometry.get()] = &mesh;
+            }
+        }
+    }
+
+    std::vector<nvrhi::DrawIndexedIndirectArguments> drawArguments;
+    drawArguments.reserve(drawInstanceCounts.size());
+    std::map<const engine::MeshGeometry*, uint32_t> geometryDraws;
+
+    uint32_t instanceSlots = 0;
+    for (const auto& [key, instanceCount] : drawInstanceCounts) {
+        const auto& [buffers, material, cullMode, geometry] = key;
+        const engine::MeshInfo& mesh = *geometryMeshes[geometry];
+
+        if (m_Batches.empty() || m_Batches.back().buffers != buffers || m_Batches.back().material != material || m_Batches.back().cullMode != cullMode) {
+            m_Batches.push_back({material, buffers, cullMode, uint32_t(drawArguments.size()), 0});
+        }
+        m_Batches.back().drawCount++;
+
+        geometryDraws[geometry] = uint32_t(drawArguments.size());
+
+        nvrhi::DrawIndexedIndirectArguments& arguments = drawArguments.emplace_back();
+        arguments.indexCount = geometry->numIndices;
+        arguments.instanceCount = 0;
+        arguments.startIndexLocation = mesh.indexOffset + geometry->indexOffsetInMesh;
+        arguments.baseVertexLocation = int32_t(mesh.vertexOffset + geometry->vertexOffsetInMesh);
+        arguments.startInstanceLocation = instanceSlots;
+        instanceSlots += instanceCount;
+    }
+    m_DrawCount = uint32_t(drawArguments.size());
+
+    for (const auto& instance : meshInstances) {
+        m_InstanceFirstRecord.push_back(uint32_t(m_Records.size()));
+        m_Instances.push_back(instance.get());
+        m_Transforms.push_back(instance->GetNode()->GetLocalToWorldTransformFloat());
+
+        for (const auto& geometry : instance->GetMesh()->geometries) {
+            if (isDrawn(*geometry)) {
+                Record& record = m_Records.emplace_back();
+                record.instanceIndex = uint32_t(instance->GetInstanceIndex());
+                record.drawIndex = geometryDraws[geometry.get()];
+                m_RecordGeometries.push_back(geometry.get());
+            }
+        }
+        UpdateInstanceBounds(m_Instances.size() - 1);
+    }
+    m_InstanceFirstRecord.push_back(uint32_t(m_Records.size()));
+
+    m_BindingSet = nullptr;
+    if (m_Records.empty()) {
+        return;
+    }
+
+    m_RecordBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                .setByteSize(m_Records.size() * sizeof(Record))
+                                                .setStructStride(sizeof(Record))
+                                                .setDebugName("GpuCullRecords")
+                                                .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                                .setKeepInitialState(true));
+
+    const size_t argumentsSize = drawArguments.size() * sizeof(nvrhi::DrawIndexedIndirectArguments);
+    m_DrawArgumentsTemplate = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                         .setByteSize(argumentsSize)
+                                                         .setDebugName("GpuDrawArgumentsTemplate")
+                                                         .setInitialState(nvrhi::ResourceStates::CopySource)
+                                                         .setKeepInitialState(true));
+    m_DrawArguments = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                 .setByteSize(argumentsSize)
+                                                 .setCanHaveUAVs(true)
+                                                 .setCanHaveRawViews(true)
+                                                 .setIsDrawIndirectArgs(true)
+                                                 .setDebugName("GpuDrawArguments")
+                                                 .setInitialState(nvrhi::ResourceStates::IndirectArgument)
+                                                 .setKeepInitialState(true));
+
+    const uint32_t instanceStride = instanceBuffer->getDesc().structStride;
+    m_VisibleInstances = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                    .setByteSize(size_t(std::max(instanceSlots, 1u)) * instanceStride)
+                                                    .setStructStride(instanceStride)
+                                                    .setCanHaveUAVs(true)
+                                                    .setIsVertexBuffer(true)
+                                                    .setDebugName("GpuVisibleInstances")
+                                                    .setInitialState(nvrhi::ResourceStates::VertexBuffer)
+                                                    .setKeepInitialState(true));
+    m_Visibility = m_Device->createBuffer(nvrhi::BufferDesc()
+                                              .setByteSize(m_Records.size() * sizeof(uint32_t))
+                                              .setStructStride(sizeof(uint32_t))
+                                              .setCanHaveUAVs(true)
+                                              .setDebugName("GpuCullVisibility")
+                                              .setInitialState(nvrhi::ResourceStates::UnorderedAccess)
+                                              .setKeepInitialState(true));
+
+    commandList->writeBuffer(m_RecordBuffer, m_Records.data(), m_Records.size() * sizeof(Record));
+    commandList->writeBuffer(m_DrawArgumentsTemplate, drawArguments.data(), argumentsSize);
+    // Nothing counts as visible last frame, so the first occlusion-culled frame draws everything late.
+    commandList->clearBufferUInt(m_Visibility, 0);
+
+    CreateBindingSet(m_PlaceholderHiZ);
+
+    log::info("GPU-driven rendering: %u cull records, %u indirect draws in %u batches", uint32_t(m_Records.size()), m_DrawCount,
+        uint32_t(m_Batches.size()));
+}
+
+void GpuDrivenRenderer::CreateBindingSet(nvrhi::ITexture* hiz) {
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(0, m_RecordBuffer),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(1, m_SceneInstanceBuffer),
+        nvrhi::BindingSetItem::Texture_SRV(2, hiz),
+        nvrhi::BindingSetItem::RawBuffer_UAV(0, m_DrawArguments),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(1, m_VisibleInstances),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(2, m_Visibility),
+        nvrhi::BindingSetItem::StructuredBuffer_UAV(3, m_StatisticsBuffer),
+    };
+    m_BindingSet = m_Device->createBindingSet(bindingSetDesc, m_BindingLayout);
+    m_BoundHiZ = hiz;
+}
+
+void GpuDrivenRenderer::UpdateInstanceBounds(size_t instance) {
+    const dm::affine3& transform = m_Transforms[instance];
+    const uint32_t end = instance + 1 < m_InstanceFirstRecord.size() ? m_InstanceFirstRecord[instance + 1] : uint32_t(m_Records.size());
+    for (uint32_t i = m_InstanceFirstRecord[instance]; i < end; i++) {
+        const dm::box3 bounds = m_RecordGeometries[i]->objectSpaceBounds * transform;
+        m_Records[i].boundsMin = bounds.m_mins;
+        m_Records[i].boundsMax = bounds.m_maxs;
+    }
+}
+
+void GpuDrivenRenderer::Update(nvrhi::ICommandList* commandList, const engine::SceneGraph& sceneGraph, nvrhi::IBuffer* instanceBuffer) {
+    const auto& meshInstances = sceneGraph.GetMeshInstances();
+
+    bool rebuild = m_SceneGraph != &sceneGraph || m_SceneInstanceBuffer != instanceBuffer || m_Instances.size() != meshInstances.size();
+    for (size_t i = 0; i < meshInstances.size() && !rebuild; i++) {
+        rebuild = m_Instances[i] != meshInstances[i].get();
+    }
+
+    if (rebuild) {
+        Rebuild(commandList, sceneGraph, instanceBuffer);
+        return;
+    }
+
+    // Transforms themselves reach the GPU through the scene's instance buffer; only the bounds are ours.
+    // The records of an instance are contiguous and follow those of the instance before, so the records of
+    // moved instances collect into ranges in order.
+    m_MovedRanges.clear();
+    uint32_t movedRecords = 0;
+    for (size_t i = 0; i < m_Instances.size(); i++) {
+        const dm::affine3 transform = m_Instances[i]->GetNode()->GetLocalToWorldTransformFloat();
+        if (memcmp(&transform, &m_Transforms[i], sizeof(transform)) != 0) {
+            m_Transforms[i] = transform;
+            UpdateInstanceBounds(i);
+
+            const uint32_t first = m_InstanceFirstRecord[i];
+            const uint32_t end = m_InstanceFirstRecord[i + 1];
+            if (!m_MovedRanges.empty() && m_MovedRanges.back().second == first) {
+                m_MovedRanges.back().second = end;
+            } else if (first != end) {
+                m_MovedRanges.emplace_back(first, end);
+            }
+            movedRecords += end - first;
+        }
+    }
+
+    if (m_MovedRanges.empty()) {
+        return;
+    }
+    // Many small writes cost more than one large one, so a busy frame rewrites the whole buffer.
+    if (movedRecords * 4 > m_Records.size()) {
+        commandList->writeBuffer(m_RecordBuffer, m_Records.data(), m_Records.size() * sizeof(Record));
+        return;
+    }
+    for (const auto& [first, end] : m_MovedRanges) {
+        commandList->writeBuffer(m_RecordBuffer, &m_Records[first], (end - first) * sizeof(Record), first * sizeof(Record));
+    }
+}
+
+void GpuDrivenRenderer::Cull(nvrhi::ICommandList* commandList, const engine::IView& view, CullPhase phase, const HiZPyramid* hiz) {
+    if (!m_BindingSet) {
+        return;
+    }
+
+    nvrhi::ITexture* hizTexture = hiz ? hiz->GetTexture() : m_PlaceholderHiZ.Get();
+    if (hizTexture != m_BoundHiZ) {
+        CreateBindingSet(hizTexture);
+    }
+
+    GpuCullingConstants constants = {};
+    constants.worldToClip = view.GetViewProjectionMatrix(false);
+    const dm::frustum& frustum = view.GetViewFrustum();
+    for (int i = 0; i < dm::frustum::PLANES_COUNT; i++) {
+        constants.frustumPlanes[i] = float4(frustum.planes[i].normal, frustum.planes[i].distance);
+    }
+    if (hiz) {
+        constants.hizSize = hiz->GetSize();
+        constants.hizMipCount = hiz->GetMipCount();
+        const nvrhi::Rect extent = view.GetViewExtent();
+        constants.viewportSize = uint2(uint(std::max(extent.width(), 1)), uint(std::max(extent.height(), 1)));
+    }
+    constants.reverseDepth = view.IsReverseDepth() ? 1 : 0;
+    constants.recordCount = uint32_t(m_Records.size());
+    constants.cullPhase = uint32_t(phase);
+    commandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
+
+    if (phase != CullPhase::Late) {
+        commandList->clearBufferUInt(m_StatisticsBuffer, 0);
+    }
+
+    // Resetting the instance counts is a copy from arguments that were written once at build time.
+    commandList->copyBuffer(m_DrawArguments, 0, m_DrawArgumentsTemplate, 0, m_DrawArguments->getDesc().byteSize);
+
+    nvrhi::ComputeState state;
+    state.pipeline = m_CullingPipeline;
+    state.bindings = {m_BindingSet};
+    commandList->setComputeState(state);
+    commandList->dispatch((constants.recordCount + GPU_CULLING_GROUP_SIZE - 1) / GPU_CULLING_GROUP_SIZE);
+
+    if (phase != CullPhase::Early) {
+        ReadBackStatistics(commandList);
+    }
+
+    // The geometry passes may run with automatic barriers disabled, so leave the outputs in their consuming states.
+    commandList->setBufferState(m_DrawArguments, nvrhi::ResourceStates::IndirectArgument);
+    commandList->setBufferState(m_VisibleInstances, nvrhi::ResourceStates::VertexBuffer);
+    commandList->commitBarriers();
+}
+
+void GpuDrivenRenderer::ReadBackStatistics(nvrhi::ICommandList* commandList) {
+    nvrhi::IBuffer* readback = m_StatisticsReadback[m_StatisticsFrame % m_StatisticsReadback.size()];
+    if (m_StatisticsFrame >= m_StatisticsReadback.size()) {
+        if (const void* data = m_Device->mapBuffer(readback, nvrhi::CpuAccessMode::Read)) {
+            memcpy(&m_Statistics, data, sizeof(m_Statistics));
+            m_Device->unmapBuffer(readback);
+        }
+    }
+
+    commandList->copyBuffer(readback, 0, m_StatisticsBuffer, 0, sizeof(GpuCullStatistics));
+    m_StatisticsFrame++;
+}
+
+void GpuDrivenRenderer::Render(nvrhi::ICommandList* commandList, const engine::IView* view, const engine::IView* viewPrev,
+    nvrhi::IFramebuffer* framebuffer, render::IGeometryPass& pass, render::GeometryPassContext& passContext) {
+    if (!m_BindingSet) {
+        return;
+    }
+
+    pass.SetupView(passContext, commandList, view, viewPrev);
+
+    nvrhi::GraphicsState state;
+    state.framebuffer = framebuffer;
+    state.viewport = view->GetViewportState();
+    state.indirectParams = m_DrawArguments;
+
+    const engine::BufferGroup* lastBuffers = nullptr;
+    const engine::Material* lastMaterial = nullptr;
+    nvrhi::RasterCullMode lastCullMode = nvrhi::RasterCullMode::Back;
+    bool drawMaterial = true;
+
+    for (const Batch& batch : m_Batches) {
+        if (batch.buffers != lastBuffers) {
+            pass.SetupInputBuffers(passContext, batch.buffers, state);
+            for (nvrhi::VertexBufferBinding& binding : state.vertexBuffers) {
+                if (binding.buffer == m_SceneInstanceBuffer) {
+                    binding.buffer = m_VisibleInstances;
+                }
+            }
+            lastBuffers = batch.buffers;
+        }
+
+        if (batch.material != lastMaterial || batch.cullMode != lastCullMode) {
+            drawMaterial = pass.SetupMaterial(passContext, batch.material, batch.cullMode, state);
+            lastMaterial = batch.material;
+            lastCullMode = batch.cullMode;
+        }
+
+        if (!drawMaterial) {
+            continue;
+        }
+
+        commandList->setGraphicsState(state);
+
+        // The input assembler shaders take the instance from the vertex stream; the arguments only
+        // let the pass fill in its push constants as it would for a direct draw.
+        nvrhi::DrawArguments arguments;
+        pass.SetPushConstants(passContext, commandList, state, arguments);
+
+        commandList->drawIndexedIndirect(batch.firstDraw * DRAW_ARGUMENTS_STRIDE, batch.drawCount);
+    }
+}
+
+} // namespace sanbox
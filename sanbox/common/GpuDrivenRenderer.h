@@ -0,0 +1,129 @@
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/View.h>
+#include <donut/render/GeometryPasses.h>
+#include <nvrhi/nvrhi.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace sanbox {
+
+class HiZPyramid;
+
+// Read back from the culling pass a few frames after it ran.
+struct GpuCullStatistics {
+    uint32_t frustumCulled = 0;
+    uint32_t occluded = 0;
+    uint32_t visible = 0;
+    uint32_t drawnEarly = 0;
+    uint32_t drawnLate = 0;
+};
+
+// GPU-driven opaque rendering. Every (instance, geometry) pair of the scene is a cull record in a
+// persistent structured buffer. A compute pass tests the records against the view frustum, copies the
+// instance data of the visible ones into a compacted buffer and counts them into one indexed indirect
+// draw per geometry. The geometry pass then issues one drawIndexedIndirect per material batch, so the
+// CPU cost does not depend on the number of instances.
+// The pass must be created with useInputAssembler: the compacted instance buffer replaces the scene's
+// instance buffer as the per-instance vertex stream, which is what honours startInstanceLocation.
+// With occlusion culling, a frame culls twice: the Early phase draws what was visible last frame, a
+// Hi-Z pyramid is built from that depth, and the Late phase draws what the pyramid does not occlude.
+class GpuDrivenRenderer {
+public:
+    enum class CullPhase : uint32_t {
+        Frustum = 0,
+        Early = 1,
+        Late = 2,
+    };
+
+    GpuDrivenRenderer(nvrhi::IDevice* device, std::shared_ptr<donut::engine::ShaderFactory> shaderFactory);
+
+    bool Init();
+
+    // Rebuilds the persistent buffers when the set of mesh instances changes and re-uploads the bounds
+    // of instances that moved. instanceBuffer is the scene's InstanceData buffer.
+    void Update(nvrhi::ICommandList* commandList, const donut::engine::SceneGraph& sceneGraph, nvrhi::IBuffer* instanceBuffer);
+
+    // Culls for the view and leaves the indirect arguments and visible instances ready for Render.
+    // The Late phase needs the pyramid built after rendering the Early phase.
+    void Cull(nvrhi::ICommandList* commandList, const donut::engine::IView& view, CullPhase phase = CullPhase::Frustum,
+        const HiZPyramid* hiz = nullptr);
+
+    void Render(nvrhi::ICommandList* commandList, const donut::engine::IView* view, const donut::engine::IView* viewPrev,
+        nvrhi::IFramebuffer* framebuffer, donut::render::IGeometryPass& pass, donut::render::GeometryPassContext& passContext);
+
+    [[nodiscard]] uint32_t GetRecordCount() const {
+        return uint32_t(m_Records.size());
+    }
+    [[nodiscard]] uint32_t GetDrawCount() const {
+        return m_DrawCount;
+    }
+    [[nodiscard]] uint32_t GetBatchCount() const {
+        return uint32_t(m_Batches.size());
+    }
+    [[nodiscard]] const GpuCullStatistics& GetCullStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    // Mirrors GpuCullRecord in shaders/gpu_culling_cb.h.
+    struct Record {
+        dm::float3 boundsMin;
+        uint32_t instanceIndex = 0;
+        dm::float3 boundsMax;
+        uint32_t drawIndex = 0;
+    };
+
+    struct Batch {
+        const donut::engine::Material* material = nullptr;
+        const donut::engine::BufferGroup* buffers = nullptr;
+        nvrhi::RasterCullMode cullMode = nvrhi::RasterCullMode::Back;
+        uint32_t firstDraw = 0;
+        uint32_t drawCount = 0;
+    };
+
+    void Rebuild(nvrhi::ICommandList* commandList, const donut::engine::SceneGraph& sceneGraph, nvrhi::IBuffer* instanceBuffer);
+    void UpdateInstanceBounds(size_t instance);
+    void CreateBindingSet(nvrhi::ITexture* hiz);
+    void ReadBackStatistics(nvrhi::ICommandList* commandList);
+
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::ShaderFactory> m_ShaderFactory;
+
+    nvrhi::ShaderHandle m_CullingShader;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::ComputePipelineHandle m_CullingPipeline;
+    nvrhi::BindingSetHandle m_BindingSet;
+
+    nvrhi::BufferHandle m_ConstantBuffer;
+    nvrhi::BufferHandle m_RecordBuffer;
+    nvrhi::BufferHandle m_DrawArgumentsTemplate;
+    nvrhi::BufferHandle m_DrawArguments;
+    nvrhi::BufferHandle m_VisibleInstances;
+    nvrhi::BufferHandle m_SceneInstanceBuffer;
+    nvrhi::BufferHandle m_Visibility;
+    nvrhi::BufferHandle m_StatisticsBuffer;
+    std::vector<nvrhi::BufferHandle> m_StatisticsReadback;
+    uint64_t m_StatisticsFrame = 0;
+    GpuCullStatistics m_Statistics;
+    nvrhi::TextureHandle m_PlaceholderHiZ;
+    nvrhi::TextureHandle m_BoundHiZ;
+
+    const donut::engine::SceneGraph* m_SceneGraph = nullptr;
+    std::vector<const donut::engine::MeshInstance*> m_Instances;
+    std::vector<dm::affine3> m_Transforms;
+    std::vector<Record> m_Records;
+    std::vector<const donut::engine::MeshGeometry*> m_RecordGeometries;
+    std::vector<uint32_t> m_InstanceFirstRecord;
+    // Record ranges [first, end) rewritten by the last Update.
+    std::vector<std::pair<uint32_t, uint32_t>> m_MovedRanges;
+    std::vector<Batch> m_Batches;
+    uint32_t m_DrawCount = 0;
+};
+
+} // namespace sanbox
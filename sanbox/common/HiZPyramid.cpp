@@ -0,0 +1,108 @@
+#include "HiZPyramid.h"
+
+#include <algorithm>
+
+using namespace donut;
+using namespace donut::math;
+
+#include "shaders/hiz_cb.h"
+
+namespace sanbox {
+
+HiZPyramid::HiZPyramid(nvrhi::IDevice* device, std::shared_ptr<engine::ShaderFactory> shaderFactory)
+    : m_Device(device)
+    , m_ShaderFactory(std::move(shaderFactory)) {
+}
+
+bool HiZPyramid::Init() {
+    m_Shader = m_ShaderFactory->CreateShader("sanbox/hiz_build_cs.hlsl", "main_cs", nullptr, nvrhi::ShaderType::Compute);
+    if (!m_Shader) {
+        return false;
+    }
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Compute;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::PushConstants(0, sizeof(HiZConstants)),
+        nvrhi::BindingLayoutItem::Texture_SRV(0),
+        nvrhi::BindingLayoutItem::Texture_UAV(0),
+    };
+    m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+    m_Pipeline = m_Device->createComputePipeline(nvrhi::ComputePipelineDesc().setComputeShader(m_Shader).addBindingLayout(m_BindingLayout));
+    return m_Pipeline != nullptr;
+}
+
+nvrhi::TextureDesc HiZPyramid::GetTextureDesc(uint2 depthSize) {
+    uint32_t mipCount = 1;
+    while ((std::max(depthSize.x, depthSize.y) >> mipCount) > 0) {
+        mipCount++;
+    }
+
+    return nvrhi::TextureDesc()
+        .setDimension(nvrhi::TextureDimension::Texture2D)
+        .setWidth(depthSize.x)
+        .setHeight(depthSize.y)
+        .setMipLevels(mipCount)
+        .setFormat(nvrhi::Format::R32_FLOAT)
+        .setIsUAV(true)
+        .setInitialState(nvrhi::ResourceStates::ShaderResource)
+        .setKeepInitialState(true)
+        .setDebugName("HiZPyramid");
+}
+
+void HiZPyramid::CreateBindingSets(nvrhi::ITexture* depthBuffer, nvrhi::ITexture* pyramid) {
+    m_Texture = pyramid;
+    m_SourceDepth = depthBuffer;
+    m_Size = uint2(pyramid->getDesc().width, pyramid->getDesc().height);
+    m_MipCount = pyramid->getDesc().mipLevels;
+
+    m_LevelBindingSets.resize(m_MipCount);
+    for (uint32_t level = 0; level < m_MipCount; level++) {
+        nvrhi::BindingSetDesc setDesc;
+        setDesc.bindings = {
+            nvrhi::BindingSetItem::PushConstants(0, sizeof(HiZConstants)),
+            level == 0 ? nvrhi::BindingSetItem::Texture_SRV(0, depthBuffer)
+                       : nvrhi::BindingSetItem::Texture_SRV(0, m_Texture, nvrhi::Format::UNKNOWN, nvrhi::TextureSubresourceSet(level - 1, 1, 0, 1)),
+            nvrhi::BindingSetItem::Texture_UAV(0, m_Texture, nvrhi::Format::UNKNOWN, nvrhi::TextureSubresourceSet(level, 1, 0, 1)),
+        };
+        m_LevelBindingSets[level] = m_Device->createBindingSet(setDesc, m_BindingLayout);
+    }
+}
+
+void HiZPyramid::Build(nvrhi::ICommandList* commandList, nvrhi::ITexture* depthBuffer, bool reverseDepth, nvrhi::ITexture* pyramid) {
+    const nvrhi::TextureDesc& depthDesc = depthBuffer->getDesc();
+    if (pyramid) {
+        if (m_Texture != pyramid || m_SourceDepth != depthBuffer) {
+            CreateBindingSets(depthBuffer, pyramid);
+        }
+    } else if (!m_Texture || m_SourceDepth != depthBuffer || m_Size.x != depthDesc.width || m_Size.y != depthDesc.height) {
+        CreateBindingSets(depthBuffer, m_Device->createTexture(GetTextureDesc(uint2(depthDesc.width, depthDesc.height))));
+    }
+
+    commandList->beginMarker("HiZPyramid");
+
+    uint2 sourceSize = m_Size;
+    for (uint32_t level = 0; level < m_MipCount; level++) {
+        const uint2 destinationSize = uint2(std::max(m_Size.x >> level, 1u), std::max(m_Size.y >> level, 1u));
+
+        nvrhi::ComputeState state;
+        state.pipeline = m_Pipeline;
+        state.bindings = {m_LevelBindingSets[level]};
+        commandList->setComputeState(state);
+
+        HiZConstants constants = {};
+        constants.sourceSize = sourceSize;
+        constants.destinationSize = destinationSize;
+        constants.reverseDepth = reverseDepth ? 1 : 0;
+        constants.copyLevel = level == 0 ? 1 : 0;
+        commandList->setPushConstants(&constants, sizeof(constants));
+
+        commandList->dispatch((destinationSize.x + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (destinationSize.y + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE);
+        sourceSize = destinationSize;
+    }
+
+    commandList->endMarker();
+}
+
+} // namespace sanbox
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/engine/ShaderFactory.h>
+#include <nvrhi/nvrhi.h>
+
+#include <memory>
+#include <vector>
+
+namespace sanbox {
+
+// Depth pyramid where every texel holds the farthest depth of the pixels it covers. Level 0 is a copy of
+// the depth buffer; the pyramid is recreated when the depth buffer changes size.
+class HiZPyramid {
+public:
+    HiZPyramid(nvrhi::IDevice* device, std::shared_ptr<donut::engine::ShaderFactory> shaderFactory);
+
+    bool Init();
+
+    // Full mip chain of a depth buffer of the given size.
+    static nvrhi::TextureDesc GetTextureDesc(dm::uint2 depthSize);
+
+    // Builds into the given texture, made from GetTextureDesc, or into one of its own without one.
+    void Build(nvrhi::ICommandList* commandList, nvrhi::ITexture* depthBuffer, bool reverseDepth, nvrhi::ITexture* pyramid = nullptr);
+
+    [[nodiscard]] nvrhi::ITexture* GetTexture() const {
+        return m_Texture;
+    }
+    [[nodiscard]] dm::uint2 GetSize() const {
+        return m_Size;
+    }
+    [[nodiscard]] uint32_t GetMipCount() const {
+        return m_MipCount;
+    }
+
+private:
+    void CreateBindingSets(nvrhi::ITexture* depthBuffer, nvrhi::ITexture* pyramid);
+
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::ShaderFactory> m_ShaderFactory;
+
+    nvrhi::ShaderHandle m_Shader;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::ComputePipelineHandle m_Pipeline;
+
+    nvrhi::TextureHandle m_Texture;
+    nvrhi::TextureHandle m_SourceDepth;
+    std::vector<nvrhi::BindingSetHandle> m_LevelBindingSets;
+    dm::uint2 m_Size = 0u;
+    uint32_t m_MipCount = 0;
+};
+
+} // namespace sanbox
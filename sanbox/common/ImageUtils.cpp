@@ -0,0 +1,283 @@
+#include "ImageUtils.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+using namespace donut;
+
+namespace sanbox {
+
+namespace {
+
+void AppendBigEndian32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(uint8_t(value >> shift));
+    }
+}
+
+void AppendLittleEndian(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        out.push_back(uint8_t(value >> (8 * i)));
+    }
+}
+
+uint32_t UpdateCrc32(uint32_t crc, const uint8_t* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries;
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            entries[n] = c;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void AppendPngChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    AppendBigEndian32(out, uint32_t(data.size()));
+    const size_t typeOffset = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    AppendBigEndian32(out, UpdateCrc32(0, out.data() + typeOffset, out.size() - typeOffset));
+}
+
+bool WriteFile(const std::filesystem::path& fileName, const std::vector<uint8_t>& data) {
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open()) {
+        log::error("Cannot write image '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+    return bool(file);
+}
+
+} // namespace
+
+bool ReadbackTexture(nvrhi::IDevice* device, nvrhi::ITexture* texture, nvrhi::ResourceStates textureState, ImageRgba8& image) {
+    const nvrhi::TextureDesc& desc = texture->getDesc();
+    if (desc.format != nvrhi::Format::RGBA8_UNORM && desc.format != nvrhi::Format::SRGBA8_UNORM) {
+        log::error("Readback of '%s' is only supported for RGBA8 textures", desc.debugName.c_str());
+        return false;
+    }
+
+    auto stagingDesc = nvrhi::TextureDesc()
+                           .setDimension(nvrhi::TextureDimension::Texture2D)
+                           .setWidth(desc.width)
+                           .setHeight(desc.height)
+                           .setFormat(desc.format)
+                           .setInitialState(nvrhi::ResourceStates::CopyDest)
+                           .setKeepInitialState(true)
+                           .setDebugName("ReadbackStaging");
+    nvrhi::StagingTextureHandle staging = device->createStagingTexture(stagingDesc, nvrhi::CpuAccessMode::Read);
+
+    nvrhi::CommandListHandle commandList = device->createCommandList();
+    commandList->open();
+    commandList->setTextureState(texture, nvrhi::AllSubresources, textureState);
+    commandList->copyTexture(staging, nvrhi::TextureSlice(), texture, nvrhi::TextureSlice());
+    commandList->close();
+    device->executeCommandList(commandList);
+    device->waitForIdle();
+
+    size_t rowPitch = 0;
+    const auto* data = static_cast<const uint8_t*>(device->mapStagingTexture(staging, nvrhi::TextureSlice(), nvrhi::CpuAccessMode::Read, &rowPitch));
+    if (!data) {
+        return false;
+    }
+
+    image.width = desc.width;
+    image.height = desc.height;
+    image.pixels.resize(size_t(desc.width) * desc.height * 4);
+    for (uint32_t y = 0; y < desc.height; y++) {
+        memcpy(image.pixels.data() + size_t(y) * desc.width * 4, data + y * rowPitch, size_t(desc.width) * 4);
+    }
+
+    device->unmapStagingTexture(staging);
+    return true;
+}
+
+bool WriteImagePpm(const std::filesystem::path& fileName, const ImageRgba8& image) {
+    std::ofstream file(fileName, std::ios::binary);
+    if (!file.is_open()) {
+        log::error("Cannot write image '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    file << "P6\n" << image.width << " " << image.height << "\n255\n";
+    std::vector<uint8_t> row(size_t(image.width) * 3);
+    for (uint32_t y = 0; y < image.height; y++) {
+        const uint8_t* src = image.pixels.data() + size_t(y) * image.width * 4;
+        for (uint32_t x = 0; x < image.width; x++) {
+            memcpy(&row[x * 3], &src[x * 4], 3);
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), std::streamsize(row.size()));
+    }
+    return true;
+}
+
+bool ReadImagePpm(const std::filesystem::path& fileName, ImageRgba8& image) {
+    std::ifstream file(fileName, std::ios::binary);
+    std::string magic;
+    uint32_t maxValue = 0;
+    if (!(file >> magic >> image.width >> image.height >> maxValue) || magic != "P6" || maxValue != 255) {
+        log::error("'%s' is not a binary 8-bit PPM image", fileName.generic_string().c_str());
+        return false;
+    }
+    file.get();
+
+    std::vector<uint8_t> rgb(size_t(image.width) * image.height * 3);
+    if (!file.read(reinterpret_cast<char*>(rgb.data()), std::streamsize(rgb.size()))) {
+        log::error("'%s' is truncated", fileName.generic_string().c_str());
+        return false;
+    }
+
+    image.pixels.resize(size_t(image.width) * image.height * 4);
+    for (size_t i = 0; i < size_t(image.width) * image.height; i++) {
+        memcpy(&image.pixels[i * 4], &rgb[i * 3], 3);
+        image.pixels[i * 4 + 3] = 255;
+    }
+    return true;
+}
+
+bool WriteImagePng(const std::filesystem::path& fileName, const ImageRgba8& image) {
+    // Scanlines of filter type 0 and RGB, in a zlib stream of stored deflate blocks.
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve(size_t(image.width * 3 + 1) * image.height);
+    for (uint32_t y = 0; y < image.height; y++) {
+        scanlines.push_back(0);
+        const uint8_t* src = image.pixels.data() + size_t(y) * image.width * 4;
+        for (uint32_t x = 0; x < image.width; x++) {
+            scanlines.insert(scanlines.end(), src + x * 4, src + x * 4 + 3);
+        }
+    }
+
+    constexpr size_t c_MaxStoredBlock = 65535;
+    std::vector<uint8_t> zlib = {0x78, 0x01};
+    zlib.reserve(scanlines.size() + scanlines.size() / c_MaxStoredBlock * 5 + 16);
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; offset < scanlines.size() || offset == 0; offset += c_MaxStoredBlock) {
+        const size_t blockSize = std::min(c_MaxStoredBlock, scanlines.size() - offset);
+        zlib.push_back(offset + blockSize == scanlines.size() ? 1 : 0);
+        AppendLittleEndian(zlib, blockSize, 2);
+        AppendLittleEndian(zlib, ~blockSize & 0xffff, 2);
+        zlib.insert(zlib.end(), scanlines.begin() + ptrdiff_t(offset), scanlines.begin() + ptrdiff_t(offset + blockSize));
+        for (size_t i = offset; i < offset + blockSize; i++) {
+            adlerA = (adlerA + scanlines[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+    }
+    AppendBigEndian32(zlib, (adlerB << 16) | adlerA);
+
+    std::vector<uint8_t> header;
+    AppendBigEndian32(header, image.width);
+    AppendBigEndian32(header, image.height);
+    // 8 bits per channel, RGB, deflate, adaptive filtering, no interlacing.
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    AppendPngChunk(png, "IHDR", header);
+    AppendPngChunk(png, "IDAT", zlib);
+    AppendPngChunk(png, "IEND", {});
+    return WriteFile(fileName, png);
+}
+
+bool WriteImageExr(const std::filesystem::path& fileName, const ImageRgba16F& image) {
+    std::vector<uint8_t> exr;
+    AppendLittleEndian(exr, 20000630, 4);
+    AppendLittleEndian(exr, 2, 4);
+
+    const auto appendAttribute = [&](const char* name, const char* type, const std::vector<uint8_t>& value) {
+        exr.insert(exr.end(), name, name + strlen(name) + 1);
+        exr.insert(exr.end(), type, type + strlen(type) + 1);
+        AppendLittleEndian(exr, value.size(), 4);
+        exr.insert(exr.end(), value.begin(), value.end());
+    };
+    const auto appendInts = [](std::vector<uint8_t>& out, std::initializer_list<uint32_t> values) {
+        for (uint32_t value : values) {
+            AppendLittleEndian(out, value, 4);
+        }
+    };
+
+    // Channels are listed, and stored in each scanline, in alphabetical order.
+    static const char c_ChannelNames[] = {'B', 'G', 'R'};
+    static const uint32_t c_ChannelOffsets[] = {2, 1, 0};
+    std::vector<uint8_t> channels;
+    for (char name : c_ChannelNames) {
+        channels.insert(channels.end(), {uint8_t(name), 0});
+        // Half floats, not perceptually linear, then the x and y sampling.
+        appendInts(channels, {1, 0, 1, 1});
+    }
+    channels.push_back(0);
+
+    std::vector<uint8_t> window;
+    appendInts(window, {0, 0, image.width - 1, image.height - 1});
+    std::vector<uint8_t> one;
+    appendInts(one, {0x3f800000});
+
+    appendAttribute("channels", "chlist", channels);
+    appendAttribute("compression", "compression", {0});
+    appendAttribute("dataWindow", "box2i", window);
+    appendAttribute("displayWindow", "box2i", window);
+    appendAttribute("lineOrder", "lineOrder", {0});
+    appendAttribute("pixelAspectRatio", "float", one);
+    appendAttribute("screenWindowCenter", "v2f", std::vector<uint8_t>(8, 0));
+    appendAttribute("screenWindowWidth", "float", one);
+    exr.push_back(0);
+
+    // The offset table, then one chunk per scanline: its y, its size and the channels one after the other.
+    const size_t chunkDataSize = size_t(image.width) * 3 * sizeof(uint16_t);
+    const size_t firstChunk = exr.size() + size_t(image.height) * sizeof(uint64_t);
+    for (uint32_t y = 0; y < image.height; y++) {
+        AppendLittleEndian(exr, firstChunk + y * (8 + chunkDataSize), 8);
+    }
+    exr.reserve(firstChunk + size_t(image.height) * (8 + chunkDataSize));
+    for (uint32_t y = 0; y < image.height; y++) {
+        appendInts(exr, {y, uint32_t(chunkDataSize)});
+        const uint16_t* src = image.pixels.data() + size_t(y) * image.width * 4;
+        for (uint32_t channel : c_ChannelOffsets) {
+            for (uint32_t x = 0; x < image.width; x++) {
+                AppendLittleEndian(exr, src[x * 4 + channel], 2);
+            }
+        }
+    }
+    return WriteFile(fileName, exr);
+}
+
+bool CompareImages(const ImageRgba8& a, const ImageRgba8& b, ImageDifference& difference) {
+    difference = ImageDifference();
+    if (a.width != b.width || a.height != b.height) {
+        return false;
+    }
+
+    double sumSquares = 0.0;
+    int maxError = 0;
+    const size_t pixelCount = size_t(a.width) * a.height;
+    for (size_t i = 0; i < pixelCount; i++) {
+        bool differs = false;
+        for (size_t c = 0; c < 3; c++) {
+            int error = std::abs(int(a.pixels[i * 4 + c]) - int(b.pixels[i * 4 + c]));
+            sumSquares += double(error * error);
+            maxError = std::max(maxError, error);
+            differs |= error != 0;
+        }
+        difference.differingPixels += differs ? 1 : 0;
+    }
+
+    difference.rmse = pixelCount ? std::sqrt(sumSquares / double(pixelCount * 3)) / 255.0 : 0.0;
+    difference.maxError = double(maxError) / 255.0;
+    return true;
+}
+
+} // namespace sanbox
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+namespace sanbox {
+
+struct ImageRgba8 {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
+// Linear color as read back from an RGBA16_FLOAT texture, four half floats per pixel.
+struct ImageRgba16F {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint16_t> pixels;
+};
+
+struct ImageDifference {
+    // Root-mean-square and largest per-channel difference, in [0, 1].
+    double rmse = 0.0;
+    double maxError = 0.0;
+    uint64_t differingPixels = 0;
+};
+
+// Copies mip 0 of an 8-bit RGBA texture to the CPU. Blocks until the copy has finished.
+bool ReadbackTexture(nvrhi::IDevice* device, nvrhi::ITexture* texture, nvrhi::ResourceStates textureState, ImageRgba8& image);
+
+// Binary PPM keeps the tooling dependency-free; alpha is dropped on write and set to opaque on read.
+bool WriteImagePpm(const std::filesystem::path& fileName, const ImageRgba8& image);
+bool ReadImagePpm(const std::filesystem::path& fileName, ImageRgba8& image);
+// PNG and OpenEXR writers for the same reason. The PNG is stored without compression, so that writing it
+// costs little more than the PPM; the EXR holds uncompressed half-float RGB scanlines. Alpha is dropped.
+bool WriteImagePng(const std::filesystem::path& fileName, const ImageRgba8& image);
+bool WriteImageExr(const std::filesystem::path& fileName, const ImageRgba16F& image);
+
+// Compares the RGB channels. Returns false if the sizes differ.
+bool CompareImages(const ImageRgba8& a, const ImageRgba8& b, ImageDifference& difference);
+
+} // namespace sanbox
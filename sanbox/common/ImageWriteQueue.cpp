@@ -0,0 +1,105 @@
+#include "ImageWriteQueue.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace sanbox {
+
+ImageWriteQueue::ImageWriteQueue(uint32_t threadCount, uint32_t capacity)
+    : m_Capacity(std::max(capacity, 1u)) {
+    if (threadCount == 0) {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (uint32_t i = 0; i < threadCount; i++) {
+        m_Threads.emplace_back(&ImageWriteQueue::ThreadMain, this);
+    }
+}
+
+ImageWriteQueue::~ImageWriteQueue() {
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Shutdown = true;
+    }
+    m_JobAvailable.notify_all();
+    for (std::thread& thread : m_Threads) {
+        thread.join();
+    }
+}
+
+void ImageWriteQueue::Push(std::filesystem::path fileName, ImageRgba8 image) {
+    Job job;
+    job.fileName = std::move(fileName);
+    job.image = std::move(image);
+    Enqueue(std::move(job));
+}
+
+void ImageWriteQueue::Push(std::filesystem::path fileName, ImageRgba16F image) {
+    Job job;
+    job.fileName = std::move(fileName);
+    job.hdrImage = std::move(image);
+    job.hdr = true;
+    Enqueue(std::move(job));
+}
+
+void ImageWriteQueue::Enqueue(Job job) {
+    const auto startTime = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_SpaceAvailable.wait(lock, [this] { return m_Jobs.size() < m_Capacity; });
+    m_Statistics.blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+    m_Jobs.push_back(std::move(job));
+    lock.unlock();
+    m_JobAvailable.notify_one();
+}
+
+void ImageWriteQueue::Flush() {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_Idle.wait(lock, [this] { return m_Jobs.empty() && m_Writing == 0; });
+}
+
+ImageWriteStatistics ImageWriteQueue::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Statistics;
+}
+
+void ImageWriteQueue::ThreadMain() {
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for (;;) {
+        m_JobAvailable.wait(lock, [this] { return m_Shutdown || !m_Jobs.empty(); });
+        // Queued images are written before the threads exit.
+        if (m_Jobs.empty()) {
+            return;
+        }
+
+        Job job = std::move(m_Jobs.front());
+        m_Jobs.pop_front();
+        m_Writing++;
+        lock.unlock();
+        m_SpaceAvailable.notify_one();
+
+        const auto startTime = std::chrono::steady_clock::now();
+        bool written;
+        if (job.hdr) {
+            written = WriteImageExr(job.fileName, job.hdrImage);
+        } else if (job.fileName.extension() == ".ppm") {
+            written = WriteImagePpm(job.fileName, job.image);
+        } else {
+            written = WriteImagePng(job.fileName, job.image);
+        }
+        const double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::error_code error;
+        const uint64_t bytes = written ? std::filesystem::file_size(job.fileName, error) : 0;
+
+        lock.lock();
+        m_Writing--;
+        m_Statistics.images += written ? 1 : 0;
+        m_Statistics.failures += written ? 0 : 1;
+        m_Statistics.bytes += error ? 0 : bytes;
+        m_Statistics.encodeMs += encodeMs;
+        if (m_Jobs.empty() && m_Writing == 0) {
+            m_Idle.notify_all();
+        }
+    }
+}
+
+} // namespace sanbox
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ImageUtils.h"
+
+namespace sanbox {
+
+struct ImageWriteStatistics {
+    uint64_t images = 0;
+    uint64_t failures = 0;
+    uint64_t bytes = 0;
+    // Summed over the threads, so it can exceed the wall time.
+    double encodeMs = 0.0;
+    // Time that Push spent waiting for room in the queue.
+    double blockedMs = 0.0;
+};
+
+// Encodes and writes images on worker threads, so that the thread that produces them only waits when the
+// queue is full. The format follows the extension of the file name: .exr for half-float images, .ppm or
+// else PNG for 8-bit ones.
+class ImageWriteQueue {
+public:
+    // threadCount == 0 uses one thread per hardware thread. The capacity bounds the images held in memory.
+    ImageWriteQueue(uint32_t threadCount, uint32_t capacity);
+    // Writes whatever is still queued.
+    ~ImageWriteQueue();
+
+    ImageWriteQueue(const ImageWriteQueue&) = delete;
+    ImageWriteQueue& operator=(const ImageWriteQueue&) = delete;
+
+    void Push(std::filesystem::path fileName, ImageRgba8 image);
+    void Push(std::filesystem::path fileName, ImageRgba16F image);
+
+    // Returns when every image pushed so far has been written.
+    void Flush();
+
+    [[nodiscard]] uint32_t GetThreadCount() const {
+        return uint32_t(m_Threads.size());
+    }
+    [[nodiscard]] ImageWriteStatistics GetStatistics() const;
+
+private:
+    struct Job {
+        std::filesystem::path fileName;
+        ImageRgba8 image;
+        ImageRgba16F hdrImage;
+        bool hdr = false;
+    };
+
+    void Enqueue(Job job);
+    void ThreadMain();
+
+    uint32_t m_Capacity;
+    std::vector<std::thread> m_Threads;
+
+    mutable std::mutex m_Mutex;
+    std::condition_variable m_JobAvailable;
+    std::condition_variable m_SpaceAvailable;
+    std::condition_variable m_Idle;
+    std::deque<Job> m_Jobs;
+    uint32_t m_Writing = 0;
+    bool m_Shutdown = false;
+    ImageWriteStatistics m_Statistics;
+};
+
+} // namespace sanbox
@@ -0,0 +1,125 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+namespace sanbox {
+
+JobSystem::JobSystem(uint32_t workerCount) {
+    if (workerCount == 0) {
+        workerCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    m_Queues.resize(workerCount + 1);
+    for (auto& queue : m_Queues) {
+        queue = std::make_unique<Queue>();
+    }
+
+    m_Workers.reserve(workerCount);
+    for (uint32_t i = 0; i < workerCount; i++) {
+        m_Workers.emplace_back(&JobSystem::WorkerMain, this, i + 1);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Shutdown = true;
+    }
+    m_WakeCondition.notify_all();
+
+    for (std::thread& worker : m_Workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::ParallelFor(uint32_t jobCount, const JobFunction& func) {
+    if (jobCount == 0) {
+        return;
+    }
+
+    if (jobCount == 1 || m_Workers.empty()) {
+        for (uint32_t i = 0; i < jobCount; i++) {
+            func(i, 0);
+        }
+        return;
+    }
+
+    m_PendingJobs.store(jobCount);
+
+    // Deal the jobs out round-robin so that every thread starts with local work.
+    for (uint32_t i = 0; i < jobCount; i++) {
+        Queue& queue = *m_Queues[i % m_Queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back({&func, i});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_Generation++;
+    }
+    m_WakeCondition.notify_all();
+
+    Job job;
+    while (PopOrSteal(0, job)) {
+        RunJob(job, 0);
+    }
+
+    std::unique_lock<std::mutex> lock(m_WakeMutex);
+    m_DoneCondition.wait(lock, [this] { return m_PendingJobs.load() == 0; });
+}
+
+bool JobSystem::PopOrSteal(uint32_t threadIndex, Job& job) {
+    {
+        Queue& own = *m_Queues[threadIndex];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+
+    const size_t queueCount = m_Queues.size();
+    for (size_t offset = 1; offset < queueCount; offset++) {
+        Queue& victim = *m_Queues[(threadIndex + offset) % queueCount];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::RunJob(const Job& job, uint32_t threadIndex) {
+    (*job.func)(job.index, threadIndex);
+
+    if (m_PendingJobs.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(m_WakeMutex);
+        m_DoneCondition.notify_all();
+    }
+}
+
+void JobSystem::WorkerMain(uint32_t threadIndex) {
+    uint64_t seenGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_WakeMutex);
+            m_WakeCondition.wait(lock, [&] { return m_Shutdown || m_Generation != seenGeneration; });
+            if (m_Shutdown) {
+                return;
+            }
+            seenGeneration = m_Generation;
+        }
+
+        Job job;
+        while (PopOrSteal(threadIndex, job)) {
+            RunJob(job, threadIndex);
+        }
+    }
+}
+
+} // namespace sanbox
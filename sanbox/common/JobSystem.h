@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sanbox {
+
+// Fixed pool of worker threads with one deque per thread. Owners pop from the back of their own
+// deque and idle threads steal from the front of the others, so uneven jobs balance out.
+// The thread that calls ParallelFor takes part as thread 0.
+class JobSystem {
+public:
+    using JobFunction = std::function<void(uint32_t jobIndex, uint32_t threadIndex)>;
+
+    // workerCount == 0 uses one worker per hardware thread besides the calling one.
+    explicit JobSystem(uint32_t workerCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Total number of threads that can run jobs, including the calling thread.
+    [[nodiscard]] uint32_t GetThreadCount() const {
+        return uint32_t(m_Queues.size());
+    }
+
+    // Runs func for every index in [0, jobCount) and returns when all of them have finished.
+    // Not reentrant: jobs must not call ParallelFor themselves.
+    void ParallelFor(uint32_t jobCount, const JobFunction& func);
+
+private:
+    struct Job {
+        const JobFunction* func = nullptr;
+        uint32_t index = 0;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    bool PopOrSteal(uint32_t threadIndex, Job& job);
+    void RunJob(const Job& job, uint32_t threadIndex);
+    void WorkerMain(uint32_t threadIndex);
+
+    std::vector<std::unique_ptr<Queue>> m_Queues;
+    std::vector<std::thread> m_Workers;
+
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeCondition;
+    std::condition_variable m_DoneCondition;
+    uint64_t m_Generation = 0;
+    std::atomic<uint32_t> m_PendingJobs = 0;
+    bool m_Shutdown = false;
+};
+
+} // namespace sanbox
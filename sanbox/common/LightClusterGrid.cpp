@@ -0,0 +1,252 @@
+#include "LightClusterGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SANBOX_CLUSTER_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SANBOX_CLUSTER_SSE 1
+#endif
+
+using namespace donut::math;
+
+#include "shaders/clustered_lighting_cb.h"
+
+namespace sanbox {
+
+static_assert(LightClusterGrid::c_TilesX == CLUSTER_TILES_X && LightClusterGrid::c_TilesY == CLUSTER_TILES_Y
+              && LightClusterGrid::c_Slices == CLUSTER_SLICES);
+static_assert(LightClusterGrid::c_TilesX % 8 == 0, "rows are tested in blocks of 8 clusters");
+
+LightClusterGrid::LightClusterGrid(float nearDepth, float farDepth)
+    : m_NearDepth(nearDepth)
+    , m_FarDepth(farDepth) {
+    for (std::vector<float>* component : {&m_MinX, &m_MinY, &m_MinZ, &m_MaxX, &m_MaxY, &m_MaxZ}) {
+        component->assign(c_ClusterCount, 0.f);
+    }
+}
+
+const char* LightClusterGrid::GetKernelName() {
+#if defined(SANBOX_CLUSTER_AVX)
+    return "avx";
+#elif defined(SANBOX_CLUSTER_SSE)
+    return "sse";
+#else
+    return "scalar";
+#endif
+}
+
+float LightClusterGrid::GetSliceDepth(uint32_t slice) const {
+    return m_NearDepth * std::pow(m_FarDepth / m_NearDepth, float(slice) / float(c_Slices));
+}
+
+uint32_t LightClusterGrid::GetSlice(float depth) const {
+    if (depth <= m_NearDepth) {
+        return 0;
+    }
+    const float slice = std::log2(depth / m_NearDepth) * float(c_Slices) / std::log2(m_FarDepth / m_NearDepth);
+    return std::min(uint32_t(slice), c_Slices - 1);
+}
+
+void LightClusterGrid::UpdateClusterBounds(const float2& projectionScale) {
+    m_ProjectionScale = projectionScale;
+
+    // A tile spans a fixed NDC interval; in view space its extent grows with depth, so the box of a cluster
+    // is bounded by the tile edges at the near and far depth of its slice.
+    for (uint32_t slice = 0; slice < c_Slices; slice++) {
+        const float z0 = GetSliceDepth(slice);
+        const float z1 = GetSliceDepth(slice + 1);
+
+        for (uint32_t tileY = 0; tileY < c_TilesY; tileY++) {
+            const float top = 1.f - 2.f * float(tileY) / float(c_TilesY);
+            const float bottom = top - 2.f / float(c_TilesY);
+
+            for (uint32_t tileX = 0; tileX < c_TilesX; tileX++) {
+                const float left = -1.f + 2.f * float(tileX) / float(c_TilesX);
+                const float right = left + 2.f / float(c_TilesX);
+
+                const uint32_t cluster = (slice * c_TilesY + tileY) * c_TilesX + tileX;
+                m_MinX[cluster] = std::min(left * z0, left * z1) / projectionScale.x;
+                m_MaxX[cluster] = std::max(right * z0, right * z1) / projectionScale.x;
+                m_MinY[cluster] = std::min(bottom * z0, bottom * z1) / projectionScale.y;
+                m_MaxY[cluster] = std::max(top * z0, top * z1) / projectionScale.y;
+                m_MinZ[cluster] = z0;
+                m_MaxZ[cluster] = z1;
+            }
+        }
+    }
+
+    // Pixels beyond the far depth fall into the last slice, so its boxes reach to infinity; the screen
+    // tiles of a light still bound it there.
+    const size_t lastSlice = size_t(c_Slices - 1) * c_TilesY * c_TilesX;
+    const float infinity = std::numeric_limits<float>::infinity();
+    std::fill(m_MinX.begin() + lastSlice, m_MinX.end(), -infinity);
+    std::fill(m_MinY.begin() + lastSlice, m_MinY.end(), -infinity);
+    std::fill(m_MaxX.begin() + lastSlice, m_MaxX.end(), infinity);
+    std::fill(m_MaxY.begin() + lastSlice, m_MaxY.end(), infinity);
+    std::fill(m_MaxZ.begin() + lastSlice, m_MaxZ.end(), infinity);
+}
+
+uint32_t LightClusterGrid::TestRow(uint32_t firstCluster, const float3& center, float radiusSquared) const {
+    // Squared distance from the sphere center to each box; only one of (min - c) and (c - max) can be positive.
+#if defined(SANBOX_CLUSTER_AVX)
+    const __m256 cx = _mm256_set1_ps(center.x);
+    const __m256 cy = _mm256_set1_ps(center.y);
+    const __m256 cz = _mm256_set1_ps(center.z);
+    const __m256 r2 = _mm256_set1_ps(radiusSquared);
+    const __m256 zero = _mm256_setzero_ps();
+
+    uint32_t mask = 0;
+    for (uint32_t block = 0; block < c_TilesX; block += 8) {
+        const size_t first = size_t(firstCluster) + block;
+        auto axisDistance = [first, zero](const std::vector<float>& mins, const std::vector<float>& maxs, __m256 c) {
+            __m256 below = _mm256_sub_ps(_mm256_loadu_ps(&mins[first]), c);
+            __m256 above = _mm256_sub_ps(c, _mm256_loadu_ps(&maxs[first]));
+            return _mm256_max_ps(_mm256_max_ps(below, above), zero);
+        };
+        __m256 dx = axisDistance(m_MinX, m_MaxX, cx);
+        __m256 dy = axisDistance(m_MinY, m_MaxY, cy);
+        __m256 dz = axisDistance(m_MinZ, m_MaxZ, cz);
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+        mask |= uint32_t(_mm256_movemask_ps(_mm256_cmp_ps(distance, r2, _CMP_LE_OQ))) << block;
+    }
+    return mask;
+#elif defined(SANBOX_CLUSTER_SSE)
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 cz = _mm_set1_ps(center.z);
+    const __m128 r2 = _mm_set1_ps(radiusSquared);
+    const __m128 zero = _mm_setzero_ps();
+
+    uint32_t mask = 0;
+    for (uint32_t block = 0; block < c_TilesX; block += 4) {
+        const size_t first = size_t(firstCluster) + block;
+        auto axisDistance = [first, zero](const std::vector<float>& mins, const std::vector<float>& maxs, __m128 c) {
+            __m128 below = _mm_sub_ps(_mm_loadu_ps(&mins[first]), c);
+            __m128 above = _mm_sub_ps(c, _mm_loadu_ps(&maxs[first]));
+            return _mm_max_ps(_mm_max_ps(below, above), zero);
+        };
+        __m128 dx = axisDistance(m_MinX, m_MaxX, cx);
+        __m128 dy = axisDistance(m_MinY, m_MaxY, cy);
+        __m128 dz = axisDistance(m_MinZ, m_MaxZ, cz);
+        __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+        mask |= uint32_t(_mm_movemask_ps(_mm_cmple_ps(distance, r2))) << block;
+    }
+    return mask;
+#else
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < c_TilesX; i++) {
+        const size_t cluster = size_t(firstCluster) + i;
+        float dx = std::max(std::max(m_MinX[cluster] - center.x, center.x - m_MaxX[cluster]), 0.f);
+        float dy = std::max(std::max(m_MinY[cluster] - center.y, center.y - m_MaxY[cluster]), 0.f);
+        float dz = std::max(std::max(m_MinZ[cluster] - center.z, center.z - m_MaxZ[cluster]), 0.f);
+        if (dx * dx + dy * dy + dz * dz <= radiusSquared) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+void LightClusterGrid::Build(const donut::engine::IView& view, const std::vector<float4>& lightSpheres) {
+    const affine3 viewMatrix = view.GetViewMatrix();
+    const float4x4 projection = view.GetProjectionMatrix(false);
+
+    const float2 projectionScale(projection[0][0], projection[1][1]);
+    if (any(projectionScale != m_ProjectionScale)) {
+        UpdateClusterBounds(projectionScale);
+    }
+    m_ViewDepthPlane = float4(viewMatrix.m_linear.col(2), viewMatrix.m_translation.z);
+
+    m_Statistics = LightClusterStatistics();
+    m_Statistics.lights = uint32_t(lightSpheres.size());
+    m_PairClusters.clear();
+    m_PairLights.clear();
+
+    for (uint32_t light = 0; light < uint32_t(lightSpheres.size()); light++) {
+        const float4& sphere = lightSpheres[light];
+
+        if (sphere.w <= 0.f) {
+            for (uint32_t cluster = 0; cluster < c_ClusterCount; cluster++) {
+                m_PairClusters.push_back(cluster);
+                m_PairLights.push_back(light);
+            }
+            continue;
+        }
+
+        const float3 center = viewMatrix.transformPoint(sphere.xyz());
+        const float radius = sphere.w;
+        const float zMin = center.z - radius;
+        const float zMax = center.z + radius;
+        if (zMax < m_NearDepth) {
+            m_Statistics.culledLights++;
+            continue;
+        }
+
+        // Screen bounds of the sphere's view-space box; x / z is extreme at the nearest or farthest depth.
+        const float zNear = std::max(zMin, m_NearDepth);
+        const float xs[4] = {(center.x - radius) / zNear, (center.x - radius) / zMax, (center.x + radius) / zNear, (center.x + radius) / zMax};
+        const float ys[4] = {(center.y - radius) / zNear, (center.y - radius) / zMax, (center.y + radius) / zNear, (center.y + radius) / zMax};
+        const float ndcLeft = *std::min_element(xs, xs + 4) * projectionScale.x;
+        const float ndcRight = *std::max_element(xs, xs + 4) * projectionScale.x;
+        const float ndcBottom = *std::min_element(ys, ys + 4) * projectionScale.y;
+        const float ndcTop = *std::max_element(ys, ys + 4) * projectionScale.y;
+        if (ndcRight < -1.f || ndcLeft > 1.f || ndcTop < -1.f || ndcBottom > 1.f) {
+            m_Statistics.culledLights++;
+            continue;
+        }
+
+        auto toTile = [](float coordinate, uint32_t tiles) {
+            return uint32_t(std::clamp(coordinate * float(tiles), 0.f, float(tiles - 1)));
+        };
+        const uint32_t tileX0 = toTile((ndcLeft + 1.f) * 0.5f, c_TilesX);
+        const uint32_t tileX1 = toTile((ndcRight + 1.f) * 0.5f, c_TilesX);
+        const uint32_t tileY0 = toTile((1.f - ndcTop) * 0.5f, c_TilesY);
+        const uint32_t tileY1 = toTile((1.f - ndcBottom) * 0.5f, c_TilesY);
+
+        const size_t pairsBefore = m_PairClusters.size();
+        for (uint32_t slice = GetSlice(zMin); slice <= GetSlice(zMax); slice++) {
+            for (uint32_t tileY = tileY0; tileY <= tileY1; tileY++) {
+                const uint32_t firstCluster = (slice * c_TilesY + tileY) * c_TilesX;
+                const uint32_t mask = TestRow(firstCluster, center, radius * radius);
+                for (uint32_t tileX = tileX0; tileX <= tileX1; tileX++) {
+                    if (mask & (1u << tileX)) {
+                        m_PairClusters.push_back(firstCluster + tileX);
+                        m_PairLights.push_back(light);
+                    }
+                }
+            }
+        }
+
+        if (m_PairClusters.size() == pairsBefore) {
+            m_Statistics.culledLights++;
+        }
+    }
+
+    // Counting sort of the (cluster, light) pairs by cluster; lights stay in ascending order within a cluster.
+    m_ClusterRanges.assign(c_ClusterCount, uint2(0u));
+    for (uint32_t cluster : m_PairClusters) {
+        m_ClusterRanges[cluster].y++;
+    }
+
+    uint32_t offset = 0;
+    for (uint2& range : m_ClusterRanges) {
+        range.x = offset;
+        offset += range.y;
+        m_Statistics.maxLightsPerCluster = std::max(m_Statistics.maxLightsPerCluster, range.y);
+        range.y = 0;
+    }
+
+    m_LightIndices.resize(m_PairClusters.size());
+    for (size_t i = 0; i < m_PairClusters.size(); i++) {
+        uint2& range = m_ClusterRanges[m_PairClusters[i]];
+        m_LightIndices[range.x + range.y++] = m_PairLights[i];
+    }
+    m_Statistics.lightIndices = uint32_t(m_LightIndices.size());
+}
+
+} // namespace sanbox
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/engine/View.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace sanbox {
+
+struct LightClusterStatistics {
+    uint32_t lights = 0;
+    // Lights whose bounds miss every cluster.
+    uint32_t culledLights = 0;
+    uint32_t lightIndices = 0;
+    uint32_t maxLightsPerCluster = 0;
+};
+
+// Assigns lights to the froxels of a view: c_TilesX x c_TilesY screen tiles by c_Slices depth slices spaced
+// exponentially between the near and far depth. Pixels beyond the far depth use the last slice.
+// Each light's bounding sphere is tested against one row of cluster boxes at a time, with AVX or SSE when available.
+// The result is one (first index, count) range per cluster into a shared list of light indices.
+class LightClusterGrid {
+public:
+    static constexpr uint32_t c_TilesX = 16;
+    static constexpr uint32_t c_TilesY = 8;
+    static constexpr uint32_t c_Slices = 24;
+    static constexpr uint32_t c_ClusterCount = c_TilesX * c_TilesY * c_Slices;
+
+    explicit LightClusterGrid(float nearDepth = 0.1f, float farDepth = 100.f);
+
+    // Spheres are in world space: xyz = center, w = radius. A radius of zero or less marks a light without
+    // a range, which is assigned to every cluster.
+    void Build(const donut::engine::IView& view, const std::vector<dm::float4>& lightSpheres);
+
+    [[nodiscard]] const std::vector<dm::uint2>& GetClusterRanges() const {
+        return m_ClusterRanges;
+    }
+    [[nodiscard]] const std::vector<uint32_t>& GetLightIndices() const {
+        return m_LightIndices;
+    }
+    [[nodiscard]] const LightClusterStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+    // View-space depth of a world position p is dot(float4(p, 1), plane), for the view of the last Build.
+    [[nodiscard]] dm::float4 GetViewDepthPlane() const {
+        return m_ViewDepthPlane;
+    }
+    [[nodiscard]] float GetNearDepth() const {
+        return m_NearDepth;
+    }
+    [[nodiscard]] float GetFarDepth() const {
+        return m_FarDepth;
+    }
+
+    // Name of the row kernel compiled into this build: "avx", "sse" or "scalar".
+    static const char* GetKernelName();
+
+private:
+    [[nodiscard]] float GetSliceDepth(uint32_t slice) const;
+    [[nodiscard]] uint32_t GetSlice(float depth) const;
+    void UpdateClusterBounds(const dm::float2& projectionScale);
+    // Returns a bit per tile of the row that starts at firstCluster, set where the sphere touches the cluster box.
+    [[nodiscard]] uint32_t TestRow(uint32_t firstCluster, const dm::float3& center, float radiusSquared) const;
+
+    float m_NearDepth;
+    float m_FarDepth;
+    dm::float2 m_ProjectionScale = 0.f;
+    dm::float4 m_ViewDepthPlane = 0.f;
+
+    // View-space cluster boxes as structure-of-arrays, one row of c_TilesX clusters after another.
+    std::vector<float> m_MinX, m_MinY, m_MinZ;
+    std::vector<float> m_MaxX, m_MaxY, m_MaxZ;
+
+    std::vector<uint32_t> m_PairClusters;
+    std::vector<uint32_t> m_PairLights;
+    std::vector<dm::uint2> m_ClusterRanges;
+    std::vector<uint32_t> m_LightIndices;
+
+    LightClusterStatistics m_Statistics;
+};
+
+} // namespace sanbox
@@ -0,0 +1,106 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace sanbox {
+
+MappedFile::~MappedFile() {
+    Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::filesystem::path& fileName) {
+    Close();
+
+    m_File = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_File == INVALID_HANDLE_VALUE) {
+        m_File = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_File, &size) || size.QuadPart == 0) {
+        Close();
+        return false;
+    }
+
+    m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_Mapping) {
+        Close();
+        return false;
+    }
+
+    m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_Data) {
+        Close();
+        return false;
+    }
+    m_Size = size_t(size.QuadPart);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (m_Data) {
+        UnmapViewOfFile(m_Data);
+    }
+    if (m_Mapping) {
+        CloseHandle(m_Mapping);
+    }
+    if (m_File) {
+        CloseHandle(m_File);
+    }
+    m_Data = nullptr;
+    m_Size = 0;
+    m_Mapping = nullptr;
+    m_File = nullptr;
+}
+
+#else
+
+bool MappedFile::Open(const std::filesystem::path& fileName) {
+    Close();
+
+    const int file = open(fileName.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+
+    struct stat status = {};
+    if (fstat(file, &status) != 0 || status.st_size == 0) {
+        close(file);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file, so the descriptor is not needed past this point.
+    void* data = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    m_Data = static_cast<const uint8_t*>(data);
+    m_Size = size_t(status.st_size);
+    return true;
+}
+
+void MappedFile::Close() {
+    if (m_Data) {
+        munmap(const_cast<uint8_t*>(m_Data), m_Size);
+    }
+    m_Data = nullptr;
+    m_Size = 0;
+}
+
+#endif
+
+} // namespace sanbox
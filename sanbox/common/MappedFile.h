@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+namespace sanbox {
+
+// Read-only memory mapping of a whole file. The pages are loaded on first access, so opening a large
+// file is cheap and only the parts that are read are paged in.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::filesystem::path& fileName);
+    void Close();
+
+    [[nodiscard]] const uint8_t* GetData() const {
+        return m_Data;
+    }
+    [[nodiscard]] size_t GetSize() const {
+        return m_Size;
+    }
+    [[nodiscard]] bool IsOpen() const {
+        return m_Data != nullptr;
+    }
+
+private:
+    const uint8_t* m_Data = nullptr;
+    size_t m_Size = 0;
+#ifdef _WIN32
+    void* m_File = nullptr;
+    void* m_Mapping = nullptr;
+#endif
+};
+
+} // namespace sanbox
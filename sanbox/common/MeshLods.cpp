@@ -0,0 +1,369 @@
+#include "MeshLods.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+#include "ContentHash.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+namespace {
+
+constexpr uint32_t c_LodFileMagic = 0x444c4253; // "SBLD"
+constexpr uint32_t c_LodFileVersion = 1;
+// Meshes this small are not worth a draw of their own at a coarser level.
+constexpr uint32_t c_MinSourceTriangles = 64;
+// A level is dropped, and the chain ends, when it keeps more than this fraction of the previous level.
+constexpr float c_MinLevelReduction = 0.9f;
+// Collapses that move the surface by more than this fraction of the mesh bounds are not made.
+constexpr float c_MaxRelativeError = 0.05f;
+
+struct LodFileHeader {
+    uint32_t magic = c_LodFileMagic;
+    uint32_t version = c_LodFileVersion;
+    uint64_t contentHash = 0;
+    uint32_t meshCount = 0;
+    uint32_t levelCount = 0;
+    uint32_t geometryCount = 0;
+    uint32_t indexCount = 0;
+};
+
+bool CanSimplify(const engine::MeshInfo& mesh) {
+    if (!mesh.buffers || mesh.type != engine::MeshType::Triangles || mesh.skinPrototype || mesh.isMorphTargetAnimationMesh
+        || !mesh.buffers->jointData.empty() || mesh.totalIndices / 3 < c_MinSourceTriangles) {
+        return false;
+    }
+
+    const engine::BufferGroup& buffers = *mesh.buffers;
+    for (const auto& geometry : mesh.geometries) {
+        const size_t firstIndex = size_t(mesh.indexOffset) + geometry->indexOffsetInMesh;
+        const size_t firstVertex = size_t(mesh.vertexOffset) + geometry->vertexOffsetInMesh;
+        if (geometry->type != engine::MeshGeometryPrimitiveType::Triangles || firstIndex + geometry->numIndices > buffers.indexData.size()
+            || firstVertex + geometry->numVertices > buffers.positionData.size()) {
+            return false;
+        }
+        const uint32_t* indices = buffers.indexData.data() + firstIndex;
+        const uint32_t vertexCount = geometry->numVertices;
+        if (!std::all_of(indices, indices + geometry->numIndices, [vertexCount](uint32_t index) { return index < vertexCount; })) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const uint32_t* GetSourceIndices(const engine::MeshInfo& mesh, const engine::MeshGeometry& geometry) {
+    return mesh.buffers->indexData.data() + mesh.indexOffset + geometry.indexOffsetInMesh;
+}
+
+const float3* GetSourcePositions(const engine::MeshInfo& mesh, const engine::MeshGeometry& geometry) {
+    return mesh.buffers->positionData.data() + mesh.vertexOffset + geometry.vertexOffsetInMesh;
+}
+
+} // namespace
+
+MeshLodSet::MeshLodSet(nvrhi::IDevice* device)
+    : m_Device(device) {
+}
+
+uint64_t MeshLodSet::HashSources(const engine::SceneGraph& sceneGraph) {
+    ContentHash hash;
+    const uint32_t parameters[] = {c_LodFileVersion, c_MaxLevels, c_MinSourceTriangles};
+    const float limits[] = {c_MinLevelReduction, c_MaxRelativeError};
+    hash.Add(parameters, sizeof(parameters));
+    hash.Add(limits, sizeof(limits));
+
+    for (const auto& mesh : sceneGraph.GetMeshes()) {
+        const uint32_t geometryCount = CanSimplify(*mesh) ? uint32_t(mesh->geometries.size()) : 0;
+        hash.Add(&geometryCount, sizeof(geometryCount));
+        for (uint32_t geometryIndex = 0; geometryIndex < geometryCount; geometryIndex++) {
+            const engine::MeshGeometry& geometry = *mesh->geometries[geometryIndex];
+            hash.Add(GetSourceIndices(*mesh, geometry), geometry.numIndices * sizeof(uint32_t));
+            hash.Add(GetSourcePositions(*mesh, geometry), geometry.numVertices * sizeof(float3));
+        }
+    }
+    return hash.Get();
+}
+
+void MeshLodSet::Simplify(const engine::SceneGraph& sceneGraph, LodData& data) {
+    const auto& meshes = sceneGraph.GetMeshes();
+    std::vector<uint32_t> simplified;
+    std::vector<uint32_t> levelIndices;
+    std::vector<GeometryLod> levelGeometries;
+
+    for (uint32_t meshIndex = 0; meshIndex < uint32_t(meshes.size()); meshIndex++) {
+        const engine::MeshInfo& mesh = *meshes[meshIndex];
+        if (!CanSimplify(mesh)) {
+            continue;
+        }
+
+        const float maxError = length(mesh.objectSpaceBounds.diagonal()) * c_MaxRelativeError;
+        MeshLod meshLod{meshIndex, uint32_t(data.levels.size()), 0};
+        uint32_t previousTriangles = mesh.totalIndices / 3;
+        float previousError = 0.f;
+
+        // Every level is simplified from the source, so that its error is measured against it.
+        for (uint32_t level = 1; level < c_MaxLevels; level++) {
+            levelIndices.clear();
+            levelGeometries.clear();
+            float levelError = previousError;
+            for (const auto& geometry : mesh.geometries) {
+                const size_t targetIndices = size_t(geometry->numIndices >> level) / 3 * 3;
+                const float error = SimplifyTriangles(GetSourceIndices(mesh, *geometry), geometry->numIndices, GetSourcePositions(mesh, *geometry),
+                                                      geometry->numVertices, targetIndices, maxError, simplified);
+                OptimizeVertexCache(simplified.data(), simplified.size(), geometry->numVertices);
+
+                levelGeometries.push_back({uint32_t(data.indices.size() + levelIndices.size()), uint32_t(simplified.size())});
+                levelIndices.insert(levelIndices.end(), simplified.begin(), simplified.end());
+                levelError = std::max(levelError, error);
+            }
+
+            const uint32_t levelTriangles = uint32_t(levelIndices.size() / 3);
+            if (float(levelTriangles) > float(previousTriangles) * c_MinLevelReduction) {
+                break;
+            }
+
+            data.levels.push_back({levelError, uint32_t(data.geometries.size())});
+            data.geometries.insert(data.geometries.end(), levelGeometries.begin(), levelGeometries.end());
+            data.indices.insert(data.indices.end(), levelIndices.begin(), levelIndices.end());
+            meshLod.levelCount++;
+            previousTriangles = levelTriangles;
+            previousError = levelError;
+        }
+
+        if (meshLod.levelCount) {
+            data.meshes.push_back(meshLod);
+        }
+    }
+}
+
+bool MeshLodSet::ReadCache(const std::filesystem::path& fileName, uint64_t contentHash, const engine::SceneGraph& sceneGraph, LodData& data) {
+    MappedFile file;
+    if (!file.Open(fileName) || file.GetSize() < sizeof(LodFileHeader)) {
+        return false;
+    }
+
+    LodFileHeader header;
+    memcpy(&header, file.GetData(), sizeof(header));
+    const size_t expectedSize = sizeof(LodFileHeader) + header.meshCount * sizeof(MeshLod) + header.levelCount * sizeof(LevelLod)
+                              + header.geometryCount * sizeof(GeometryLod) + header.indexCount * sizeof(uint32_t);
+    if (header.magic != c_LodFileMagic || header.version != c_LodFileVersion || expectedSize != file.GetSize()) {
+        log::info("Mesh LOD cache '%s' is from another version, rebuilding it", fileName.generic_string().c_str());
+        return false;
+    }
+    if (header.contentHash != contentHash) {
+        log::info("Mesh LOD cache '%s' is out of date, rebuilding it", fileName.generic_string().c_str());
+        return false;
+    }
+
+    const uint8_t* read = file.GetData() + sizeof(LodFileHeader);
+    const auto readArray = [&read](auto& items, uint32_t count) {
+        items.resize(count);
+        if (count) {
+            memcpy(items.data(), read, count * sizeof(items[0]));
+            read += count * sizeof(items[0]);
+        }
+    };
+    readArray(data.meshes, header.meshCount);
+    readArray(data.levels, header.levelCount);
+    readArray(data.geometries, header.geometryCount);
+    readArray(data.indices, header.indexCount);
+
+    // The hash matched, so only the links between the records can be wrong, if the file was damaged.
+    const auto& meshes = sceneGraph.GetMeshes();
+    for (const MeshLod& meshLod : data.meshes) {
+        bool valid = meshLod.meshIndex < meshes.size() && size_t(meshLod.firstLevel) + meshLod.levelCount <= data.levels.size();
+        for (uint32_t level = 0; level < meshLod.levelCount && valid; level++) {
+            const size_t firstGeometry = data.levels[meshLod.firstLevel + level].firstGeometry;
+            valid = firstGeometry + meshes[meshLod.meshIndex]->geometries.size() <= data.geometries.size();
+            for (size_t geometry = 0; geometry < meshes[meshLod.meshIndex]->geometries.size() && valid; geometry++) {
+                const GeometryLod& geometryLod = data.geometries[firstGeometry + geometry];
+                valid = size_t(geometryLod.firstIndex) + geometryLod.indexCount <= data.indices.size();
+            }
+        }
+        if (!valid) {
+            log::warning("Mesh LOD cache '%s' is damaged", fileName.generic_string().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeshLodSet::WriteCache(const std::filesystem::path& fileName, uint64_t contentHash, const LodData& data) {
+    LodFileHeader header;
+    header.contentHash = contentHash;
+    header.meshCount = uint32_t(data.meshes.size());
+    header.levelCount = uint32_t(data.levels.size());
+    header.geometryCount = uint32_t(data.geometries.size());
+    header.indexCount = uint32_t(data.indices.size());
+
+    std::error_code error;
+    std::filesystem::create_directories(fileName.parent_path(), error);
+
+    // Written next to the target and renamed, so a reader never maps a partial file.
+    std::filesystem::path temporaryFileName = fileName;
+    temporaryFileName += ".tmp";
+    {
+        std::ofstream file(temporaryFileName, std::ios::binary | std::ios::trunc);
+        const auto writeArray = [&file](const auto& items) {
+            file.write(reinterpret_cast<const char*>(items.data()), std::streamsize(items.size() * sizeof(items[0])));
+        };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        writeArray(data.meshes);
+        writeArray(data.levels);
+        writeArray(data.geometries);
+        writeArray(data.indices);
+        if (!file.good()) {
+            log::warning("Cannot write mesh LOD cache '%s'", fileName.generic_string().c_str());
+            return;
+        }
+    }
+    std::filesystem::rename(temporaryFileName, fileName, error);
+    if (error) {
+        log::warning("Cannot write mesh LOD cache '%s'", fileName.generic_string().c_str());
+    }
+}
+
+void MeshLodSet::CreateLevels(const engine::SceneGraph& sceneGraph, const LodData& data) {
+    const auto& meshes = sceneGraph.GetMeshes();
+
+    // One index buffer per source buffer group, with the levels of its meshes one after another.
+    std::unordered_map<const engine::BufferGroup*, std::vector<const MeshLod*>> groups;
+    std::vector<const engine::BufferGroup*> groupOrder;
+    for (const MeshLod& meshLod : data.meshes) {
+        const engine::BufferGroup* buffers = meshes[meshLod.meshIndex]->buffers.get();
+        auto [it, inserted] = groups.try_emplace(buffers);
+        if (inserted) {
+            groupOrder.push_back(buffers);
+        }
+        it->second.push_back(&meshLod);
+    }
+
+    // The scene graph numbers its meshes in this order; GetLevels finds them by their global index.
+    m_Levels.assign(meshes.size(), {});
+    nvrhi::CommandListHandle commandList = m_Device->createCommandList();
+    commandList->open();
+
+    std::vector<uint32_t> groupIndices;
+    for (const engine::BufferGroup* source : groupOrder) {
+        auto buffers = std::make_shared<engine::BufferGroup>();
+        m_BufferGroups.emplace_back(source, buffers);
+        groupIndices.clear();
+
+        for (const MeshLod* meshLod : groups[source]) {
+            const std::shared_ptr<engine::MeshInfo>& sourceMesh = meshes[meshLod->meshIndex];
+            std::vector<MeshLodLevel>& levels = m_Levels[meshLod->meshIndex];
+            levels.push_back({sourceMesh.get(), 0.f, sourceMesh->totalIndices / 3});
+
+            for (uint32_t level = 0; level < meshLod->levelCount; level++) {
+                const LevelLod& levelLod = data.levels[meshLod->firstLevel + level];
+                auto mesh = std::make_shared<engine::MeshInfo>();
+                mesh->name = sourceMesh->name + " LOD" + std::to_string(level + 1);
+                mesh->type = sourceMesh->type;
+                mesh->buffers = buffers;
+                mesh->objectSpaceBounds = sourceMesh->objectSpaceBounds;
+                mesh->indexOffset = uint32_t(groupIndices.size());
+                mesh->vertexOffset = sourceMesh->vertexOffset;
+                mesh->totalVertices = sourceMesh->totalVertices;
+                mesh->globalMeshIndex = sourceMesh->globalMeshIndex;
+
+                for (size_t geometryIndex = 0; geometryIndex < sourceMesh->geometries.size(); geometryIndex++) {
+                    const GeometryLod& geometryLod = data.geometries[levelLod.firstGeometry + geometryIndex];
+                    auto geometry = std::make_shared<engine::MeshGeometry>(*sourceMesh->geometries[geometryIndex]);
+                    geometry->indexOffsetInMesh = uint32_t(groupIndices.size()) - mesh->indexOffset;
+                    geometry->numIndices = geometryLod.indexCount;
+                    groupIndices.insert(groupIndices.end(), data.indices.begin() + geometryLod.firstIndex,
+                                        data.indices.begin() + geometryLod.firstIndex + geometryLod.indexCount);
+                    mesh->geometries.push_back(std::move(geometry));
+                }
+                mesh->totalIndices = uint32_t(groupIndices.size()) - mesh->indexOffset;
+
+                levels.push_back({mesh.get(), levelLod.error, mesh->totalIndices / 3});
+                m_LodMeshes.push_back(std::move(mesh));
+                m_Statistics.levels++;
+                m_Statistics.lodTriangles += levels.back().triangles;
+            }
+            m_Statistics.meshes++;
+            m_Statistics.sourceTriangles += levels.front().triangles;
+        }
+
+        const size_t byteSize = std::max<size_t>(groupIndices.size(), 1) * sizeof(uint32_t);
+        buffers->indexBuffer = m_Device->createBuffer(
+            nvrhi::BufferDesc().setByteSize(byteSize).setIsIndexBuffer(true).setCanHaveRawViews(true).setDebugName("LodIndexBuffer"));
+        commandList->beginTrackingBufferState(buffers->indexBuffer, nvrhi::ResourceStates::CopyDest);
+        commandList->writeBuffer(buffers->indexBuffer, groupIndices.data(), groupIndices.size() * sizeof(uint32_t));
+        commandList->setPermanentBufferState(buffers->indexBuffer, nvrhi::ResourceStates::IndexBuffer | nvrhi::ResourceStates::ShaderResource);
+    }
+
+    commandList->close();
+    m_Device->executeCommandList(commandList);
+    SyncBuffers();
+}
+
+void MeshLodSet::Build(const engine::SceneGraph& sceneGraph, const std::filesystem::path& cacheFileName, bool rebuildCache) {
+    const auto startTime = std::chrono::steady_clock::now();
+    m_Statistics = MeshLodStatistics();
+    m_Levels.clear();
+    m_LodMeshes.clear();
+    m_BufferGroups.clear();
+
+    const uint64_t contentHash = HashSources(sceneGraph);
+    LodData data;
+    m_Statistics.fromCache = !cacheFileName.empty() && !rebuildCache && ReadCache(cacheFileName, contentHash, sceneGraph, data);
+    if (!m_Statistics.fromCache) {
+        data = LodData();
+        Simplify(sceneGraph, data);
+        if (!cacheFileName.empty()) {
+            WriteCache(cacheFileName, contentHash, data);
+        }
+    }
+    CreateLevels(sceneGraph, data);
+
+    m_Statistics.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    log::info("%s %u LODs of %u meshes in %.1f ms: %.2f M source triangles, %.2f M LOD triangles", m_Statistics.fromCache ? "Loaded" : "Built",
+              m_Statistics.levels, m_Statistics.meshes, m_Statistics.buildMs, double(m_Statistics.sourceTriangles) * 1e-6,
+              double(m_Statistics.lodTriangles) * 1e-6);
+}
+
+void MeshLodSet::SyncBuffers() {
+    for (const auto& [source, buffers] : m_BufferGroups) {
+        buffers->vertexBuffer = source->vertexBuffer;
+        buffers->instanceBuffer = source->instanceBuffer;
+        buffers->vertexBufferDescriptor = source->vertexBufferDescriptor;
+        buffers->instanceBufferDescriptor = source->instanceBufferDescriptor;
+        buffers->vertexBufferRanges = source->vertexBufferRanges;
+    }
+}
+
+const std::vector<MeshLodLevel>* MeshLodSet::GetLevels(const engine::MeshInfo& mesh) const {
+    const size_t slot = size_t(std::max(mesh.globalMeshIndex, 0));
+    if (slot < m_Levels.size() && !m_Levels[slot].empty() && m_Levels[slot].front().mesh == &mesh) {
+        return &m_Levels[slot];
+    }
+    return nullptr;
+}
+
+uint32_t MeshLodSet::SelectLevel(const std::vector<MeshLodLevel>& levels, float pixelsPerUnit, float errorPixels, uint32_t currentLevel) {
+    uint32_t level = 0;
+    while (level + 1 < levels.size() && levels[level + 1].error * pixelsPerUnit <= errorPixels) {
+        level++;
+    }
+    const float coarserErrorPixels = errorPixels * (1.f - c_Hysteresis);
+    while (level > currentLevel && levels[level].error * pixelsPerUnit > coarserErrorPixels) {
+        level--;
+    }
+    return level;
+}
+
+} // namespace sanbox
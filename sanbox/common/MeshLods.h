@@ -0,0 +1,110 @@
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace sanbox {
+
+struct MeshLodLevel {
+    // Level 0 is the scene's own mesh.
+    const donut::engine::MeshInfo* mesh = nullptr;
+    // Largest distance, in object space, between the level's surface and the source mesh.
+    float error = 0.f;
+    uint32_t triangles = 0;
+};
+
+struct MeshLodStatistics {
+    uint32_t meshes = 0;
+    uint32_t levels = 0;
+    uint64_t sourceTriangles = 0;
+    uint64_t lodTriangles = 0;
+    double buildMs = 0.0;
+    bool fromCache = false;
+};
+
+// Per PrepareForView of the draw strategy; the full detail count is what the same instances cost at level 0.
+struct LodSelectionStatistics {
+    uint64_t drawnTriangles = 0;
+    uint64_t fullDetailTriangles = 0;
+    uint32_t coarseInstances = 0;
+    uint32_t lodSwitches = 0;
+};
+
+// Chains of simplified index lists for the static triangle meshes of a scene, each level with half the
+// triangles of the previous one. The levels reuse the vertices of their source mesh, so they cost only
+// index buffer memory: every buffer group gets a twin that shares its vertex and instance buffers and has
+// the LOD indices of all its meshes, and every level is a MeshInfo whose geometries keep the vertex
+// offsets, materials and global geometry indices of the source and point at their own indices.
+// Building the chains takes seconds for Sponza, so they are cached in a file keyed by a hash of the source
+// indices and positions.
+class MeshLodSet {
+public:
+    static constexpr uint32_t c_MaxLevels = 5;
+    // Going to a coarser level needs the error to be this much below the threshold, so that instances that
+    // sit at the threshold do not switch every frame.
+    static constexpr float c_Hysteresis = 0.25f;
+
+    explicit MeshLodSet(nvrhi::IDevice* device);
+
+    // After Scene::FinishedLoading and VertexQuantizer, since the levels share the final vertex buffers.
+    // An empty cache file name disables the cache.
+    void Build(const donut::engine::SceneGraph& sceneGraph, const std::filesystem::path& cacheFileName, bool rebuildCache);
+
+    // Picks up instance buffers that the scene recreated since Build.
+    void SyncBuffers();
+
+    // Null or a single level for meshes without LODs.
+    [[nodiscard]] const std::vector<MeshLodLevel>* GetLevels(const donut::engine::MeshInfo& mesh) const;
+
+    // Coarsest level whose error, projected at pixelsPerUnit, is below errorPixels, with hysteresis
+    // against the level the instance is drawn with now.
+    [[nodiscard]] static uint32_t SelectLevel(const std::vector<MeshLodLevel>& levels, float pixelsPerUnit, float errorPixels,
+                                              uint32_t currentLevel);
+
+    [[nodiscard]] const MeshLodStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    struct GeometryLod {
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+    };
+    struct LevelLod {
+        float error = 0.f;
+        uint32_t firstGeometry = 0;
+    };
+    struct MeshLod {
+        uint32_t meshIndex = 0;
+        uint32_t firstLevel = 0;
+        uint32_t levelCount = 0;
+    };
+    // The chains as they are simplified or read from the cache, with indices relative to their geometry.
+    struct LodData {
+        std::vector<MeshLod> meshes;
+        std::vector<LevelLod> levels;
+        std::vector<GeometryLod> geometries;
+        std::vector<uint32_t> indices;
+    };
+
+    static uint64_t HashSources(const donut::engine::SceneGraph& sceneGraph);
+    static void Simplify(const donut::engine::SceneGraph& sceneGraph, LodData& data);
+    static bool ReadCache(const std::filesystem::path& fileName, uint64_t contentHash, const donut::engine::SceneGraph& sceneGraph,
+                          LodData& data);
+    static void WriteCache(const std::filesystem::path& fileName, uint64_t contentHash, const LodData& data);
+    void CreateLevels(const donut::engine::SceneGraph& sceneGraph, const LodData& data);
+
+    nvrhi::DeviceHandle m_Device;
+    MeshLodStatistics m_Statistics;
+    // Indexed by the global mesh index.
+    std::vector<std::vector<MeshLodLevel>> m_Levels;
+    std::vector<std::shared_ptr<donut::engine::MeshInfo>> m_LodMeshes;
+    std::vector<std::pair<const donut::engine::BufferGroup*, std::shared_ptr<donut::engine::BufferGroup>>> m_BufferGroups;
+};
+
+} // namespace sanbox
@@ -0,0 +1,622 @@
+#include "MeshOptimizer.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+namespace {
+
+// Cache size that Forsyth's scoring is tuned for; larger than the hardware FIFO that ACMR is measured with.
+constexpr uint32_t c_ForsythCacheSize = 32;
+constexpr uint32_t c_InvalidIndex = ~0u;
+
+float GetVertexScore(int cachePosition, uint32_t remainingTriangles) {
+    if (remainingTriangles == 0) {
+        return -1.f;
+    }
+
+    float score = 0.f;
+    if (cachePosition >= 0) {
+        // The three vertices of the last triangle score the same, so that strips do not win over fans.
+        score = cachePosition < 3 ? 0.75f : std::pow(1.f - float(cachePosition - 3) / float(c_ForsythCacheSize - 3), 1.5f);
+    }
+    // Vertices with few triangles left are finished first, so that they do not have to be reloaded later.
+    return score + 2.f / std::sqrt(float(remainingTriangles));
+}
+
+template <typename T>
+void PermuteVertices(std::vector<T>& data, uint32_t firstVertex, const std::vector<uint32_t>& remap) {
+    if (data.size() < size_t(firstVertex) + remap.size()) {
+        return;
+    }
+    const std::vector<T> original(data.begin() + firstVertex, data.begin() + firstVertex + remap.size());
+    for (size_t vertex = 0; vertex < remap.size(); vertex++) {
+        data[firstVertex + remap[vertex]] = original[vertex];
+    }
+}
+
+// Bytes per vertex of the streams that Scene::FinishedLoading uploads for the buffer group.
+uint32_t GetVertexStride(const engine::BufferGroup& buffers) {
+    uint32_t stride = 0;
+    stride += buffers.positionData.empty() ? 0 : uint32_t(sizeof(float3));
+    stride += buffers.texcoord1Data.empty() ? 0 : uint32_t(sizeof(float2));
+    stride += buffers.texcoord2Data.empty() ? 0 : uint32_t(sizeof(float2));
+    stride += buffers.normalData.empty() ? 0 : uint32_t(sizeof(uint32_t));
+    stride += buffers.tangentData.empty() ? 0 : uint32_t(sizeof(uint32_t));
+    stride += buffers.jointData.empty() ? 0 : uint32_t(sizeof(uint4));
+    stride += buffers.weightData.empty() ? 0 : uint32_t(sizeof(float4));
+    return stride;
+}
+
+bool HasTriangleData(const engine::MeshInfo& mesh) {
+    return mesh.buffers && mesh.type == engine::MeshType::Triangles && !mesh.buffers->indexData.empty() && !mesh.buffers->positionData.empty();
+}
+
+bool HasValidRange(const engine::MeshInfo& mesh, const engine::MeshGeometry& geometry) {
+    const engine::BufferGroup& buffers = *mesh.buffers;
+    const size_t firstIndex = size_t(mesh.indexOffset) + geometry.indexOffsetInMesh;
+    const size_t firstVertex = size_t(mesh.vertexOffset) + geometry.vertexOffsetInMesh;
+    if (geometry.type != engine::MeshGeometryPrimitiveType::Triangles || firstIndex + geometry.numIndices > buffers.indexData.size()
+        || firstVertex + geometry.numVertices > buffers.positionData.size()) {
+        return false;
+    }
+    const uint32_t* indices = buffers.indexData.data() + firstIndex;
+    const uint32_t vertexCount = geometry.numVertices;
+    return std::all_of(indices, indices + geometry.numIndices, [vertexCount](uint32_t index) { return index < vertexCount; });
+}
+
+// Sum of squared distances to a set of planes, weighted by the area of the triangles they come from.
+struct Quadric {
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    void AddPlane(const double3& normal, double distance, double area) {
+        a00 += area * normal.x * normal.x;
+        a01 += area * normal.x * normal.y;
+        a02 += area * normal.x * normal.z;
+        a11 += area * normal.y * normal.y;
+        a12 += area * normal.y * normal.z;
+        a22 += area * normal.z * normal.z;
+        b0 += area * normal.x * distance;
+        b1 += area * normal.y * distance;
+        b2 += area * normal.z * distance;
+        c += area * distance * distance;
+        weight += area;
+    }
+
+    Quadric& operator+=(const Quadric& q) {
+        a00 += q.a00, a01 += q.a01, a02 += q.a02, a11 += q.a11, a12 += q.a12, a22 += q.a22;
+        b0 += q.b0, b1 += q.b1, b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+
+    // Mean squared distance of the point to the planes.
+    [[nodiscard]] double Evaluate(const float3& point) const {
+        const double x = point.x, y = point.y, z = point.z;
+        const double sum = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                         + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+    }
+};
+
+struct EdgeCollapse {
+    uint32_t from;
+    uint32_t to;
+    float cost;
+};
+
+MeshProcessingReport MeasureMesh(const engine::MeshInfo& mesh) {
+    MeshProcessingReport report;
+    report.mesh = &mesh;
+    report.name = mesh.name;
+    report.vertices = mesh.totalVertices;
+    report.triangles = mesh.totalIndices / 3;
+    report.vertexBytesBefore = uint64_t(mesh.totalVertices) * GetVertexStride(*mesh.buffers);
+    report.vertexBytesAfter = report.vertexBytesBefore;
+
+    double misses = 0.0;
+    uint32_t triangles = 0;
+    for (const auto& geometry : mesh.geometries) {
+        if (HasValidRange(mesh, *geometry)) {
+            const uint32_t* indices = mesh.buffers->indexData.data() + mesh.indexOffset + geometry->indexOffsetInMesh;
+            misses += double(ComputeAcmr(indices, geometry->numIndices, geometry->numVertices)) * (geometry->numIndices / 3);
+            triangles += geometry->numIndices / 3;
+        }
+    }
+    report.acmrBefore = triangles ? float(misses / double(triangles)) : 0.f;
+    return report;
+}
+
+} // namespace
+
+float ComputeAcmr(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return 0.f;
+    }
+
+    // A vertex is in the FIFO if fewer than cacheSize misses happened since it was loaded.
+    std::vector<uint32_t> loadTime(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (size_t index = 0; index < triangleCount * 3; index++) {
+        const uint32_t vertex = indices[index];
+        if (time - loadTime[vertex] > cacheSize) {
+            loadTime[vertex] = time++;
+            misses++;
+        }
+    }
+    return float(double(misses) / double(triangleCount));
+}
+
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, uint32_t vertexCount) {
+    const uint32_t triangleCount = uint32_t(indexCount / 3);
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // Live triangles of every vertex; emitted triangles are swapped out of the front of each list.
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t index = 0; index < size_t(triangleCount) * 3; index++) {
+        remaining[indices[index]]++;
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    std::partial_sum(remaining.begin(), remaining.end(), adjacencyOffsets.begin() + 1);
+    std::vector<uint32_t> adjacency(size_t(triangleCount) * 3);
+    {
+        std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                adjacency[cursor[indices[triangle * 3 + corner]]++] = triangle;
+            }
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+        vertexScore[vertex] = GetVertexScore(-1, remaining[vertex]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+        triangleScore[triangle]
+            = vertexScore[indices[triangle * 3]] + vertexScore[indices[triangle * 3 + 1]] + vertexScore[indices[triangle * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> output;
+    output.reserve(size_t(triangleCount) * 3);
+    std::vector<uint32_t> cache;
+    std::vector<uint32_t> nextCache;
+
+    uint32_t bestTriangle = uint32_t(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    uint32_t scanCursor = 0;
+
+    for (uint32_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        if (bestTriangle == c_InvalidIndex) {
+            // Nothing left next to the cache: continue with the next triangle in input order.
+            while (emitted[scanCursor]) {
+                scanCursor++;
+            }
+            bestTriangle = scanCursor;
+        }
+
+        const uint32_t* triangleVertices = indices + size_t(bestTriangle) * 3;
+        emitted[bestTriangle] = true;
+        nextCache.assign(triangleVertices, triangleVertices + 3);
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            const uint32_t vertex = triangleVertices[corner];
+            output.push_back(vertex);
+
+            uint32_t* list = adjacency.data() + adjacencyOffsets[vertex];
+            uint32_t* end = list + remaining[vertex];
+            uint32_t* found = std::find(list, end, bestTriangle);
+            if (found != end) {
+                std::swap(*found, *(end - 1));
+                remaining[vertex]--;
+            }
+        }
+
+        for (uint32_t vertex : cache) {
+            if (vertex != triangleVertices[0] && vertex != triangleVertices[1] && vertex != triangleVertices[2]) {
+                nextCache.push_back(vertex);
+            }
+        }
+
+        // Rescore the vertices that were or are in the cache and propagate the change to their live triangles.
+        for (uint32_t position = 0; position < uint32_t(nextCache.size()); position++) {
+            const uint32_t vertex = nextCache[position];
+            cachePosition[vertex] = position < c_ForsythCacheSize ? int(position) : -1;
+
+            const float score = GetVertexScore(cachePosition[vertex], remaining[vertex]);
+            const float delta = score - vertexScore[vertex];
+            vertexScore[vertex] = score;
+            for (uint32_t entry = 0; entry < remaining[vertex]; entry++) {
+                triangleScore[adjacency[adjacencyOffsets[vertex] + entry]] += delta;
+            }
+        }
+        if (nextCache.size() > c_ForsythCacheSize) {
+            nextCache.resize(c_ForsythCacheSize);
+        }
+        cache.swap(nextCache);
+
+        bestTriangle = c_InvalidIndex;
+        float bestScore = -1.f;
+        for (uint32_t vertex : cache) {
+            for (uint32_t entry = 0; entry < remaining[vertex]; entry++) {
+                const uint32_t triangle = adjacency[adjacencyOffsets[vertex] + entry];
+                if (triangleScore[triangle] > bestScore) {
+                    bestScore = triangleScore[triangle];
+                    bestTriangle = triangle;
+                }
+            }
+        }
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const float3* positions, uint32_t vertexCount) {
+    const uint32_t triangleCount = uint32_t(indexCount / 3);
+    if (triangleCount < 2) {
+        return;
+    }
+
+    // Clusters start where the cache-optimized order restarts with a triangle of three misses.
+    std::vector<uint32_t> clusterStarts;
+    {
+        std::vector<uint32_t> loadTime(vertexCount, 0);
+        uint32_t time = c_AcmrCacheSize + 1;
+        for (uint32_t triangle = 0; triangle < triangleCount; triangle++) {
+            uint32_t misses = 0;
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                const uint32_t vertex = indices[triangle * 3 + corner];
+                if (time - loadTime[vertex] > c_AcmrCacheSize) {
+                    loadTime[vertex] = time++;
+                    misses++;
+                }
+            }
+            if (misses == 3 || triangle == 0) {
+                clusterStarts.push_back(triangle);
+            }
+        }
+    }
+    const uint32_t clusterCount = uint32_t(clusterStarts.size());
+    if (clusterCount < 2) {
+        return;
+    }
+    clusterStarts.push_back(triangleCount);
+
+    // Area-weighted centroid and normal of every cluster, and the centroid of the whole geometry.
+    std::vector<float3> clusterCentroids(clusterCount, float3(0.f));
+    std::vector<float3> clusterNormals(clusterCount, float3(0.f));
+    std::vector<float> clusterAreas(clusterCount, 0.f);
+    float3 meshCentroid = 0.f;
+    float meshArea = 0.f;
+    for (uint32_t cluster = 0; cluster < clusterCount; cluster++) {
+        for (uint32_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; triangle++) {
+            const float3& p0 = positions[indices[triangle * 3]];
+            const float3& p1 = positions[indices[triangle * 3 + 1]];
+            const float3& p2 = positions[indices[triangle * 3 + 2]];
+            const float3 normal = cross(p1 - p0, p2 - p0);
+            const float area = length(normal);
+            const float3 centroid = (p0 + p1 + p2) * (area / 3.f);
+
+            clusterCentroids[cluster] += centroid;
+            clusterNormals[cluster] += normal;
+            clusterAreas[cluster] += area;
+            meshCentroid += centroid;
+            meshArea += area;
+        }
+    }
+    if (meshArea > 0.f) {
+        meshCentroid /= meshArea;
+    }
+
+    std::vector<float> sortKeys(clusterCount, 0.f);
+    for (uint32_t cluster = 0; cluster < clusterCount; cluster++) {
+        const float normalLength = length(clusterNormals[cluster]);
+        if (clusterAreas[cluster] > 0.f && normalLength > 0.f) {
+            const float3 centroid = clusterCentroids[cluster] / clusterAreas[cluster];
+            sortKeys[cluster] = dot(centroid - meshCentroid, clusterNormals[cluster] / normalLength);
+        }
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> reordered;
+    reordered.reserve(size_t(triangleCount) * 3);
+    for (uint32_t cluster : order) {
+        reordered.insert(reordered.end(), indices + size_t(clusterStarts[cluster]) * 3, indices + size_t(clusterStarts[cluster + 1]) * 3);
+    }
+    std::copy(reordered.begin(), reordered.end(), indices);
+}
+
+std::vector<uint32_t> OptimizeVertexFetch(uint32_t* indices, size_t indexCount, uint32_t vertexCount) {
+    std::vector<uint32_t> remap(vertexCount, c_InvalidIndex);
+    uint32_t nextVertex = 0;
+    for (size_t index = 0; index < indexCount; index++) {
+        uint32_t& vertex = indices[index];
+        if (remap[vertex] == c_InvalidIndex) {
+            remap[vertex] = nextVertex++;
+        }
+        vertex = remap[vertex];
+    }
+    for (uint32_t& vertex : remap) {
+        if (vertex == c_InvalidIndex) {
+            vertex = nextVertex++;
+        }
+    }
+    return remap;
+}
+
+float SimplifyTriangles(const uint32_t* indices, size_t indexCount, const float3* positions, uint32_t vertexCount, size_t targetIndexCount,
+                        float maxError, std::vector<uint32_t>& result) {
+    result.assign(indices, indices + indexCount / 3 * 3);
+    size_t triangleCount = result.size() / 3;
+    const size_t targetTriangles = targetIndexCount / 3;
+    if (triangleCount <= targetTriangles) {
+        return 0.f;
+    }
+
+    // Vertices that share a position are split by a UV or normal seam; they are merged by sorting.
+    std::vector<uint32_t> positionIds(vertexCount);
+    std::vector<uint8_t> locked(vertexCount, 0);
+    {
+        std::vector<uint32_t> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0u);
+        const auto less = [positions](uint32_t a, uint32_t b) {
+            const float3& pa = positions[a];
+            const float3& pb = positions[b];
+            return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+        };
+        std::sort(order.begin(), order.end(), less);
+        for (size_t first = 0; first < order.size();) {
+            size_t last = first + 1;
+            while (last < order.size() && !less(order[first], order[last])) {
+                last++;
+            }
+            for (size_t i = first; i < last; i++) {
+                positionIds[order[i]] = order[first];
+                locked[order[i]] = last - first > 1;
+            }
+            first = last;
+        }
+    }
+
+    // Edges that are not shared by exactly two triangles are borders or non-manifold; both ends stay.
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(result.size());
+        for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+            for (uint32_t corner = 0; corner < 3; corner++) {
+                const uint32_t a = positionIds[result[triangle * 3 + corner]];
+                const uint32_t b = positionIds[result[triangle * 3 + (corner + 1) % 3]];
+                edges.push_back(uint64_t(std::min(a, b)) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        std::vector<uint8_t> lockedPositions(vertexCount, 0);
+        for (size_t first = 0; first < edges.size();) {
+            size_t last = first + 1;
+            while (last < edges.size() && edges[last] == edges[first]) {
+                last++;
+            }
+            if (last - first != 2) {
+                lockedPositions[edges[first] >> 32] = 1;
+                lockedPositions[edges[first] & 0xffffffffu] = 1;
+            }
+            first = last;
+        }
+        for (uint32_t vertex = 0; vertex < vertexCount; vertex++) {
+            locked[vertex] |= lockedPositions[positionIds[vertex]];
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t triangle = 0; triangle < triangleCount; triangle++) {
+        const float3& p0 = positions[result[triangle * 3]];
+        const float3 normal = cross(positions[result[triangle * 3 + 1]] - p0, positions[result[triangle * 3 + 2]] - p0);
+        const float doubleArea = length(normal);
+        if (doubleArea <= 0.f) {
+            continue;
+        }
+        const double3 unitNormal = double3(normal / doubleArea);
+        Quadric plane;
+        plane.AddPlane(unitNormal, -(unitNormal.x * p0.x + unitNormal.y * p0.y + unitNormal.z * p0.z), 0.5 * doubleArea);
+        for (uint32_t corner = 0; corner < 3; corner++) {
+            quadrics[result[triangle * 3 + corner]] += plane;
+        }
+    }
+
+    // Each pass collapses the cheapest edges whose neighborhoods do not overlap, so that the flip test
+    // and the adjacency of the pass stay valid, then compacts the triangles and starts over.
+    const float maxCost = maxError * maxError;
+    float resultCost = 0.f;
+    std::vector<uint32_t> adjacencyOffsets;
+    std::vector<uint32_t> adjacency;
+    std::vector<EdgeCollapse> collapses;
+    std::vector<uint8_t> touched;
+    std::vector<uint8_t> removed;
+    while (triangleCount > targetTriangles) {
+        adjacencyOffsets.assign(vertexCount + 1, 0);
+        for (uint32_t vertex : result) {
+            adjacencyOffsets[vertex + 1]++;
+        }
+        std::partial_sum(adjacencyOffsets.begin(), adjacencyOffsets.end(), adjacencyOffsets.begin());
+        adjacency.resize(result.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t index = 0; index < result.size(); index++) {
+                adjacency[fill[result[index]]++] = uint32_t(index / 3);
+            }
+        }
+
+        // Interior edges appear once in each direction, one per adjacent triangle.
+        collapses.clear();
+        for (size_t index = 0; index < result.size(); index++) {
+            const uint32_t from = result[index];
+            const uint32_t to = result[index - index % 3 + (index + 1) % 3];
+            if (!locked[from]) {
+                Quadric quadric = quadrics[from];
+                quadric += quadrics[to];
+                collapses.push_back({from, to, float(quadric.Evaluate(positions[to]))});
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const EdgeCollapse& a, const EdgeCollapse& b) { return a.cost < b.cost; });
+
+        touched.assign(vertexCount, 0);
+        removed.assign(triangleCount, 0);
+        size_t collapsed = 0;
+        for (const EdgeCollapse& collapse : collapses) {
+            if (collapse.cost > maxCost || triangleCount <= targetTriangles) {
+                break;
+            }
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            const float3& target = positions[collapse.to];
+            bool flips = false;
+            for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1] && !flips; i++) {
+                const uint32_t* triangle = &result[size_t(adjacency[i]) * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                    continue;
+                }
+                const uint32_t corner = triangle[0] == collapse.from ? 0 : triangle[1] == collapse.from ? 1 : 2;
+                const float3& p1 = positions[triangle[(corner + 1) % 3]];
+                const float3& p2 = positions[triangle[(corner + 2) % 3]];
+                const float3& p0 = positions[collapse.from];
+                flips = dot(cross(p1 - p0, p2 - p0), cross(p1 - target, p2 - target)) <= 0.f;
+            }
+            if (flips) {
+                continue;
+            }
+
+            for (uint32_t i = adjacencyOffsets[collapse.from]; i < adjacencyOffsets[collapse.from + 1]; i++) {
+                const uint32_t triangleIndex = adjacency[i];
+                uint32_t* triangle = &result[size_t(triangleIndex) * 3];
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = 1;
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to) {
+                    removed[triangleIndex] = 1;
+                    triangleCount--;
+                } else {
+                    std::replace(triangle, triangle + 3, collapse.from, collapse.to);
+                }
+            }
+            quadrics[collapse.to] += quadrics[collapse.from];
+            resultCost = std::max(resultCost, collapse.cost);
+            collapsed++;
+        }
+        if (collapsed == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t triangle = 0; triangle < removed.size(); triangle++) {
+            if (!removed[triangle]) {
+                std::copy_n(&result[triangle * 3], 3, &result[write]);
+                write += 3;
+            }
+        }
+        result.resize(write);
+    }
+    return std::sqrt(resultCost);
+}
+
+std::vector<MeshProcessingReport> MeasureSceneMeshes(const engine::SceneGraph& sceneGraph) {
+    std::vector<MeshProcessingReport> reports;
+    for (const auto& mesh : sceneGraph.GetMeshes()) {
+        if (HasTriangleData(*mesh)) {
+            MeshProcessingReport report = MeasureMesh(*mesh);
+            report.acmrAfter = report.acmrBefore;
+            reports.push_back(std::move(report));
+        }
+    }
+    return reports;
+}
+
+std::vector<MeshProcessingReport> OptimizeSceneMeshes(engine::SceneGraph& sceneGraph) {
+    std::vector<MeshProcessingReport> reports;
+
+    for (const auto& mesh : sceneGraph.GetMeshes()) {
+        if (!HasTriangleData(*mesh)) {
+            continue;
+        }
+        MeshProcessingReport report = MeasureMesh(*mesh);
+
+        engine::BufferGroup& buffers = *mesh->buffers;
+        const bool optimizable = !mesh->skinPrototype && !mesh->isMorphTargetAnimationMesh && buffers.jointData.empty();
+        for (const auto& geometry : mesh->geometries) {
+            if (!optimizable || !HasValidRange(*mesh, *geometry)) {
+                continue;
+            }
+
+            // Geometry indices are relative to the geometry's first vertex, and geometries do not share vertices.
+            uint32_t* indices = buffers.indexData.data() + mesh->indexOffset + geometry->indexOffsetInMesh;
+            const uint32_t firstVertex = mesh->vertexOffset + geometry->vertexOffsetInMesh;
+            const size_t indexCount = geometry->numIndices;
+            const uint32_t vertexCount = geometry->numVertices;
+
+            OptimizeVertexCache(indices, indexCount, vertexCount);
+            OptimizeOverdraw(indices, indexCount, buffers.positionData.data() + firstVertex, vertexCount);
+            const std::vector<uint32_t> remap = OptimizeVertexFetch(indices, indexCount, vertexCount);
+
+            PermuteVertices(buffers.positionData, firstVertex, remap);
+            PermuteVertices(buffers.texcoord1Data, firstVertex, remap);
+            PermuteVertices(buffers.texcoord2Data, firstVertex, remap);
+            PermuteVertices(buffers.normalData, firstVertex, remap);
+            PermuteVertices(buffers.tangentData, firstVertex, remap);
+            PermuteVertices(buffers.weightData, firstVertex, remap);
+            PermuteVertices(buffers.radiusData, firstVertex, remap);
+        }
+
+        report.acmrAfter = MeasureMesh(*mesh).acmrBefore;
+        reports.push_back(std::move(report));
+    }
+
+    return reports;
+}
+
+MeshProcessingReport SummarizeMeshReports(const std::vector<MeshProcessingReport>& reports) {
+    MeshProcessingReport total;
+    total.name = "total";
+    double missesBefore = 0.0;
+    double missesAfter = 0.0;
+
+    for (const MeshProcessingReport& report : reports) {
+        log::info("Mesh %s: %u triangles, %u vertices, ACMR %.3f -> %.3f, vertex data %.1f -> %.1f KB", report.name.c_str(), report.triangles,
+            report.vertices, report.acmrBefore, report.acmrAfter, double(report.vertexBytesBefore) / 1024.0,
+            double(report.vertexBytesAfter) / 1024.0);
+
+        total.triangles += report.triangles;
+        total.vertices += report.vertices;
+        total.vertexBytesBefore += report.vertexBytesBefore;
+        total.vertexBytesAfter += report.vertexBytesAfter;
+        missesBefore += double(report.acmrBefore) * report.triangles;
+        missesAfter += double(report.acmrAfter) * report.triangles;
+    }
+
+    if (total.triangles > 0) {
+        total.acmrBefore = float(missesBefore / double(total.triangles));
+        total.acmrAfter = float(missesAfter / double(total.triangles));
+    }
+    log::info("Meshes: %u, ACMR %.3f -> %.3f, vertex data %.2f -> %.2f MB", uint32_t(reports.size()), total.acmrBefore, total.acmrAfter,
+        double(total.vertexBytesBefore) / double(1 << 20), double(total.vertexBytesAfter) / double(1 << 20));
+    return total;
+}
+
+} // namespace sanbox
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/engine/SceneGraph.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sanbox {
+
+// Entries of the post-transform cache that ACMR is measured with, a FIFO as in most current hardware models.
+constexpr uint32_t c_AcmrCacheSize = 16;
+
+// Average cache miss ratio: transformed vertices per triangle for a FIFO cache of cacheSize entries.
+// 3 is the worst case, 0.5 the limit for a large regular grid.
+float ComputeAcmr(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = c_AcmrCacheSize);
+
+// Reorders the triangles for the post-transform cache with Forsyth's linear-speed algorithm.
+void OptimizeVertexCache(uint32_t* indices, size_t indexCount, uint32_t vertexCount);
+
+// Reorders the clusters that a cache-optimized index list naturally falls into, those that start with a
+// triangle whose vertices are all cache misses, so that clusters facing away from the mesh center are
+// drawn first and occlude the rest. Keeps the order inside clusters, so ACMR barely changes.
+void OptimizeOverdraw(uint32_t* indices, size_t indexCount, const dm::float3* positions, uint32_t vertexCount);
+
+// Returns the new index of every vertex so that vertices are stored in the order the indices first use
+// them; unreferenced vertices go to the end. Rewrites the indices accordingly.
+std::vector<uint32_t> OptimizeVertexFetch(uint32_t* indices, size_t indexCount, uint32_t vertexCount);
+
+// Collapses edges in the order of their quadric error, keeping the vertex they collapse onto, until at most
+// targetIndexCount indices are left or the next collapse would move the surface by more than maxError.
+// Vertices on borders and on UV or normal seams, where several vertices share a position, do not move, so
+// the result needs no new vertices and keeps the outline of open meshes. Returns the largest error it
+// accepted, in the units of the positions.
+float SimplifyTriangles(const uint32_t* indices, size_t indexCount, const dm::float3* positions, uint32_t vertexCount, size_t targetIndexCount,
+                        float maxError, std::vector<uint32_t>& result);
+
+struct MeshProcessingReport {
+    const donut::engine::MeshInfo* mesh = nullptr;
+    std::string name;
+    uint32_t triangles = 0;
+    uint32_t vertices = 0;
+    float acmrBefore = 0.f;
+    float acmrAfter = 0.f;
+    // Bytes of vertex data the mesh uploads, as donut lays it out and after quantization if it is enabled.
+    uint64_t vertexBytesBefore = 0;
+    uint64_t vertexBytesAfter = 0;
+};
+
+// Measures the triangle meshes of the graph as they are, with the same values before and after.
+std::vector<MeshProcessingReport> MeasureSceneMeshes(const donut::engine::SceneGraph& sceneGraph);
+
+// Optimizes the index and vertex order of every geometry of the static triangle meshes in the graph, in the
+// CPU copies of their buffer groups. Must run before Scene::FinishedLoading creates the GPU buffers.
+// Skinned and morph target meshes are left alone. Returns one report per triangle mesh.
+std::vector<MeshProcessingReport> OptimizeSceneMeshes(donut::engine::SceneGraph& sceneGraph);
+
+// Logs one line per mesh and returns the totals, with the ACMR weighted by triangle count.
+MeshProcessingReport SummarizeMeshReports(const std::vector<MeshProcessingReport>& reports);
+
+} // namespace sanbox
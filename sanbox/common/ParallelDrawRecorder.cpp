@@ -0,0 +1,102 @@
+#include "ParallelDrawRecorder.h"
+
+#include <algorithm>
+
+#include "FramePipeline.h"
+
+using namespace donut;
+
+namespace sanbox {
+
+ParallelDrawRecorder::ParallelDrawRecorder(nvrhi::IDevice* device, JobSystem* jobSystem, uint32_t framesInFlight)
+    : m_Device(device)
+    , m_JobSystem(jobSystem) {
+    m_CommandLists.resize(std::clamp(framesInFlight, 1u, FramePipeline::c_MaxFramesInFlight));
+    m_Items.reserve(4096);
+}
+
+void ParallelDrawRecorder::Gather(const std::shared_ptr<engine::SceneGraphNode>& rootNode, render::IDrawStrategy& drawStrategy,
+    const engine::IView& view) {
+    m_Items.clear();
+
+    drawStrategy.PrepareForView(rootNode, view);
+    while (const engine::DrawItem* item = drawStrategy.GetNextItem()) {
+        m_Items.push_back(*item);
+    }
+}
+
+void ParallelDrawRecorder::SplitChunks(uint32_t frameSlot) {
+    m_Chunks.clear();
+    m_RecordedLists.clear();
+    m_ChunkStatistics.clear();
+
+    if (m_Items.empty()) {
+        return;
+    }
+
+    // Twice as many chunks as threads gives the work-stealing queues something to balance with.
+    const size_t maxChunks = GetMaxCommandListsPerFrame();
+    const size_t chunkCount = std::clamp<size_t>(m_Items.size() / c_MinDrawsPerChunk, 1, maxChunks);
+    const size_t chunkSize = (m_Items.size() + chunkCount - 1) / chunkCount;
+
+    size_t begin = 0;
+    while (begin < m_Items.size()) {
+        size_t end = std::min(begin + chunkSize, m_Items.size());
+
+        // RenderDrawItems merges consecutive items of the same geometry into one instanced draw,
+        // so do not cut such a run in two.
+        while (end < m_Items.size() && m_Items[end].geometry == m_Items[end - 1].geometry) {
+            end++;
+        }
+
+        m_Chunks.push_back({begin, end});
+        begin = end;
+    }
+
+    std::vector<nvrhi::CommandListHandle>& lists = m_CommandLists[frameSlot % m_CommandLists.size()];
+    while (lists.size() < m_Chunks.size()) {
+        // Deferred lists may be open on several threads at once; immediate ones may not.
+        lists.push_back(m_Device->createCommandList(nvrhi::CommandListParameters().setEnableImmediateExecution(false)));
+    }
+
+    for (size_t i = 0; i < m_Chunks.size(); i++) {
+        m_RecordedLists.push_back(lists[i]);
+    }
+    m_ChunkStatistics.assign(m_Chunks.size(), {});
+}
+
+void ParallelDrawRecorder::WarmPassCaches(render::IGeometryPass& pass, render::GeometryPassContext& context, nvrhi::IFramebuffer* framebuffer) {
+    // The passes create pipelines and binding sets lazily into caches that are not safe to insert into
+    // from several threads. Touching every new material and buffer group here means the jobs only ever look them up.
+    nvrhi::GraphicsState state;
+    // Pipelines are created for the framebuffer's formats.
+    state.framebuffer = framebuffer;
+
+    for (const engine::DrawItem& item : m_Items) {
+        if (m_WarmBuffers.insert(item.buffers).second) {
+            pass.SetupInputBuffers(context, item.buffers, state);
+        }
+        if (m_WarmMaterials.emplace(item.material, item.cullMode).second) {
+            pass.SetupMaterial(context, item.material, item.cullMode, state);
+        }
+    }
+}
+
+void ParallelDrawRecorder::RecordChunk(nvrhi::ICommandList* commandList, const Chunk& chunk, render::IGeometryPass& pass,
+    render::GeometryPassContext& context, const engine::IView* view, const engine::IView* viewPrev, nvrhi::IFramebuffer* framebuffer,
+    DrawSubmissionStatistics& statistics) {
+    render::PassthroughDrawStrategy drawStrategy;
+    drawStrategy.SetData(m_Items.data() + chunk.begin, chunk.end - chunk.begin);
+
+    // Each list starts from unknown resource states; the framebuffer transition is cheap and
+    // keeps the per-draw barrier tracking out of the hot loop.
+    commandList->setEnableAutomaticBarriers(false);
+    commandList->setResourceStatesForFramebuffer(framebuffer);
+    commandList->commitBarriers();
+
+    RenderDrawItems(commandList, view, viewPrev, framebuffer, drawStrategy, pass, context, statistics, &m_BindingSets);
+
+    commandList->setEnableAutomaticBarriers(true);
+}
+
+} // namespace sanbox
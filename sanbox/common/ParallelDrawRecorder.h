@@ -0,0 +1,128 @@
+#pragma once
+
+#include <donut/engine/SceneTypes.h>
+#include <donut/engine/View.h>
+#include <donut/render/DrawStrategy.h>
+#include <donut/render/GeometryPasses.h>
+#include <nvrhi/nvrhi.h>
+
+#include <memory>
+#include <set>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "DrawSubmission.h"
+#include "JobSystem.h"
+
+namespace sanbox {
+
+// Records the draws of one geometry pass on several threads. The draw list of a view is gathered
+// once on the calling thread, cut into chunks, and each chunk is recorded by a job into its own
+// command list. The lists come back in draw order and must be submitted between the lists that
+// record the work before and after the pass.
+class ParallelDrawRecorder {
+public:
+    // Chunks never hold fewer draws than this, so small scenes do not pay for idle command lists.
+    static constexpr uint32_t c_MinDrawsPerChunk = 64;
+
+    ParallelDrawRecorder(nvrhi::IDevice* device, JobSystem* jobSystem, uint32_t framesInFlight);
+
+    // Collects the draw items produced by the strategy for the view.
+    void Gather(const std::shared_ptr<donut::engine::SceneGraphNode>& rootNode, donut::render::IDrawStrategy& drawStrategy,
+        const donut::engine::IView& view);
+
+    // Records the gathered draws with the pass. Each job creates a TContext and calls
+    // prepare(commandList, context) on its own command list before drawing, which is where per-list
+    // state such as volatile constant buffers has to be written. The pass must tolerate concurrent
+    // SetupMaterial/SetupInputBuffers calls once its caches are warm; the warm-up runs here, serially,
+    // on mainCommandList.
+    template <typename TContext, typename TPrepare>
+    void Record(uint32_t frameSlot, nvrhi::ICommandList* mainCommandList, donut::render::IGeometryPass& pass, const donut::engine::IView* view,
+        const donut::engine::IView* viewPrev, nvrhi::IFramebuffer* framebuffer, TPrepare&& prepare);
+
+    // Must be called whenever the pass's binding caches are reset, so the next Record warms them again.
+    void ResetPassCaches() {
+        m_WarmBuffers.clear();
+        m_WarmMaterials.clear();
+        m_BindingSets.Reset();
+    }
+
+    // Command lists recorded by the last call to Record, in submission order.
+    [[nodiscard]] const std::vector<nvrhi::ICommandList*>& GetCommandLists() const {
+        return m_RecordedLists;
+    }
+    [[nodiscard]] size_t GetDrawCount() const {
+        return m_Items.size();
+    }
+    // Of the last call to Record, summed over its command lists.
+    [[nodiscard]] const DrawSubmissionStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+    [[nodiscard]] uint32_t GetThreadCount() const {
+        return m_JobSystem->GetThreadCount();
+    }
+    // Upper bound on the lists recorded per frame, each of which writes the pass's volatile constant buffers.
+    [[nodiscard]] uint32_t GetMaxCommandListsPerFrame() const {
+        return m_JobSystem->GetThreadCount() * 2;
+    }
+
+private:
+    struct Chunk {
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    void SplitChunks(uint32_t frameSlot);
+    void WarmPassCaches(donut::render::IGeometryPass& pass, donut::render::GeometryPassContext& context, nvrhi::IFramebuffer* framebuffer);
+    void RecordChunk(nvrhi::ICommandList* commandList, const Chunk& chunk, donut::render::IGeometryPass& pass,
+        donut::render::GeometryPassContext& context, const donut::engine::IView* view, const donut::engine::IView* viewPrev,
+        nvrhi::IFramebuffer* framebuffer, DrawSubmissionStatistics& statistics);
+
+    nvrhi::DeviceHandle m_Device;
+    JobSystem* m_JobSystem;
+    std::vector<std::vector<nvrhi::CommandListHandle>> m_CommandLists;
+    std::vector<nvrhi::ICommandList*> m_RecordedLists;
+    std::vector<donut::engine::DrawItem> m_Items;
+    std::vector<Chunk> m_Chunks;
+    std::vector<DrawSubmissionStatistics> m_ChunkStatistics;
+    DrawSubmissionStatistics m_Statistics;
+    BindingSetTracker m_BindingSets;
+
+    std::unordered_set<const donut::engine::BufferGroup*> m_WarmBuffers;
+    std::set<std::pair<const donut::engine::Material*, nvrhi::RasterCullMode>> m_WarmMaterials;
+};
+
+template <typename TContext, typename TPrepare>
+void ParallelDrawRecorder::Record(uint32_t frameSlot, nvrhi::ICommandList* mainCommandList, donut::render::IGeometryPass& pass,
+    const donut::engine::IView* view, const donut::engine::IView* viewPrev, nvrhi::IFramebuffer* framebuffer, TPrepare&& prepare) {
+    SplitChunks(frameSlot);
+    m_Statistics = {};
+    if (m_Chunks.empty()) {
+        return;
+    }
+
+    {
+        TContext context;
+        prepare(mainCommandList, context);
+        pass.SetupView(context, mainCommandList, view, viewPrev);
+        WarmPassCaches(pass, context, framebuffer);
+    }
+
+    m_JobSystem->ParallelFor(uint32_t(m_Chunks.size()), [&](uint32_t chunkIndex, uint32_t) {
+        nvrhi::ICommandList* commandList = m_RecordedLists[chunkIndex];
+        commandList->open();
+
+        TContext context;
+        prepare(commandList, context);
+        RecordChunk(commandList, m_Chunks[chunkIndex], pass, context, view, viewPrev, framebuffer, m_ChunkStatistics[chunkIndex]);
+
+        commandList->close();
+    });
+
+    for (const DrawSubmissionStatistics& statistics : m_ChunkStatistics) {
+        m_Statistics += statistics;
+    }
+}
+
+} // namespace sanbox
@@ -0,0 +1,189 @@
+#include "PipelineCache.h"
+
+#include <donut/core/log.h>
+
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#include "ContentHash.h"
+#include "MappedFile.h"
+
+using namespace donut;
+
+namespace sanbox {
+
+namespace {
+
+constexpr uint32_t c_PipelineFileMagic = 0x50434253; // "SBCP"
+constexpr uint32_t c_PipelineFileVersion = 1;
+
+struct PipelineFileHeader {
+    uint32_t magic = c_PipelineFileMagic;
+    uint32_t version = c_PipelineFileVersion;
+    uint32_t entryCount = 0;
+    uint32_t reserved = 0;
+};
+
+struct PipelineFileEntry {
+    uint64_t pass = 0;
+    uint64_t framebuffer = 0;
+    uint64_t shaders = 0;
+    uint32_t key = 0;
+    uint32_t reserved = 0;
+};
+
+uint64_t HashPass(std::string_view pass) {
+    ContentHash hash;
+    hash.Add(pass.data(), pass.size());
+    return hash.Get();
+}
+
+// The formats only; a resize keeps the pipelines.
+uint64_t HashFramebuffer(const nvrhi::FramebufferInfo& framebufferInfo) {
+    ContentHash hash;
+    for (nvrhi::Format format : framebufferInfo.colorFormats) {
+        hash.Add(&format, sizeof(format));
+    }
+    const uint32_t values[] = {uint32_t(framebufferInfo.colorFormats.size()), uint32_t(framebufferInfo.depthFormat),
+        framebufferInfo.sampleCount, framebufferInfo.sampleQuality};
+    hash.Add(values, sizeof(values));
+    return hash.Get();
+}
+
+uint64_t HashShaders(const nvrhi::GraphicsPipelineDesc& desc) {
+    ContentHash hash;
+    for (nvrhi::IShader* shader : {desc.VS.Get(), desc.PS.Get()}) {
+        const void* bytecode = nullptr;
+        size_t size = 0;
+        if (shader) {
+            shader->getBytecode(&bytecode, &size);
+        }
+        hash.Add(&size, sizeof(size));
+        if (bytecode) {
+            hash.Add(bytecode, size);
+        }
+    }
+    return hash.Get();
+}
+
+} // namespace
+
+PipelineCache::PipelineCache(std::filesystem::path fileName)
+    : m_FileName(std::move(fileName)) {
+    if (!m_FileName.empty()) {
+        Load();
+    }
+}
+
+PipelineCache::~PipelineCache() {
+    Save();
+}
+
+void PipelineCache::Load() {
+    MappedFile file;
+    if (!file.Open(m_FileName) || file.GetSize() < sizeof(PipelineFileHeader)) {
+        return;
+    }
+
+    PipelineFileHeader header;
+    memcpy(&header, file.GetData(), sizeof(header));
+    if (header.magic != c_PipelineFileMagic || header.version != c_PipelineFileVersion
+        || file.GetSize() != sizeof(PipelineFileHeader) + size_t(header.entryCount) * sizeof(PipelineFileEntry)) {
+        log::info("Pipeline cache '%s' is from another version, ignoring it", m_FileName.generic_string().c_str());
+        return;
+    }
+
+    for (uint32_t index = 0; index < header.entryCount; index++) {
+        PipelineFileEntry entry;
+        memcpy(&entry, file.GetData() + sizeof(PipelineFileHeader) + index * sizeof(PipelineFileEntry), sizeof(entry));
+        m_Entries[{entry.pass, entry.framebuffer, entry.key}] = entry.shaders;
+    }
+    m_Statistics.loadedEntries = header.entryCount;
+}
+
+bool PipelineCache::Save() {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_FileName.empty() || !m_Changed) {
+        return true;
+    }
+
+    PipelineFileHeader header;
+    header.entryCount = uint32_t(m_Entries.size());
+
+    std::error_code error;
+    std::filesystem::create_directories(m_FileName.parent_path(), error);
+
+    // Written next to the target and renamed, so a reader never maps a partial file.
+    std::filesystem::path temporaryFileName = m_FileName;
+    temporaryFileName += ".tmp";
+    {
+        std::ofstream file(temporaryFileName, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for (const auto& [key, shaders] : m_Entries) {
+            PipelineFileEntry entry;
+            entry.pass = key.pass;
+            entry.framebuffer = key.framebuffer;
+            entry.shaders = shaders;
+            entry.key = key.key;
+            file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        }
+        if (!file.good()) {
+            log::warning("Cannot write pipeline cache '%s'", m_FileName.generic_string().c_str());
+            return false;
+        }
+    }
+    std::filesystem::rename(temporaryFileName, m_FileName, error);
+    if (error) {
+        log::warning("Cannot write pipeline cache '%s'", m_FileName.generic_string().c_str());
+        return false;
+    }
+    m_Changed = false;
+    return true;
+}
+
+std::vector<uint32_t> PipelineCache::GetRecordedKeys(std::string_view pass, const nvrhi::FramebufferInfo& framebufferInfo) const {
+    const uint64_t passHash = HashPass(pass);
+    const uint64_t framebufferHash = HashFramebuffer(framebufferInfo);
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    std::vector<uint32_t> keys;
+    for (const auto& entry : m_Entries) {
+        if (entry.first.pass == passHash && entry.first.framebuffer == framebufferHash) {
+            keys.push_back(entry.first.key);
+        }
+    }
+    return keys;
+}
+
+void PipelineCache::Record(std::string_view pass, uint32_t key, const nvrhi::FramebufferInfo& framebufferInfo,
+    const nvrhi::GraphicsPipelineDesc& desc, double createMs) {
+    const EntryKey entryKey = {HashPass(pass), HashFramebuffer(framebufferInfo), key};
+    const uint64_t shaders = HashShaders(desc);
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Statistics.created++;
+    m_Statistics.createMs += createMs;
+
+    auto [it, inserted] = m_Entries.try_emplace(entryKey, shaders);
+    if (inserted) {
+        m_Changed = true;
+    } else if (it->second != shaders) {
+        it->second = shaders;
+        m_Statistics.changedShaders++;
+        m_Changed = true;
+    }
+}
+
+void PipelineCache::RecordPrecreated(uint32_t count, double precreateMs) {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Statistics.precreated += count;
+    m_Statistics.precreateMs += precreateMs;
+}
+
+PipelineCacheStatistics PipelineCache::GetStatistics() const {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Statistics;
+}
+
+} // namespace sanbox
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace sanbox {
+
+struct PipelineCacheStatistics {
+    // Entries read from the file at startup; a start with none is cold.
+    uint32_t loadedEntries = 0;
+    uint32_t created = 0;
+    // Of the created pipelines, those made from the file's entries before the first frame that needs them.
+    uint32_t precreated = 0;
+    // Pipelines whose shaders differ from the ones the file recorded for them, which the driver has to
+    // compile again.
+    uint32_t changedShaders = 0;
+    double createMs = 0.0;
+    double precreateMs = 0.0;
+};
+
+// The graphics pipelines that passes created, keyed by pass, pipeline key and framebuffer formats, kept on
+// disk so that the next start creates them up front rather than at the first draw that needs each one.
+// Every entry also holds a hash of the pipeline's shader bytecode, so that a start can tell which pipelines
+// are new to the driver's own cache. The driver's pipeline blobs are not reachable through nvrhi, so the
+// file stores what to create rather than the compiled pipelines.
+// Passes may record from several threads; the file is written by Save or on destruction.
+class PipelineCache {
+public:
+    // An empty file name keeps the cache in memory only.
+    explicit PipelineCache(std::filesystem::path fileName);
+    ~PipelineCache();
+
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    // The keys the file recorded for the pass and the framebuffer's formats.
+    [[nodiscard]] std::vector<uint32_t> GetRecordedKeys(std::string_view pass, const nvrhi::FramebufferInfo& framebufferInfo) const;
+
+    // Called by the passes for every pipeline they create, with the time it took.
+    void Record(std::string_view pass, uint32_t key, const nvrhi::FramebufferInfo& framebufferInfo, const nvrhi::GraphicsPipelineDesc& desc,
+        double createMs);
+    void RecordPrecreated(uint32_t count, double precreateMs);
+
+    // Writes the file if a pipeline was recorded since it was read or last written.
+    bool Save();
+
+    [[nodiscard]] PipelineCacheStatistics GetStatistics() const;
+
+private:
+    struct EntryKey {
+        uint64_t pass = 0;
+        uint64_t framebuffer = 0;
+        uint32_t key = 0;
+
+        bool operator==(const EntryKey& other) const {
+            return pass == other.pass && framebuffer == other.framebuffer && key == other.key;
+        }
+    };
+    struct EntryKeyHash {
+        size_t operator()(const EntryKey& entry) const {
+            return size_t(entry.pass ^ (entry.framebuffer * 31) ^ (uint64_t(entry.key) << 17));
+        }
+    };
+
+    void Load();
+
+    std::filesystem::path m_FileName;
+    mutable std::mutex m_Mutex;
+    // Entry to the hash of the pipeline's shader bytecode.
+    std::unordered_map<EntryKey, uint64_t, EntryKeyHash> m_Entries;
+    bool m_Changed = false;
+    PipelineCacheStatistics m_Statistics;
+};
+
+} // namespace sanbox
@@ -0,0 +1,247 @@
+#include "Profiler.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <fstream>
+
+using namespace donut;
+
+namespace sanbox {
+
+Profiler::Profiler(nvrhi::IDevice* device, uint32_t frameLatency, uint32_t maxScopesPerFrame)
+    : m_Device(device)
+    , m_MaxScopesPerFrame(maxScopesPerFrame)
+    , m_StartTime(std::chrono::high_resolution_clock::now()) {
+    m_Slots.resize(std::max(frameLatency, 2u));
+    for (FrameSlot& slot : m_Slots) {
+        slot.scopes.reserve(m_MaxScopesPerFrame);
+        slot.queries.resize(m_MaxScopesPerFrame);
+        for (nvrhi::TimerQueryHandle& query : slot.queries) {
+            query = m_Device->createTimerQuery();
+        }
+    }
+
+    m_OpenScopes.reserve(16);
+    m_GpuFrameHistory.reserve(c_HistoryLength);
+    m_CpuFrameHistory.reserve(c_HistoryLength);
+}
+
+double Profiler::NowUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - m_StartTime).count();
+}
+
+void Profiler::BeginFrame() {
+    FrameSlot& slot = m_Slots[m_FrameNumber % m_Slots.size()];
+    if (slot.pending) {
+        ResolveSlot(slot);
+    }
+
+    slot.frameNumber = m_FrameNumber;
+    slot.pending = true;
+    slot.scopes.clear();
+    slot.queriesUsed = 0;
+    slot.cpuBeginUs = NowUs();
+    m_OpenScopes.clear();
+}
+
+void Profiler::EndFrame() {
+    FrameSlot& slot = m_Slots[m_FrameNumber % m_Slots.size()];
+    if (!m_OpenScopes.empty()) {
+        log::warning("Profiler: %u scopes were left open at the end of the frame", uint32_t(m_OpenScopes.size()));
+    }
+    slot.cpuEndUs = NowUs();
+    m_FrameNumber++;
+}
+
+void Profiler::BeginScope(nvrhi::ICommandList* commandList, const char* name, bool marker) {
+    FrameSlot& slot = m_Slots[m_FrameNumber % m_Slots.size()];
+
+    ScopeRecord record;
+    record.name = name;
+    record.depth = uint32_t(m_OpenScopes.size());
+    record.cpuBeginUs = NowUs();
+
+    if (commandList) {
+        record.marker = marker;
+        if (marker) {
+            commandList->beginMarker(name);
+        }
+        if (slot.queriesUsed < m_MaxScopesPerFrame) {
+            record.query = int32_t(slot.queriesUsed++);
+            commandList->beginTimerQuery(slot.queries[record.query]);
+        }
+    }
+
+    m_OpenScopes.push_back(uint32_t(slot.scopes.size()));
+    slot.scopes.push_back(record);
+}
+
+void Profiler::EndScope(nvrhi::ICommandList* commandList) {
+    if (m_OpenScopes.empty()) {
+        log::warning("Profiler: EndScope called without a matching BeginScope");
+        return;
+    }
+
+    FrameSlot& slot = m_Slots[m_FrameNumber % m_Slots.size()];
+    ScopeRecord& record = slot.scopes[m_OpenScopes.back()];
+    m_OpenScopes.pop_back();
+
+    record.cpuEndUs = NowUs();
+
+    if (commandList) {
+        if (record.query >= 0) {
+            commandList->endTimerQuery(slot.queries[record.query]);
+        }
+        if (record.marker) {
+            commandList->endMarker();
+        }
+    }
+}
+
+void Profiler::SetCounter(const char* name, double value) {
+    auto it = std::find_if(m_Counters.begin(), m_Counters.end(), [name](const ProfilerCounter& counter) { return counter.name == name; });
+    if (it == m_Counters.end()) {
+        it = m_Counters.insert(m_Counters.end(), ProfilerCounter{name});
+    }
+
+    it->value = value;
+    it->sampleCount++;
+    it->mean += (value - it->mean) / double(it->sampleCount);
+}
+
+void Profiler::ResolveAll() {
+    for (size_t i = 0; i < m_Slots.size(); i++) {
+        FrameSlot& slot = m_Slots[(m_FrameNumber + i) % m_Slots.size()];
+        if (slot.pending && slot.frameNumber < m_FrameNumber) {
+            ResolveSlot(slot);
+        }
+    }
+}
+
+void Profiler::PushHistory(std::vector<float>& history, float value) {
+    if (history.size() == c_HistoryLength) {
+        history.erase(history.begin());
+    }
+    history.push_back(value);
+}
+
+void Profiler::ResolveSlot(FrameSlot& slot) {
+    constexpr double rollingWeight = 1.0 / 30.0;
+
+    slot.pending = false;
+    m_ResolvedFrameCount = slot.frameNumber + 1;
+    m_LatestScopes.resize(slot.scopes.size());
+
+    double gpuFrameMs = 0.0;
+    for (size_t i = 0; i < slot.scopes.size(); i++) {
+        const ScopeRecord& record = slot.scopes[i];
+        ProfilerScopeStatistics& stats = m_LatestScopes[i];
+
+        stats.gpuMs = 0.0;
+        if (record.query >= 0) {
+            nvrhi::ITimerQuery* query = slot.queries[record.query];
+            stats.gpuMs = double(m_Device->getTimerQueryTime(query)) * 1000.0;
+            m_Device->resetTimerQuery(query);
+        }
+        stats.cpuMs = (record.cpuEndUs - record.cpuBeginUs) / 1000.0;
+        stats.name = record.name;
+        stats.depth = record.depth;
+
+        if (record.depth == 0) {
+            gpuFrameMs += stats.gpuMs;
+        }
+
+        RunningAverage& average = m_Averages[stats.name];
+        if (average.count == 0) {
+            average.gpuRolling = stats.gpuMs;
+            average.cpuRolling = stats.cpuMs;
+        } else {
+            average.gpuRolling += (stats.gpuMs - average.gpuRolling) * rollingWeight;
+            average.cpuRolling += (stats.cpuMs - average.cpuRolling) * rollingWeight;
+        }
+        average.gpuSum += stats.gpuMs;
+        average.cpuSum += stats.cpuMs;
+        average.count++;
+
+        stats.rollingGpuMs = average.gpuRolling;
+        stats.rollingCpuMs = average.cpuRolling;
+        stats.meanGpuMs = average.gpuSum / double(average.count);
+        stats.meanCpuMs = average.cpuSum / double(average.count);
+        stats.sampleCount = average.count;
+    }
+
+    PushHistory(m_GpuFrameHistory, float(gpuFrameMs));
+    PushHistory(m_CpuFrameHistory, float((slot.cpuEndUs - slot.cpuBeginUs) / 1000.0));
+
+    if (!m_TraceCaptureEnabled) {
+        return;
+    }
+
+    if (m_TraceFrames.size() >= m_MaxTraceFrames) {
+        m_TraceFrames.pop_front();
+    }
+
+    std::vector<TraceEvent>& events = m_TraceFrames.emplace_back();
+    events.reserve(slot.scopes.size() * 2 + 1);
+    events.push_back({"Frame", false, slot.cpuBeginUs, slot.cpuEndUs - slot.cpuBeginUs});
+
+    // Timer queries only report durations, so the GPU track lays the scopes out back to back
+    // in submission order, starting when the CPU finished recording the frame.
+    std::vector<double> gpuCursor(m_OpenScopes.capacity() + 2, slot.cpuEndUs);
+    for (size_t i = 0; i < slot.scopes.size(); i++) {
+        const ScopeRecord& record = slot.scopes[i];
+        events.push_back({record.name, false, record.cpuBeginUs, record.cpuEndUs - record.cpuBeginUs});
+
+        if (record.query < 0) {
+            continue;
+        }
+
+        if (record.depth + 1 >= gpuCursor.size()) {
+            gpuCursor.resize(record.depth + 2, gpuCursor.back());
+        }
+
+        double durationUs = m_LatestScopes[i].gpuMs * 1000.0;
+        double beginUs = gpuCursor[record.depth];
+        gpuCursor[record.depth] += durationUs;
+        gpuCursor[record.depth + 1] = beginUs;
+        events.push_back({record.name, true, beginUs, durationUs});
+    }
+}
+
+void Profiler::SetTraceCaptureEnabled(bool enabled, uint32_t maxFrames) {
+    m_TraceCaptureEnabled = enabled;
+    m_MaxTraceFrames = std::max(maxFrames, 1u);
+    if (!enabled) {
+        m_TraceFrames.clear();
+    }
+}
+
+bool Profiler::WriteChromeTrace(const std::filesystem::path& fileName) const {
+    std::ofstream file(fileName);
+    if (!file.is_open()) {
+        log::error("Cannot write profiler trace to '%s'", fileName.generic_string().c_str());
+        return false;
+    }
+
+    constexpr int cpuThread = 1;
+    constexpr int gpuThread = 2;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << cpuThread << ",\"args\":{\"name\":\"CPU\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpuThread << ",\"args\":{\"name\":\"GPU\"}}";
+
+    file.precision(3);
+    file << std::fixed;
+    for (const std::vector<TraceEvent>& frame : m_TraceFrames) {
+        for (const TraceEvent& event : frame) {
+            file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"" << (event.gpu ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << (event.gpu ? gpuThread : cpuThread) << ",\"ts\":" << event.beginUs << ",\"dur\":" << event.durationUs << "}";
+        }
+    }
+
+    file << "\n]}\n";
+    return true;
+}
+
+} // namespace sanbox
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sanbox {
+
+struct ProfilerScopeStatistics {
+    std::string name;
+    uint32_t depth = 0;
+    double gpuMs = 0.0;
+    double cpuMs = 0.0;
+    double rollingGpuMs = 0.0;
+    double rollingCpuMs = 0.0;
+    double meanGpuMs = 0.0;
+    double meanCpuMs = 0.0;
+    uint64_t sampleCount = 0;
+};
+
+// A value reported once per frame, such as a draw count, with its mean over the run.
+struct ProfilerCounter {
+    std::string name;
+    double value = 0.0;
+    double mean = 0.0;
+    uint64_t sampleCount = 0;
+};
+
+// Per-pass CPU scopes and GPU timer queries. Query sets are kept in a ring of frameLatency frames
+// and read back when their slot comes around again, so resolving results never stalls the GPU
+// as long as the ring is longer than the number of frames in flight.
+// Scopes must be opened and closed from the thread that calls BeginFrame/EndFrame, and scope names
+// must be string literals since they are kept by pointer until the frame is resolved.
+class Profiler {
+public:
+    static constexpr uint32_t c_HistoryLength = 120;
+
+    Profiler(nvrhi::IDevice* device, uint32_t frameLatency, uint32_t maxScopesPerFrame = 64);
+
+    void BeginFrame();
+    void EndFrame();
+
+    // Pass a null command list for a CPU-only scope. A scope may end on a different command list than
+    // it began on, as long as they are submitted in order; such scopes must disable the debug marker.
+    void BeginScope(nvrhi::ICommandList* commandList, const char* name, bool marker = true);
+    void EndScope(nvrhi::ICommandList* commandList);
+
+    // Per-frame statistics such as visible instance counts, shown next to the scopes. Set once per frame.
+    void SetCounter(const char* name, double value);
+
+    // Blocks until every recorded frame has been resolved; the device must be idle or about to be.
+    void ResolveAll();
+
+    void SetTraceCaptureEnabled(bool enabled, uint32_t maxFrames = 1000);
+    bool WriteChromeTrace(const std::filesystem::path& fileName) const;
+
+    // Scopes of the most recently resolved frame, in recording order, with rolling and whole-run averages.
+    [[nodiscard]] const std::vector<ProfilerScopeStatistics>& GetLatestScopes() const {
+        return m_LatestScopes;
+    }
+    [[nodiscard]] const std::vector<ProfilerCounter>& GetCounters() const {
+        return m_Counters;
+    }
+    [[nodiscard]] const std::vector<float>& GetGpuFrameHistory() const {
+        return m_GpuFrameHistory;
+    }
+    [[nodiscard]] const std::vector<float>& GetCpuFrameHistory() const {
+        return m_CpuFrameHistory;
+    }
+    // The frame between BeginFrame and EndFrame, counted from zero.
+    [[nodiscard]] uint64_t GetFrameNumber() const {
+        return m_FrameNumber;
+    }
+    // Frames resolve in the order they were recorded, so the last entry of the frame histories is of frame
+    // GetResolvedFrameCount() - 1.
+    [[nodiscard]] uint64_t GetResolvedFrameCount() const {
+        return m_ResolvedFrameCount;
+    }
+
+private:
+    struct ScopeRecord {
+        const char* name = nullptr;
+        uint32_t depth = 0;
+        int32_t query = -1;
+        bool marker = false;
+        double cpuBeginUs = 0.0;
+        double cpuEndUs = 0.0;
+    };
+
+    struct FrameSlot {
+        uint64_t frameNumber = 0;
+        bool pending = false;
+        double cpuBeginUs = 0.0;
+        double cpuEndUs = 0.0;
+        std::vector<ScopeRecord> scopes;
+        std::vector<nvrhi::TimerQueryHandle> queries;
+        uint32_t queriesUsed = 0;
+    };
+
+    struct TraceEvent {
+        const char* name;
+        bool gpu;
+        double beginUs;
+        double durationUs;
+    };
+
+    struct RunningAverage {
+        double gpuSum = 0.0;
+        double cpuSum = 0.0;
+        double gpuRolling = 0.0;
+        double cpuRolling = 0.0;
+        uint64_t count = 0;
+    };
+
+    double NowUs() const;
+    void ResolveSlot(FrameSlot& slot);
+    void PushHistory(std::vector<float>& history, float value);
+
+    nvrhi::DeviceHandle m_Device;
+    uint32_t m_MaxScopesPerFrame;
+    std::vector<FrameSlot> m_Slots;
+    uint64_t m_FrameNumber = 0;
+    uint64_t m_ResolvedFrameCount = 0;
+    std::vector<uint32_t> m_OpenScopes;
+    std::chrono::high_resolution_clock::time_point m_StartTime;
+
+    std::vector<ProfilerScopeStatistics> m_LatestScopes;
+    std::unordered_map<std::string, RunningAverage> m_Averages;
+    std::vector<ProfilerCounter> m_Counters;
+    std::vector<float> m_GpuFrameHistory;
+    std::vector<float> m_CpuFrameHistory;
+
+    bool m_TraceCaptureEnabled = false;
+    uint32_t m_MaxTraceFrames = 0;
+    std::deque<std::vector<TraceEvent>> m_TraceFrames;
+};
+
+class ProfilerScope {
+public:
+    ProfilerScope(Profiler* profiler, nvrhi::ICommandList* commandList, const char* name)
+        : m_Profiler(profiler)
+        , m_CommandList(commandList) {
+        if (m_Profiler) {
+            m_Profiler->BeginScope(m_CommandList, name);
+        }
+    }
+
+    ~ProfilerScope() {
+        if (m_Profiler) {
+            m_Profiler->EndScope(m_CommandList);
+        }
+    }
+
+    ProfilerScope(const ProfilerScope&) = delete;
+    ProfilerScope& operator=(const ProfilerScope&) = delete;
+
+private:
+    Profiler* m_Profiler;
+    nvrhi::ICommandList* m_CommandList;
+};
+
+} // namespace sanbox
@@ -0,0 +1,58 @@
+#include "ProfilerOverlay.h"
+
+#include <algorithm>
+
+using namespace donut;
+
+namespace sanbox {
+
+ProfilerOverlay::ProfilerOverlay(app::DeviceManager* deviceManager, const Profiler* profiler)
+    : ImGui_Renderer(deviceManager)
+    , m_Profiler(profiler) {
+}
+
+void ProfilerOverlay::buildUI() {
+    ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.7f);
+    ImGui::Begin("Profiler", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
+
+    const std::vector<float>& gpuHistory = m_Profiler->GetGpuFrameHistory();
+    const std::vector<float>& cpuHistory = m_Profiler->GetCpuFrameHistory();
+    if (!gpuHistory.empty()) {
+        float scaleMax = std::max(*std::max_element(gpuHistory.begin(), gpuHistory.end()), *std::max_element(cpuHistory.begin(), cpuHistory.end()));
+        ImGui::PlotLines("GPU", gpuHistory.data(), int(gpuHistory.size()), 0, nullptr, 0.f, scaleMax, ImVec2(240.f, 40.f));
+        ImGui::PlotLines("CPU", cpuHistory.data(), int(cpuHistory.size()), 0, nullptr, 0.f, scaleMax, ImVec2(240.f, 40.f));
+        ImGui::Separator();
+    }
+
+    if (ImGui::BeginTable("Scopes", 3)) {
+        ImGui::TableSetupColumn("Scope");
+        ImGui::TableSetupColumn("GPU ms");
+        ImGui::TableSetupColumn("CPU ms");
+        ImGui::TableHeadersRow();
+
+        for (const ProfilerScopeStatistics& scope : m_Profiler->GetLatestScopes()) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%*s%s", int(scope.depth * 2), "", scope.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", scope.rollingGpuMs);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", scope.rollingCpuMs);
+        }
+
+        ImGui::EndTable();
+    }
+
+    const std::vector<ProfilerCounter>& counters = m_Profiler->GetCounters();
+    if (!counters.empty()) {
+        ImGui::Separator();
+        for (const ProfilerCounter& counter : counters) {
+            ImGui::Text("%s: %.0f", counter.name.c_str(), counter.value);
+        }
+    }
+
+    ImGui::End();
+}
+
+} // namespace sanbox
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <donut/app/imgui_renderer.h>
+
+#include "Profiler.h"
+
+namespace sanbox {
+
+// Rolling per-pass timings of a Profiler drawn in a corner of the window.
+class ProfilerOverlay : public donut::app::ImGui_Renderer {
+public:
+    ProfilerOverlay(donut::app::DeviceManager* deviceManager, const Profiler* profiler);
+
+    void buildUI() override;
+
+private:
+    const Profiler* m_Profiler;
+};
+
+} // namespace sanbox
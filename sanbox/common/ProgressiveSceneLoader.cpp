@@ -0,0 +1,131 @@
+#include "ProgressiveSceneLoader.h"
+
+#include <donut/core/log.h>
+#include <donut/engine/SceneGraph.h>
+
+#include <algorithm>
+
+using namespace donut;
+
+namespace sanbox {
+
+ProgressiveSceneLoader::ProgressiveSceneLoader(std::shared_ptr<engine::TextureCache> textureCache, uint32_t decodeThreads, float uploadBudgetMs)
+    : m_TextureCache(std::move(textureCache))
+    , m_DecodeThreads(decodeThreads)
+    , m_UploadBudgetMs(uploadBudgetMs) {
+}
+
+ProgressiveSceneLoader::~ProgressiveSceneLoader() {
+    if (m_SceneThread.joinable()) {
+        m_SceneThread.join();
+    }
+    if (m_DecodeThread.joinable()) {
+        m_DecodeThread.join();
+    }
+}
+
+double ProgressiveSceneLoader::GetElapsedMs() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_StartTime).count();
+}
+
+void ProgressiveSceneLoader::Start(std::unique_ptr<CachedScene> scene, std::filesystem::path sceneFileName) {
+    m_StartTime = std::chrono::high_resolution_clock::now();
+    m_Timeline = SceneLoadingTimeline();
+
+    if (!scene->HasTextureRequestHandler()) {
+        scene->SetTextureRequestHandler(
+            [this](const std::shared_ptr<engine::Material>& material, CachedScene::TextureSlot slot, const std::string& path, bool sRGB) {
+                m_TextureRequests.push_back({material, slot, path, sRGB, nullptr});
+            });
+    }
+
+    m_SceneThread = std::thread([this, scene = std::move(scene), sceneFileName = std::move(sceneFileName)]() mutable {
+        if (scene->Load(sceneFileName)) {
+            m_LoadedScene = std::move(scene);
+        }
+        m_SceneThreadDone = true;
+    });
+}
+
+std::unique_ptr<CachedScene> ProgressiveSceneLoader::TakeScene() {
+    if (!m_SceneThread.joinable() || !m_SceneThreadDone) {
+        return nullptr;
+    }
+    m_SceneThread.join();
+
+    if (!m_LoadedScene) {
+        m_Failed = true;
+        log::error("Scene loading failed after %.0f ms", GetElapsedMs());
+        return nullptr;
+    }
+    m_LoadedScene->SetTextureRequestHandler(nullptr);
+    m_Timeline.sceneMs = GetElapsedMs();
+    log::info("Scene ready after %.0f ms", m_Timeline.sceneMs);
+
+    if (!m_TextureRequests.empty()) {
+        m_DecodePending = uint32_t(m_TextureRequests.size());
+        m_JobSystem = std::make_unique<JobSystem>(m_DecodeThreads ? m_DecodeThreads - 1 : 0);
+        m_DecodeThread = std::thread([this]() { DecodeTextures(); });
+        log::info("Decoding %zu textures on %u threads", m_TextureRequests.size(), m_JobSystem->GetThreadCount());
+    }
+
+    return std::move(m_LoadedScene);
+}
+
+void ProgressiveSceneLoader::FrameRendered() {
+    if (m_Timeline.firstFrameMs < 0.0) {
+        m_Timeline.firstFrameMs = GetElapsedMs();
+    }
+}
+
+void ProgressiveSceneLoader::DecodeTextures() {
+    m_JobSystem->ParallelFor(uint32_t(m_TextureRequests.size()), [this](uint32_t index, uint32_t) {
+        TextureRequest& request = m_TextureRequests[index];
+        // The cache is safe to call from several threads; it queues the decoded texture for finalization.
+        request.texture = m_TextureCache->LoadTextureFromFileDeferred(request.path, request.sRGB);
+
+        std::lock_guard<std::mutex> lock(m_DecodedMutex);
+        m_Decoded.push_back(index);
+        m_DecodePending--;
+    });
+}
+
+bool ProgressiveSceneLoader::UpdateTextures(engine::CommonRenderPasses& commonPasses, engine::Scene& scene) {
+    // Checked first: once nothing is pending, every decoded request is in the list swapped out below.
+    const bool allDecoded = m_DecodePending == 0;
+    std::vector<uint32_t> decoded;
+    {
+        std::lock_guard<std::mutex> lock(m_DecodedMutex);
+        decoded.swap(m_Decoded);
+    }
+
+    // A texture is attached as soon as it is decoded, but materials only sample it once it is finalized.
+    for (uint32_t index : decoded) {
+        TextureRequest& request = m_TextureRequests[index];
+        (*request.material).*request.slot = request.texture;
+        request.material->dirty = true;
+    }
+
+    const bool finalized = m_TextureCache->ProcessRenderingThreadCommands(commonPasses, m_UploadBudgetMs);
+    if (finalized) {
+        for (const auto& material : scene.GetSceneGraph()->GetMaterials()) {
+            material->dirty = true;
+        }
+    }
+
+    if (m_DecodeThread.joinable() && allDecoded) {
+        m_DecodeThread.join();
+        m_JobSystem.reset();
+    }
+
+    m_TexturesRequested = std::max(m_TextureCache->GetNumberOfRequestedTextures(), uint32_t(m_TextureRequests.size()));
+    m_TexturesFinalized = m_TextureCache->GetNumberOfFinalizedTextures();
+    m_TexturesComplete = !m_DecodeThread.joinable() && !finalized && decoded.empty();
+    if (m_TexturesComplete && m_Timeline.texturesMs < 0.0) {
+        m_Timeline.texturesMs = GetElapsedMs();
+        log::info("Scene textures complete after %.0f ms (%u textures)", m_Timeline.texturesMs, m_TexturesFinalized);
+    }
+    return finalized || !decoded.empty();
+}
+
+} // namespace sanbox
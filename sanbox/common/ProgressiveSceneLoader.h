@@ -0,0 +1,113 @@
+#pragma once
+
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/TextureCache.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CachedScene.h"
+#include "JobSystem.h"
+
+namespace sanbox {
+
+// Milliseconds from Start to each stage, or -1 until the stage is reached.
+struct SceneLoadingTimeline {
+    double firstFrameMs = -1.0;
+    double sceneMs = -1.0;
+    double texturesMs = -1.0;
+};
+
+// Loads a scene on a background thread while the application keeps rendering. Once the scene is handed
+// over, its geometry can be drawn right away: a packaged scene's textures are decoded in parallel on a
+// job system and attached to their materials as they are uploaded, a few per frame. Until then the
+// materials use their constant colors. A scene loaded from glTF decodes its textures during the load
+// itself, and only the uploads are spread over frames.
+class ProgressiveSceneLoader {
+public:
+    // decodeThreads == 0 uses one per hardware thread. The budget bounds the time spent uploading
+    // textures and generating their mips in each call to UpdateTextures.
+    ProgressiveSceneLoader(std::shared_ptr<donut::engine::TextureCache> textureCache, uint32_t decodeThreads, float uploadBudgetMs);
+    ~ProgressiveSceneLoader();
+
+    // A texture request handler that is already set on the scene is kept, and its textures are left to it.
+    void Start(std::unique_ptr<CachedScene> scene, std::filesystem::path sceneFileName);
+
+    // Returns the scene the first time it is called after the load has succeeded, and null otherwise.
+    // FinishedLoading has not been called on the scene yet.
+    std::unique_ptr<CachedScene> TakeScene();
+
+    // Render thread, once per frame after TakeScene. Returns true if any material of the scene changed, after
+    // which its material buffers and the passes' material binding sets must be refreshed.
+    bool UpdateTextures(donut::engine::CommonRenderPasses& commonPasses, donut::engine::Scene& scene);
+
+    [[nodiscard]] bool IsSceneLoading() const {
+        return m_SceneThread.joinable();
+    }
+    [[nodiscard]] bool HasFailed() const {
+        return m_Failed;
+    }
+    // The scene has been taken and every texture is on the GPU.
+    [[nodiscard]] bool IsComplete() const {
+        return !IsSceneLoading() && !m_Failed && m_TexturesComplete;
+    }
+    // Call after every rendered frame, whether it shows the scene or not.
+    void FrameRendered();
+
+    [[nodiscard]] const SceneLoadingTimeline& GetTimeline() const {
+        return m_Timeline;
+    }
+    [[nodiscard]] uint32_t GetTexturesFinalized() const {
+        return m_TexturesFinalized;
+    }
+    [[nodiscard]] uint32_t GetTexturesRequested() const {
+        return m_TexturesRequested;
+    }
+
+private:
+    struct TextureRequest {
+        std::shared_ptr<donut::engine::Material> material;
+        CachedScene::TextureSlot slot = nullptr;
+        std::string path;
+        bool sRGB = false;
+        std::shared_ptr<donut::engine::LoadedTexture> texture;
+    };
+
+    void DecodeTextures();
+    [[nodiscard]] double GetElapsedMs() const;
+
+    std::shared_ptr<donut::engine::TextureCache> m_TextureCache;
+    uint32_t m_DecodeThreads;
+    float m_UploadBudgetMs;
+
+    std::thread m_SceneThread;
+    std::atomic<bool> m_SceneThreadDone = false;
+    std::unique_ptr<CachedScene> m_LoadedScene;
+    bool m_Failed = false;
+
+    // Filled by the scene thread during the load, then only read by the decode thread.
+    std::vector<TextureRequest> m_TextureRequests;
+    std::thread m_DecodeThread;
+    std::unique_ptr<JobSystem> m_JobSystem;
+
+    // Requests whose texture has been decoded and not yet attached to the material.
+    std::mutex m_DecodedMutex;
+    std::vector<uint32_t> m_Decoded;
+    std::atomic<uint32_t> m_DecodePending = 0;
+
+    std::chrono::high_resolution_clock::time_point m_StartTime;
+    SceneLoadingTimeline m_Timeline;
+
+    bool m_TexturesComplete = false;
+    uint32_t m_TexturesRequested = 0;
+    uint32_t m_TexturesFinalized = 0;
+};
+
+} // namespace sanbox
@@ -0,0 +1,304 @@
+#include "QuantizedGBufferFillPass.h"
+
+#include <donut/core/log.h>
+#include <donut/engine/MaterialBindingCache.h>
+
+#include <chrono>
+#include <cstddef>
+
+#include "VertexQuantizer.h"
+
+using namespace donut;
+using namespace donut::math;
+
+#include <donut/shaders/gbuffer_cb.h>
+
+#include "shaders/bindless_material_cb.h"
+#include "shaders/mesh_quantization_cb.h"
+
+namespace sanbox {
+
+// The vertex shaders read the draw constants of the bindless push constants as donut's.
+static_assert(offsetof(BindlessGBufferPushConstants, materialIndex) == sizeof(GBufferPushConstants));
+
+QuantizedGBufferFillPass::QuantizedGBufferFillPass(nvrhi::IDevice* device, std::shared_ptr<engine::CommonRenderPasses> commonPasses)
+    : GBufferFillPass(device, std::move(commonPasses)) {
+}
+
+nvrhi::ShaderHandle QuantizedGBufferFillPass::CreateVertexShader(engine::ShaderFactory& shaderFactory, const CreateParameters& params) {
+    if (!m_VertexQuantization) {
+        return GBufferFillPass::CreateVertexShader(shaderFactory, params);
+    }
+    const char* entryName = params.useInputAssembler ? "input_assembler" : "buffer_loads";
+    return shaderFactory.CreateShader("sanbox/quantized_gbuffer_vs.hlsl", entryName, nullptr, nvrhi::ShaderType::Vertex);
+}
+
+nvrhi::ShaderHandle QuantizedGBufferFillPass::CreatePixelShader(
+    engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested) {
+    const auto createShader = [&](bool bindless) {
+        std::vector<engine::ShaderMacro> macros = {
+            engine::ShaderMacro("BINDLESS_MATERIALS", bindless ? "1" : "0"),
+            engine::ShaderMacro("ALPHA_TESTED", alphaTested ? "1" : "0"),
+            engine::ShaderMacro("COMPACT_GBUFFER", m_CompactLayout ? "1" : "0"),
+        };
+        return shaderFactory.CreateShader("sanbox/gbuffer_ps.hlsl", "main", &macros, nvrhi::ShaderType::Pixel);
+    };
+
+    // The base pass's pipelines are created with these; the bindless ones are derived from them.
+    if (m_BindlessMaterials) {
+        m_BindlessPixelShaders[alphaTested] = createShader(true);
+    }
+    // donut's shader writes the standard layout only.
+    if (m_CompactLayout) {
+        return createShader(false);
+    }
+    return GBufferFillPass::CreatePixelShader(shaderFactory, params, alphaTested);
+}
+
+nvrhi::InputLayoutHandle QuantizedGBufferFillPass::CreateInputLayout(nvrhi::IShader* vertexShader, const CreateParameters& params) {
+    if (!m_VertexQuantization) {
+        return GBufferFillPass::CreateInputLayout(vertexShader, params);
+    }
+    m_QuantizedInputAssembler = params.useInputAssembler;
+    return params.useInputAssembler ? VertexQuantizer::CreateInputLayout(m_Device, vertexShader) : nullptr;
+}
+
+void QuantizedGBufferFillPass::CreateViewBindings(nvrhi::BindingLayoutHandle& layout, nvrhi::BindingSetHandle& set, const CreateParameters& params) {
+    if (!m_VertexQuantization) {
+        GBufferFillPass::CreateViewBindings(layout, set, params);
+        return;
+    }
+
+    // The base pass's view space, plus the position decode data.
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Vertex | nvrhi::ShaderType::Pixel;
+    layoutDesc.registerSpace = GBUFFER_SPACE_VIEW;
+    layoutDesc.registerSpaceIsDescriptorSet = true;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(GBUFFER_BINDING_VIEW_CONSTANTS),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(MESH_QUANTIZATION_BINDING),
+    };
+    layout = m_Device->createBindingLayout(layoutDesc);
+
+    m_TrackViewLiveness = params.trackLiveness;
+    // Nothing is drawn before the scene is quantized, but the set needs a buffer until then.
+    if (!m_QuantizedMeshes) {
+        m_QuantizedMeshes = VertexQuantizer::CreateMeshDataBuffer(m_Device, 1);
+    }
+    set = CreateQuantizedViewBindingSet(layout);
+}
+
+nvrhi::BindingSetHandle QuantizedGBufferFillPass::CreateQuantizedViewBindingSet(nvrhi::IBindingLayout* layout) {
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(GBUFFER_BINDING_VIEW_CONSTANTS, m_GBufferCB),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(MESH_QUANTIZATION_BINDING, m_QuantizedMeshes),
+    };
+    bindingSetDesc.trackLiveness = m_TrackViewLiveness;
+    return m_Device->createBindingSet(bindingSetDesc, layout);
+}
+
+void QuantizedGBufferFillPass::SetQuantizedMeshBuffer(nvrhi::IBuffer* buffer) {
+    m_QuantizedMeshes = buffer;
+    if (m_VertexQuantization && m_ViewBindingLayout) {
+        m_ViewBindings = CreateQuantizedViewBindingSet(m_ViewBindingLayout);
+    }
+}
+
+void QuantizedGBufferFillPass::SetupInputBuffers(
+    render::GeometryPassContext& context, const engine::BufferGroup* buffers, nvrhi::GraphicsState& state) {
+    if (m_QuantizedInputAssembler) {
+        VertexQuantizer::SetupInputBuffers(buffers, state);
+        return;
+    }
+    GBufferFillPass::SetupInputBuffers(context, buffers, state);
+}
+
+nvrhi::BindingLayoutHandle QuantizedGBufferFillPass::CreateInputBindingLayout() {
+    if (!m_BindlessMaterials) {
+        return GBufferFillPass::CreateInputBindingLayout();
+    }
+
+    // The base pass's input space, with push constants that have room for the material index.
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Vertex | nvrhi::ShaderType::Pixel;
+    layoutDesc.registerSpace = GBUFFER_SPACE_INPUT;
+    layoutDesc.registerSpaceIsDescriptorSet = true;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(GBUFFER_BINDING_INSTANCE_BUFFER),
+        nvrhi::BindingLayoutItem::RawBuffer_SRV(GBUFFER_BINDING_VERTEX_BUFFER),
+        nvrhi::BindingLayoutItem::PushConstants(GBUFFER_BINDING_PUSH_CONSTANTS, sizeof(BindlessGBufferPushConstants)),
+    };
+    return m_Device->createBindingLayout(layoutDesc);
+}
+
+nvrhi::BindingSetHandle QuantizedGBufferFillPass::CreateInputBindingSet(const engine::BufferGroup* bufferGroup) {
+    if (!m_BindlessMaterials) {
+        return GBufferFillPass::CreateInputBindingSet(bufferGroup);
+    }
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(GBUFFER_BINDING_INSTANCE_BUFFER, bufferGroup->instanceBuffer),
+        nvrhi::BindingSetItem::RawBuffer_SRV(GBUFFER_BINDING_VERTEX_BUFFER, bufferGroup->vertexBuffer),
+        nvrhi::BindingSetItem::PushConstants(GBUFFER_BINDING_PUSH_CONSTANTS, sizeof(BindlessGBufferPushConstants)),
+    };
+    bindingSetDesc.trackLiveness = m_TrackInputLiveness;
+    return m_Device->createBindingSet(bindingSetDesc, m_InputBindingLayout);
+}
+
+nvrhi::GraphicsPipelineHandle QuantizedGBufferFillPass::CreateGraphicsPipeline(PipelineKey key, nvrhi::IFramebuffer* framebuffer) {
+    const auto startTime = std::chrono::steady_clock::now();
+    nvrhi::GraphicsPipelineHandle pipeline = CreatePipelineVariant(key, framebuffer);
+    if (m_PipelineCache && pipeline) {
+        const double createMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        m_PipelineCache->Record(c_PipelineCacheName, key.value, framebuffer->getFramebufferInfo(), pipeline->getDesc(), createMs);
+    }
+    return pipeline;
+}
+
+void QuantizedGBufferFillPass::PrecreatePipelines(nvrhi::IFramebuffer* framebuffer) {
+    if (!m_PipelineCache) {
+        return;
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+    uint32_t created = 0;
+    for (uint32_t keyValue : m_PipelineCache->GetRecordedKeys(c_PipelineCacheName, framebuffer->getFramebufferInfo())) {
+        if (keyValue >= PipelineKey::Count || m_Pipelines[keyValue]) {
+            continue;
+        }
+        PipelineKey key;
+        key.value = keyValue;
+        m_Pipelines[keyValue] = CreateGraphicsPipeline(key, framebuffer);
+        created += m_Pipelines[keyValue] ? 1 : 0;
+    }
+    m_PipelineCache->RecordPrecreated(created, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+nvrhi::GraphicsPipelineHandle QuantizedGBufferFillPass::CreatePipelineVariant(PipelineKey key, nvrhi::IFramebuffer* framebuffer) {
+    nvrhi::GraphicsPipelineHandle pipeline = GBufferFillPass::CreateGraphicsPipeline(key, framebuffer);
+    if (!m_BindlessMaterials || !pipeline) {
+        return pipeline;
+    }
+
+    // The base pass's states, with the material space replaced and the texture table in the space after the last.
+    nvrhi::GraphicsPipelineDesc pipelineDesc = pipeline->getDesc();
+    pipelineDesc.PS = m_BindlessPixelShaders[key.bits.alphaTested];
+    for (nvrhi::BindingLayoutHandle& layout : pipelineDesc.bindingLayouts) {
+        if (layout == m_MaterialBindings->GetLayout()) {
+            layout = m_BindlessMaterialLayout;
+        }
+    }
+    pipelineDesc.bindingLayouts.push_back(m_MaterialTable->GetLayout());
+    return m_Device->createGraphicsPipeline(pipelineDesc, framebuffer);
+}
+
+void QuantizedGBufferFillPass::Init(engine::ShaderFactory& shaderFactory, const CreateParameters& params) {
+    if (m_BindlessMaterials && (params.useInputAssembler || params.enableMotionVectors)) {
+        log::warning("Bindless materials need the buffer-load path without motion vectors; the G-buffer pass keeps a binding set per material");
+        m_BindlessMaterials = false;
+    }
+
+    if (m_BindlessMaterials) {
+        nvrhi::BindingLayoutDesc layoutDesc;
+        layoutDesc.visibility = nvrhi::ShaderType::Pixel;
+        layoutDesc.registerSpace = GBUFFER_SPACE_MATERIAL;
+        layoutDesc.registerSpaceIsDescriptorSet = true;
+        layoutDesc.bindings = {
+            nvrhi::BindingLayoutItem::StructuredBuffer_SRV(BINDLESS_MATERIAL_BINDING_MATERIALS),
+            nvrhi::BindingLayoutItem::Sampler(BINDLESS_MATERIAL_BINDING_SAMPLER),
+        };
+        m_BindlessMaterialLayout = m_Device->createBindingLayout(layoutDesc);
+        m_TrackInputLiveness = params.trackLiveness;
+    }
+
+    GBufferFillPass::Init(shaderFactory, params);
+}
+
+void QuantizedGBufferFillPass::SetMaterialTable(const BindlessMaterialTable* table) {
+    m_MaterialTable = table;
+    if (!m_BindlessMaterials || !table) {
+        return;
+    }
+
+    nvrhi::BindingSetDesc bindingSetDesc;
+    bindingSetDesc.bindings = {
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(BINDLESS_MATERIAL_BINDING_MATERIALS, table->GetMaterialBuffer()),
+        nvrhi::BindingSetItem::Sampler(BINDLESS_MATERIAL_BINDING_SAMPLER, table->GetSampler()),
+    };
+    bindingSetDesc.trackLiveness = m_TrackInputLiveness;
+    m_BindlessMaterialSet = m_Device->createBindingSet(bindingSetDesc, m_BindlessMaterialLayout);
+}
+
+bool QuantizedGBufferFillPass::SetupMaterial(
+    render::GeometryPassContext& abstractContext, const engine::Material* material, nvrhi::RasterCullMode cullMode, nvrhi::GraphicsState& state) {
+    if (!m_BindlessMaterials) {
+        return GBufferFillPass::SetupMaterial(abstractContext, material, cullMode, state);
+    }
+
+    auto& context = static_cast<Context&>(abstractContext);
+    context.materialIndex = m_MaterialTable ? m_MaterialTable->GetMaterialIndex(material) : ~0u;
+    if (context.materialIndex == ~0u) {
+        return false;
+    }
+
+    PipelineKey key = context.keyTemplate;
+    key.bits.cullMode = cullMode;
+    switch (material->domain) {
+    case engine::MaterialDomain::Opaque:
+    case engine::MaterialDomain::AlphaBlended:
+    case engine::MaterialDomain::Transmissive:
+    case engine::MaterialDomain::TransmissiveAlphaBlended:
+        key.bits.alphaTested = false;
+        break;
+    case engine::MaterialDomain::AlphaTested:
+    case engine::MaterialDomain::TransmissiveAlphaTested:
+        key.bits.alphaTested = true;
+        break;
+    default:
+        return false;
+    }
+
+    nvrhi::GraphicsPipelineHandle& pipeline = m_Pipelines[key.value];
+    if (!pipeline) {
+        std::lock_guard<std::mutex> lockGuard(m_Mutex);
+        if (!pipeline) {
+            pipeline = CreateGraphicsPipeline(key, state.framebuffer);
+        }
+        if (!pipeline) {
+            return false;
+        }
+    }
+
+    // The same for every material, so that the draw loop sets the state only when the pipeline changes.
+    // In the order of the pipeline's layouts, which is that of their register spaces.
+    state.pipeline = pipeline;
+    state.bindings = {m_BindlessMaterialSet, context.inputBindingSet, m_ViewBindings, m_MaterialTable->GetDescriptorTable()};
+    return true;
+}
+
+void QuantizedGBufferFillPass::SetPushConstants(
+    render::GeometryPassContext& abstractContext, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state, nvrhi::DrawArguments& args) {
+    if (!m_BindlessMaterials) {
+        GBufferFillPass::SetPushConstants(abstractContext, commandList, state, args);
+        return;
+    }
+
+    auto& context = static_cast<Context&>(abstractContext);
+    BindlessGBufferPushConstants constants = {};
+    constants.startInstanceLocation = args.startInstanceLocation;
+    constants.startVertexLocation = args.startVertexLocation;
+    constants.positionOffset = context.positionOffset;
+    constants.prevPositionOffset = context.prevPositionOffset;
+    constants.texCoordOffset = context.texCoordOffset;
+    constants.normalOffset = context.normalOffset;
+    constants.tangentOffset = context.tangentOffset;
+    constants.materialIndex = context.materialIndex;
+    commandList->setPushConstants(&constants, sizeof(constants));
+
+    args.startInstanceLocation = 0;
+    args.startVertexLocation = 0;
+}
+
+} // namespace sanbox
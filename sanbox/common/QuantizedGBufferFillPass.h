@@ -0,0 +1,95 @@
+#pragma once
+
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/render/GBufferFillPass.h>
+#include <nvrhi/nvrhi.h>
+
+#include <memory>
+
+#include "BindlessMaterialTable.h"
+#include "PipelineCache.h"
+
+namespace sanbox {
+
+// donut's G-buffer fill pass, which can also draw the vertex buffers written by VertexQuantizer. Without
+// vertex quantization it behaves exactly like the base pass.
+// With bindless materials, every material comes from a BindlessMaterialTable that is bound once per pass,
+// and draws select theirs by an index in the push constants.
+class QuantizedGBufferFillPass : public donut::render::GBufferFillPass {
+public:
+    // The index of the material that SetupMaterial set up, for the push constants of the draws.
+    class Context : public donut::render::GBufferFillPass::Context {
+    public:
+        uint32_t materialIndex = 0;
+    };
+
+    QuantizedGBufferFillPass(nvrhi::IDevice* device, std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses);
+
+    // Decode the vertices of VertexQuantizer; every mesh drawn with the pass must be quantized. Call before Init.
+    void SetVertexQuantization(bool enabled) {
+        m_VertexQuantization = enabled;
+    }
+    // VertexQuantizer::GetMeshDataBuffer, once the scene has been quantized.
+    void SetQuantizedMeshBuffer(nvrhi::IBuffer* buffer);
+
+    // Draws must then use the pass's Context. Only for the buffer-load path without motion vectors; call
+    // before Init.
+    void SetBindlessMaterials(bool enabled) {
+        m_BindlessMaterials = enabled;
+    }
+    // Write the compact layout of GBufferLayout instead of donut's. Only without motion vectors; call before Init.
+    void SetCompactLayout(bool enabled) {
+        m_CompactLayout = enabled;
+    }
+
+    // After every BindlessMaterialTable::Update, since the table may have a new material buffer.
+    void SetMaterialTable(const BindlessMaterialTable* table);
+
+    // Pipelines created from then on are timed and recorded in the cache.
+    void SetPipelineCache(PipelineCache* cache) {
+        m_PipelineCache = cache;
+    }
+    // Creates the pipelines that the cache recorded for the framebuffer's formats, so that the first frames
+    // do not. With bindless materials, call after SetMaterialTable.
+    void PrecreatePipelines(nvrhi::IFramebuffer* framebuffer);
+
+    void Init(donut::engine::ShaderFactory& shaderFactory, const CreateParameters& params) override;
+    bool SetupMaterial(donut::render::GeometryPassContext& context, const donut::engine::Material* material, nvrhi::RasterCullMode cullMode,
+        nvrhi::GraphicsState& state) override;
+    void SetupInputBuffers(donut::render::GeometryPassContext& context, const donut::engine::BufferGroup* buffers,
+        nvrhi::GraphicsState& state) override;
+    void SetPushConstants(donut::render::GeometryPassContext& context, nvrhi::ICommandList* commandList, nvrhi::GraphicsState& state,
+        nvrhi::DrawArguments& args) override;
+
+protected:
+    nvrhi::ShaderHandle CreateVertexShader(donut::engine::ShaderFactory& shaderFactory, const CreateParameters& params) override;
+    nvrhi::ShaderHandle CreatePixelShader(donut::engine::ShaderFactory& shaderFactory, const CreateParameters& params, bool alphaTested) override;
+    nvrhi::InputLayoutHandle CreateInputLayout(nvrhi::IShader* vertexShader, const CreateParameters& params) override;
+    void CreateViewBindings(nvrhi::BindingLayoutHandle& layout, nvrhi::BindingSetHandle& set, const CreateParameters& params) override;
+    nvrhi::BindingLayoutHandle CreateInputBindingLayout() override;
+    nvrhi::BindingSetHandle CreateInputBindingSet(const donut::engine::BufferGroup* bufferGroup) override;
+    nvrhi::GraphicsPipelineHandle CreateGraphicsPipeline(PipelineKey key, nvrhi::IFramebuffer* framebuffer) override;
+
+private:
+    static constexpr const char* c_PipelineCacheName = "QuantizedGBuffer";
+
+    nvrhi::GraphicsPipelineHandle CreatePipelineVariant(PipelineKey key, nvrhi::IFramebuffer* framebuffer);
+    nvrhi::BindingSetHandle CreateQuantizedViewBindingSet(nvrhi::IBindingLayout* layout);
+
+    bool m_VertexQuantization = false;
+    bool m_QuantizedInputAssembler = false;
+    bool m_TrackViewLiveness = true;
+    nvrhi::BufferHandle m_QuantizedMeshes;
+
+    bool m_CompactLayout = false;
+    bool m_BindlessMaterials = false;
+    bool m_TrackInputLiveness = true;
+    const BindlessMaterialTable* m_MaterialTable = nullptr;
+    nvrhi::ShaderHandle m_BindlessPixelShaders[2];
+    nvrhi::BindingLayoutHandle m_BindlessMaterialLayout;
+    nvrhi::BindingSetHandle m_BindlessMaterialSet;
+    PipelineCache* m_PipelineCache = nullptr;
+};
+
+} // namespace sanbox
@@ -0,0 +1,302 @@
+#include "RenderGraph.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <numeric>
+
+using namespace donut;
+
+namespace sanbox {
+
+namespace {
+
+uint64_t AlignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// What a texture takes with an allocation of its own, for devices that cannot report it.
+uint64_t EstimateTextureBytes(const nvrhi::TextureDesc& desc) {
+    const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo(desc.format);
+    const uint32_t blockSize = std::max<uint32_t>(formatInfo.blockSize, 1);
+    uint64_t bytes = 0;
+    for (uint32_t mip = 0; mip < desc.mipLevels; mip++) {
+        const uint64_t width = (std::max(desc.width >> mip, 1u) + blockSize - 1) / blockSize;
+        const uint64_t height = (std::max(desc.height >> mip, 1u) + blockSize - 1) / blockSize;
+        bytes += width * height * formatInfo.bytesPerBlock;
+    }
+    return bytes * desc.arraySize * desc.sampleCount;
+}
+
+} // namespace
+
+RenderTargetHeapPool::RenderTargetHeapPool(nvrhi::IDevice* device)
+    : m_Device(device) {
+}
+
+nvrhi::HeapHandle RenderTargetHeapPool::Acquire(uint64_t size) {
+    PooledHeap* best = nullptr;
+    for (PooledHeap& heap : m_Heaps) {
+        if (!heap.inUse && heap.capacity >= size && (!best || heap.capacity < best->capacity)) {
+            best = &heap;
+        }
+    }
+    if (best) {
+        best->inUse = true;
+        return best->heap;
+    }
+
+    // The free heaps are too small for this request and, the graphs only ever growing past them, for any
+    // later one.
+    m_Heaps.erase(std::remove_if(m_Heaps.begin(), m_Heaps.end(), [](const PooledHeap& heap) { return !heap.inUse; }), m_Heaps.end());
+
+    nvrhi::HeapDesc heapDesc;
+    heapDesc.capacity = AlignUp(std::max<uint64_t>(size, 1), c_HeapGranularity);
+    heapDesc.type = nvrhi::HeapType::DeviceLocal;
+    heapDesc.debugName = "RenderTargetHeap";
+    nvrhi::HeapHandle heap = m_Device->createHeap(heapDesc);
+    if (!heap) {
+        return nullptr;
+    }
+    m_Heaps.push_back({heap, heapDesc.capacity, true});
+    m_CreatedHeaps++;
+    return heap;
+}
+
+void RenderTargetHeapPool::Release(nvrhi::IHeap* heap) {
+    for (PooledHeap& pooled : m_Heaps) {
+        if (pooled.heap == heap) {
+            pooled.inUse = false;
+        }
+    }
+}
+
+uint64_t RenderTargetHeapPool::GetCapacity() const {
+    uint64_t capacity = 0;
+    for (const PooledHeap& heap : m_Heaps) {
+        capacity += heap.capacity;
+    }
+    return capacity;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Read(TextureId texture, nvrhi::ResourceStates state) {
+    m_Graph.m_Passes[m_Pass].accesses.push_back({texture, state, false});
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::Write(TextureId texture, nvrhi::ResourceStates state) {
+    m_Graph.m_Passes[m_Pass].accesses.push_back({texture, state, true});
+    return *this;
+}
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::SkipAutomaticBarriers() {
+    m_Graph.m_Passes[m_Pass].skipAutomaticBarriers = true;
+    return *this;
+}
+
+RenderGraph::RenderGraph(nvrhi::IDevice* device, RenderTargetHeapPool& heapPool)
+    : m_Device(device)
+    , m_HeapPool(heapPool) {
+}
+
+RenderGraph::~RenderGraph() {
+    Reset();
+}
+
+void RenderGraph::Reset() {
+    m_Passes.clear();
+    m_Textures.clear();
+    if (m_Heap) {
+        m_HeapPool.Release(m_Heap);
+        m_Heap = nullptr;
+    }
+}
+
+RenderGraph::TextureId RenderGraph::CreateTexture(const nvrhi::TextureDesc& desc) {
+    Texture texture;
+    texture.desc = desc;
+    m_Textures.push_back(texture);
+    return TextureId(m_Textures.size() - 1);
+}
+
+RenderGraph::PassBuilder RenderGraph::AddPass(const char* name) {
+    Pass pass;
+    pass.name = name;
+    m_Passes.push_back(pass);
+    return PassBuilder(*this, PassId(m_Passes.size() - 1));
+}
+
+void RenderGraph::Compile() {
+    for (PassId pass = 0; pass < PassId(m_Passes.size()); pass++) {
+        for (const TextureAccess& access : m_Passes[pass].accesses) {
+            Texture& texture = m_Textures[access.texture];
+            if (texture.firstPass == c_Invalid) {
+                texture.firstPass = pass;
+                texture.desc.initialState = access.state;
+                if (!access.write) {
+                    log::warning("Render graph texture '%s' is read by '%s' before it is written", texture.desc.debugName.c_str(),
+                        m_Passes[pass].name.c_str());
+                }
+            }
+            texture.lastPass = pass;
+        }
+    }
+    for (Texture& texture : m_Textures) {
+        if (texture.firstPass == c_Invalid) {
+            texture.firstPass = 0;
+            texture.lastPass = PassId(m_Passes.size());
+        }
+        texture.desc.keepInitialState = true;
+    }
+
+    const uint32_t compiles = m_Statistics.compiles + 1;
+    m_Statistics = RenderGraphStatistics();
+    m_Statistics.compiles = compiles;
+    m_Statistics.textures = uint32_t(m_Textures.size());
+    if (!m_Device->queryFeatureSupport(nvrhi::Feature::VirtualResources) || !CreatePlacedTextures()) {
+        CreateCommittedTextures();
+    }
+
+    log::info("Render graph: %u textures, %u aliased, %.1f MB placed in a %.1f MB heap, %.1f MB with an allocation each", m_Statistics.textures,
+        m_Statistics.aliasedTextures, double(m_Statistics.peakBytes) / double(1 << 20), double(m_Statistics.heapBytes) / double(1 << 20),
+        double(m_Statistics.dedicatedBytes) / double(1 << 20));
+}
+
+void RenderGraph::PlaceTextures() {
+    std::vector<uint32_t> order(m_Textures.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return m_Textures[a].size > m_Textures[b].size; });
+
+    // Largest first, each at the lowest offset where it overlaps no placed texture that is alive at the
+    // same time; the candidates are the start of the heap and the ends of those textures.
+    std::vector<uint32_t> placed;
+    std::vector<uint64_t> candidates;
+    for (uint32_t index : order) {
+        Texture& texture = m_Textures[index];
+        const auto livesWith = [&texture](const Texture& other) {
+            return texture.firstPass <= other.lastPass && other.firstPass <= texture.lastPass;
+        };
+
+        candidates.assign(1, 0);
+        for (uint32_t other : placed) {
+            if (livesWith(m_Textures[other])) {
+                candidates.push_back(AlignUp(m_Textures[other].offset + m_Textures[other].size, texture.alignment));
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        for (uint64_t offset : candidates) {
+            const bool fits = std::none_of(placed.begin(), placed.end(), [&](uint32_t other) {
+                const Texture& placedTexture = m_Textures[other];
+                return livesWith(placedTexture) && offset < placedTexture.offset + placedTexture.size &&
+                       placedTexture.offset < offset + texture.size;
+            });
+            if (fits) {
+                texture.offset = offset;
+                break;
+            }
+        }
+        placed.push_back(index);
+        m_Statistics.peakBytes = std::max(m_Statistics.peakBytes, texture.offset + texture.size);
+    }
+
+    for (Texture& texture : m_Textures) {
+        for (const Texture& other : m_Textures) {
+            if (&other != &texture && texture.offset < other.offset + other.size && other.offset < texture.offset + texture.size) {
+                texture.aliased = true;
+            }
+        }
+        m_Statistics.aliasedTextures += texture.aliased ? 1 : 0;
+    }
+}
+
+bool RenderGraph::CreatePlacedTextures() {
+    for (Texture& texture : m_Textures) {
+        texture.desc.isVirtual = true;
+        texture.texture = m_Device->createTexture(texture.desc);
+        if (!texture.texture) {
+            return false;
+        }
+        const nvrhi::MemoryRequirements requirements = m_Device->getTextureMemoryRequirements(texture.texture);
+        texture.size = requirements.size;
+        texture.alignment = std::max<uint64_t>(requirements.alignment, 1);
+        m_Statistics.dedicatedBytes += texture.size;
+    }
+
+    PlaceTextures();
+
+    m_Heap = m_HeapPool.Acquire(m_Statistics.peakBytes);
+    if (!m_Heap) {
+        return false;
+    }
+    m_Statistics.heapBytes = m_HeapPool.GetCapacity();
+
+    for (Texture& texture : m_Textures) {
+        // The first access has to find the texture in another state, so that it waits for the last one of
+        // the memory's previous texture.
+        if (texture.aliased) {
+            texture.desc.initialState = texture.desc.initialState == nvrhi::ResourceStates::ShaderResource ? nvrhi::ResourceStates::CopyDest
+                                                                                                           : nvrhi::ResourceStates::ShaderResource;
+            texture.texture = m_Device->createTexture(texture.desc);
+        }
+        if (!texture.texture || !m_Device->bindTextureMemory(texture.texture, m_Heap, texture.offset)) {
+            log::error("Cannot place render graph texture '%s'", texture.desc.debugName.c_str());
+            m_HeapPool.Release(m_Heap);
+            m_Heap = nullptr;
+            return false;
+        }
+    }
+    return true;
+}
+
+void RenderGraph::CreateCommittedTextures() {
+    const uint32_t compiles = m_Statistics.compiles;
+    m_Statistics = RenderGraphStatistics();
+    m_Statistics.compiles = compiles;
+    m_Statistics.textures = uint32_t(m_Textures.size());
+    for (Texture& texture : m_Textures) {
+        texture.desc.isVirtual = false;
+        texture.aliased = false;
+        texture.offset = 0;
+        texture.texture = m_Device->createTexture(texture.desc);
+        texture.size = EstimateTextureBytes(texture.desc);
+        m_Statistics.dedicatedBytes += texture.size;
+    }
+    m_Statistics.peakBytes = m_Statistics.dedicatedBytes;
+    m_Statistics.heapBytes = m_Statistics.dedicatedBytes;
+}
+
+void RenderGraph::BeginPass(nvrhi::ICommandList* commandList, PassId pass) {
+    const Pass& graphPass = m_Passes[pass];
+
+    for (const TextureAccess& access : graphPass.accesses) {
+        const Texture& texture = m_Textures[access.texture];
+        if (!texture.aliased || texture.firstPass != pass) {
+            continue;
+        }
+        const nvrhi::FormatInfo& formatInfo = nvrhi::getFormatInfo(texture.desc.format);
+        if (formatInfo.hasDepth || formatInfo.hasStencil) {
+            commandList->clearDepthStencilTexture(texture.texture, nvrhi::AllSubresources, formatInfo.hasDepth, texture.desc.clearValue.r,
+                formatInfo.hasStencil, 0);
+        } else {
+            commandList->clearTextureFloat(texture.texture, nvrhi::AllSubresources, texture.desc.clearValue);
+        }
+    }
+
+    for (const TextureAccess& access : graphPass.accesses) {
+        commandList->setTextureState(m_Textures[access.texture].texture, nvrhi::AllSubresources, access.state);
+    }
+    commandList->commitBarriers();
+
+    if (graphPass.skipAutomaticBarriers) {
+        commandList->setEnableAutomaticBarriers(false);
+    }
+}
+
+void RenderGraph::EndPass(nvrhi::ICommandList* commandList, PassId pass) {
+    if (m_Passes[pass].skipAutomaticBarriers) {
+        commandList->setEnableAutomaticBarriers(true);
+    }
+}
+
+} // namespace sanbox
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sanbox {
+
+// Device-local heaps that render targets are placed in. A heap serves one graph at a time and returns to
+// the pool when the graph is reset, so that a resize places the new targets in the memory of the old ones
+// whenever they fit.
+class RenderTargetHeapPool {
+public:
+    // Heaps are created in multiples of this, so that a window resized by a few pixels keeps its heap.
+    static constexpr uint64_t c_HeapGranularity = 32ull << 20;
+
+    explicit RenderTargetHeapPool(nvrhi::IDevice* device);
+
+    nvrhi::HeapHandle Acquire(uint64_t size);
+    void Release(nvrhi::IHeap* heap);
+
+    [[nodiscard]] uint64_t GetCapacity() const;
+    [[nodiscard]] uint32_t GetCreatedHeaps() const {
+        return m_CreatedHeaps;
+    }
+
+private:
+    struct PooledHeap {
+        nvrhi::HeapHandle heap;
+        uint64_t capacity = 0;
+        bool inUse = false;
+    };
+
+    nvrhi::DeviceHandle m_Device;
+    std::vector<PooledHeap> m_Heaps;
+    uint32_t m_CreatedHeaps = 0;
+};
+
+struct RenderGraphStatistics {
+    uint32_t textures = 0;
+    // Textures that share memory with another texture whose lifetime does not overlap theirs.
+    uint32_t aliasedTextures = 0;
+    // What the textures take with an allocation each, and what they take placed in one heap.
+    uint64_t dedicatedBytes = 0;
+    uint64_t peakBytes = 0;
+    uint64_t heapBytes = 0;
+    uint32_t compiles = 0;
+};
+
+// The render targets of a frame and the passes that use them, declared whenever the targets change rather
+// than every frame, so that the binding caches of the passes stay valid in between.
+// Compile gives every texture the range of passes it is used in and places the textures in one heap, two
+// textures overlapping in memory only when their lifetimes do not overlap. BeginPass moves the textures of
+// a pass into the states the pass declared, so that passes need no barriers of their own.
+// nvrhi has no aliasing barriers, so a texture that shares memory is created in a state other than the one
+// of its first access, which forces a transition there, and is cleared by that access's BeginPass; its
+// first access must be a write. Without virtual resource support every texture gets memory of its own.
+class RenderGraph {
+public:
+    using TextureId = uint32_t;
+    using PassId = uint32_t;
+    static constexpr uint32_t c_Invalid = ~0u;
+
+    class PassBuilder {
+    public:
+        PassBuilder(RenderGraph& graph, PassId pass)
+            : m_Graph(graph)
+            , m_Pass(pass) {
+        }
+
+        PassBuilder& Read(TextureId texture, nvrhi::ResourceStates state = nvrhi::ResourceStates::ShaderResource);
+        PassBuilder& Write(TextureId texture, nvrhi::ResourceStates state);
+        // For passes that touch nothing but their declared textures and resources that keep their states,
+        // such as the scene's, so that their draws can skip nvrhi's state tracking of every binding.
+        PassBuilder& SkipAutomaticBarriers();
+
+        [[nodiscard]] PassId GetId() const {
+            return m_Pass;
+        }
+
+    private:
+        RenderGraph& m_Graph;
+        PassId m_Pass;
+    };
+
+    RenderGraph(nvrhi::IDevice* device, RenderTargetHeapPool& heapPool);
+    ~RenderGraph();
+
+    // Drops the passes and textures and returns the heap to the pool. Frames in flight keep their textures
+    // through nvrhi's references.
+    void Reset();
+
+    // The desc's state fields are ignored; the graph sets them from the accesses.
+    TextureId CreateTexture(const nvrhi::TextureDesc& desc);
+    PassBuilder AddPass(const char* name);
+
+    void Compile();
+
+    [[nodiscard]] nvrhi::ITexture* GetTexture(TextureId texture) const {
+        return m_Textures[texture].texture;
+    }
+
+    void BeginPass(nvrhi::ICommandList* commandList, PassId pass);
+    void EndPass(nvrhi::ICommandList* commandList, PassId pass);
+
+    [[nodiscard]] const RenderGraphStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    struct TextureAccess {
+        TextureId texture = c_Invalid;
+        nvrhi::ResourceStates state = nvrhi::ResourceStates::Unknown;
+        bool write = false;
+    };
+    struct Pass {
+        std::string name;
+        std::vector<TextureAccess> accesses;
+        bool skipAutomaticBarriers = false;
+    };
+    struct Texture {
+        nvrhi::TextureDesc desc;
+        nvrhi::TextureHandle texture;
+        PassId firstPass = c_Invalid;
+        PassId lastPass = 0;
+        uint64_t size = 0;
+        uint64_t alignment = 1;
+        uint64_t offset = 0;
+        bool aliased = false;
+    };
+
+    void PlaceTextures();
+    bool CreatePlacedTextures();
+    void CreateCommittedTextures();
+
+    nvrhi::DeviceHandle m_Device;
+    RenderTargetHeapPool& m_HeapPool;
+    nvrhi::HeapHandle m_Heap;
+    std::vector<Pass> m_Passes;
+    std::vector<Texture> m_Textures;
+    RenderGraphStatistics m_Statistics;
+};
+
+// Begins a graph pass and ends it when the scope exits, next to the pass's ProfilerScope.
+class RenderGraphPassScope {
+public:
+    RenderGraphPassScope(RenderGraph& graph, nvrhi::ICommandList* commandList, RenderGraph::PassId pass)
+        : m_Graph(graph)
+        , m_CommandList(commandList)
+        , m_Pass(pass) {
+        m_Graph.BeginPass(m_CommandList, m_Pass);
+    }
+    ~RenderGraphPassScope() {
+        m_Graph.EndPass(m_CommandList, m_Pass);
+    }
+
+    RenderGraphPassScope(const RenderGraphPassScope&) = delete;
+    RenderGraphPassScope& operator=(const RenderGraphPassScope&) = delete;
+
+private:
+    RenderGraph& m_Graph;
+    nvrhi::ICommandList* m_CommandList;
+    RenderGraph::PassId m_Pass;
+};
+
+} // namespace sanbox
@@ -0,0 +1,206 @@
+#include "SceneApplication.h"
+
+#include <donut/core/log.h>
+#include <donut/shaders/light_types.h>
+
+#include <GLFW/glfw3.h>
+#include <nvrhi/utils.h>
+
+using namespace donut;
+
+namespace sanbox {
+
+SceneApplication::SceneApplication(app::DeviceManager* deviceManager, const BenchmarkParameters& benchmarkParams)
+    : ApplicationBase(deviceManager)
+    , m_BenchmarkParams(benchmarkParams) {
+}
+
+bool SceneApplication::IsLoading() const {
+    if (HasLoadingFailed()) {
+        return false;
+    }
+    return (m_SceneLoader && !m_SceneLoader->IsComplete()) || (m_TextureStreamer && m_TextureStreamer->IsDecoding());
+}
+
+bool SceneApplication::HasLoadingFailed() const {
+    return m_SceneLoader && m_SceneLoader->HasFailed();
+}
+
+std::unique_ptr<CachedScene> SceneApplication::CreateScene(std::shared_ptr<vfs::IFileSystem> fs) {
+    std::filesystem::path cacheDirectory;
+    if (m_BenchmarkParams.sceneCache) {
+        cacheDirectory = app::GetDirectoryWithExecutable() / "scene-cache";
+    }
+    auto scene = std::make_unique<CachedScene>(
+        GetDevice(), *m_ShaderFactory, std::move(fs), m_TextureCache, cacheDirectory, m_BenchmarkParams.rebuildSceneCache);
+    if (m_TextureStreamer) {
+        scene->SetTextureRequestHandler(
+            [this](const std::shared_ptr<engine::Material>& material, CachedScene::TextureSlot slot, const std::string& path, bool sRGB) {
+                m_TextureStreamer->RequestTexture(material, slot, path, sRGB);
+            });
+    }
+    return scene;
+}
+
+bool SceneApplication::LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) {
+    std::unique_ptr<CachedScene> scene = CreateScene(fs);
+
+    if (scene->Load(sceneFileName)) {
+        m_SceneLoadStatistics = scene->GetLoadStatistics();
+        m_Scene = std::move(scene);
+        return true;
+    }
+    return false;
+}
+
+void SceneApplication::SceneReady() {
+    engine::SceneGraph& sceneGraph = *m_Scene->GetSceneGraph();
+    std::vector<MeshProcessingReport> meshReports;
+    if (m_BenchmarkParams.meshOptimization) {
+        meshReports = OptimizeSceneMeshes(sceneGraph);
+    } else if (m_BenchmarkParams.vertexQuantization) {
+        meshReports = MeasureSceneMeshes(sceneGraph);
+    }
+
+    m_Scene->FinishedLoading(GetFrameIndex());
+
+    if (m_BenchmarkParams.vertexQuantization) {
+        m_VertexQuantizer = std::make_unique<VertexQuantizer>(GetDevice());
+        m_VertexQuantizer->Quantize(sceneGraph, meshReports);
+    }
+    if (!meshReports.empty()) {
+        m_MeshProcessing = SummarizeMeshReports(meshReports);
+    }
+
+    if (m_BenchmarkParams.meshLods) {
+        const std::filesystem::path cacheFileName = m_Scene->GetCacheFileName(".lods");
+        if (m_BenchmarkParams.gpuDriven || !m_BenchmarkParams.bvhCulling) {
+            log::warning("Mesh LODs are only drawn by the frustum-culled CPU draw path");
+        }
+        m_MeshLods = std::make_unique<MeshLodSet>(GetDevice());
+        m_MeshLods->Build(sceneGraph, cacheFileName, m_BenchmarkParams.rebuildSceneCache);
+        if (m_CulledDrawStrategy) {
+            m_CulledDrawStrategy->SetLods(m_MeshLods.get(), m_BenchmarkParams.lodErrorPixels);
+        }
+    }
+
+    if (m_BenchmarkParams.gridColumns * m_BenchmarkParams.gridRows > 1) {
+        m_InstanceGrid = std::make_unique<InstanceGrid>(sceneGraph, m_BenchmarkParams.gridColumns, m_BenchmarkParams.gridRows);
+        m_Scene->RefreshSceneGraph(GetFrameIndex());
+        m_SceneBuffersStale = true;
+        log::info("Instance grid: %u cells, %zu mesh instances", m_InstanceGrid->GetCellCount(), sceneGraph.GetMeshInstances().size());
+    }
+
+    // After the grid, so that its copies of the instances request mips as well.
+    if (m_TextureStreamer) {
+        m_TextureStreamer->AdoptSceneTextures(sceneGraph, *m_TextureCache);
+        m_TextureStreamer->StartDecoding(sceneGraph);
+    }
+
+    if (m_BenchmarkParams.stressLights > 0) {
+        AddStressLights(sceneGraph, m_BenchmarkParams.stressLights, sceneGraph.GetRootNode()->GetGlobalBoundingBox());
+        m_Scene->RefreshSceneGraph(GetFrameIndex());
+        log::info("Added %u stress lights", m_BenchmarkParams.stressLights);
+    }
+
+    if (m_ShadowMap) {
+        SetupShadows(sceneGraph);
+    }
+
+    if (m_BenchmarkParams.soaTransforms && m_InstanceGrid) {
+        if (m_GpuDrivenRenderer || !m_BenchmarkParams.bvhCulling) {
+            log::warning("Only the frustum-culled CPU draw path culls with the SoA transforms; the others keep the load-time bounds");
+        }
+        m_TransformHierarchy = std::make_unique<TransformHierarchy>();
+        m_TransformHierarchy->Build(sceneGraph);
+        if (m_BenchmarkParams.decoupledUpdate) {
+            m_SimulationTransforms = std::make_unique<TransformHierarchy>();
+            m_SimulationTransforms->Build(sceneGraph);
+        }
+        if (!m_JobSystem) {
+            m_JobSystem = std::make_unique<JobSystem>();
+        }
+        if (m_CulledDrawStrategy) {
+            m_CulledDrawStrategy->SetTransformHierarchy(m_TransformHierarchy.get());
+        }
+        if (m_ShadowMap) {
+            m_ShadowMap->SetTransformHierarchy(m_TransformHierarchy.get());
+        }
+        if (m_TextureStreamer) {
+            m_TextureStreamer->SetTransformHierarchy(m_TransformHierarchy.get());
+        }
+        const TransformUpdateStatistics& stats = m_TransformHierarchy->GetStatistics();
+        log::info("SoA transform hierarchy: %u nodes in %u levels", stats.nodes, stats.levels);
+    } else if (m_BenchmarkParams.decoupledUpdate && m_InstanceGrid && m_BenchmarkParams.animateGrid) {
+        log::warning("Without SoA transforms the grid is animated on the render thread");
+    }
+    ScenePrepared();
+}
+
+void SceneApplication::SetupShadows(engine::SceneGraph& sceneGraph) {
+    for (const auto& light : sceneGraph.GetLights()) {
+        if (light->GetLightType() == LightType_Directional) {
+            m_SunLight = std::static_pointer_cast<engine::DirectionalLight>(light);
+            break;
+        }
+    }
+    if (!m_SunLight) {
+        m_SunLight = AddSunLight(sceneGraph);
+        m_Scene->RefreshSceneGraph(GetFrameIndex());
+        log::info("Added a sun light for the shadow map");
+    }
+    m_SunLight->shadowMap = m_ShadowMap->GetShadowMap();
+
+    if (m_InstanceGrid && m_BenchmarkParams.animateGrid) {
+        m_ShadowMap->SetDynamicNodes(m_InstanceGrid->GetCellNodes());
+    }
+    m_ShadowMap->Invalidate();
+}
+
+bool SceneApplication::TakeLoadedScene(nvrhi::IFramebuffer* framebuffer) {
+    if (!m_Scene && m_SceneLoader) {
+        if (std::unique_ptr<CachedScene> scene = m_SceneLoader->TakeScene()) {
+            m_SceneLoadStatistics = scene->GetLoadStatistics();
+            m_Scene = std::move(scene);
+            SceneReady();
+        }
+    }
+    if (m_Scene) {
+        return true;
+    }
+
+    if (HasLoadingFailed()) {
+        // There is nothing to show; a headless run reports the failure in its exit code instead.
+        if (GLFWwindow* window = GetDeviceManager()->GetWindow()) {
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+    } else if (m_SceneLoader) {
+        RenderLoadingFrame(framebuffer);
+    }
+    return false;
+}
+
+// Shown until the progressive loader has the scene; the window stays responsive meanwhile.
+void SceneApplication::RenderLoadingFrame(nvrhi::IFramebuffer* framebuffer) {
+    FrameContext& frame = m_FramePipeline->BeginFrame();
+    frame.commandList->open();
+    nvrhi::utils::ClearColorAttachment(frame.commandList, framebuffer, 0, nvrhi::Color(0.f));
+    frame.commandList->close();
+    m_FramePipeline->Submit(frame);
+    m_SceneLoader->FrameRendered();
+}
+
+void SceneApplication::UpdateSceneTextures(nvrhi::ICommandList* commandList) {
+    ProfilerScope scope(m_Profiler.get(), commandList, "TextureUploads");
+    if (m_SceneLoader->UpdateTextures(*m_CommonPasses, *m_Scene)) {
+        MaterialTexturesChanged(commandList);
+        // Alpha-tested casters cut out their shape only once their textures have arrived.
+        if (m_ShadowMap) {
+            m_ShadowMap->Invalidate();
+        }
+    }
+    m_Profiler->SetCounter("texturesFinalized", m_SceneLoader->GetTexturesFinalized());
+    m_Profiler->SetCounter("texturesRequested", m_SceneLoader->GetTexturesRequested());
+}
+
+} // namespace sanbox
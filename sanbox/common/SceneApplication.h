@@ -0,0 +1,97 @@
+#pragma once
+
+#include <donut/app/ApplicationBase.h>
+#include <donut/core/vfs/VFS.h>
+#include <donut/engine/Scene.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/ShaderFactory.h>
+#include <nvrhi/nvrhi.h>
+
+#include <filesystem>
+#include <memory>
+
+#include "Benchmark.h"
+#include "CachedScene.h"
+#include "CachedShadowMap.h"
+#include "CulledDrawStrategy.h"
+#include "FramePipeline.h"
+#include "GpuDrivenRenderer.h"
+#include "JobSystem.h"
+#include "MeshLods.h"
+#include "MeshOptimizer.h"
+#include "Profiler.h"
+#include "ProgressiveSceneLoader.h"
+#include "StressScene.h"
+#include "TextureStreamer.h"
+#include "TransformHierarchy.h"
+#include "VertexQuantizer.h"
+
+namespace sanbox {
+
+// What the forward and deferred samples share of loading the scene: the scene itself, loaded synchronously
+// through ApplicationBase or progressively, and what the benchmark parameters build on it once it is ready.
+// The samples create the objects that their passes use as well in Init; SceneReady only refers to them.
+// Members are destroyed after those of the sample, so the sample's threads stop before they go away.
+class SceneApplication : public donut::app::ApplicationBase, public IBenchmarkTarget {
+public:
+    SceneApplication(donut::app::DeviceManager* deviceManager, const BenchmarkParameters& benchmarkParams);
+
+    bool IsLoading() const override;
+    bool HasLoadingFailed() const override;
+
+protected:
+    std::unique_ptr<CachedScene> CreateScene(std::shared_ptr<donut::vfs::IFileSystem> fs);
+    // Synchronous loading only; the progressive loader hands the scene over in TakeLoadedScene.
+    bool LoadScene(std::shared_ptr<donut::vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override;
+
+    // Creates the scene's GPU resources and adds what the benchmark parameters ask for, then calls ScenePrepared.
+    void SceneReady();
+    // For what only the sample sets up on the scene, such as handing its passes the quantized meshes.
+    virtual void ScenePrepared() {
+    }
+
+    // Render, before anything else: takes the scene over from the progressive loader once it is loaded.
+    // Returns false while there is no scene to draw, after rendering a loading frame into the framebuffer.
+    // A window closes when loading fails.
+    bool TakeLoadedScene(nvrhi::IFramebuffer* framebuffer);
+    // Attaches the textures that have arrived since the last frame and refreshes what refers to them.
+    void UpdateSceneTextures(nvrhi::ICommandList* commandList);
+    // Material constants and binding sets refer to the texture objects, which loading and streaming replace.
+    virtual void MaterialTexturesChanged(nvrhi::ICommandList* commandList) = 0;
+
+    BenchmarkParameters m_BenchmarkParams;
+    std::shared_ptr<donut::engine::ShaderFactory> m_ShaderFactory;
+    std::unique_ptr<FramePipeline> m_FramePipeline;
+    std::unique_ptr<Profiler> m_Profiler;
+
+    std::unique_ptr<CachedScene> m_Scene;
+    SceneLoadStatistics m_SceneLoadStatistics;
+    // Before the loader, whose scene passes it the texture requests until the loader is gone.
+    std::unique_ptr<TextureStreamer> m_TextureStreamer;
+    std::unique_ptr<ProgressiveSceneLoader> m_SceneLoader;
+    std::unique_ptr<VertexQuantizer> m_VertexQuantizer;
+    MeshProcessingReport m_MeshProcessing;
+    std::unique_ptr<MeshLodSet> m_MeshLods;
+    std::unique_ptr<InstanceGrid> m_InstanceGrid;
+    std::unique_ptr<TransformHierarchy> m_TransformHierarchy;
+    // With decoupled updates, the hierarchy that the simulation thread animates; m_TransformHierarchy then
+    // takes the instances over from the snapshots.
+    std::unique_ptr<TransformHierarchy> m_SimulationTransforms;
+    // Set when the scene grew after FinishedLoading, so that its buffers and what refers to them are
+    // recreated on the next frame.
+    bool m_SceneBuffersStale = false;
+
+    std::unique_ptr<CachedShadowMap> m_ShadowMap;
+    std::shared_ptr<donut::engine::DirectionalLight> m_SunLight;
+    std::shared_ptr<CulledDrawStrategy> m_CulledDrawStrategy;
+    std::unique_ptr<GpuDrivenRenderer> m_GpuDrivenRenderer;
+    std::unique_ptr<JobSystem> m_JobSystem;
+
+private:
+    // Gives the first directional light of the scene the shadow map, or a new sun light if it has none. The
+    // cells of an animated instance grid are the dynamic casters.
+    void SetupShadows(donut::engine::SceneGraph& sceneGraph);
+    void RenderLoadingFrame(nvrhi::IFramebuffer* framebuffer);
+};
+
+} // namespace sanbox
@@ -0,0 +1,86 @@
+#include "SharpenUpscalePass.h"
+
+using namespace donut;
+using namespace donut::math;
+
+#include "shaders/sharpen_upscale_cb.h"
+
+namespace sanbox {
+
+SharpenUpscalePass::SharpenUpscalePass(
+    nvrhi::IDevice* device, std::shared_ptr<engine::ShaderFactory> shaderFactory, std::shared_ptr<engine::CommonRenderPasses> commonPasses)
+    : m_Device(device)
+    , m_ShaderFactory(std::move(shaderFactory))
+    , m_CommonPasses(std::move(commonPasses)) {
+}
+
+bool SharpenUpscalePass::Init() {
+    m_PixelShader = m_ShaderFactory->CreateShader("sanbox/sharpen_upscale_ps.hlsl", "main", nullptr, nvrhi::ShaderType::Pixel);
+    if (!m_PixelShader) {
+        return false;
+    }
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Pixel;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::PushConstants(0, sizeof(SharpenUpscaleConstants)),
+        nvrhi::BindingLayoutItem::Texture_SRV(0),
+        nvrhi::BindingLayoutItem::Sampler(0),
+    };
+    m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
+    return m_BindingLayout != nullptr;
+}
+
+void SharpenUpscalePass::ResetBindingCache() {
+    m_BindingSet = nullptr;
+    m_BoundSource = nullptr;
+}
+
+void SharpenUpscalePass::Render(
+    nvrhi::ICommandList* commandList, nvrhi::IFramebuffer* framebuffer, nvrhi::ITexture* source, const nvrhi::Rect& sourceRect, float sharpness) {
+    if (!m_Pipeline || m_Pipeline->getFramebufferInfo() != framebuffer->getFramebufferInfo()) {
+        nvrhi::GraphicsPipelineDesc pipelineDesc;
+        pipelineDesc.primType = nvrhi::PrimitiveType::TriangleStrip;
+        pipelineDesc.VS = m_CommonPasses->m_FullscreenVS;
+        pipelineDesc.PS = m_PixelShader;
+        pipelineDesc.bindingLayouts = {m_BindingLayout};
+        pipelineDesc.renderState.rasterState.setCullNone();
+        pipelineDesc.renderState.depthStencilState.depthTestEnable = false;
+        m_Pipeline = m_Device->createGraphicsPipeline(pipelineDesc, framebuffer);
+    }
+
+    if (!m_BindingSet || m_BoundSource != source) {
+        nvrhi::BindingSetDesc setDesc;
+        setDesc.bindings = {
+            nvrhi::BindingSetItem::PushConstants(0, sizeof(SharpenUpscaleConstants)),
+            nvrhi::BindingSetItem::Texture_SRV(0, source),
+            nvrhi::BindingSetItem::Sampler(0, m_CommonPasses->m_LinearClampSampler),
+        };
+        m_BindingSet = m_Device->createBindingSet(setDesc, m_BindingLayout);
+        m_BoundSource = source;
+    }
+
+    const nvrhi::TextureDesc& sourceDesc = source->getDesc();
+    const float2 texelSize = float2(1.f / float(sourceDesc.width), 1.f / float(sourceDesc.height));
+
+    SharpenUpscaleConstants constants = {};
+    constants.sourceOrigin = float2(float(sourceRect.minX), float(sourceRect.minY)) * texelSize;
+    constants.sourceSize = float2(float(sourceRect.width()), float(sourceRect.height())) * texelSize;
+    constants.sourceTexelSize = texelSize;
+    constants.sharpness = sharpness;
+
+    const nvrhi::FramebufferInfoEx& framebufferInfo = framebuffer->getFramebufferInfo();
+    nvrhi::GraphicsState state;
+    state.pipeline = m_Pipeline;
+    state.framebuffer = framebuffer;
+    state.bindings = {m_BindingSet};
+    state.viewport.addViewportAndScissorRect(nvrhi::Viewport(float(framebufferInfo.width), float(framebufferInfo.height)));
+    commandList->setGraphicsState(state);
+    commandList->setPushConstants(&constants, sizeof(constants));
+
+    nvrhi::DrawArguments args;
+    args.vertexCount = 4;
+    commandList->draw(args);
+}
+
+} // namespace sanbox
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/ShaderFactory.h>
+#include <nvrhi/nvrhi.h>
+
+#include <memory>
+
+namespace sanbox {
+
+// Scales a rectangle of a texture to the whole of a framebuffer with bilinear filtering, and sharpens the
+// result to make up for some of the detail lost to rendering at a lower resolution. Stands in for
+// CommonRenderPasses::BlitTexture at the end of a frame rendered at a dynamic scale.
+class SharpenUpscalePass {
+public:
+    SharpenUpscalePass(nvrhi::IDevice* device, std::shared_ptr<donut::engine::ShaderFactory> shaderFactory,
+        std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses);
+
+    bool Init();
+
+    // A sharpness of 0 is a plain bilinear upscale, 1 the strongest sharpening.
+    void Render(nvrhi::ICommandList* commandList, nvrhi::IFramebuffer* framebuffer, nvrhi::ITexture* source, const nvrhi::Rect& sourceRect,
+        float sharpness);
+
+    // Drops the binding set, which references the source texture of the last Render.
+    void ResetBindingCache();
+
+private:
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::ShaderFactory> m_ShaderFactory;
+    std::shared_ptr<donut::engine::CommonRenderPasses> m_CommonPasses;
+
+    nvrhi::ShaderHandle m_PixelShader;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    // Created for the formats of the framebuffer it is drawn to, and again only when they change.
+    nvrhi::GraphicsPipelineHandle m_Pipeline;
+
+    nvrhi::BindingSetHandle m_BindingSet;
+    nvrhi::ITexture* m_BoundSource = nullptr;
+};
+
+} // namespace sanbox
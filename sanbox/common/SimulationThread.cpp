@@ -0,0 +1,95 @@
+#include "SimulationThread.h"
+
+#include <algorithm>
+
+namespace sanbox {
+
+SimulationThread::SimulationThread(float updateRate)
+    : m_Period(1.f / std::max(updateRate, 1.f)) {
+}
+
+SimulationThread::~SimulationThread() {
+    Stop();
+}
+
+void SimulationThread::Start(UpdateFunction update) {
+    Stop();
+    m_UpdateFunction = std::move(update);
+    m_StopRequested = false;
+    Update();
+    m_Thread = std::thread(&SimulationThread::ThreadMain, this);
+}
+
+void SimulationThread::Stop() {
+    if (!m_Thread.joinable()) {
+        return;
+    }
+    m_StopRequested = true;
+    m_Thread.join();
+}
+
+void SimulationThread::Post(std::function<void()> event) {
+    std::lock_guard<std::mutex> lock(m_EventMutex);
+    m_Events.push_back({std::move(event), std::chrono::high_resolution_clock::now()});
+}
+
+const SimulationSnapshot* SimulationThread::AcquireLatest() {
+    bool fresh = false;
+    const SimulationSnapshot* snapshot = m_Snapshots.AcquireLatest(fresh);
+    if (snapshot && !fresh) {
+        m_RepeatedSnapshots++;
+    }
+    return snapshot;
+}
+
+SimulationStatistics SimulationThread::GetStatistics() const {
+    SimulationStatistics stats;
+    stats.updates = m_PublishedUpdates.load(std::memory_order_relaxed);
+    stats.skippedSnapshots = m_SkippedSnapshots.load(std::memory_order_relaxed);
+    stats.repeatedSnapshots = m_RepeatedSnapshots;
+    return stats;
+}
+
+void SimulationThread::Update() {
+    const auto updateStart = std::chrono::high_resolution_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_EventMutex);
+        m_PendingEvents.swap(m_Events);
+    }
+
+    SimulationSnapshot& snapshot = m_Snapshots.GetBack();
+    snapshot.inputTime = updateStart;
+    for (Event& event : m_PendingEvents) {
+        event.function();
+        snapshot.inputTime = std::min(snapshot.inputTime, event.postTime);
+    }
+    m_PendingEvents.clear();
+
+    // A fixed step, so that the simulation does not depend on how the thread is scheduled.
+    m_UpdateCount++;
+    m_Time += double(m_Period);
+    snapshot.update = m_UpdateCount;
+    snapshot.time = m_Time;
+    m_UpdateFunction(m_Period, snapshot);
+
+    snapshot.publishTime = std::chrono::high_resolution_clock::now();
+    if (!m_Snapshots.Publish()) {
+        m_SkippedSnapshots.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_PublishedUpdates.store(m_UpdateCount, std::memory_order_relaxed);
+}
+
+void SimulationThread::ThreadMain() {
+    const auto period = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<float>(m_Period));
+    auto nextUpdate = std::chrono::high_resolution_clock::now() + period;
+
+    while (!m_StopRequested) {
+        std::this_thread::sleep_until(nextUpdate);
+        Update();
+
+        // An update that overran starts the next one right away instead of catching up on the missed ones.
+        nextUpdate = std::max(nextUpdate + period, std::chrono::high_resolution_clock::now());
+    }
+}
+
+} // namespace sanbox
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "TransformHierarchy.h"
+
+namespace sanbox {
+
+// What the render thread needs of one simulation update. Written by the simulation thread only, and
+// read-only once published.
+struct SimulationSnapshot {
+    uint64_t update = 0;
+    double time = 0.0;
+    // When the oldest input that the update took in was posted, or when the update began without input.
+    std::chrono::high_resolution_clock::time_point inputTime;
+    std::chrono::high_resolution_clock::time_point publishTime;
+
+    dm::float3 cameraPosition = 0.f;
+    dm::float3 cameraDirection = 0.f;
+    dm::affine3 worldToView = dm::affine3::identity();
+    InstanceTransformSnapshot instances;
+};
+
+// Latest-value handoff between one producer and one consumer thread over three slots: one being written,
+// one being read, and one holding the newest finished value. Neither side waits for the other; the
+// producer overwrites values that the consumer never took, and the consumer reads the newest value again
+// until a newer one is published.
+template <typename T>
+class SnapshotBuffer {
+public:
+    // Producer. Holds whatever was last written to the slot, so unchanged parts need not be written again.
+    [[nodiscard]] T& GetBack() {
+        return m_Slots[m_Back];
+    }
+    // Producer. Returns false if the value it replaced was never acquired.
+    bool Publish() {
+        const uint32_t previous = m_Middle.exchange(m_Back | c_Fresh, std::memory_order_acq_rel);
+        m_Back = previous & c_IndexMask;
+        return !(previous & c_Fresh);
+    }
+
+    // Consumer. Null until the first value is published. Returns false in fresh if the value is the one
+    // acquired last time.
+    [[nodiscard]] const T* AcquireLatest(bool& fresh) {
+        fresh = (m_Middle.load(std::memory_order_relaxed) & c_Fresh) != 0;
+        if (fresh) {
+            m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & c_IndexMask;
+            m_HasFront = true;
+        }
+        return m_HasFront ? &m_Slots[m_Front] : nullptr;
+    }
+
+private:
+    static constexpr uint32_t c_IndexMask = 3;
+    static constexpr uint32_t c_Fresh = 4;
+
+    std::array<T, 3> m_Slots;
+    uint32_t m_Back = 0;
+    std::atomic<uint32_t> m_Middle = 1;
+    uint32_t m_Front = 2;
+    bool m_HasFront = false;
+};
+
+struct SimulationStatistics {
+    uint64_t updates = 0;
+    // Snapshots overwritten before the render thread took them, and frames that drew a snapshot again.
+    uint64_t skippedSnapshots = 0;
+    uint64_t repeatedSnapshots = 0;
+};
+
+// Runs the simulation of a sample at a fixed rate on a thread of its own, so that neither waits for the
+// other: every update ends in a snapshot that the render thread takes the newest of when a frame begins.
+// Input reaches the simulation as events posted from the render thread, which run before the next update.
+// Only the update function and the events touch the simulation state while the thread runs.
+class SimulationThread {
+public:
+    using UpdateFunction = std::function<void(float elapsedSeconds, SimulationSnapshot& snapshot)>;
+
+    explicit SimulationThread(float updateRate);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // Runs the first update on the calling thread, so that there is a snapshot from the start.
+    void Start(UpdateFunction update);
+    void Stop();
+    [[nodiscard]] bool IsRunning() const {
+        return m_Thread.joinable();
+    }
+
+    void Post(std::function<void()> event);
+
+    // Render thread. The snapshot stays valid until the next call. Never blocks.
+    [[nodiscard]] const SimulationSnapshot* AcquireLatest();
+
+    // Render thread.
+    [[nodiscard]] SimulationStatistics GetStatistics() const;
+
+private:
+    struct Event {
+        std::function<void()> function;
+        std::chrono::high_resolution_clock::time_point postTime;
+    };
+
+    void Update();
+    void ThreadMain();
+
+    float m_Period;
+    UpdateFunction m_UpdateFunction;
+    std::thread m_Thread;
+    std::atomic<bool> m_StopRequested = false;
+
+    std::mutex m_EventMutex;
+    std::vector<Event> m_Events;
+    std::vector<Event> m_PendingEvents;
+
+    SnapshotBuffer<SimulationSnapshot> m_Snapshots;
+    uint64_t m_UpdateCount = 0;
+    double m_Time = 0.0;
+    std::atomic<uint64_t> m_PublishedUpdates = 0;
+    std::atomic<uint64_t> m_SkippedSnapshots = 0;
+    uint64_t m_RepeatedSnapshots = 0;
+};
+
+} // namespace sanbox
@@ -0,0 +1,168 @@
+#include "StressScene.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "TransformHierarchy.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+namespace {
+
+// Copies the node and everything below it, with new instances of the same meshes; other leaves are left out.
+void CopyMeshSubtree(engine::SceneGraph& sceneGraph, const engine::SceneGraphNode& source, const std::shared_ptr<engine::SceneGraphNode>& parent) {
+    auto node = std::make_shared<engine::SceneGraphNode>();
+    node->SetName(source.GetName());
+    node->SetTransform(&source.GetTranslation(), &source.GetRotation(), &source.GetScaling());
+    if (auto instance = std::dynamic_pointer_cast<engine::MeshInstance>(source.GetLeaf())) {
+        node->SetLeaf(std::make_shared<engine::MeshInstance>(instance->GetMesh()));
+    }
+    sceneGraph.Attach(parent, node);
+
+    for (const engine::SceneGraphNode* child = source.GetFirstChild(); child; child = child->GetNextSibling()) {
+        CopyMeshSubtree(sceneGraph, *child, node);
+    }
+}
+
+} // namespace
+
+std::shared_ptr<engine::SceneGraphNode> AddStressLights(engine::SceneGraph& sceneGraph, uint32_t count, const box3& bounds, uint32_t seed) {
+    auto root = std::make_shared<engine::SceneGraphNode>();
+    root->SetName("StressLights");
+    sceneGraph.Attach(sceneGraph.GetRootNode(), root);
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+    // Ranges shrink as the count grows so the total light coverage of the scene stays roughly constant.
+    const float extent = length(bounds.diagonal());
+    const float maxRange = std::max(extent * 0.15f / std::cbrt(float(std::max(count, 1u)) / 64.f), 1.f);
+
+    for (uint32_t i = 0; i < count; i++) {
+        auto light = std::make_shared<engine::PointLight>();
+        light->color = float3(unit(random), unit(random), unit(random)) * 0.8f + 0.2f;
+        light->range = maxRange * (0.5f + 0.5f * unit(random));
+        light->intensity = light->range * light->range * 0.05f;
+        light->radius = 0.05f;
+
+        const float3 position = bounds.m_mins + bounds.diagonal() * float3(unit(random), unit(random), unit(random));
+
+        auto node = std::make_shared<engine::SceneGraphNode>();
+        node->SetTranslation(double3(position));
+        node->SetLeaf(light);
+        sceneGraph.Attach(root, node);
+    }
+
+    return root;
+}
+
+std::shared_ptr<engine::DirectionalLight> AddSunLight(engine::SceneGraph& sceneGraph) {
+    auto sun = std::make_shared<engine::DirectionalLight>();
+    sun->color = float3(1.f, 0.95f, 0.85f);
+    sun->irradiance = 4.f;
+    sun->angularSize = 0.53f;
+
+    auto node = std::make_shared<engine::SceneGraphNode>();
+    node->SetName("Sun");
+    node->SetLeaf(sun);
+    sceneGraph.Attach(sceneGraph.GetRootNode(), node);
+    sun->SetDirection(normalize(double3(0.25, -1.0, 0.35)));
+
+    return sun;
+}
+
+InstanceGrid::InstanceGrid(engine::SceneGraph& sceneGraph, uint32_t columns, uint32_t rows) {
+    const std::shared_ptr<engine::SceneGraphNode>& root = sceneGraph.GetRootNode();
+    std::vector<const engine::SceneGraphNode*> sourceChildren;
+    for (const engine::SceneGraphNode* child = root->GetFirstChild(); child; child = child->GetNextSibling()) {
+        sourceChildren.push_back(child);
+    }
+
+    const float3 extent = root->GetGlobalBoundingBox().diagonal();
+    const float spacingX = std::max(extent.x * 1.1f, 1.f);
+    const float spacingZ = std::max(extent.z * 1.1f, 1.f);
+    m_BobAmplitude = extent.y * 0.05f;
+
+    auto gridNode = std::make_shared<engine::SceneGraphNode>();
+    gridNode->SetName("InstanceGrid");
+    sceneGraph.Attach(root, gridNode);
+
+    for (uint32_t row = 0; row < rows; row++) {
+        for (uint32_t column = 0; column < columns; column++) {
+            if (row == 0 && column == 0) {
+                continue;
+            }
+
+            const float3 origin(float(column) * spacingX, 0.f, float(row) * spacingZ);
+            auto cell = std::make_shared<engine::SceneGraphNode>();
+            cell->SetName("InstanceGridCell");
+            cell->SetTranslation(double3(origin));
+            sceneGraph.Attach(gridNode, cell);
+
+            // The root's own transform applies to the copies too.
+            auto sceneCopy = std::make_shared<engine::SceneGraphNode>();
+            sceneCopy->SetTransform(&root->GetTranslation(), &root->GetRotation(), &root->GetScaling());
+            sceneGraph.Attach(cell, sceneCopy);
+            for (const engine::SceneGraphNode* child : sourceChildren) {
+                CopyMeshSubtree(sceneGraph, *child, sceneCopy);
+            }
+
+            m_Cells.push_back(cell);
+            m_CellOrigins.push_back(origin);
+        }
+    }
+}
+
+std::vector<const engine::SceneGraphNode*> InstanceGrid::GetCellNodes() const {
+    std::vector<const engine::SceneGraphNode*> nodes;
+    nodes.reserve(m_Cells.size());
+    for (const auto& cell : m_Cells) {
+        nodes.push_back(cell.get());
+    }
+    return nodes;
+}
+
+void InstanceGrid::GetCellPose(uint32_t cell, float time, float3& position, float& yaw) const {
+    // Golden angle steps, so that neighboring cells are out of phase.
+    const float phase = float(cell) * 2.39996f;
+    position = m_CellOrigins[cell] + float3(0.f, m_BobAmplitude * std::sin(time * 1.5f + phase), 0.f);
+    yaw = 0.1f * std::sin(time * 0.5f + phase);
+}
+
+void InstanceGrid::Animate(float time) {
+    for (uint32_t cell = 0; cell < uint32_t(m_Cells.size()); cell++) {
+        float3 position;
+        float yaw;
+        GetCellPose(cell, time, position, yaw);
+        const double3 translation(position);
+        const dquat rotation = rotationQuat(double3(0.0, 1.0, 0.0), double(yaw));
+        m_Cells[cell]->SetTransform(&translation, &rotation, nullptr);
+    }
+}
+
+void InstanceGrid::Animate(float time, TransformHierarchy& hierarchy) {
+    if (m_Hierarchy != &hierarchy || m_HierarchyNodeCount != hierarchy.GetStatistics().nodes) {
+        m_Hierarchy = &hierarchy;
+        m_HierarchyNodeCount = hierarchy.GetStatistics().nodes;
+        m_HierarchyNodes.clear();
+        for (const auto& cell : m_Cells) {
+            m_HierarchyNodes.push_back(hierarchy.FindNode(cell.get()));
+        }
+    }
+
+    for (uint32_t cell = 0; cell < uint32_t(m_Cells.size()); cell++) {
+        if (m_HierarchyNodes[cell] == TransformHierarchy::c_InvalidNode) {
+            continue;
+        }
+        float3 position;
+        float yaw;
+        GetCellPose(cell, time, position, yaw);
+        hierarchy.SetLocalTransform(m_HierarchyNodes[cell], rotation(float3(0.f, 1.f, 0.f), yaw) * translation(position));
+    }
+}
+
+} // namespace sanbox
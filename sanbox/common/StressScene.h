@@ -0,0 +1,54 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/engine/SceneGraph.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace sanbox {
+
+// Attaches count point lights with random colors and ranges under one new node of the graph, spread
+// uniformly through bounds. The same seed always produces the same lights. Returns the new node.
+std::shared_ptr<donut::engine::SceneGraphNode> AddStressLights(
+    donut::engine::SceneGraph& sceneGraph, uint32_t count, const dm::box3& bounds, uint32_t seed = 1);
+
+// Attaches a directional light under a new node of the graph, for scenes that come without one. It shines
+// steeply enough to light the floor of an atrium and at an angle that gives walls and columns long shadows.
+std::shared_ptr<donut::engine::DirectionalLight> AddSunLight(donut::engine::SceneGraph& sceneGraph);
+
+class TransformHierarchy;
+
+// Copies of the mesh instances of a scene laid out in a grid of columns x rows cells on the XZ plane,
+// spaced by the extent of the scene. Cell 0 is the loaded scene itself, which stays where it is; every
+// other cell is a node of its own with a copy of the node hierarchy above the mesh instances.
+// Animated cells bob and sway about their origin, each with its own phase.
+class InstanceGrid {
+public:
+    // The graph must have been refreshed, since the spacing comes from the bounds of its root.
+    InstanceGrid(donut::engine::SceneGraph& sceneGraph, uint32_t columns, uint32_t rows);
+
+    // Moves the cell nodes of the scene graph, for donut's own transform propagation.
+    void Animate(float time);
+    // Moves the same cells in the hierarchy instead, which must have been built after the grid.
+    void Animate(float time, TransformHierarchy& hierarchy);
+
+    [[nodiscard]] uint32_t GetCellCount() const {
+        return uint32_t(m_Cells.size()) + 1;
+    }
+    // The nodes of every cell but the loaded scene, which are the ones that Animate moves.
+    [[nodiscard]] std::vector<const donut::engine::SceneGraphNode*> GetCellNodes() const;
+
+private:
+    void GetCellPose(uint32_t cell, float time, dm::float3& position, float& yaw) const;
+
+    std::vector<std::shared_ptr<donut::engine::SceneGraphNode>> m_Cells;
+    std::vector<dm::float3> m_CellOrigins;
+    std::vector<uint32_t> m_HierarchyNodes;
+    const TransformHierarchy* m_Hierarchy = nullptr;
+    uint32_t m_HierarchyNodeCount = 0;
+    float m_BobAmplitude = 0.f;
+};
+
+} // namespace sanbox
@@ -0,0 +1,539 @@
+#include "TextureStreamer.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "TransformHierarchy.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace sanbox {
+
+// Borrows the texture cache's file reading and image decoding, without its upload path.
+class TextureDecoder : public engine::TextureCache {
+public:
+    TextureDecoder(nvrhi::IDevice* device, std::shared_ptr<vfs::IFileSystem> fs)
+        : TextureCache(device, std::move(fs), nullptr) {
+    }
+
+    std::shared_ptr<engine::TextureData> Decode(const std::filesystem::path& path) const {
+        std::shared_ptr<vfs::IBlob> fileData = ReadTextureFile(path);
+        if (!fileData) {
+            return nullptr;
+        }
+        auto texture = std::make_shared<engine::TextureData>();
+        texture->path = path.generic_string();
+        if (!FillTextureData(fileData, texture, path.extension().generic_string(), "")) {
+            return nullptr;
+        }
+        return texture;
+    }
+};
+
+namespace {
+
+struct MaterialTextureSlot {
+    CachedScene::TextureSlot slot;
+    bool sRGB;
+};
+
+// Color textures are sRGB, as the glTF importer loads them.
+const MaterialTextureSlot c_MaterialTextureSlots[] = {
+    {&engine::Material::baseOrDiffuseTexture, true},
+    {&engine::Material::metalRoughOrSpecularTexture, false},
+    {&engine::Material::normalTexture, false},
+    {&engine::Material::emissiveTexture, true},
+    {&engine::Material::occlusionTexture, false},
+    {&engine::Material::transmissionTexture, false},
+    {&engine::Material::opacityTexture, false},
+};
+
+nvrhi::Format GetSrgbFormat(nvrhi::Format format) {
+    switch (format) {
+    case nvrhi::Format::RGBA8_UNORM:
+        return nvrhi::Format::SRGBA8_UNORM;
+    case nvrhi::Format::BGRA8_UNORM:
+        return nvrhi::Format::SBGRA8_UNORM;
+    case nvrhi::Format::BC1_UNORM:
+        return nvrhi::Format::BC1_UNORM_SRGB;
+    case nvrhi::Format::BC2_UNORM:
+        return nvrhi::Format::BC2_UNORM_SRGB;
+    case nvrhi::Format::BC3_UNORM:
+        return nvrhi::Format::BC3_UNORM_SRGB;
+    case nvrhi::Format::BC7_UNORM:
+        return nvrhi::Format::BC7_UNORM_SRGB;
+    default:
+        return format;
+    }
+}
+
+float SrgbToLinear(uint8_t value) {
+    static const std::array<float, 256> table = []() {
+        std::array<float, 256> result {};
+        for (uint32_t i = 0; i < 256; i++) {
+            const float c = float(i) / 255.f;
+            result[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return result;
+    }();
+    return table[value];
+}
+
+uint8_t LinearToSrgb(float value) {
+    const float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    return uint8_t(std::clamp(c * 255.f + 0.5f, 0.f, 255.f));
+}
+
+// 2x2 box filter of 8-bit four-channel texels; color channels are averaged in linear space for sRGB data.
+void DownsampleRgba8(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, bool sRGB) {
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            float sum[4] = {};
+            for (uint32_t sample = 0; sample < 4; sample++) {
+                const uint32_t sx = std::min(x * 2 + (sample & 1), srcWidth - 1);
+                const uint32_t sy = std::min(y * 2 + (sample >> 1), srcHeight - 1);
+                const uint8_t* texel = src + (size_t(sy) * srcWidth + sx) * 4;
+                for (uint32_t channel = 0; channel < 4; channel++) {
+                    sum[channel] += sRGB && channel < 3 ? SrgbToLinear(texel[channel]) : float(texel[channel]) / 255.f;
+                }
+            }
+            uint8_t* texel = dst + (size_t(y) * dstWidth + x) * 4;
+            for (uint32_t channel = 0; channel < 4; channel++) {
+                const float average = sum[channel] * 0.25f;
+                texel[channel] = sRGB && channel < 3 ? LinearToSrgb(average) : uint8_t(std::clamp(average * 255.f + 0.5f, 0.f, 255.f));
+            }
+        }
+    }
+}
+
+void DownsampleRgba32F(const float* src, uint32_t srcWidth, uint32_t srcHeight, float* dst, uint32_t dstWidth, uint32_t dstHeight) {
+    for (uint32_t y = 0; y < dstHeight; y++) {
+        for (uint32_t x = 0; x < dstWidth; x++) {
+            float* texel = dst + (size_t(y) * dstWidth + x) * 4;
+            std::fill(texel, texel + 4, 0.f);
+            for (uint32_t sample = 0; sample < 4; sample++) {
+                const uint32_t sx = std::min(x * 2 + (sample & 1), srcWidth - 1);
+                const uint32_t sy = std::min(y * 2 + (sample >> 1), srcHeight - 1);
+                const float* source = src + (size_t(sy) * srcWidth + sx) * 4;
+                for (uint32_t channel = 0; channel < 4; channel++) {
+                    texel[channel] += source[channel] * 0.25f;
+                }
+            }
+        }
+    }
+}
+
+// Object-space distance per unit of UV over the triangles of a geometry, or 0 if it has no usable UVs.
+float ComputeWorldPerUv(const engine::MeshInfo& mesh, const engine::MeshGeometry& geometry) {
+    const engine::BufferGroup& buffers = *mesh.buffers;
+    if (buffers.texcoord1Data.empty() || buffers.positionData.empty() || buffers.indexData.empty()) {
+        return 0.f;
+    }
+
+    const uint32_t firstIndex = mesh.indexOffset + geometry.indexOffsetInMesh;
+    const uint32_t firstVertex = mesh.vertexOffset + geometry.vertexOffsetInMesh;
+    double worldArea = 0.0;
+    double uvArea = 0.0;
+    for (uint32_t index = 0; index + 2 < geometry.numIndices; index += 3) {
+        const uint32_t v0 = firstVertex + buffers.indexData[firstIndex + index];
+        const uint32_t v1 = firstVertex + buffers.indexData[firstIndex + index + 1];
+        const uint32_t v2 = firstVertex + buffers.indexData[firstIndex + index + 2];
+
+        worldArea += length(cross(buffers.positionData[v1] - buffers.positionData[v0], buffers.positionData[v2] - buffers.positionData[v0]));
+        const float2 uv1 = buffers.texcoord1Data[v1] - buffers.texcoord1Data[v0];
+        const float2 uv2 = buffers.texcoord1Data[v2] - buffers.texcoord1Data[v0];
+        uvArea += std::abs(uv1.x * uv2.y - uv1.y * uv2.x);
+    }
+    return uvArea > 0.0 ? float(std::sqrt(worldArea / uvArea)) : 0.f;
+}
+
+// The same image can be used as color and as data, which are different textures.
+std::string GetTextureKey(const std::string& path, bool sRGB) {
+    return sRGB ? path + "|srgb" : path;
+}
+
+} // namespace
+
+uint64_t TextureStreamer::StreamedTexture::GetBytes(uint32_t firstMip) const {
+    uint64_t bytes = 0;
+    for (uint32_t mip = firstMip; mip < uint32_t(mips.size()); mip++) {
+        bytes += mips[mip].data.size();
+    }
+    return bytes;
+}
+
+TextureStreamer::TextureStreamer(nvrhi::IDevice* device, std::shared_ptr<vfs::IFileSystem> fs, uint64_t budgetBytes, uint32_t decodeThreads)
+    : m_Device(device)
+    , m_Decoder(std::make_unique<TextureDecoder>(device, std::move(fs)))
+    , m_BudgetBytes(budgetBytes)
+    , m_DecodeThreads(decodeThreads) {
+    m_Statistics.budgetBytes = budgetBytes;
+}
+
+TextureStreamer::~TextureStreamer() {
+    if (m_DecodeThread.joinable()) {
+        m_DecodeThread.join();
+    }
+}
+
+uint32_t TextureStreamer::AddTexture(const std::string& path, bool sRGB) {
+    const std::string key = GetTextureKey(path, sRGB);
+    auto it = m_TextureIndices.find(key);
+    if (it != m_TextureIndices.end()) {
+        return it->second;
+    }
+
+    StreamedTexture& texture = m_Textures.emplace_back();
+    texture.loaded = std::make_shared<engine::LoadedTexture>();
+    texture.loaded->path = path;
+    texture.path = path;
+    texture.sRGB = sRGB;
+
+    const uint32_t index = uint32_t(m_Textures.size() - 1);
+    m_TextureIndices[key] = index;
+    return index;
+}
+
+void TextureStreamer::RequestTexture(
+    const std::shared_ptr<engine::Material>& material, CachedScene::TextureSlot slot, const std::string& path, bool sRGB) {
+    StreamedTexture& texture = m_Textures[AddTexture(path, sRGB)];
+    (*material).*slot = texture.loaded;
+    if (std::find(texture.materials.begin(), texture.materials.end(), material) == texture.materials.end()) {
+        texture.materials.push_back(material);
+    }
+}
+
+void TextureStreamer::AdoptSceneTextures(const engine::SceneGraph& sceneGraph, engine::TextureCache& textureCache) {
+    for (const auto& material : sceneGraph.GetMaterials()) {
+        for (const MaterialTextureSlot& textureSlot : c_MaterialTextureSlots) {
+            // A copy, since the request replaces the texture in the slot.
+            std::shared_ptr<engine::LoadedTexture> cached = (*material).*textureSlot.slot;
+            if (!cached || cached->path.empty()) {
+                continue;
+            }
+            auto it = m_TextureIndices.find(GetTextureKey(cached->path, textureSlot.sRGB));
+            if (it != m_TextureIndices.end() && m_Textures[it->second].loaded == cached) {
+                continue;
+            }
+            RequestTexture(material, textureSlot.slot, cached->path, textureSlot.sRGB);
+            textureCache.UnloadTexture(cached);
+        }
+    }
+}
+
+void TextureStreamer::StartDecoding(const engine::SceneGraph& sceneGraph) {
+    std::unordered_map<const engine::LoadedTexture*, uint32_t> textureIndices;
+    for (uint32_t index = 0; index < uint32_t(m_Textures.size()); index++) {
+        textureIndices[m_Textures[index].loaded.get()] = index;
+    }
+
+    std::unordered_map<const engine::MeshGeometry*, float> worldPerUv;
+    const auto& meshInstances = sceneGraph.GetMeshInstances();
+    m_FeedbackInstanceCount = uint32_t(meshInstances.size());
+    for (uint32_t instanceIndex = 0; instanceIndex < m_FeedbackInstanceCount; instanceIndex++) {
+        const auto& instance = meshInstances[instanceIndex];
+        const engine::MeshInfo& mesh = *instance->GetMesh();
+        for (const auto& geometry : mesh.geometries) {
+            if (!geometry->material) {
+                continue;
+            }
+
+            FeedbackItem item;
+            item.instance = instance.get();
+            item.instanceIndex = instanceIndex;
+            item.firstTexture = uint32_t(m_FeedbackTextures.size());
+            for (const MaterialTextureSlot& textureSlot : c_MaterialTextureSlots) {
+                auto it = textureIndices.find(((*geometry->material).*textureSlot.slot).get());
+                if (it != textureIndices.end()) {
+                    m_FeedbackTextures.push_back(it->second);
+                }
+            }
+            item.textureCount = uint32_t(m_FeedbackTextures.size()) - item.firstTexture;
+            if (item.textureCount == 0) {
+                continue;
+            }
+
+            auto density = worldPerUv.find(geometry.get());
+            if (density == worldPerUv.end()) {
+                density = worldPerUv.emplace(geometry.get(), ComputeWorldPerUv(mesh, *geometry)).first;
+            }
+            item.worldPerUv = density->second;
+            m_FeedbackItems.push_back(item);
+        }
+    }
+
+    m_Statistics.textures = uint32_t(m_Textures.size());
+    if (m_Textures.empty()) {
+        return;
+    }
+
+    m_DecodePending = uint32_t(m_Textures.size());
+    m_JobSystem = std::make_unique<JobSystem>(m_DecodeThreads ? m_DecodeThreads - 1 : 0);
+    m_DecodeThread = std::thread([this]() { DecodeTextures(); });
+    log::info("Streaming %zu textures with a budget of %llu MB, %zu feedback instances", m_Textures.size(),
+        (unsigned long long)(m_BudgetBytes >> 20), m_FeedbackItems.size());
+}
+
+void TextureStreamer::DecodeTextures() {
+    m_JobSystem->ParallelFor(uint32_t(m_Textures.size()), [this](uint32_t index, uint32_t) {
+        StreamedTexture& texture = m_Textures[index];
+        if (!DecodeTexture(texture)) {
+            log::warning("Cannot stream texture '%s'", texture.path.c_str());
+            // A decode can fail after some of the mips are in.
+            texture.mips.clear();
+        }
+
+        std::lock_guard<std::mutex> lock(m_DecodedMutex);
+        m_Decoded.push_back(index);
+        m_DecodePending--;
+    });
+}
+
+bool TextureStreamer::DecodeTexture(StreamedTexture& texture) const {
+    std::shared_ptr<engine::TextureData> data = m_Decoder->Decode(texture.path);
+    if (!data || !data->data || data->dimension != nvrhi::TextureDimension::Texture2D || data->arraySize != 1 || data->dataLayout.empty()) {
+        return false;
+    }
+
+    const uint8_t* source = static_cast<const uint8_t*>(data->data->data());
+    for (uint32_t mip = 0; mip < uint32_t(data->dataLayout[0].size()); mip++) {
+        const engine::TextureSubresourceData& layout = data->dataLayout[0][mip];
+        if (layout.dataOffset + layout.dataSize > data->data->size()) {
+            return false;
+        }
+        MipLevel& level = texture.mips.emplace_back();
+        level.width = std::max(data->width >> mip, 1u);
+        level.height = std::max(data->height >> mip, 1u);
+        level.rowPitch = layout.rowPitch;
+        level.data.assign(source + layout.dataOffset, source + layout.dataOffset + layout.dataSize);
+    }
+    if (texture.mips.empty()) {
+        return false;
+    }
+
+    // Images come with only their top mip; the rest of the chain is generated here for the formats the
+    // image decoder produces. Block-compressed files stream the mips they contain.
+    const bool rgba8 = data->format == nvrhi::Format::RGBA8_UNORM || data->format == nvrhi::Format::BGRA8_UNORM;
+    const bool rgba32F = data->format == nvrhi::Format::RGBA32_FLOAT;
+    if (rgba8 || rgba32F) {
+        const size_t texelBytes = rgba8 ? 4 : 16;
+        while (texture.mips.back().width > 1 || texture.mips.back().height > 1) {
+            const MipLevel& src = texture.mips.back();
+            MipLevel dst;
+            dst.width = std::max(src.width / 2, 1u);
+            dst.height = std::max(src.height / 2, 1u);
+            dst.rowPitch = dst.width * texelBytes;
+            dst.data.resize(dst.rowPitch * dst.height);
+            if (rgba8) {
+                DownsampleRgba8(src.data.data(), src.width, src.height, dst.data.data(), dst.width, dst.height, texture.sRGB);
+            } else {
+                DownsampleRgba32F(reinterpret_cast<const float*>(src.data.data()), src.width, src.height, reinterpret_cast<float*>(dst.data.data()),
+                    dst.width, dst.height);
+            }
+            texture.mips.push_back(std::move(dst));
+        }
+    }
+
+    texture.format = texture.sRGB ? GetSrgbFormat(data->format) : data->format;
+    texture.tailMip = uint32_t(texture.mips.size()) - 1;
+    for (uint32_t mip = 0; mip < uint32_t(texture.mips.size()); mip++) {
+        if (std::max(texture.mips[mip].width, texture.mips[mip].height) <= c_MipTailSize) {
+            texture.tailMip = mip;
+            break;
+        }
+    }
+    return true;
+}
+
+void TextureStreamer::SetResidency(nvrhi::ICommandList* commandList, StreamedTexture& texture, uint32_t firstMip) {
+    const MipLevel& top = texture.mips[firstMip];
+    nvrhi::TextureDesc desc;
+    desc.width = top.width;
+    desc.height = top.height;
+    desc.mipLevels = uint32_t(texture.mips.size()) - firstMip;
+    desc.format = texture.format;
+    desc.debugName = texture.path;
+    desc.initialState = nvrhi::ResourceStates::ShaderResource;
+    desc.keepInitialState = true;
+    nvrhi::TextureHandle resident = m_Device->createTexture(desc);
+
+    // Mips that are already on the GPU are copied from the old texture, which is released once the GPU is done.
+    nvrhi::ITexture* previous = texture.IsResident() ? texture.loaded->texture.Get() : nullptr;
+    for (uint32_t mip = firstMip; mip < uint32_t(texture.mips.size()); mip++) {
+        if (previous && mip >= texture.residentMip) {
+            commandList->copyTexture(resident, nvrhi::TextureSlice().setMipLevel(mip - firstMip), previous,
+                nvrhi::TextureSlice().setMipLevel(mip - texture.residentMip));
+        } else {
+            const MipLevel& level = texture.mips[mip];
+            commandList->writeTexture(resident, 0, mip - firstMip, level.data.data(), level.rowPitch);
+            m_Statistics.uploadedBytes += level.data.size();
+        }
+    }
+
+    const uint64_t previousBytes = texture.IsResident() ? texture.GetBytes(texture.residentMip) : 0;
+    const uint64_t residentBytes = texture.GetBytes(firstMip);
+    if (residentBytes < previousBytes) {
+        m_Statistics.evictedBytes += previousBytes - residentBytes;
+    }
+    m_Statistics.residentBytes = m_Statistics.residentBytes + residentBytes - previousBytes;
+
+    texture.loaded->texture = resident;
+    texture.residentMip = firstMip;
+}
+
+void TextureStreamer::UpdateFeedback(const engine::IView& view) {
+    // Textures that are still being decoded belong to the decode jobs until Update publishes them.
+    for (StreamedTexture& texture : m_Textures) {
+        if (texture.decoded) {
+            texture.wantedMip = texture.tailMip;
+        }
+    }
+
+    // Screen pixels per world unit at unit distance; the texel density of a mip level then follows from the
+    // distance to the instance and the world size of its UV space.
+    const float4x4 projection = view.GetProjectionMatrix(false);
+    const float pixelsPerWorld = 0.5f * float(view.GetViewExtent().height()) * projection[1][1];
+    const float3 viewOrigin = view.GetViewOrigin();
+    const frustum& viewFrustum = view.GetViewFrustum();
+
+    const bool useHierarchy = m_Hierarchy && m_Hierarchy->GetInstanceCount() == m_FeedbackInstanceCount;
+    for (const FeedbackItem& item : m_FeedbackItems) {
+        const engine::SceneGraphNode* node = item.instance->GetNode();
+        if (!node) {
+            continue;
+        }
+        const dm::box3& bounds = useHierarchy ? m_Hierarchy->GetInstanceBounds(item.instanceIndex) : node->GetGlobalBoundingBox();
+        if (!viewFrustum.intersectsWith(bounds)) {
+            continue;
+        }
+
+        const float distance = std::max(length(viewOrigin - clamp(viewOrigin, bounds.m_mins, bounds.m_maxs)), 0.1f);
+
+        const affine3 transform = useHierarchy ? m_Hierarchy->GetInstanceTransform(item.instanceIndex) : node->GetLocalToWorldTransformFloat();
+        const float scale = std::cbrt(length(transform.transformVector(float3(1.f, 0.f, 0.f)))
+            * length(transform.transformVector(float3(0.f, 1.f, 0.f))) * length(transform.transformVector(float3(0.f, 0.f, 1.f))));
+        // Pixels covered by one unit of UV, at the closest point of the instance.
+        const float pixelsPerUv = item.worldPerUv * scale * pixelsPerWorld / distance;
+
+        for (uint32_t index = 0; index < item.textureCount; index++) {
+            StreamedTexture& texture = m_Textures[m_FeedbackTextures[item.firstTexture + index]];
+            texture.lastUsedFrame = m_FrameNumber;
+            if (!texture.decoded) {
+                continue;
+            }
+
+            uint32_t mip = 0;
+            if (pixelsPerUv > 0.f) {
+                const float texelsPerPixel = float(std::max(texture.mips[0].width, texture.mips[0].height)) / pixelsPerUv;
+                mip = uint32_t(std::max(std::floor(std::log2(std::max(texelsPerPixel, 1.f))), 0.f));
+            }
+            texture.wantedMip = std::min(texture.wantedMip, std::min(mip, texture.tailMip));
+        }
+    }
+}
+
+bool TextureStreamer::Update(nvrhi::ICommandList* commandList, const engine::IView& view) {
+    m_FrameNumber++;
+    m_Statistics.uploadedBytes = 0;
+    m_Statistics.evictedBytes = 0;
+    m_Statistics.deniedRequests = 0;
+    bool changed = false;
+
+    std::vector<uint32_t> decoded;
+    {
+        std::lock_guard<std::mutex> lock(m_DecodedMutex);
+        decoded.swap(m_Decoded);
+    }
+    for (uint32_t index : decoded) {
+        StreamedTexture& texture = m_Textures[index];
+        if (texture.mips.empty() || texture.format == nvrhi::Format::UNKNOWN) {
+            m_Statistics.texturesFailed++;
+            continue;
+        }
+        texture.decoded = true;
+        texture.residentMip = uint32_t(texture.mips.size());
+        SetResidency(commandList, texture, texture.tailMip);
+        for (const auto& material : texture.materials) {
+            material->dirty = true;
+        }
+        m_Statistics.texturesDecoded++;
+        changed = true;
+    }
+    if (m_DecodeThread.joinable() && m_DecodePending == 0) {
+        m_DecodeThread.join();
+        m_JobSystem.reset();
+    }
+
+    UpdateFeedback(view);
+
+    // Most urgent first: the textures that are furthest from the mip they are seen at.
+    std::vector<uint32_t> streamIn;
+    // Least recently used first; among the textures seen this frame, only mips beyond the wanted one.
+    std::vector<uint32_t> evictable;
+    m_Statistics.requestedBytes = 0;
+    for (uint32_t index = 0; index < uint32_t(m_Textures.size()); index++) {
+        const StreamedTexture& texture = m_Textures[index];
+        if (!texture.IsResident()) {
+            continue;
+        }
+        m_Statistics.requestedBytes += texture.GetBytes(texture.wantedMip);
+        if (texture.residentMip > texture.wantedMip) {
+            streamIn.push_back(index);
+        } else if (texture.residentMip < texture.wantedMip) {
+            evictable.push_back(index);
+        }
+    }
+    std::sort(streamIn.begin(), streamIn.end(), [this](uint32_t a, uint32_t b) {
+        return m_Textures[a].residentMip - m_Textures[a].wantedMip > m_Textures[b].residentMip - m_Textures[b].wantedMip;
+    });
+    std::sort(evictable.begin(), evictable.end(), [this](uint32_t a, uint32_t b) {
+        return m_Textures[a].lastUsedFrame < m_Textures[b].lastUsedFrame;
+    });
+
+    size_t nextEviction = 0;
+    for (uint32_t index : streamIn) {
+        StreamedTexture& texture = m_Textures[index];
+        const uint64_t residentBytes = texture.GetBytes(texture.residentMip);
+
+        // The finest mip that fits in what is left of this update's upload allowance, but at least one level.
+        uint32_t firstMip = texture.wantedMip;
+        while (firstMip + 1 < texture.residentMip
+               && m_Statistics.uploadedBytes + texture.GetBytes(firstMip) - residentBytes > c_MaxUploadBytesPerUpdate) {
+            firstMip++;
+        }
+
+        bool denied = false;
+        while (firstMip < texture.residentMip && m_Statistics.residentBytes + texture.GetBytes(firstMip) - residentBytes > m_BudgetBytes) {
+            if (nextEviction < evictable.size()) {
+                // Unused textures want only their tail, so they drop back to it; the others keep the mip they are seen at.
+                StreamedTexture& victim = m_Textures[evictable[nextEviction++]];
+                SetResidency(commandList, victim, victim.wantedMip);
+                changed = true;
+            } else {
+                firstMip++;
+                denied = true;
+            }
+        }
+        m_Statistics.deniedRequests += denied ? 1 : 0;
+
+        if (firstMip < texture.residentMip) {
+            SetResidency(commandList, texture, firstMip);
+            changed = true;
+        }
+        if (m_Statistics.uploadedBytes >= c_MaxUploadBytesPerUpdate) {
+            break;
+        }
+    }
+
+    m_Statistics.pendingRequests = m_Statistics.textures - m_Statistics.texturesDecoded - m_Statistics.texturesFailed;
+    for (const StreamedTexture& texture : m_Textures) {
+        m_Statistics.pendingRequests += texture.IsResident() && texture.residentMip > texture.wantedMip ? 1 : 0;
+    }
+    return changed;
+}
+
+} // namespace sanbox
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <donut/core/vfs/VFS.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/TextureCache.h>
+#include <donut/engine/View.h>
+#include <nvrhi/nvrhi.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "CachedScene.h"
+#include "JobSystem.h"
+
+namespace sanbox {
+
+class TextureDecoder;
+class TransformHierarchy;
+
+struct TextureStreamingStatistics {
+    uint32_t textures = 0;
+    uint32_t texturesDecoded = 0;
+    // Textures that could not be decoded; their materials keep the textures they were loaded with.
+    uint32_t texturesFailed = 0;
+    // Textures still decoding or with fewer mips resident than the feedback asks for.
+    uint32_t pendingRequests = 0;
+    uint64_t budgetBytes = 0;
+    uint64_t residentBytes = 0;
+    // Bytes the textures would take with every mip the feedback asks for.
+    uint64_t requestedBytes = 0;
+    // Traffic of the last update.
+    uint64_t uploadedBytes = 0;
+    uint64_t evictedBytes = 0;
+    // Mip requests of the last update that did not fit in the budget even after evicting.
+    uint32_t deniedRequests = 0;
+
+    // Above 1 the budget cannot hold what is on screen, and the streamer stays behind the feedback.
+    [[nodiscard]] float GetBudgetPressure() const {
+        return budgetBytes ? float(double(requestedBytes) / double(budgetBytes)) : 0.f;
+    }
+};
+
+// Keeps the scene's material textures resident at the mip levels they are seen at instead of with their
+// whole mip chain. Every texture is decoded once into system memory with its full mip chain; on the GPU it
+// starts with only the mip tail, the mips no larger than c_MipTailSize, which always stays resident. Once per
+// frame the mip each texture needs is estimated on the CPU from the screen-space size of the visible
+// instances that use it and from the texel density of their UVs. Textures that need more mips are
+// reallocated with them, copying the mips already resident on the GPU and uploading the others; when that
+// would exceed the budget, the least recently used textures give up their streamed mips first.
+// Materials keep their LoadedTexture objects, whose texture handles change with the residency.
+class TextureStreamer {
+public:
+    static constexpr uint32_t c_MipTailSize = 64;
+    // Bounds the mip data uploaded per update, so camera cuts stream in over a few frames.
+    static constexpr uint64_t c_MaxUploadBytesPerUpdate = 32ull << 20;
+
+    // decodeThreads == 0 uses one per hardware thread.
+    TextureStreamer(nvrhi::IDevice* device, std::shared_ptr<donut::vfs::IFileSystem> fs, uint64_t budgetBytes, uint32_t decodeThreads = 0);
+    ~TextureStreamer();
+
+    // Attaches a streamed texture to the material slot; it stays empty until its mip tail is uploaded.
+    // Same signature as CachedScene::TextureRequestHandler. Must not be called after StartDecoding.
+    void RequestTexture(const std::shared_ptr<donut::engine::Material>& material, CachedScene::TextureSlot slot, const std::string& path, bool sRGB);
+
+    // Streams the material textures that were loaded through the texture cache instead, and unloads them
+    // from the cache. Used for scenes that are not loaded from a package.
+    void AdoptSceneTextures(const donut::engine::SceneGraph& sceneGraph, donut::engine::TextureCache& textureCache);
+
+    // Gathers the mesh instances that drive the feedback and decodes the requested textures in the background.
+    void StartDecoding(const donut::engine::SceneGraph& sceneGraph);
+
+    // With SoA transforms the donut nodes keep their load-time transforms; the feedback then takes the
+    // instance bounds and transforms from the hierarchy, which must be built from the same scene graph.
+    void SetTransformHierarchy(const TransformHierarchy* hierarchy) {
+        m_Hierarchy = hierarchy;
+    }
+
+    // Render thread, once per frame. Returns true if any texture handle changed, after which the material
+    // buffers and the passes' material binding sets must be refreshed.
+    bool Update(nvrhi::ICommandList* commandList, const donut::engine::IView& view);
+
+    [[nodiscard]] bool IsDecoding() const {
+        return m_DecodeThread.joinable();
+    }
+    [[nodiscard]] const TextureStreamingStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    struct MipLevel {
+        std::vector<uint8_t> data;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        size_t rowPitch = 0;
+    };
+
+    struct StreamedTexture {
+        std::shared_ptr<donut::engine::LoadedTexture> loaded;
+        std::vector<std::shared_ptr<donut::engine::Material>> materials;
+        std::string path;
+        bool sRGB = false;
+
+        // Written by the decode job, then only read.
+        nvrhi::Format format = nvrhi::Format::UNKNOWN;
+        std::vector<MipLevel> mips;
+        uint32_t tailMip = 0;
+        bool decoded = false;
+
+        // First mip resident on the GPU, or mips.size() before the tail is uploaded.
+        uint32_t residentMip = 0;
+        uint32_t wantedMip = 0;
+        uint64_t lastUsedFrame = 0;
+
+        [[nodiscard]] uint64_t GetBytes(uint32_t firstMip) const;
+        [[nodiscard]] bool IsResident() const {
+            return decoded && residentMip < uint32_t(mips.size());
+        }
+    };
+
+    // A geometry instance whose screen-space size requests mips of its material's textures.
+    struct FeedbackItem {
+        const donut::engine::MeshInstance* instance = nullptr;
+        // In SceneGraph::GetMeshInstances order, as the transform hierarchy numbers them.
+        uint32_t instanceIndex = 0;
+        // Object-space distance covered by one unit of UV, from the ratio of triangle areas.
+        float worldPerUv = 0.f;
+        uint32_t firstTexture = 0;
+        uint32_t textureCount = 0;
+    };
+
+    uint32_t AddTexture(const std::string& path, bool sRGB);
+    void DecodeTextures();
+    bool DecodeTexture(StreamedTexture& texture) const;
+    void UpdateFeedback(const donut::engine::IView& view);
+    void SetResidency(nvrhi::ICommandList* commandList, StreamedTexture& texture, uint32_t firstMip);
+
+    nvrhi::DeviceHandle m_Device;
+    std::unique_ptr<TextureDecoder> m_Decoder;
+    uint64_t m_BudgetBytes;
+    uint32_t m_DecodeThreads;
+
+    std::vector<StreamedTexture> m_Textures;
+    std::unordered_map<std::string, uint32_t> m_TextureIndices;
+    std::vector<FeedbackItem> m_FeedbackItems;
+    std::vector<uint32_t> m_FeedbackTextures;
+    uint32_t m_FeedbackInstanceCount = 0;
+    const TransformHierarchy* m_Hierarchy = nullptr;
+
+    std::thread m_DecodeThread;
+    std::unique_ptr<JobSystem> m_JobSystem;
+    std::mutex m_DecodedMutex;
+    std::vector<uint32_t> m_Decoded;
+    std::atomic<uint32_t> m_DecodePending = 0;
+
+    uint64_t m_FrameNumber = 0;
+    TextureStreamingStatistics m_Statistics;
+};
+
+} // namespace sanbox
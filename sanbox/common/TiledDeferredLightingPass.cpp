@@ -0,0 +1,204 @@
+#include "TiledDeferredLightingPass.h"
+
+#include <donut/engine/ShadowMap.h>
+#include <nvrhi/utils.h>
+
+#include <algorithm>
+
+#include "FramePipeline.h"
+
+using namespace donut;
+using namespace donut::math;
+
+#include <donut/shaders/light_cb.h>
+#include <donut/shaders/light_types.h>
+
+#include "shaders/tiled_lighting_cb.h"
+
+namespace sanbox {
+
+namespace {
+
+constexpr uint32_t c_MinLightCapacity = 256;
+
+} // namespace
+
+TiledDeferredLightingPass::TiledDeferredLightingPass(
+    nvrhi::IDevice* device, std::shared_ptr<engine::ShaderFactory> shaderFactory, std::shared_ptr<engine::CommonRenderPasses> commonPasses)
+    : m_Device(device)
+    , m_ShaderFactory(std::move(shaderFactory))
+    , m_CommonPasses(std::move(commonPasses)) {
+}
+
+TiledDeferredLightingPass::~TiledDeferredLightingPass() = default;
+
+bool TiledDeferredLightingPass::Init() {
+    std::vector<engine::ShaderMacro> macros = {engine::ShaderMacro("COMPACT_GBUFFER", m_CompactGBuffer ? "1" : "0")};
+    m_Shader = m_ShaderFactory->CreateShader("sanbox/tiled_deferred_lighting_cs.hlsl", "main_cs", &macros, nvrhi::ShaderType::Compute);
+    if (!m_Shader) {
+        return false;
+    }
+
+    nvrhi::BindingLayoutDesc layoutDesc;
+    layoutDesc.visibility = nvrhi::ShaderType::Compute;
+    layoutDesc.bindings = {
+        nvrhi::BindingLayoutItem::VolatileConstantBuffer(0),
+        nvrhi::BindingLayoutItem::Texture_SRV(0),
+        nvrhi::BindingLayoutItem::Texture_SRV(1),
+        nvrhi::BindingLayoutItem::Texture_SRV(2),
+        nvrhi::BindingLayoutItem::Texture_SRV(3),
+        nvrhi::BindingLayoutItem::Texture_SRV(4),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(5),
+        nvrhi::BindingLayoutItem::StructuredBuffer_SRV(6),
+        nvrhi::BindingLayoutItem::Texture_SRV(7),
+        nvrhi::BindingLayoutItem::Sampler(0),
+        nvrhi::BindingLayoutItem::Texture_UAV(0),
+    };
+    m_BindingLayout = m_Device->createBindingLayout(layoutDesc);
+
+    m_Pipeline = m_Device->createComputePipeline(nvrhi::ComputePipelineDesc().setComputeShader(m_Shader).addBindingLayout(m_BindingLayout));
+
+    m_ConstantBuffer = m_Device->createBuffer(
+        nvrhi::utils::CreateVolatileConstantBufferDesc(sizeof(TiledLightingConstants), "TiledLightingConstants", FramePipeline::c_MaxFramesInFlight));
+
+    // Points outside a cascade compare against the border and come out lit.
+    m_ShadowSampler = m_Device->createSampler(nvrhi::SamplerDesc()
+                                                  .setAllAddressModes(nvrhi::SamplerAddressMode::Border)
+                                                  .setBorderColor(nvrhi::Color(1.f))
+                                                  .setReductionType(nvrhi::SamplerReductionType::Comparison));
+
+    ReserveBuffers(c_MinLightCapacity);
+    return m_Pipeline != nullptr;
+}
+
+void TiledDeferredLightingPass::ResetBindingCache() {
+    m_BindingSet = nullptr;
+    m_BoundResources.clear();
+}
+
+void TiledDeferredLightingPass::ReserveBuffers(uint32_t lightCount) {
+    if (lightCount <= m_LightCapacity) {
+        return;
+    }
+
+    m_LightCapacity = std::max(m_LightCapacity, c_MinLightCapacity);
+    while (m_LightCapacity < lightCount) {
+        m_LightCapacity *= 2;
+    }
+
+    m_Lights = m_Device->createBuffer(nvrhi::BufferDesc()
+                                          .setByteSize(size_t(m_LightCapacity) * sizeof(LightConstants))
+                                          .setStructStride(sizeof(LightConstants))
+                                          .setDebugName("TiledLights")
+                                          .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                          .setKeepInitialState(true));
+    m_LightBounds = m_Device->createBuffer(nvrhi::BufferDesc()
+                                               .setByteSize(size_t(m_LightCapacity) * sizeof(float4))
+                                               .setStructStride(sizeof(float4))
+                                               .setDebugName("TiledLightBounds")
+                                               .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                               .setKeepInitialState(true));
+    ResetBindingCache();
+}
+
+void TiledDeferredLightingPass::UpdateBindingSet(const render::DeferredLightingPass::Inputs& inputs, nvrhi::ITexture* shadowMap) {
+    const std::vector<nvrhi::IResource*> resources = {
+        inputs.depth, inputs.gbufferDiffuse, inputs.gbufferSpecular, inputs.gbufferNormals, inputs.gbufferEmissive, inputs.output, shadowMap};
+    if (m_BindingSet && resources == m_BoundResources) {
+        return;
+    }
+
+    nvrhi::BindingSetDesc setDesc;
+    setDesc.bindings = {
+        nvrhi::BindingSetItem::ConstantBuffer(0, m_ConstantBuffer),
+        nvrhi::BindingSetItem::Texture_SRV(0, inputs.depth),
+        nvrhi::BindingSetItem::Texture_SRV(1, inputs.gbufferDiffuse),
+        nvrhi::BindingSetItem::Texture_SRV(2, inputs.gbufferSpecular),
+        nvrhi::BindingSetItem::Texture_SRV(3, inputs.gbufferNormals),
+        nvrhi::BindingSetItem::Texture_SRV(4, inputs.gbufferEmissive),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(5, m_Lights),
+        nvrhi::BindingSetItem::StructuredBuffer_SRV(6, m_LightBounds),
+        nvrhi::BindingSetItem::Texture_SRV(7, shadowMap ? shadowMap : m_CommonPasses->m_BlackTexture2DArray.Get()),
+        nvrhi::BindingSetItem::Sampler(0, m_ShadowSampler),
+        nvrhi::BindingSetItem::Texture_UAV(0, inputs.output),
+    };
+    m_BindingSet = m_Device->createBindingSet(setDesc, m_BindingLayout);
+    m_BoundResources = resources;
+}
+
+void TiledDeferredLightingPass::Render(
+    nvrhi::ICommandList* commandList, const engine::IView& view, const render::DeferredLightingPass::Inputs& inputs) {
+    const affine3 viewMatrix = view.GetViewMatrix();
+    TiledLightingConstants constants = {};
+
+    const engine::IShadowMap* shadowMap = nullptr;
+    if (inputs.lights) {
+        for (const auto& light : *inputs.lights) {
+            if (light->shadowMap) {
+                shadowMap = light->shadowMap.get();
+                break;
+            }
+        }
+    }
+
+    m_LightConstants.clear();
+    m_ViewLightBounds.clear();
+    uint32_t shadowCount = 0;
+    if (inputs.lights) {
+        for (const auto& light : *inputs.lights) {
+            LightConstants& lightConstants = m_LightConstants.emplace_back();
+            light->FillLightConstants(lightConstants);
+
+            if (shadowMap && light->shadowMap && light->shadowMap->GetTexture() == shadowMap->GetTexture()) {
+                const uint32_t cascades = std::min(light->shadowMap->GetNumberOfCascades(), 4u);
+                for (uint32_t cascade = 0; cascade < cascades && shadowCount < TILED_LIGHTING_MAX_SHADOWS; cascade++) {
+                    light->shadowMap->GetCascade(cascade)->FillShadowConstants(constants.shadows[shadowCount]);
+                    lightConstants.shadowCascades[cascade] = int(shadowCount++);
+                }
+            }
+
+            // Spot lights are bounded by the sphere of their range; directional lights and lights without
+            // a range are kept in every tile.
+            const int lightType = light->GetLightType();
+            const bool hasRange = (lightType == LightType_Point || lightType == LightType_Spot) && lightConstants.angularSizeOrInvRange > 0.f;
+            m_ViewLightBounds.push_back(
+                hasRange ? float4(viewMatrix.transformPoint(lightConstants.position), 1.f / lightConstants.angularSizeOrInvRange) : float4(0.f));
+        }
+    }
+
+    ReserveBuffers(uint32_t(m_LightConstants.size()));
+    UpdateBindingSet(inputs, shadowMap ? shadowMap->GetTexture() : nullptr);
+
+    if (!m_LightConstants.empty()) {
+        commandList->writeBuffer(m_Lights, m_LightConstants.data(), m_LightConstants.size() * sizeof(LightConstants));
+        commandList->writeBuffer(m_LightBounds, m_ViewLightBounds.data(), m_ViewLightBounds.size() * sizeof(float4));
+    }
+
+    const nvrhi::Rect extent = view.GetViewExtent();
+    const uint2 viewportSize = uint2(uint(std::max(extent.width(), 1)), uint(std::max(extent.height(), 1)));
+
+    constants.clipToWorld = view.GetInverseViewProjectionMatrix(true);
+    constants.clipToView = view.GetInverseProjectionMatrix(true);
+    constants.cameraDirectionOrPosition = float4(view.GetViewOrigin(), 1.f);
+    constants.ambientColorTop = float4(inputs.ambientColorTop, 0.f);
+    constants.ambientColorBottom = float4(inputs.ambientColorBottom, 0.f);
+    constants.viewportOrigin = float2(float(extent.minX), float(extent.minY));
+    constants.viewportSizeInv = float2(1.f / float(viewportSize.x), 1.f / float(viewportSize.y));
+    constants.viewportSize = viewportSize;
+    constants.reverseDepth = view.IsReverseDepth() ? 1 : 0;
+    constants.lightCount = uint32_t(m_LightConstants.size());
+    if (shadowMap) {
+        constants.shadowMapTextureSize = float2(shadowMap->GetTextureSize());
+    }
+    commandList->writeBuffer(m_ConstantBuffer, &constants, sizeof(constants));
+
+    nvrhi::ComputeState state;
+    state.pipeline = m_Pipeline;
+    state.bindings = {m_BindingSet};
+    commandList->setComputeState(state);
+
+    const uint2 tileCount = (viewportSize + uint2(TILED_LIGHTING_TILE_SIZE - 1)) / uint2(TILED_LIGHTING_TILE_SIZE);
+    commandList->dispatch(tileCount.x, tileCount.y);
+}
+
+} // namespace sanbox
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <donut/engine/CommonRenderPasses.h>
+#include <donut/engine/SceneGraph.h>
+#include <donut/engine/ShaderFactory.h>
+#include <donut/engine/View.h>
+#include <donut/render/DeferredLightingPass.h>
+#include <nvrhi/nvrhi.h>
+
+#include <memory>
+#include <vector>
+
+struct LightConstants;
+
+namespace sanbox {
+
+// Replacement for donut's DeferredLightingPass that takes the same inputs and writes the same output, but
+// shades each 16x16 screen tile with only the lights whose bounds reach the tile's depth range, instead of
+// every light at every pixel. Like donut's pass, it samples the shadow map of the first light that has one,
+// and only the lights that share it are shadowed. Light probes and indirect lighting inputs are not supported.
+class TiledDeferredLightingPass {
+public:
+    TiledDeferredLightingPass(nvrhi::IDevice* device, std::shared_ptr<donut::engine::ShaderFactory> shaderFactory,
+        std::shared_ptr<donut::engine::CommonRenderPasses> commonPasses);
+    ~TiledDeferredLightingPass();
+
+    // Read the G-buffer in the compact layout of GBufferLayout. Call before Init.
+    void SetCompactGBuffer(bool enabled) {
+        m_CompactGBuffer = enabled;
+    }
+
+    bool Init();
+
+    void Render(nvrhi::ICommandList* commandList, const donut::engine::IView& view, const donut::render::DeferredLightingPass::Inputs& inputs);
+
+    // Drops the binding set, which references the G-buffer textures of the last Render.
+    void ResetBindingCache();
+
+private:
+    void ReserveBuffers(uint32_t lightCount);
+    void UpdateBindingSet(const donut::render::DeferredLightingPass::Inputs& inputs, nvrhi::ITexture* shadowMap);
+
+    nvrhi::DeviceHandle m_Device;
+    std::shared_ptr<donut::engine::ShaderFactory> m_ShaderFactory;
+    std::shared_ptr<donut::engine::CommonRenderPasses> m_CommonPasses;
+
+    bool m_CompactGBuffer = false;
+    nvrhi::ShaderHandle m_Shader;
+    nvrhi::BindingLayoutHandle m_BindingLayout;
+    nvrhi::ComputePipelineHandle m_Pipeline;
+    nvrhi::BufferHandle m_ConstantBuffer;
+    nvrhi::SamplerHandle m_ShadowSampler;
+
+    nvrhi::BufferHandle m_Lights;
+    nvrhi::BufferHandle m_LightBounds;
+    uint32_t m_LightCapacity = 0;
+
+    nvrhi::BindingSetHandle m_BindingSet;
+    std::vector<nvrhi::IResource*> m_BoundResources;
+
+    std::vector<LightConstants> m_LightConstants;
+    std::vector<dm::float4> m_ViewLightBounds;
+};
+
+} // namespace sanbox
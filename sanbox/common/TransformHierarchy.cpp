@@ -0,0 +1,282 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+
+#include "JobSystem.h"
+
+using namespace donut;
+using namespace donut::math;
+
+// After the using-directives: the shader header declares InstanceData with the math types unqualified.
+#include <donut/shaders/bindless.h>
+
+namespace sanbox {
+
+namespace {
+
+// Large enough that a job is worth its dispatch, small enough that a level of a few thousand nodes spreads.
+constexpr uint32_t c_NodesPerJob = 512;
+
+} // namespace
+
+TransformHierarchy::TransformHierarchy() = default;
+TransformHierarchy::~TransformHierarchy() = default;
+
+void TransformHierarchy::Build(const engine::SceneGraph& sceneGraph) {
+    *this = TransformHierarchy();
+
+    std::vector<const engine::SceneGraphNode*> nodes;
+    if (sceneGraph.GetRootNode()) {
+        nodes.push_back(sceneGraph.GetRootNode().get());
+        m_Parents.push_back(c_InvalidNode);
+        m_LevelStarts.push_back(0);
+    }
+
+    // Breadth first: a level ends where the children of its last node have been appended.
+    size_t levelEnd = nodes.size();
+    for (size_t index = 0; index < nodes.size(); index++) {
+        if (index == levelEnd) {
+            m_LevelStarts.push_back(uint32_t(index));
+            levelEnd = nodes.size();
+        }
+        m_FirstChildren.push_back(uint32_t(nodes.size()));
+        uint32_t childCount = 0;
+        for (const engine::SceneGraphNode* child = nodes[index]->GetFirstChild(); child; child = child->GetNextSibling()) {
+            nodes.push_back(child);
+            m_Parents.push_back(uint32_t(index));
+            childCount++;
+        }
+        m_ChildCounts.push_back(childCount);
+    }
+    m_LevelStarts.push_back(uint32_t(nodes.size()));
+
+    m_LocalTransforms.resize(nodes.size());
+    m_WorldTransforms.resize(nodes.size());
+    m_NodeInstances.assign(nodes.size(), c_InvalidNode);
+    m_Dirty.assign(nodes.size(), 0);
+    m_UpdateStamps.assign(nodes.size(), 0);
+    m_NodeIndices.reserve(nodes.size());
+    for (size_t index = 0; index < nodes.size(); index++) {
+        m_LocalTransforms[index] = affine3(nodes[index]->GetLocalToParentTransform());
+        m_WorldTransforms[index] = nodes[index]->GetLocalToWorldTransformFloat();
+        m_NodeIndices.emplace(nodes[index], uint32_t(index));
+    }
+
+    const auto& meshInstances = sceneGraph.GetMeshInstances();
+    uint32_t instanceBufferSize = 0;
+    for (const auto& meshInstance : meshInstances) {
+        instanceBufferSize = std::max(instanceBufferSize, uint32_t(meshInstance->GetInstanceIndex() + 1));
+    }
+    m_InstanceData.resize(instanceBufferSize);
+
+    for (uint32_t instance = 0; instance < uint32_t(meshInstances.size()); instance++) {
+        const engine::MeshInstance& meshInstance = *meshInstances[instance];
+        const engine::MeshInfo& mesh = *meshInstance.GetMesh();
+        const uint32_t node = FindNode(meshInstance.GetNode());
+
+        m_InstanceNodes.push_back(node);
+        m_NodeInstances[node] = instance;
+        m_InstanceBufferIndices.push_back(uint32_t(meshInstance.GetInstanceIndex()));
+        m_InstanceObjectBounds.push_back(mesh.objectSpaceBounds);
+        m_InstanceWorldBounds.push_back(mesh.objectSpaceBounds * m_WorldTransforms[node]);
+        m_InstanceMoveUpdates.push_back(0);
+
+        // As Scene::UpdateInstances writes it, so that partial uploads leave the rest of the buffer alone.
+        InstanceData& data = m_InstanceData[m_InstanceBufferIndices.back()];
+        data.flags = 0;
+        data.firstGeometryInstanceIndex = uint32_t(meshInstance.GetGeometryInstanceIndex());
+        data.firstGeometryIndex = mesh.geometries.empty() ? 0 : uint32_t(mesh.geometries[0]->globalGeometryIndex);
+        data.numGeometries = uint32_t(mesh.geometries.size());
+        data.transform = affineToColumnMajor(m_WorldTransforms[node]);
+        data.prevTransform = data.transform;
+    }
+
+    m_Statistics.nodes = uint32_t(nodes.size());
+    m_Statistics.levels = uint32_t(m_LevelStarts.size()) - 1;
+}
+
+uint32_t TransformHierarchy::FindNode(const engine::SceneGraphNode* node) const {
+    auto it = m_NodeIndices.find(node);
+    return it != m_NodeIndices.end() ? it->second : c_InvalidNode;
+}
+
+void TransformHierarchy::SetLocalTransform(uint32_t node, const affine3& transform) {
+    m_LocalTransforms[node] = transform;
+    if (!m_Dirty[node]) {
+        m_Dirty[node] = 1;
+        m_DirtyNodes.push_back(node);
+    }
+}
+
+void TransformHierarchy::Update(JobSystem* jobSystem) {
+    m_UpdateCount++;
+    m_PreviouslyMoved.swap(m_MovedInstances);
+    m_MovedInstances.clear();
+    m_Statistics.dirtyNodes = uint32_t(m_DirtyNodes.size());
+    m_Statistics.updatedNodes = 0;
+    m_Statistics.movedInstances = 0;
+    if (m_DirtyNodes.empty()) {
+        return;
+    }
+
+    // Node indices grow with the level, so sorting groups the dirty nodes by level.
+    m_Stamp++;
+    std::sort(m_DirtyNodes.begin(), m_DirtyNodes.end());
+    const uint32_t threadCount = jobSystem ? jobSystem->GetThreadCount() : 1;
+    m_ThreadChildren.resize(threadCount);
+    m_ThreadMoved.resize(threadCount);
+
+    const auto updateNodes = [this](uint32_t job, uint32_t thread) {
+        std::vector<uint32_t>& children = m_ThreadChildren[thread];
+        std::vector<uint32_t>& moved = m_ThreadMoved[thread];
+        const uint32_t end = std::min(uint32_t(m_Frontier.size()), (job + 1) * c_NodesPerJob);
+        for (uint32_t i = job * c_NodesPerJob; i < end; i++) {
+            const uint32_t node = m_Frontier[i];
+            const uint32_t parent = m_Parents[node];
+            m_WorldTransforms[node] = parent == c_InvalidNode ? m_LocalTransforms[node] : m_LocalTransforms[node] * m_WorldTransforms[parent];
+            m_UpdateStamps[node] = m_Stamp;
+
+            const uint32_t instance = m_NodeInstances[node];
+            if (instance != c_InvalidNode) {
+                m_InstanceWorldBounds[instance] = m_InstanceObjectBounds[instance] * m_WorldTransforms[node];
+                moved.push_back(instance);
+            }
+            for (uint32_t child = m_FirstChildren[node]; child < m_FirstChildren[node] + m_ChildCounts[node]; child++) {
+                children.push_back(child);
+            }
+        }
+    };
+
+    // The frontier of a level is the children of the nodes updated on the level above, plus the dirty
+    // nodes of the level whose parent did not move, which would otherwise be updated twice.
+    m_Frontier.clear();
+    size_t dirtyIndex = 0;
+    for (size_t level = 0; level + 1 < m_LevelStarts.size(); level++) {
+        for (; dirtyIndex < m_DirtyNodes.size() && m_DirtyNodes[dirtyIndex] < m_LevelStarts[level + 1]; dirtyIndex++) {
+            const uint32_t node = m_DirtyNodes[dirtyIndex];
+            const uint32_t parent = m_Parents[node];
+            if (parent == c_InvalidNode || m_UpdateStamps[parent] != m_Stamp) {
+                m_Frontier.push_back(node);
+            }
+            m_Dirty[node] = 0;
+        }
+        if (m_Frontier.empty()) {
+            if (dirtyIndex == m_DirtyNodes.size()) {
+                break;
+            }
+            continue;
+        }
+
+        const uint32_t jobCount = (uint32_t(m_Frontier.size()) + c_NodesPerJob - 1) / c_NodesPerJob;
+        if (jobSystem && jobCount > 1) {
+            jobSystem->ParallelFor(jobCount, updateNodes);
+        } else {
+            for (uint32_t job = 0; job < jobCount; job++) {
+                updateNodes(job, 0);
+            }
+        }
+        m_Statistics.updatedNodes += uint32_t(m_Frontier.size());
+
+        m_Frontier.clear();
+        for (std::vector<uint32_t>& children : m_ThreadChildren) {
+            m_Frontier.insert(m_Frontier.end(), children.begin(), children.end());
+            children.clear();
+        }
+    }
+    m_DirtyNodes.clear();
+
+    for (std::vector<uint32_t>& moved : m_ThreadMoved) {
+        m_MovedInstances.insert(m_MovedInstances.end(), moved.begin(), moved.end());
+        moved.clear();
+    }
+    for (uint32_t instance : m_MovedInstances) {
+        m_InstanceMoveUpdates[instance] = m_UpdateCount;
+    }
+    m_Statistics.movedInstances = uint32_t(m_MovedInstances.size());
+}
+
+void TransformHierarchy::CaptureInstances(InstanceTransformSnapshot& snapshot) const {
+    const uint32_t instanceCount = GetInstanceCount();
+    if (snapshot.transforms.size() != instanceCount) {
+        snapshot.transforms.resize(instanceCount);
+        snapshot.bounds.resize(instanceCount);
+        snapshot.moveUpdates.resize(instanceCount);
+        snapshot.updateCount = 0;
+    }
+
+    // A snapshot is rewritten every few updates, so only the instances that moved since are copied.
+    for (uint32_t instance = 0; instance < instanceCount; instance++) {
+        if (snapshot.updateCount == 0 || m_InstanceMoveUpdates[instance] > snapshot.updateCount) {
+            snapshot.transforms[instance] = GetInstanceTransform(instance);
+            snapshot.bounds[instance] = m_InstanceWorldBounds[instance];
+            snapshot.moveUpdates[instance] = m_InstanceMoveUpdates[instance];
+        }
+    }
+    snapshot.updateCount = m_UpdateCount;
+    snapshot.statistics = m_Statistics;
+}
+
+void TransformHierarchy::ApplyInstances(const InstanceTransformSnapshot& snapshot) {
+    m_UpdateCount++;
+    m_PreviouslyMoved.swap(m_MovedInstances);
+    m_MovedInstances.clear();
+
+    if (snapshot.transforms.size() == GetInstanceCount()) {
+        for (uint32_t instance = 0; instance < GetInstanceCount(); instance++) {
+            if (snapshot.moveUpdates[instance] > m_AppliedUpdateCount) {
+                m_WorldTransforms[m_InstanceNodes[instance]] = snapshot.transforms[instance];
+                m_InstanceWorldBounds[instance] = snapshot.bounds[instance];
+                m_MovedInstances.push_back(instance);
+            }
+        }
+        m_AppliedUpdateCount = snapshot.updateCount;
+    }
+
+    m_Statistics.dirtyNodes = snapshot.statistics.dirtyNodes;
+    m_Statistics.updatedNodes = snapshot.statistics.updatedNodes;
+    m_Statistics.movedInstances = uint32_t(m_MovedInstances.size());
+}
+
+void TransformHierarchy::UploadInstances(nvrhi::ICommandList* commandList, nvrhi::IBuffer* instanceBuffer) {
+    m_Statistics.uploadedBytes = 0;
+    if (!instanceBuffer || m_InstanceData.empty()) {
+        return;
+    }
+
+    // Instances that stopped in the last update still have last frame's transform as the previous one.
+    m_Uploads.clear();
+    for (uint32_t instance : m_PreviouslyMoved) {
+        InstanceData& data = m_InstanceData[m_InstanceBufferIndices[instance]];
+        data.prevTransform = data.transform;
+        m_Uploads.push_back(m_InstanceBufferIndices[instance]);
+    }
+    for (uint32_t instance : m_MovedInstances) {
+        InstanceData& data = m_InstanceData[m_InstanceBufferIndices[instance]];
+        data.prevTransform = data.transform;
+        data.transform = affineToColumnMajor(GetInstanceTransform(instance));
+        m_Uploads.push_back(m_InstanceBufferIndices[instance]);
+    }
+
+    // Many small writes cost more than one large one, so a busy frame rewrites the whole buffer.
+    if (m_UploadAll || m_Uploads.size() * 4 > m_InstanceData.size()) {
+        m_Statistics.uploadedBytes = m_InstanceData.size() * sizeof(InstanceData);
+        commandList->writeBuffer(instanceBuffer, m_InstanceData.data(), m_Statistics.uploadedBytes);
+        m_UploadAll = false;
+        return;
+    }
+
+    std::sort(m_Uploads.begin(), m_Uploads.end());
+    m_Uploads.erase(std::unique(m_Uploads.begin(), m_Uploads.end()), m_Uploads.end());
+    for (size_t first = 0; first < m_Uploads.size();) {
+        size_t last = first + 1;
+        while (last < m_Uploads.size() && m_Uploads[last] == m_Uploads[last - 1] + 1) {
+            last++;
+        }
+        const size_t byteSize = (last - first) * sizeof(InstanceData);
+        commandList->writeBuffer(instanceBuffer, &m_InstanceData[m_Uploads[first]], byteSize, m_Uploads[first] * sizeof(InstanceData));
+        m_Statistics.uploadedBytes += byteSize;
+        first = last;
+    }
+}
+
+} // namespace sanbox
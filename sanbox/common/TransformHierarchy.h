@@ -0,0 +1,134 @@
+#pragma once
+
+#include <donut/core/math/math.h>
+#include <donut/engine/SceneGraph.h>
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+struct InstanceData;
+
+namespace sanbox {
+
+class JobSystem;
+
+struct TransformUpdateStatistics {
+    uint32_t nodes = 0;
+    uint32_t levels = 0;
+    uint32_t dirtyNodes = 0;
+    uint32_t updatedNodes = 0;
+    uint32_t movedInstances = 0;
+    uint64_t uploadedBytes = 0;
+};
+
+// The instances of a hierarchy as of one of its updates, for a hierarchy on another thread to take over;
+// see CaptureInstances and ApplyInstances.
+struct InstanceTransformSnapshot {
+    std::vector<dm::affine3> transforms;
+    std::vector<dm::box3> bounds;
+    // The update in which each instance last moved.
+    std::vector<uint64_t> moveUpdates;
+    uint64_t updateCount = 0;
+    TransformUpdateStatistics statistics;
+};
+
+// Copy of the transforms of a scene graph in structure-of-arrays form: parents, local and world
+// transforms, and instance bounds each in an array of their own, with the nodes in breadth-first order so
+// that every level is a contiguous range and the children of a node are contiguous in the next one.
+// Update propagates from the nodes whose local transform was set, level by level, touching only their
+// subtrees; the nodes of a level are updated in parallel once the level above is done.
+// The donut nodes are left alone, so nothing that reads transforms from them sees the changes: the
+// instance transforms reach the GPU through UploadInstances, and CulledDrawStrategy takes the moved
+// instances and their bounds from here. The structure is fixed at Build.
+class TransformHierarchy {
+public:
+    static constexpr uint32_t c_InvalidNode = ~0u;
+
+    // Out of line, since InstanceData comes from a shader header that only the source file includes.
+    TransformHierarchy();
+    ~TransformHierarchy();
+
+    void Build(const donut::engine::SceneGraph& sceneGraph);
+
+    [[nodiscard]] uint32_t FindNode(const donut::engine::SceneGraphNode* node) const;
+    void SetLocalTransform(uint32_t node, const dm::affine3& transform);
+
+    // Runs on the calling thread without a job system.
+    void Update(JobSystem* jobSystem);
+
+    // Copies the instances that moved since the snapshot was last captured into it, all of them the first
+    // time. A snapshot is only ever captured from one hierarchy.
+    void CaptureInstances(InstanceTransformSnapshot& snapshot) const;
+    // Takes the instance transforms and bounds over from a snapshot of a hierarchy built from the same scene
+    // graph, as an update of its own that moves the instances that moved since the last snapshot applied.
+    // The transforms of the other nodes are left alone; a hierarchy fed this way is not updated itself.
+    void ApplyInstances(const InstanceTransformSnapshot& snapshot);
+
+    // Writes the transforms of the instances that moved in the last two updates into the scene's instance
+    // buffer, so that the previous transforms settle once an instance stops.
+    void UploadInstances(nvrhi::ICommandList* commandList, nvrhi::IBuffer* instanceBuffer);
+    // For when the scene has rewritten the instance buffer from its own, stale, node transforms.
+    void InvalidateInstanceBuffer() {
+        m_UploadAll = true;
+    }
+
+    // Instances are numbered as in SceneGraph::GetMeshInstances at Build.
+    [[nodiscard]] uint32_t GetInstanceCount() const {
+        return uint32_t(m_InstanceNodes.size());
+    }
+    [[nodiscard]] const dm::affine3& GetInstanceTransform(uint32_t instance) const {
+        return m_WorldTransforms[m_InstanceNodes[instance]];
+    }
+    [[nodiscard]] const dm::box3& GetInstanceBounds(uint32_t instance) const {
+        return m_InstanceWorldBounds[instance];
+    }
+    [[nodiscard]] const std::vector<uint32_t>& GetMovedInstances() const {
+        return m_MovedInstances;
+    }
+    // Tells consumers that poll the moved instances whether they missed an update.
+    [[nodiscard]] uint64_t GetUpdateCount() const {
+        return m_UpdateCount;
+    }
+    [[nodiscard]] const TransformUpdateStatistics& GetStatistics() const {
+        return m_Statistics;
+    }
+
+private:
+    // Per node.
+    std::vector<uint32_t> m_Parents;
+    std::vector<uint32_t> m_FirstChildren;
+    std::vector<uint32_t> m_ChildCounts;
+    std::vector<uint32_t> m_NodeInstances;
+    std::vector<dm::affine3> m_LocalTransforms;
+    std::vector<dm::affine3> m_WorldTransforms;
+    std::vector<uint8_t> m_Dirty;
+    std::vector<uint32_t> m_UpdateStamps;
+    std::vector<uint32_t> m_LevelStarts;
+    std::unordered_map<const donut::engine::SceneGraphNode*, uint32_t> m_NodeIndices;
+
+    // Per instance.
+    std::vector<uint32_t> m_InstanceNodes;
+    std::vector<uint32_t> m_InstanceBufferIndices;
+    std::vector<dm::box3> m_InstanceObjectBounds;
+    std::vector<dm::box3> m_InstanceWorldBounds;
+    std::vector<InstanceData> m_InstanceData;
+    std::vector<uint64_t> m_InstanceMoveUpdates;
+
+    std::vector<uint32_t> m_DirtyNodes;
+    std::vector<uint32_t> m_Frontier;
+    std::vector<std::vector<uint32_t>> m_ThreadChildren;
+    std::vector<std::vector<uint32_t>> m_ThreadMoved;
+    std::vector<uint32_t> m_MovedInstances;
+    std::vector<uint32_t> m_PreviouslyMoved;
+    std::vector<uint32_t> m_Uploads;
+    uint32_t m_Stamp = 0;
+    uint64_t m_UpdateCount = 0;
+    // Of the last snapshot applied.
+    uint64_t m_AppliedUpdateCount = 0;
+    bool m_UploadAll = true;
+    TransformUpdateStatistics m_Statistics;
+};
+
+} // namespace sanbox
@@ -0,0 +1,321 @@
+#include "VertexQuantizer.h"
+
+#include <donut/core/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+
+using namespace donut;
+using namespace donut::math;
+
+#include <donut/shaders/bindless.h>
+
+#include "shaders/mesh_quantization_cb.h"
+
+namespace sanbox {
+
+namespace {
+
+// Streams start at multiples of this, so every stream of a buffer group can be bound at its own offset.
+constexpr uint64_t c_StreamAlignment = 16;
+
+uint64_t AlignStream(uint64_t offset) {
+    return (offset + c_StreamAlignment - 1) & ~(c_StreamAlignment - 1);
+}
+
+// Round to nearest even; values beyond the half range become infinity.
+uint16_t FloatToHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    const uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x47800000) {
+        return uint16_t(sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+    if (magnitude < 0x38800000) {
+        // Below the smallest normal half: a denormal in units of 2^-24.
+        float absolute;
+        std::memcpy(&absolute, &magnitude, sizeof(absolute));
+        return uint16_t(sign | uint32_t(std::lrint(absolute * 16777216.f)));
+    }
+
+    uint32_t half = (magnitude - 0x38000000) >> 13;
+    const uint32_t remainder = magnitude & 0x1fff;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return uint16_t(sign | half);
+}
+
+// The normals and tangents of a buffer group are four signed bytes, as donut packs them.
+float4 UnpackSnorm8(uint32_t packed) {
+    return float4(float(int8_t(packed & 0xff)), float(int8_t((packed >> 8) & 0xff)), float(int8_t((packed >> 16) & 0xff)),
+               float(int8_t(packed >> 24)))
+        / 127.f;
+}
+
+float2 EncodeOctahedral(const float3& v) {
+    const float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    if (l1 <= 0.f) {
+        return float2(0.f);
+    }
+    const float3 p = v / l1;
+    if (p.z >= 0.f) {
+        return float2(p.x, p.y);
+    }
+    return float2((1.f - std::abs(p.y)) * (p.x >= 0.f ? 1.f : -1.f), (1.f - std::abs(p.x)) * (p.y >= 0.f ? 1.f : -1.f));
+}
+
+// Maps [-1, 1] to [0, 2 * halfRange], so that 0 stays exact.
+uint32_t QuantizeSnorm(float value, uint32_t halfRange) {
+    return uint32_t(int32_t(std::lround(std::clamp(value, -1.f, 1.f) * float(halfRange))) + int32_t(halfRange));
+}
+
+uint32_t PackFrame(uint32_t packedNormal, uint32_t packedTangent) {
+    const float4 normal = UnpackSnorm8(packedNormal);
+    const float4 tangent = UnpackSnorm8(packedTangent);
+    const float2 normalOct = EncodeOctahedral(float3(normal.x, normal.y, normal.z));
+    const float2 tangentOct = EncodeOctahedral(float3(tangent.x, tangent.y, tangent.z));
+
+    return QuantizeSnorm(normalOct.x, 127) | (QuantizeSnorm(normalOct.y, 127) << 8) | (QuantizeSnorm(tangentOct.x, 127) << 16)
+        | (QuantizeSnorm(tangentOct.y, 63) << 24) | (tangent.w < 0.f ? 0x80000000u : 0u);
+}
+
+struct QuantizedGroup {
+    engine::BufferGroup* buffers = nullptr;
+    std::vector<const engine::MeshInfo*> meshes;
+    bool quantizable = true;
+};
+
+} // namespace
+
+VertexQuantizer::VertexQuantizer(nvrhi::IDevice* device)
+    : m_Device(device) {
+}
+
+void VertexQuantizer::Quantize(const engine::SceneGraph& sceneGraph, std::vector<MeshProcessingReport>& reports) {
+    // The meshes of a model file share a buffer group, which can only be quantized if all of them can.
+    std::vector<QuantizedGroup> groups;
+    std::unordered_map<const engine::BufferGroup*, size_t> groupIndices;
+    for (const auto& mesh : sceneGraph.GetMeshes()) {
+        if (!mesh->buffers) {
+            continue;
+        }
+        auto [it, inserted] = groupIndices.try_emplace(mesh->buffers.get(), groups.size());
+        if (inserted) {
+            groups.emplace_back().buffers = mesh->buffers.get();
+        }
+        QuantizedGroup& group = groups[it->second];
+        group.meshes.push_back(mesh.get());
+
+        const engine::BufferGroup& buffers = *mesh->buffers;
+        if (mesh->type != engine::MeshType::Triangles || mesh->skinPrototype || mesh->isMorphTargetAnimationMesh || !buffers.jointData.empty()
+            || buffers.positionData.empty() || !buffers.vertexBuffer) {
+            group.quantizable = false;
+        }
+    }
+
+    std::unordered_map<const engine::MeshInfo*, uint64_t> quantizedBytes;
+    std::vector<QuantizedMeshData> meshData(std::max<size_t>(sceneGraph.GetGeometryCount(), 1), QuantizedMeshData{});
+    nvrhi::CommandListHandle commandList = m_Device->createCommandList();
+    commandList->open();
+
+    uint64_t bytesBefore = 0;
+    uint64_t bytesAfter = 0;
+    uint32_t quantizedGroups = 0;
+    m_SkippedMeshes = 0;
+
+    for (const QuantizedGroup& group : groups) {
+        if (!group.quantizable) {
+            m_SkippedMeshes += uint32_t(group.meshes.size());
+            continue;
+        }
+
+        engine::BufferGroup& buffers = *group.buffers;
+        const uint64_t vertexCount = buffers.positionData.size();
+        const bool hasTexCoords = buffers.texcoord1Data.size() == vertexCount;
+        const bool hasNormals = buffers.normalData.size() == vertexCount;
+        const bool hasTangents = buffers.tangentData.size() == vertexCount;
+
+        const uint64_t positionOffset = 0;
+        const uint64_t texCoordOffset = AlignStream(positionOffset + vertexCount * QUANTIZED_POSITION_STRIDE);
+        const uint64_t frameOffset = AlignStream(texCoordOffset + (hasTexCoords ? vertexCount * QUANTIZED_TEXCOORD_STRIDE : 0));
+        const uint64_t byteSize = frameOffset + (hasNormals ? vertexCount * QUANTIZED_FRAME_STRIDE : 0);
+        const uint32_t vertexStride
+            = QUANTIZED_POSITION_STRIDE + (hasTexCoords ? QUANTIZED_TEXCOORD_STRIDE : 0) + (hasNormals ? QUANTIZED_FRAME_STRIDE : 0);
+        std::vector<uint32_t> words(byteSize / sizeof(uint32_t), 0);
+
+        // Positions are quantized against the bounds of the vertices of each mesh, which its geometries share.
+        for (const engine::MeshInfo* mesh : group.meshes) {
+            const uint64_t firstVertex = mesh->vertexOffset;
+            if (mesh->totalVertices == 0 || firstVertex + mesh->totalVertices > vertexCount) {
+                continue;
+            }
+            const float3* positions = buffers.positionData.data() + firstVertex;
+
+            float3 boundsMin = positions[0];
+            float3 boundsMax = positions[0];
+            for (uint32_t vertex = 1; vertex < mesh->totalVertices; vertex++) {
+                boundsMin = min(boundsMin, positions[vertex]);
+                boundsMax = max(boundsMax, positions[vertex]);
+            }
+            const float3 extent = boundsMax - boundsMin;
+            const float3 quantizeScale(extent.x > 0.f ? 65535.f / extent.x : 0.f, extent.y > 0.f ? 65535.f / extent.y : 0.f,
+                extent.z > 0.f ? 65535.f / extent.z : 0.f);
+
+            uint32_t* packed = words.data() + (positionOffset + firstVertex * QUANTIZED_POSITION_STRIDE) / sizeof(uint32_t);
+            for (uint32_t vertex = 0; vertex < mesh->totalVertices; vertex++) {
+                const float3 q = (positions[vertex] - boundsMin) * quantizeScale;
+                const uint32_t x = uint32_t(std::clamp(std::lround(q.x), 0l, 65535l));
+                const uint32_t y = uint32_t(std::clamp(std::lround(q.y), 0l, 65535l));
+                const uint32_t z = uint32_t(std::clamp(std::lround(q.z), 0l, 65535l));
+                packed[vertex * 2] = x | (y << 16);
+                packed[vertex * 2 + 1] = z | 0xffff0000u;
+            }
+
+            for (const auto& geometry : mesh->geometries) {
+                if (geometry->globalGeometryIndex >= 0 && size_t(geometry->globalGeometryIndex) < meshData.size()) {
+                    QuantizedMeshData& data = meshData[geometry->globalGeometryIndex];
+                    data.positionScale = float4(extent, 0.f);
+                    data.positionOffset = float4(boundsMin, 0.f);
+                }
+            }
+            quantizedBytes[mesh] = uint64_t(mesh->totalVertices) * vertexStride;
+        }
+
+        if (hasTexCoords) {
+            uint32_t* packed = words.data() + texCoordOffset / sizeof(uint32_t);
+            for (uint64_t vertex = 0; vertex < vertexCount; vertex++) {
+                const float2& uv = buffers.texcoord1Data[vertex];
+                packed[vertex] = uint32_t(FloatToHalf(uv.x)) | (uint32_t(FloatToHalf(uv.y)) << 16);
+            }
+        }
+        if (hasNormals) {
+            uint32_t* packed = words.data() + frameOffset / sizeof(uint32_t);
+            for (uint64_t vertex = 0; vertex < vertexCount; vertex++) {
+                packed[vertex] = PackFrame(buffers.normalData[vertex], hasTangents ? buffers.tangentData[vertex] : 0);
+            }
+        }
+
+        bytesBefore += buffers.vertexBuffer->getDesc().byteSize;
+        bytesAfter += byteSize;
+
+        nvrhi::BufferHandle vertexBuffer = m_Device->createBuffer(nvrhi::BufferDesc()
+                                                                      .setByteSize(byteSize)
+                                                                      .setIsVertexBuffer(true)
+                                                                      .setCanHaveRawViews(true)
+                                                                      .setDebugName("QuantizedVertexBuffer"));
+        commandList->beginTrackingBufferState(vertexBuffer, nvrhi::ResourceStates::CopyDest);
+        commandList->writeBuffer(vertexBuffer, words.data(), byteSize);
+        commandList->setPermanentBufferState(vertexBuffer, nvrhi::ResourceStates::VertexBuffer | nvrhi::ResourceStates::ShaderResource);
+
+        // The streams that the quantized shaders do not read are dropped with the float buffer.
+        buffers.vertexBuffer = vertexBuffer;
+        std::fill(buffers.vertexBufferRanges.begin(), buffers.vertexBufferRanges.end(), nvrhi::BufferRange());
+        buffers.getVertexBufferRange(engine::VertexAttribute::Position) = nvrhi::BufferRange(positionOffset, vertexCount * QUANTIZED_POSITION_STRIDE);
+        if (hasTexCoords) {
+            buffers.getVertexBufferRange(engine::VertexAttribute::TexCoord1)
+                = nvrhi::BufferRange(texCoordOffset, vertexCount * QUANTIZED_TEXCOORD_STRIDE);
+        }
+        if (hasNormals) {
+            const nvrhi::BufferRange frameRange(frameOffset, vertexCount * QUANTIZED_FRAME_STRIDE);
+            buffers.getVertexBufferRange(engine::VertexAttribute::Normal) = frameRange;
+            if (hasTangents) {
+                buffers.getVertexBufferRange(engine::VertexAttribute::Tangent) = frameRange;
+            }
+        }
+        quantizedGroups++;
+    }
+
+    m_MeshData = CreateMeshDataBuffer(m_Device, meshData.size());
+    commandList->writeBuffer(m_MeshData, meshData.data(), meshData.size() * sizeof(QuantizedMeshData));
+    commandList->close();
+    m_Device->executeCommandList(commandList);
+
+    for (MeshProcessingReport& report : reports) {
+        if (auto it = quantizedBytes.find(report.mesh); it != quantizedBytes.end()) {
+            report.vertexBytesAfter = it->second;
+        }
+    }
+
+    log::info("Quantized the vertices of %u buffer groups: %.2f -> %.2f MB", quantizedGroups, double(bytesBefore) / double(1 << 20),
+        double(bytesAfter) / double(1 << 20));
+    if (m_SkippedMeshes > 0) {
+        log::warning("%u skinned or morph target meshes keep float vertices and will not draw with quantized vertex shaders", m_SkippedMeshes);
+    }
+}
+
+nvrhi::BufferHandle VertexQuantizer::CreateMeshDataBuffer(nvrhi::IDevice* device, size_t meshCount) {
+    return device->createBuffer(nvrhi::BufferDesc()
+                                    .setByteSize(std::max<size_t>(meshCount, 1) * sizeof(QuantizedMeshData))
+                                    .setStructStride(sizeof(QuantizedMeshData))
+                                    .setDebugName("QuantizedMeshData")
+                                    .setInitialState(nvrhi::ResourceStates::ShaderResource)
+                                    .setKeepInitialState(true));
+}
+
+nvrhi::InputLayoutHandle VertexQuantizer::CreateInputLayout(nvrhi::IDevice* device, nvrhi::IShader* vertexShader) {
+    const nvrhi::VertexAttributeDesc attributes[] = {
+        nvrhi::VertexAttributeDesc()
+            .setName("POS")
+            .setFormat(nvrhi::Format::RGBA16_UNORM)
+            .setBufferIndex(0)
+            .setElementStride(QUANTIZED_POSITION_STRIDE),
+        nvrhi::VertexAttributeDesc()
+            .setName("TEXCOORD")
+            .setFormat(nvrhi::Format::RG16_FLOAT)
+            .setBufferIndex(1)
+            .setElementStride(QUANTIZED_TEXCOORD_STRIDE),
+        nvrhi::VertexAttributeDesc().setName("FRAME").setFormat(nvrhi::Format::R32_UINT).setBufferIndex(2).setElementStride(QUANTIZED_FRAME_STRIDE),
+        nvrhi::VertexAttributeDesc()
+            .setName("TRANSFORM")
+            .setFormat(nvrhi::Format::RGBA32_FLOAT)
+            .setArraySize(3)
+            .setBufferIndex(3)
+            .setOffset(offsetof(InstanceData, transform))
+            .setElementStride(sizeof(InstanceData))
+            .setIsInstanced(true),
+        nvrhi::VertexAttributeDesc()
+            .setName("PREV_TRANSFORM")
+            .setFormat(nvrhi::Format::RGBA32_FLOAT)
+            .setArraySize(3)
+            .setBufferIndex(3)
+            .setOffset(offsetof(InstanceData, prevTransform))
+            .setElementStride(sizeof(InstanceData))
+            .setIsInstanced(true),
+        nvrhi::VertexAttributeDesc()
+            .setName("GEOMETRY_INDEX")
+            .setFormat(nvrhi::Format::R32_UINT)
+            .setBufferIndex(3)
+            .setOffset(offsetof(InstanceData, firstGeometryIndex))
+            .setElementStride(sizeof(InstanceData))
+            .setIsInstanced(true),
+    };
+    return device->createInputLayout(attributes, uint32_t(std::size(attributes)), vertexShader);
+}
+
+void VertexQuantizer::SetupInputBuffers(const engine::BufferGroup* buffers, nvrhi::GraphicsState& state) {
+    state.vertexBuffers = {
+        nvrhi::VertexBufferBinding()
+            .setBuffer(buffers->vertexBuffer)
+            .setSlot(0)
+            .setOffset(buffers->getVertexBufferRange(engine::VertexAttribute::Position).byteOffset),
+        nvrhi::VertexBufferBinding()
+            .setBuffer(buffers->vertexBuffer)
+            .setSlot(1)
+            .setOffset(buffers->getVertexBufferRange(engine::VertexAttribute::TexCoord1).byteOffset),
+        nvrhi::VertexBufferBinding()
+            .setBuffer(buffers->vertexBuffer)
+            .setSlot(2)
+            .setOffset(buffers->getVertexBufferRange(engine::VertexAttribute::Normal).byteOffset),
+        nvrhi::VertexBufferBinding().setBuffer(buffers->instanceBuffer).setSlot(3).setOffset(0),
+    };
+    state.indexBuffer = nvrhi::IndexBufferBinding().setBuffer(buffers->indexBuffer).setFormat(nvrhi::Format::R32_UINT).setOffset(0);
+}
+
+} // namespace sanbox
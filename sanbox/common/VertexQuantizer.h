@@ -0,0 +1,47 @@
+#pragma once
+
+#include <donut/engine/SceneGraph.h>
+#include <nvrhi/nvrhi.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshOptimizer.h"
+
+namespace sanbox {
+
+// Replaces the vertex buffers of the static meshes with quantized ones once Scene::FinishedLoading has
+// created them: positions as RGBA16_UNORM relative to the bounds of their mesh, UVs as RG16_FLOAT, and
+// normal and tangent as one 32-bit octahedral frame, 16 bytes per vertex instead of donut's 28. The vertex
+// buffer ranges of the buffer groups are pointed at the quantized streams, so the geometry passes find them
+// at the usual offsets; only their vertex shaders change. The scale and offset that decode the positions
+// are in a structured buffer indexed by the firstGeometryIndex of the instance.
+// Buffer groups used by skinned or morph target meshes keep their float vertices, which the quantized
+// shaders cannot read, so such scenes must be drawn without quantization. The CPU copies stay as loaded.
+class VertexQuantizer {
+public:
+    explicit VertexQuantizer(nvrhi::IDevice* device);
+
+    // Sets vertexBytesAfter of the reports of the meshes it quantizes.
+    void Quantize(const donut::engine::SceneGraph& sceneGraph, std::vector<MeshProcessingReport>& reports);
+
+    [[nodiscard]] nvrhi::IBuffer* GetMeshDataBuffer() const {
+        return m_MeshData;
+    }
+    [[nodiscard]] uint32_t GetSkippedMeshCount() const {
+        return m_SkippedMeshes;
+    }
+
+    // Shared by the passes that draw quantized vertices. With the input assembler the position, UV and
+    // frame streams go to slots 0-2 and the instance buffer to slot 3; the index buffer is 32-bit.
+    static nvrhi::BufferHandle CreateMeshDataBuffer(nvrhi::IDevice* device, size_t meshCount);
+    static nvrhi::InputLayoutHandle CreateInputLayout(nvrhi::IDevice* device, nvrhi::IShader* vertexShader);
+    static void SetupInputBuffers(const donut::engine::BufferGroup* buffers, nvrhi::GraphicsState& state);
+
+private:
+    nvrhi::DeviceHandle m_Device;
+    nvrhi::BufferHandle m_MeshData;
+    uint32_t m_SkippedMeshes = 0;
+};
+
+} // namespace sanbox
@@ -0,0 +1,48 @@
+#ifndef BINDLESS_MATERIAL_HLSLI
+#define BINDLESS_MATERIAL_HLSLI
+
+#include <donut/shaders/binding_helpers.hlsli>
+#include <donut/shaders/material_cb.h>
+#include <donut/shaders/scene_material.hlsli>
+
+#include "bindless_material_cb.h"
+
+// Materials of sanbox::BindlessMaterialTable. The including shader defines BINDLESS_MATERIAL_SPACE and
+// BINDLESS_TEXTURE_SPACE for its pass and selects the material with the index from its push constants.
+
+StructuredBuffer<MaterialConstants> t_BindlessMaterials : REGISTER_SRV(BINDLESS_MATERIAL_BINDING_MATERIALS, BINDLESS_MATERIAL_SPACE);
+SamplerState s_BindlessMaterialSampler : REGISTER_SAMPLER(BINDLESS_MATERIAL_BINDING_SAMPLER, BINDLESS_MATERIAL_SPACE);
+Texture2D t_BindlessTextures[] : REGISTER_SRV(0, BINDLESS_TEXTURE_SPACE);
+
+// The table clears the flag of every texture it has no descriptor for, so a set flag means a valid index.
+// The index comes from the draw's material and is uniform, so it needs no NonUniformResourceIndex.
+MaterialTextureSample SampleBindlessMaterialTextures(float2 texCoord, MaterialConstants material)
+{
+    MaterialTextureSample values = DefaultMaterialTextures();
+
+    if ((material.flags & MaterialFlags_UseBaseOrDiffuseTexture) != 0)
+        values.baseOrDiffuse = t_BindlessTextures[material.baseOrDiffuseTextureIndex].Sample(s_BindlessMaterialSampler, texCoord);
+
+    if ((material.flags & MaterialFlags_UseMetalRoughOrSpecularTexture) != 0)
+        values.metalRoughOrSpecular = t_BindlessTextures[material.metalRoughOrSpecularTextureIndex].Sample(s_BindlessMaterialSampler, texCoord);
+
+    if ((material.flags & MaterialFlags_UseEmissiveTexture) != 0)
+        values.emissive = t_BindlessTextures[material.emissiveTextureIndex].Sample(s_BindlessMaterialSampler, texCoord);
+
+    if ((material.flags & MaterialFlags_UseNormalTexture) != 0)
+        values.normal = t_BindlessTextures[material.normalTextureIndex].Sample(s_BindlessMaterialSampler,
+            texCoord * material.normalTextureTransformScale);
+
+    if ((material.flags & MaterialFlags_UseOcclusionTexture) != 0)
+        values.occlusion = t_BindlessTextures[material.occlusionTextureIndex].Sample(s_BindlessMaterialSampler, texCoord);
+
+    if ((material.flags & MaterialFlags_UseTransmissionTexture) != 0)
+        values.transmission = t_BindlessTextures[material.transmissionTextureIndex].Sample(s_BindlessMaterialSampler, texCoord);
+
+    if ((material.flags & MaterialFlags_UseOpacityTexture) != 0)
+        values.opacity = t_BindlessTextures[material.opacityTextureIndex].Sample(s_BindlessMaterialSampler, texCoord);
+
+    return values;
+}
+
+#endif // BINDLESS_MATERIAL_HLSLI
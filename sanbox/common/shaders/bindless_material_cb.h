@@ -0,0 +1,36 @@
+#ifndef BINDLESS_MATERIAL_CB_H
+#define BINDLESS_MATERIAL_CB_H
+
+// Material space of the forward and G-buffer passes in bindless mode: the constants of every material,
+// indexed by the draw's push constants, and the sampler all material textures are read with.
+#define BINDLESS_MATERIAL_BINDING_MATERIALS 0
+#define BINDLESS_MATERIAL_BINDING_SAMPLER   0
+
+// Register spaces of the scene texture table, one past the last space of each pass.
+#define BINDLESS_FORWARD_TEXTURE_SPACE 4
+#define BINDLESS_GBUFFER_TEXTURE_SPACE 3
+
+// donut's ForwardPushConstants and GBufferPushConstants with the material index appended, so that the
+// vertex shaders read the draw constants where they always have.
+struct BindlessForwardPushConstants {
+    uint startInstanceLocation;
+    uint startVertexLocation;
+    uint positionOffset;
+    uint texCoordOffset;
+    uint normalOffset;
+    uint tangentOffset;
+    uint materialIndex;
+};
+
+struct BindlessGBufferPushConstants {
+    uint startInstanceLocation;
+    uint startVertexLocation;
+    uint positionOffset;
+    uint prevPositionOffset;
+    uint texCoordOffset;
+    uint normalOffset;
+    uint tangentOffset;
+    uint materialIndex;
+};
+
+#endif // BINDLESS_MATERIAL_CB_H
@@ -0,0 +1,149 @@
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/binding_helpers.hlsli>
+#include <donut/shaders/forward_cb.h>
+#include <donut/shaders/forward_vertex.hlsli>
+#include <donut/shaders/lighting.hlsli>
+#include <donut/shaders/shadows.hlsli>
+
+#include "clustered_lighting_cb.h"
+
+#if BINDLESS_MATERIALS
+#define BINDLESS_MATERIAL_SPACE FORWARD_SPACE_MATERIAL
+#define BINDLESS_TEXTURE_SPACE  BINDLESS_FORWARD_TEXTURE_SPACE
+#include "bindless_material.hlsli"
+#else
+#include <donut/shaders/material_bindings.hlsli>
+#include <donut/shaders/scene_material.hlsli>
+#endif
+
+// Opaque and alpha-tested variant of donut's forward_ps.hlsl. The few lights passed to PrepareLights are
+// shaded everywhere, with the cascades of their shadow maps; point and spot lights come from the cluster that
+// contains the pixel and are unshadowed.
+// With BINDLESS_MATERIALS the material comes from the table of sanbox::BindlessMaterialTable instead of
+// a binding set of its own.
+
+DECLARE_CBUFFER(ForwardShadingViewConstants, g_ForwardView, FORWARD_BINDING_VIEW_CONSTANTS, FORWARD_SPACE_VIEW);
+DECLARE_CBUFFER(ForwardShadingLightConstants, g_ForwardLight, FORWARD_BINDING_LIGHT_CONSTANTS, FORWARD_SPACE_SHADING);
+DECLARE_CBUFFER(ClusteredLightingConstants, g_Clustered, CLUSTERED_BINDING_CONSTANTS, FORWARD_SPACE_VIEW);
+#if BINDLESS_MATERIALS
+DECLARE_PUSH_CONSTANTS(BindlessForwardPushConstants, g_BindlessPush, FORWARD_BINDING_PUSH_CONSTANTS, FORWARD_SPACE_INPUT);
+#endif
+
+Texture2DArray t_ShadowMapArray : REGISTER_SRV(FORWARD_BINDING_SHADOW_MAP_TEXTURE, FORWARD_SPACE_SHADING);
+SamplerComparisonState s_ShadowSampler : REGISTER_SAMPLER(FORWARD_BINDING_SHADOW_MAP_SAMPLER, FORWARD_SPACE_SHADING);
+
+StructuredBuffer<LightConstants> t_ClusteredLights : REGISTER_SRV(CLUSTERED_BINDING_LIGHTS, FORWARD_SPACE_VIEW);
+StructuredBuffer<uint2> t_ClusterRanges : REGISTER_SRV(CLUSTERED_BINDING_CLUSTER_RANGES, FORWARD_SPACE_VIEW);
+StructuredBuffer<uint> t_ClusterLightIndices : REGISTER_SRV(CLUSTERED_BINDING_LIGHT_INDICES, FORWARD_SPACE_VIEW);
+
+float3 GetViewIncident(float4 cameraDirectionOrPosition, float3 surfacePos)
+{
+    if (cameraDirectionOrPosition.w > 0)
+        return normalize(surfacePos - cameraDirectionOrPosition.xyz);
+    return cameraDirectionOrPosition.xyz;
+}
+
+uint GetClusterIndex(float2 pixelPosition, float3 surfaceWorldPos)
+{
+    uint2 tile = uint2((pixelPosition - g_Clustered.viewportOrigin) * g_Clustered.tilesPerPixel);
+    tile = min(tile, uint2(CLUSTER_TILES_X - 1, CLUSTER_TILES_Y - 1));
+
+    float depth = max(dot(float4(surfaceWorldPos, 1.0), g_Clustered.viewDepthPlane), g_Clustered.nearDepth);
+    uint slice = min(uint(max(log2(depth) * g_Clustered.sliceScale + g_Clustered.sliceBias, 0.0)), CLUSTER_SLICES - 1);
+
+    return (slice * CLUSTER_TILES_Y + tile.y) * CLUSTER_TILES_X + tile.x;
+}
+
+void AccumulateLight(LightConstants light, MaterialSample surfaceMaterial, float3 surfaceWorldPos, float3 viewIncident,
+    inout float3 diffuseTerm, inout float3 specularTerm, float shadow = 1)
+{
+    float3 diffuseRadiance, specularRadiance;
+    ShadeSurface(light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseRadiance, specularRadiance);
+
+    diffuseTerm += diffuseRadiance * light.color * shadow;
+    specularTerm += specularRadiance * light.color * shadow;
+}
+
+// Blends the cascades from the finest that covers the point, as donut's forward_ps.hlsl does; points that no
+// cascade covers take the light's out-of-bounds value.
+float EvaluateLightShadow(LightConstants light, float3 surfaceWorldPos)
+{
+    float2 shadow = 0;
+    for (int cascade = 0; cascade < 4; cascade++)
+    {
+        if (light.shadowCascades[cascade] < 0)
+            break;
+
+        float2 cascadeShadow = EvaluateShadowPCF(t_ShadowMapArray, s_ShadowSampler, g_ForwardLight.shadows[light.shadowCascades[cascade]],
+            surfaceWorldPos, g_ForwardLight.shadowMapTextureSize);
+        shadow = saturate(shadow + cascadeShadow * (1.0001 - shadow.y));
+
+        if (shadow.y == 1)
+            break;
+    }
+
+    return shadow.x + (1 - shadow.y) * light.outOfBoundsShadow;
+}
+
+void main(
+    in float4 i_position : SV_Position,
+    in SceneVertex i_vtx,
+    in bool i_isFrontFace : SV_IsFrontFace,
+    out float4 o_color : SV_Target0)
+{
+#if BINDLESS_MATERIALS
+    MaterialConstants material = t_BindlessMaterials[g_BindlessPush.materialIndex];
+    MaterialTextureSample textures = SampleBindlessMaterialTextures(i_vtx.texCoord, material);
+#else
+    MaterialConstants material = g_Material;
+    MaterialTextureSample textures = SampleMaterialTexturesAuto(i_vtx.texCoord, g_Material.normalTextureTransformScale);
+#endif
+    MaterialSample surfaceMaterial = EvaluateSceneMaterial(i_vtx.normal, i_vtx.tangent, material, textures);
+    float3 surfaceWorldPos = i_vtx.pos;
+
+    if (!i_isFrontFace)
+        surfaceMaterial.shadingNormal = -surfaceMaterial.shadingNormal;
+
+    if (material.domain != MaterialDomain_Opaque)
+        clip(surfaceMaterial.opacity - material.alphaCutoff);
+
+    float3 viewIncident = GetViewIncident(g_ForwardView.view.cameraDirectionOrPosition, surfaceWorldPos);
+
+    float3 diffuseTerm = 0;
+    float3 specularTerm = 0;
+
+    [loop]
+    for (uint nLight = 0; nLight < g_ForwardLight.numLights; nLight++)
+    {
+        LightConstants light = g_ForwardLight.lights[nLight];
+        float shadow = light.shadowCascades[0] >= 0 ? EvaluateLightShadow(light, surfaceWorldPos) : 1;
+        AccumulateLight(light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseTerm, specularTerm, shadow);
+    }
+
+    if (g_Clustered.naiveLightLoop != 0)
+    {
+        [loop]
+        for (uint index = 0; index < g_Clustered.lightCount; index++)
+        {
+            AccumulateLight(t_ClusteredLights[index], surfaceMaterial, surfaceWorldPos, viewIncident, diffuseTerm, specularTerm);
+        }
+    }
+    else
+    {
+        uint2 range = t_ClusterRanges[GetClusterIndex(i_position.xy, surfaceWorldPos)];
+
+        [loop]
+        for (uint index = 0; index < range.y; index++)
+        {
+            LightConstants light = t_ClusteredLights[t_ClusterLightIndices[range.x + index]];
+            AccumulateLight(light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseTerm, specularTerm);
+        }
+    }
+
+    float3 ambientColor = lerp(g_ForwardLight.ambientColorBottom.rgb, g_ForwardLight.ambientColorTop.rgb, surfaceMaterial.shadingNormal.y * 0.5 + 0.5);
+    diffuseTerm += ambientColor * surfaceMaterial.diffuseAlbedo * surfaceMaterial.occlusion;
+    specularTerm += ambientColor * surfaceMaterial.specularF0 * surfaceMaterial.occlusion;
+
+    o_color = float4(diffuseTerm + specularTerm + surfaceMaterial.emissiveColor, surfaceMaterial.opacity);
+}
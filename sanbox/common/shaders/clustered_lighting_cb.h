@@ -0,0 +1,33 @@
+#ifndef CLUSTERED_LIGHTING_CB_H
+#define CLUSTERED_LIGHTING_CB_H
+
+// The view is split into CLUSTER_TILES_X x CLUSTER_TILES_Y screen tiles and CLUSTER_SLICES depth slices that
+// are spaced exponentially between nearDepth and farDepth. Cluster index = (slice * TILES_Y + tileY) * TILES_X + tileX.
+#define CLUSTER_TILES_X 16
+#define CLUSTER_TILES_Y 8
+#define CLUSTER_SLICES  24
+
+// Added to the view binding space of the forward shading pass.
+#define CLUSTERED_BINDING_CONSTANTS      10
+#define CLUSTERED_BINDING_LIGHTS         10
+#define CLUSTERED_BINDING_CLUSTER_RANGES 11
+#define CLUSTERED_BINDING_LIGHT_INDICES  12
+
+struct ClusteredLightingConstants {
+    // View-space depth of a world position is dot(float4(p, 1), viewDepthPlane).
+    float4 viewDepthPlane;
+    float2 viewportOrigin;
+    float2 tilesPerPixel;
+    float nearDepth;
+    // slice = log2(depth) * sliceScale + sliceBias
+    float sliceScale;
+    float sliceBias;
+    // Non-zero to shade every light at every pixel, which is what the clusters are measured against.
+    uint naiveLightLoop;
+    uint lightCount;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+#endif // CLUSTERED_LIGHTING_CB_H
@@ -0,0 +1,82 @@
+#ifndef GBUFFER_PACKING_HLSLI
+#define GBUFFER_PACKING_HLSLI
+
+#include <donut/shaders/gbuffer.hlsli>
+#include <donut/shaders/scene_material.hlsli>
+
+// Encoding of the G-buffer channels that the fill shaders write and the lighting shaders read; both include
+// this file, so the two sides cannot disagree. The formats of the channels are those of sanbox::GBufferLayout.
+//
+// Standard, donut's layout:
+//   0 diffuse albedo, opacity                 SRGBA8
+//   1 specular F0, occlusion                  SRGBA8
+//   2 shading normal, roughness               RGBA16_SNORM
+//   3 emissive                                RGBA16_FLOAT
+// COMPACT_GBUFFER:
+//   0 base color, occlusion                   SRGBA8
+//   1 octahedral shading normal               RG16_SNORM
+//   2 roughness, metalness                    RG8
+//   3 emissive                                R11G11B10_FLOAT
+// The compact layout keeps the metal-rough parameters and derives albedo and F0 from them when it is read,
+// the way EvaluateSceneMaterial does. Specular-gloss materials lose their specular color to it.
+
+#ifndef COMPACT_GBUFFER
+#define COMPACT_GBUFFER 0
+#endif
+
+static const float c_GBufferDielectricF0 = 0.04;
+
+float2 EncodeOctahedralNormal(float3 normal)
+{
+    normal /= abs(normal.x) + abs(normal.y) + abs(normal.z);
+    if (normal.z < 0.0)
+    {
+        float2 signs = float2(normal.x >= 0.0 ? 1.0 : -1.0, normal.y >= 0.0 ? 1.0 : -1.0);
+        return (1.0 - abs(normal.yx)) * signs;
+    }
+    return normal.xy;
+}
+
+float3 DecodeOctahedralNormal(float2 encoded)
+{
+    float3 normal = float3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    float fold = saturate(-normal.z);
+    normal.x += normal.x >= 0.0 ? -fold : fold;
+    normal.y += normal.y >= 0.0 ? -fold : fold;
+    return normalize(normal);
+}
+
+void EncodeSurfaceToGBuffer(MaterialSample surface, out float4 channels[4])
+{
+#if COMPACT_GBUFFER
+    channels[0] = float4(surface.baseColor, surface.occlusion);
+    channels[1] = float4(EncodeOctahedralNormal(surface.shadingNormal), 0, 0);
+    channels[2] = float4(surface.roughness, surface.metalness, 0, 0);
+    channels[3] = float4(surface.emissiveColor, 0);
+#else
+    channels[0] = float4(surface.diffuseAlbedo, surface.opacity);
+    channels[1] = float4(surface.specularF0, surface.occlusion);
+    channels[2] = float4(surface.shadingNormal, surface.roughness);
+    channels[3] = float4(surface.emissiveColor, 0);
+#endif
+}
+
+MaterialSample DecodeSurfaceFromGBuffer(float4 channels[4])
+{
+#if COMPACT_GBUFFER
+    MaterialSample surface = DefaultMaterialSample();
+    surface.baseColor = channels[0].rgb;
+    surface.occlusion = channels[0].a;
+    surface.shadingNormal = DecodeOctahedralNormal(channels[1].xy);
+    surface.roughness = channels[2].r;
+    surface.metalness = channels[2].g;
+    surface.emissiveColor = channels[3].rgb;
+    surface.diffuseAlbedo = surface.baseColor * (1.0 - c_GBufferDielectricF0) * (1.0 - surface.metalness);
+    surface.specularF0 = lerp(c_GBufferDielectricF0, surface.baseColor, surface.metalness);
+    return surface;
+#else
+    return DecodeGBuffer(channels);
+#endif
+}
+
+#endif // GBUFFER_PACKING_HLSLI
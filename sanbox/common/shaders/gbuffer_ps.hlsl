@@ -0,0 +1,70 @@
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/binding_helpers.hlsli>
+#include <donut/shaders/forward_vertex.hlsli>
+#include <donut/shaders/gbuffer_cb.h>
+
+#if BINDLESS_MATERIALS
+#define BINDLESS_MATERIAL_SPACE GBUFFER_SPACE_MATERIAL
+#define BINDLESS_TEXTURE_SPACE  BINDLESS_GBUFFER_TEXTURE_SPACE
+#include "bindless_material.hlsli"
+#else
+#define MATERIAL_REGISTER_SPACE    GBUFFER_SPACE_MATERIAL
+#define MATERIAL_CB_SLOT           GBUFFER_BINDING_MATERIAL_CONSTANTS
+#define MATERIAL_DIFFUSE_SLOT      GBUFFER_BINDING_MATERIAL_DIFFUSE_TEXTURE
+#define MATERIAL_SPECULAR_SLOT     GBUFFER_BINDING_MATERIAL_SPECULAR_TEXTURE
+#define MATERIAL_NORMALS_SLOT      GBUFFER_BINDING_MATERIAL_NORMAL_TEXTURE
+#define MATERIAL_EMISSIVE_SLOT     GBUFFER_BINDING_MATERIAL_EMISSIVE_TEXTURE
+#define MATERIAL_OCCLUSION_SLOT    GBUFFER_BINDING_MATERIAL_OCCLUSION_TEXTURE
+#define MATERIAL_TRANSMISSION_SLOT GBUFFER_BINDING_MATERIAL_TRANSMISSION_TEXTURE
+#define MATERIAL_OPACITY_SLOT      GBUFFER_BINDING_MATERIAL_OPACITY_TEXTURE
+
+#define MATERIAL_SAMPLER_REGISTER_SPACE GBUFFER_SPACE_VIEW
+#define MATERIAL_SAMPLER_SLOT           GBUFFER_BINDING_MATERIAL_SAMPLER
+#include <donut/shaders/material_bindings.hlsli>
+#include <donut/shaders/scene_material.hlsli>
+#endif
+
+#include "gbuffer_packing.hlsli"
+
+// Variant of donut's gbuffer_ps.hlsl, without motion vectors, that writes the channels of gbuffer_packing.hlsli.
+// With BINDLESS_MATERIALS the material comes from the table of sanbox::BindlessMaterialTable instead of
+// a binding set of its own.
+
+#if BINDLESS_MATERIALS
+DECLARE_PUSH_CONSTANTS(BindlessGBufferPushConstants, g_BindlessPush, GBUFFER_BINDING_PUSH_CONSTANTS, GBUFFER_SPACE_INPUT);
+#endif
+
+void main(
+    in float4 i_position : SV_Position,
+    in SceneVertex i_vtx,
+    in bool i_isFrontFace : SV_IsFrontFace,
+    out float4 o_channel0 : SV_Target0,
+    out float4 o_channel1 : SV_Target1,
+    out float4 o_channel2 : SV_Target2,
+    out float4 o_channel3 : SV_Target3)
+{
+#if BINDLESS_MATERIALS
+    MaterialConstants material = t_BindlessMaterials[g_BindlessPush.materialIndex];
+    MaterialTextureSample textures = SampleBindlessMaterialTextures(i_vtx.texCoord, material);
+#else
+    MaterialConstants material = g_Material;
+    MaterialTextureSample textures = SampleMaterialTexturesAuto(i_vtx.texCoord, g_Material.normalTextureTransformScale);
+#endif
+    MaterialSample surface = EvaluateSceneMaterial(i_vtx.normal, i_vtx.tangent, material, textures);
+
+#if ALPHA_TESTED
+    if (material.domain != MaterialDomain_Opaque)
+        clip(surface.opacity - material.alphaCutoff);
+#endif
+
+    if (!i_isFrontFace)
+        surface.shadingNormal = -surface.shadingNormal;
+
+    float4 channels[4];
+    EncodeSurfaceToGBuffer(surface, channels);
+    o_channel0 = channels[0];
+    o_channel1 = channels[1];
+    o_channel2 = channels[2];
+    o_channel3 = channels[3];
+}
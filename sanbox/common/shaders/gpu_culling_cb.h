@@ -0,0 +1,47 @@
+#ifndef GPU_CULLING_CB_H
+#define GPU_CULLING_CB_H
+
+#define GPU_CULLING_GROUP_SIZE 64
+
+// Layout of nvrhi::DrawIndexedIndirectArguments, in bytes.
+#define DRAW_ARGUMENTS_STRIDE         20
+#define DRAW_ARGUMENTS_INSTANCE_COUNT 4
+#define DRAW_ARGUMENTS_START_INSTANCE 16
+
+// Frustum culls every record. Early draws the records that were visible last frame, Late tests the rest
+// against the Hi-Z pyramid built from the early depth and draws the ones that became visible.
+#define GPU_CULL_PHASE_FRUSTUM 0
+#define GPU_CULL_PHASE_EARLY   1
+#define GPU_CULL_PHASE_LATE    2
+
+// Slots of the statistics buffer.
+#define GPU_CULL_STAT_FRUSTUM_CULLED 0
+#define GPU_CULL_STAT_OCCLUDED       1
+#define GPU_CULL_STAT_VISIBLE        2
+#define GPU_CULL_STAT_DRAWN_EARLY    3
+#define GPU_CULL_STAT_DRAWN_LATE     4
+#define GPU_CULL_STAT_COUNT          5
+
+// One mesh geometry of one instance, with its world-space bounds.
+struct GpuCullRecord {
+    float3 boundsMin;
+    uint instanceIndex;
+    float3 boundsMax;
+    uint drawIndex;
+};
+
+struct GpuCullingConstants {
+    float4x4 worldToClip;
+    // xyz = outward normal, w = distance, as in dm::plane.
+    float4 frustumPlanes[6];
+    uint2 hizSize;
+    uint hizMipCount;
+    uint reverseDepth;
+    uint recordCount;
+    uint cullPhase;
+    // The part of the pyramid's level 0 that the view rendered into, from its top left corner; smaller
+    // than hizSize when the view renders at a reduced scale.
+    uint2 viewportSize;
+};
+
+#endif // GPU_CULLING_CB_H
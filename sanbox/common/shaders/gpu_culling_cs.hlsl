@@ -0,0 +1,157 @@
+#include <donut/shaders/bindless.h>
+
+#include "gpu_culling_cb.h"
+
+cbuffer c_Culling : register(b0) {
+    GpuCullingConstants g_Culling;
+};
+
+StructuredBuffer<GpuCullRecord> t_CullRecords : register(t0);
+StructuredBuffer<InstanceData> t_Instances : register(t1);
+Texture2D<float> t_HiZ : register(t2);
+
+RWByteAddressBuffer u_DrawArguments : register(u0);
+RWStructuredBuffer<InstanceData> u_VisibleInstances : register(u1);
+// 1 for the records that passed both tests in the last Late phase.
+RWStructuredBuffer<uint> u_Visibility : register(u2);
+RWStructuredBuffer<uint> u_Statistics : register(u3);
+
+bool IsInFrustum(GpuCullRecord record)
+{
+    [unroll]
+    for (uint i = 0; i < 6; i++)
+    {
+        float4 plane = g_Culling.frustumPlanes[i];
+        float3 nearest = float3(
+            plane.x > 0 ? record.boundsMin.x : record.boundsMax.x,
+            plane.y > 0 ? record.boundsMin.y : record.boundsMax.y,
+            plane.z > 0 ? record.boundsMin.z : record.boundsMax.z);
+
+        if (dot(plane.xyz, nearest) > plane.w)
+            return false;
+    }
+    return true;
+}
+
+bool IsOccluded(GpuCullRecord record)
+{
+    if (g_Culling.hizMipCount == 0)
+        return false;
+
+    bool reverseDepth = g_Culling.reverseDepth != 0;
+    float2 uvMin = 1.0;
+    float2 uvMax = 0.0;
+    float nearestDepth = reverseDepth ? 0.0 : 1.0;
+
+    [unroll]
+    for (uint corner = 0; corner < 8; corner++)
+    {
+        float3 position = float3(
+            (corner & 1) ? record.boundsMax.x : record.boundsMin.x,
+            (corner & 2) ? record.boundsMax.y : record.boundsMin.y,
+            (corner & 4) ? record.boundsMax.z : record.boundsMin.z);
+
+        float4 clip = mul(float4(position, 1.0), g_Culling.worldToClip);
+
+        // Boxes that cross the near plane cannot be bounded on screen.
+        if (clip.w <= 0)
+            return false;
+
+        float3 ndc = clip.xyz / clip.w;
+        float2 uv = ndc.xy * float2(0.5, -0.5) + 0.5;
+        uvMin = min(uvMin, uv);
+        uvMax = max(uvMax, uv);
+        nearestDepth = reverseDepth ? max(nearestDepth, ndc.z) : min(nearestDepth, ndc.z);
+    }
+
+    uvMin = saturate(uvMin);
+    uvMax = saturate(uvMax);
+
+    int2 size = int2(g_Culling.hizSize);
+    int2 viewportSize = int2(g_Culling.viewportSize);
+    int2 pixelMin = min(int2(uvMin * float2(viewportSize)), viewportSize - 1);
+    int2 pixelMax = min(int2(uvMax * float2(viewportSize)), viewportSize - 1);
+
+    // The level where the rectangle spans at most two texels in each direction.
+    int2 extent = pixelMax - pixelMin + 1;
+    uint level = uint(ceil(log2(float(max(extent.x, extent.y)))));
+    level = min(level, g_Culling.hizMipCount - 1);
+
+    int2 levelSize = max(size >> level, 1);
+    int2 texelMin = min(pixelMin >> level, levelSize - 1);
+    int2 texelMax = min(pixelMax >> level, levelSize - 1);
+
+    float depth00 = t_HiZ.Load(int3(texelMin.x, texelMin.y, level));
+    float depth10 = t_HiZ.Load(int3(texelMax.x, texelMin.y, level));
+    float depth01 = t_HiZ.Load(int3(texelMin.x, texelMax.y, level));
+    float depth11 = t_HiZ.Load(int3(texelMax.x, texelMax.y, level));
+
+    if (reverseDepth)
+    {
+        float farthest = min(min(depth00, depth10), min(depth01, depth11));
+        return nearestDepth < farthest;
+    }
+
+    float farthest = max(max(depth00, depth10), max(depth01, depth11));
+    return nearestDepth > farthest;
+}
+
+void EmitInstance(GpuCullRecord record)
+{
+    // Each draw owns a range of the visible instance buffer starting at its startInstanceLocation;
+    // the instance count doubles as the allocation cursor within that range.
+    uint argumentsOffset = record.drawIndex * DRAW_ARGUMENTS_STRIDE;
+    uint slot;
+    u_DrawArguments.InterlockedAdd(argumentsOffset + DRAW_ARGUMENTS_INSTANCE_COUNT, 1, slot);
+    uint firstInstance = u_DrawArguments.Load(argumentsOffset + DRAW_ARGUMENTS_START_INSTANCE);
+
+    u_VisibleInstances[firstInstance + slot] = t_Instances[record.instanceIndex];
+}
+
+[numthreads(GPU_CULLING_GROUP_SIZE, 1, 1)]
+void main_cs(uint i_globalIdx : SV_DispatchThreadID)
+{
+    if (i_globalIdx >= g_Culling.recordCount)
+        return;
+
+    GpuCullRecord record = t_CullRecords[i_globalIdx];
+    bool inFrustum = IsInFrustum(record);
+
+    if (g_Culling.cullPhase == GPU_CULL_PHASE_FRUSTUM)
+    {
+        InterlockedAdd(u_Statistics[inFrustum ? GPU_CULL_STAT_VISIBLE : GPU_CULL_STAT_FRUSTUM_CULLED], 1);
+        if (inFrustum)
+            EmitInstance(record);
+        return;
+    }
+
+    bool wasVisible = u_Visibility[i_globalIdx] != 0;
+
+    if (g_Culling.cullPhase == GPU_CULL_PHASE_EARLY)
+    {
+        if (inFrustum && wasVisible)
+        {
+            InterlockedAdd(u_Statistics[GPU_CULL_STAT_DRAWN_EARLY], 1);
+            EmitInstance(record);
+        }
+        return;
+    }
+
+    bool occluded = inFrustum && IsOccluded(record);
+    bool visible = inFrustum && !occluded;
+    u_Visibility[i_globalIdx] = visible ? 1 : 0;
+
+    if (!inFrustum)
+        InterlockedAdd(u_Statistics[GPU_CULL_STAT_FRUSTUM_CULLED], 1);
+    else if (occluded)
+        InterlockedAdd(u_Statistics[GPU_CULL_STAT_OCCLUDED], 1);
+    else
+        InterlockedAdd(u_Statistics[GPU_CULL_STAT_VISIBLE], 1);
+
+    // Records drawn in the early phase are already in the depth buffer and must not be drawn twice.
+    if (visible && !wasVisible)
+    {
+        InterlockedAdd(u_Statistics[GPU_CULL_STAT_DRAWN_LATE], 1);
+        EmitInstance(record);
+    }
+}
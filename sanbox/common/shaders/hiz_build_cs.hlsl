@@ -0,0 +1,43 @@
+#include <donut/shaders/vulkan.hlsli>
+
+#include "hiz_cb.h"
+
+VK_PUSH_CONSTANT ConstantBuffer<HiZConstants> g_HiZ : register(b0);
+
+Texture2D<float> t_Source : register(t0);
+RWTexture2D<float> u_Destination : register(u0);
+
+// Each texel keeps the farthest depth of its footprint in the level above. Odd-sized levels fold the
+// extra row and column into the last texel so that the pyramid stays conservative.
+[numthreads(HIZ_GROUP_SIZE, HIZ_GROUP_SIZE, 1)]
+void main_cs(uint2 i_globalIdx : SV_DispatchThreadID)
+{
+    if (any(i_globalIdx >= g_HiZ.destinationSize))
+        return;
+
+    if (g_HiZ.copyLevel != 0)
+    {
+        u_Destination[i_globalIdx] = t_Source[i_globalIdx];
+        return;
+    }
+
+    uint2 first = i_globalIdx * 2;
+    uint2 last = first + 1;
+    if (i_globalIdx.x == g_HiZ.destinationSize.x - 1)
+        last.x += g_HiZ.sourceSize.x & 1;
+    if (i_globalIdx.y == g_HiZ.destinationSize.y - 1)
+        last.y += g_HiZ.sourceSize.y & 1;
+    last = min(last, g_HiZ.sourceSize - 1);
+
+    float farthest = g_HiZ.reverseDepth != 0 ? 1.0 : 0.0;
+    for (uint y = first.y; y <= last.y; y++)
+    {
+        for (uint x = first.x; x <= last.x; x++)
+        {
+            float depth = t_Source[uint2(x, y)];
+            farthest = g_HiZ.reverseDepth != 0 ? min(farthest, depth) : max(farthest, depth);
+        }
+    }
+
+    u_Destination[i_globalIdx] = farthest;
+}
@@ -0,0 +1,13 @@
+#ifndef HIZ_CB_H
+#define HIZ_CB_H
+
+#define HIZ_GROUP_SIZE 8
+
+struct HiZConstants {
+    uint2 sourceSize;
+    uint2 destinationSize;
+    uint reverseDepth;
+    uint copyLevel;
+};
+
+#endif // HIZ_CB_H
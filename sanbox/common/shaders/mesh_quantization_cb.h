@@ -0,0 +1,20 @@
+#ifndef MESH_QUANTIZATION_CB_H
+#define MESH_QUANTIZATION_CB_H
+
+// Added to the view binding space of the forward and G-buffer passes when they draw quantized vertices.
+#define MESH_QUANTIZATION_BINDING 13
+
+// Bytes per vertex of the streams that sanbox::VertexQuantizer writes. Positions are RGBA16_UNORM
+// relative to the bounds of their mesh, UVs RG16_FLOAT, and the frame packs the octahedral normal in
+// 8+8 bits, the octahedral tangent in 8+7 bits and the bitangent sign in the top bit.
+#define QUANTIZED_POSITION_STRIDE 8
+#define QUANTIZED_TEXCOORD_STRIDE 4
+#define QUANTIZED_FRAME_STRIDE    4
+
+// Indexed by the firstGeometryIndex of the instance: objectPosition = unorm16Position * scale + offset.
+struct QuantizedMeshData {
+    float4 positionScale;
+    float4 positionOffset;
+};
+
+#endif // MESH_QUANTIZATION_CB_H
@@ -0,0 +1,53 @@
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/binding_helpers.hlsli>
+#include <donut/shaders/bindless.h>
+#include <donut/shaders/gbuffer_cb.h>
+
+#include "quantized_vertex.hlsli"
+
+// Variant of donut's gbuffer_vs.hlsl for the vertices written by sanbox::VertexQuantizer. The previous
+// position always goes through the previous instance transform, so it serves both motion vector settings.
+
+DECLARE_CBUFFER(GBufferFillConstants, g_GBuffer, GBUFFER_BINDING_VIEW_CONSTANTS, GBUFFER_SPACE_VIEW);
+DECLARE_PUSH_CONSTANTS(GBufferPushConstants, g_Push, GBUFFER_BINDING_PUSH_CONSTANTS, GBUFFER_SPACE_INPUT);
+
+StructuredBuffer<QuantizedMeshData> t_QuantizedMeshes : REGISTER_SRV(MESH_QUANTIZATION_BINDING, GBUFFER_SPACE_VIEW);
+StructuredBuffer<InstanceData> t_Instances : REGISTER_SRV(GBUFFER_BINDING_INSTANCE_BUFFER, GBUFFER_SPACE_INPUT);
+ByteAddressBuffer t_Vertices : REGISTER_SRV(GBUFFER_BINDING_VERTEX_BUFFER, GBUFFER_SPACE_INPUT);
+
+void input_assembler(
+    in QuantizedVertex i_vtx,
+    in float4 i_instanceMatrix0 : TRANSFORM0,
+    in float4 i_instanceMatrix1 : TRANSFORM1,
+    in float4 i_instanceMatrix2 : TRANSFORM2,
+    in float4 i_prevInstanceMatrix0 : PREV_TRANSFORM0,
+    in float4 i_prevInstanceMatrix1 : PREV_TRANSFORM1,
+    in float4 i_prevInstanceMatrix2 : PREV_TRANSFORM2,
+    in uint i_geometryIndex : GEOMETRY_INDEX,
+    out float4 o_position : SV_Position,
+    out SceneVertex o_vtx)
+{
+    float3x4 instanceMatrix = float3x4(i_instanceMatrix0, i_instanceMatrix1, i_instanceMatrix2);
+    float3x4 prevInstanceMatrix = float3x4(i_prevInstanceMatrix0, i_prevInstanceMatrix1, i_prevInstanceMatrix2);
+    SceneVertex vtx = DecodeQuantizedVertex(i_vtx, t_QuantizedMeshes[i_geometryIndex]);
+
+    o_vtx = TransformQuantizedVertex(vtx, instanceMatrix, prevInstanceMatrix);
+    o_position = mul(float4(o_vtx.pos, 1.0), g_GBuffer.view.matWorldToClip);
+}
+
+void buffer_loads(
+    in uint i_vertexID : SV_VertexID,
+    in uint i_instance : SV_InstanceID,
+    out float4 o_position : SV_Position,
+    out SceneVertex o_vtx)
+{
+    InstanceData instance = t_Instances[i_instance + g_Push.startInstanceLocation];
+    uint vertexIndex = i_vertexID + g_Push.startVertexLocation;
+
+    QuantizedVertex qv = LoadQuantizedVertex(t_Vertices, vertexIndex, g_Push.positionOffset, g_Push.texCoordOffset, g_Push.normalOffset);
+    SceneVertex vtx = DecodeQuantizedVertex(qv, t_QuantizedMeshes[instance.firstGeometryIndex]);
+
+    o_vtx = TransformQuantizedVertex(vtx, instance.transform, instance.prevTransform);
+    o_position = mul(float4(o_vtx.pos, 1.0), g_GBuffer.view.matWorldToClip);
+}
@@ -0,0 +1,65 @@
+#ifndef QUANTIZED_VERTEX_HLSLI
+#define QUANTIZED_VERTEX_HLSLI
+
+#include <donut/shaders/forward_vertex.hlsli>
+
+#include "mesh_quantization_cb.h"
+
+// Input assembler layout of sanbox::VertexQuantizer::CreateInputLayout.
+struct QuantizedVertex
+{
+    float4 position : POS;
+    float2 texCoord : TEXCOORD;
+    uint frame : FRAME;
+};
+
+float3 DecodeOctahedral(float2 e)
+{
+    float3 v = float3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+    {
+        float2 signs = float2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+        v.xy = (1.0 - abs(v.yx)) * signs;
+    }
+    return normalize(v);
+}
+
+SceneVertex DecodeQuantizedVertex(QuantizedVertex qv, QuantizedMeshData mesh)
+{
+    uint frame = qv.frame;
+    float2 normalOct = (float2(frame & 0xff, (frame >> 8) & 0xff) - 127.0) / 127.0;
+    float2 tangentOct = float2((float((frame >> 16) & 0xff) - 127.0) / 127.0, (float((frame >> 24) & 0x7f) - 63.0) / 63.0);
+
+    SceneVertex vtx;
+    vtx.pos = qv.position.xyz * mesh.positionScale.xyz + mesh.positionOffset.xyz;
+    vtx.prevPos = vtx.pos;
+    vtx.texCoord = qv.texCoord;
+    vtx.normal = DecodeOctahedral(normalOct);
+    vtx.tangent = float4(DecodeOctahedral(tangentOct), (frame & 0x80000000) != 0 ? -1.0 : 1.0);
+    return vtx;
+}
+
+// The same vertex read from the raw vertex buffer, for the passes that do not use the input assembler.
+QuantizedVertex LoadQuantizedVertex(ByteAddressBuffer vertices, uint vertexIndex, uint positionOffset, uint texCoordOffset, uint frameOffset)
+{
+    uint2 position = vertices.Load2(positionOffset + vertexIndex * QUANTIZED_POSITION_STRIDE);
+    uint texCoord = vertices.Load(texCoordOffset + vertexIndex * QUANTIZED_TEXCOORD_STRIDE);
+
+    QuantizedVertex qv;
+    qv.position = float4(float3(position.x & 0xffff, position.x >> 16, position.y & 0xffff) / 65535.0, 1.0);
+    qv.texCoord = f16tof32(uint2(texCoord & 0xffff, texCoord >> 16));
+    qv.frame = vertices.Load(frameOffset + vertexIndex * QUANTIZED_FRAME_STRIDE);
+    return qv;
+}
+
+SceneVertex TransformQuantizedVertex(SceneVertex vtx, float3x4 transform, float3x4 prevTransform)
+{
+    SceneVertex result = vtx;
+    result.pos = mul(transform, float4(vtx.pos, 1.0)).xyz;
+    result.prevPos = mul(prevTransform, float4(vtx.prevPos, 1.0)).xyz;
+    result.normal = mul(transform, float4(vtx.normal, 0.0)).xyz;
+    result.tangent.xyz = mul(transform, float4(vtx.tangent.xyz, 0.0)).xyz;
+    return result;
+}
+
+#endif // QUANTIZED_VERTEX_HLSLI
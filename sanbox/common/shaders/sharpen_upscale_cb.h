@@ -0,0 +1,14 @@
+#ifndef SHARPEN_UPSCALE_CB_H
+#define SHARPEN_UPSCALE_CB_H
+
+// The source rectangle in texture coordinates of the source texture.
+struct SharpenUpscaleConstants {
+    float2 sourceOrigin;
+    float2 sourceSize;
+    float2 sourceTexelSize;
+    // 0 is a plain bilinear upscale, 1 the strongest sharpening.
+    float sharpness;
+    float padding;
+};
+
+#endif // SHARPEN_UPSCALE_CB_H
@@ -0,0 +1,50 @@
+#include <donut/shaders/vulkan.hlsli>
+
+#include "sharpen_upscale_cb.h"
+
+VK_PUSH_CONSTANT ConstantBuffer<SharpenUpscaleConstants> g_Upscale : register(b0);
+
+Texture2D t_Source : register(t0);
+SamplerState s_Linear : register(s0);
+
+float3 SampleSource(float2 uv)
+{
+    // Clamped to the source rectangle; the texels around it hold what earlier frames rendered at other scales.
+    float2 uvMin = g_Upscale.sourceOrigin + 0.5 * g_Upscale.sourceTexelSize;
+    float2 uvMax = g_Upscale.sourceOrigin + g_Upscale.sourceSize - 0.5 * g_Upscale.sourceTexelSize;
+    return t_Source.SampleLevel(s_Linear, clamp(uv, uvMin, uvMax), 0).rgb;
+}
+
+// Bilinear upscale followed by a sharpening filter on the cross of neighbouring source texels, in the manner of
+// contrast adaptive sharpening: the negative lobe shrinks where the neighbourhood is close to black or white, so
+// that edges do not ring. Channels above 1 are left unsharpened.
+void main(
+    in float4 i_position : SV_Position,
+    in float2 i_uv : UV,
+    out float4 o_color : SV_Target0)
+{
+    float2 uv = g_Upscale.sourceOrigin + i_uv * g_Upscale.sourceSize;
+    float3 center = SampleSource(uv);
+
+    if (g_Upscale.sharpness <= 0)
+    {
+        o_color = float4(center, 1);
+        return;
+    }
+
+    float2 texel = g_Upscale.sourceTexelSize;
+    float3 north = SampleSource(uv + float2(0, -texel.y));
+    float3 south = SampleSource(uv + float2(0, texel.y));
+    float3 west = SampleSource(uv + float2(-texel.x, 0));
+    float3 east = SampleSource(uv + float2(texel.x, 0));
+
+    float3 minColor = min(center, min(min(north, south), min(west, east)));
+    float3 maxColor = max(center, max(max(north, south), max(west, east)));
+
+    float3 amount = sqrt(saturate(min(minColor, 1.0 - maxColor) / max(maxColor, 1e-4)));
+    // A lobe of -1/5 is the strongest that keeps the weights of the five taps positive in sum.
+    float3 weight = -amount * (0.2 * saturate(g_Upscale.sharpness));
+
+    float3 color = (center + weight * (north + south + west + east)) / (1.0 + 4.0 * weight);
+    o_color = float4(clamp(color, minColor, maxColor), 1);
+}
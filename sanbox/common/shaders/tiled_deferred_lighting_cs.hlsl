@@ -0,0 +1,200 @@
+#pragma pack_matrix(row_major)
+
+#include <donut/shaders/lighting.hlsli>
+#include <donut/shaders/shadows.hlsli>
+
+#include "gbuffer_packing.hlsli"
+#include "tiled_lighting_cb.h"
+
+// Deferred lighting in screen tiles. Each group finds the depth range of its tile, culls the light bounds
+// against the tile's frustum into a shared list, and then shades its pixels with only the listed lights.
+// COMPACT_GBUFFER reads the compact layout of gbuffer_packing.hlsli.
+
+cbuffer c_TiledLighting : register(b0) {
+    TiledLightingConstants g_Tiled;
+};
+
+Texture2D<float> t_GBufferDepth : register(t0);
+Texture2D t_GBuffer0 : register(t1);
+Texture2D t_GBuffer1 : register(t2);
+Texture2D t_GBuffer2 : register(t3);
+Texture2D t_GBuffer3 : register(t4);
+StructuredBuffer<LightConstants> t_Lights : register(t5);
+// View-space center and range of each light; a range of zero or less reaches every tile.
+StructuredBuffer<float4> t_LightBounds : register(t6);
+Texture2DArray t_ShadowMapArray : register(t7);
+SamplerComparisonState s_ShadowSampler : register(s0);
+
+RWTexture2D<float4> u_Output : register(u0);
+
+groupshared uint s_MinDepth;
+groupshared uint s_MaxDepth;
+groupshared uint s_LightCount;
+groupshared uint s_LightIndices[TILED_LIGHTING_MAX_LIGHTS_PER_TILE];
+
+float3 GetViewIncident(float4 cameraDirectionOrPosition, float3 surfacePos)
+{
+    if (cameraDirectionOrPosition.w > 0)
+        return normalize(surfacePos - cameraDirectionOrPosition.xyz);
+    return cameraDirectionOrPosition.xyz;
+}
+
+// Blends the cascades from the finest that covers the point, as donut's deferred lighting does; points that
+// no cascade covers take the light's out-of-bounds value.
+float EvaluateLightShadow(LightConstants light, float3 surfaceWorldPos)
+{
+    float2 shadow = 0;
+    for (int cascade = 0; cascade < 4; cascade++)
+    {
+        if (light.shadowCascades[cascade] < 0)
+            break;
+
+        float2 cascadeShadow = EvaluateShadowPCF(t_ShadowMapArray, s_ShadowSampler, g_Tiled.shadows[light.shadowCascades[cascade]],
+            surfaceWorldPos, g_Tiled.shadowMapTextureSize);
+        shadow = saturate(shadow + cascadeShadow * (1.0001 - shadow.y));
+
+        if (shadow.y == 1)
+            break;
+    }
+
+    return shadow.x + (1 - shadow.y) * light.outOfBoundsShadow;
+}
+
+float2 PixelToClip(float2 pixelPosition)
+{
+    float2 uv = (pixelPosition - g_Tiled.viewportOrigin) * g_Tiled.viewportSizeInv;
+    return float2(uv.x * 2.0 - 1.0, 1.0 - uv.y * 2.0);
+}
+
+// Point on the near plane of the view that projects to the clip-space position.
+float3 ClipToViewOnNearPlane(float2 clipPosition)
+{
+    float4 viewPosition = mul(float4(clipPosition, g_Tiled.reverseDepth != 0 ? 1.0 : 0.0, 1.0), g_Tiled.clipToView);
+    return viewPosition.xyz / viewPosition.w;
+}
+
+// Plane through the view origin and two tile corners, facing the inside of the tile.
+float3 GetTilePlane(float3 corner0, float3 corner1, float3 inside)
+{
+    float3 normal = normalize(cross(corner0, corner1));
+    return dot(normal, inside) < 0 ? -normal : normal;
+}
+
+[numthreads(TILED_LIGHTING_TILE_SIZE, TILED_LIGHTING_TILE_SIZE, 1)]
+void main_cs(uint2 groupId : SV_GroupID, uint2 threadId : SV_GroupThreadID, uint threadIndex : SV_GroupIndex)
+{
+    uint2 pixelPosition = uint2(g_Tiled.viewportOrigin) + groupId * TILED_LIGHTING_TILE_SIZE + threadId;
+    bool insideViewport = all(groupId * TILED_LIGHTING_TILE_SIZE + threadId < g_Tiled.viewportSize);
+
+    if (threadIndex == 0)
+    {
+        s_MinDepth = 0x7f7fffff;
+        s_MaxDepth = 0;
+        s_LightCount = 0;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    float deviceDepth = insideViewport ? t_GBufferDepth[pixelPosition] : 0;
+    bool background = !insideViewport || deviceDepth == (g_Tiled.reverseDepth != 0 ? 0.0 : 1.0);
+
+    float2 clipPosition = PixelToClip(float2(pixelPosition) + 0.5);
+    if (!background)
+    {
+        float4 viewPosition = mul(float4(clipPosition, deviceDepth, 1.0), g_Tiled.clipToView);
+        // View depth is positive, so its bit pattern orders like the float.
+        uint viewDepth = asuint(max(viewPosition.z / viewPosition.w, 0.0));
+        InterlockedMin(s_MinDepth, viewDepth);
+        InterlockedMax(s_MaxDepth, viewDepth);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    float minDepth = asfloat(s_MinDepth);
+    float maxDepth = asfloat(s_MaxDepth);
+
+    if (minDepth <= maxDepth)
+    {
+        float2 tileMin = float2(groupId * TILED_LIGHTING_TILE_SIZE) + g_Tiled.viewportOrigin;
+        float2 clipTopLeft = PixelToClip(tileMin);
+        float2 clipBottomRight = PixelToClip(tileMin + TILED_LIGHTING_TILE_SIZE);
+
+        float3 topLeft = ClipToViewOnNearPlane(clipTopLeft);
+        float3 topRight = ClipToViewOnNearPlane(float2(clipBottomRight.x, clipTopLeft.y));
+        float3 bottomLeft = ClipToViewOnNearPlane(float2(clipTopLeft.x, clipBottomRight.y));
+        float3 bottomRight = ClipToViewOnNearPlane(clipBottomRight);
+        float3 center = topLeft + bottomRight;
+
+        float3 planes[4];
+        planes[0] = GetTilePlane(topLeft, bottomLeft, center);
+        planes[1] = GetTilePlane(topRight, bottomRight, center);
+        planes[2] = GetTilePlane(topLeft, topRight, center);
+        planes[3] = GetTilePlane(bottomLeft, bottomRight, center);
+
+        for (uint lightIndex = threadIndex; lightIndex < g_Tiled.lightCount; lightIndex += TILED_LIGHTING_TILE_SIZE * TILED_LIGHTING_TILE_SIZE)
+        {
+            float4 bounds = t_LightBounds[lightIndex];
+            bool visible = true;
+
+            if (bounds.w > 0)
+            {
+                visible = bounds.z + bounds.w >= minDepth && bounds.z - bounds.w <= maxDepth;
+
+                [unroll]
+                for (uint plane = 0; plane < 4; plane++)
+                    visible = visible && dot(planes[plane], bounds.xyz) >= -bounds.w;
+            }
+
+            if (visible)
+            {
+                uint slot;
+                InterlockedAdd(s_LightCount, 1, slot);
+                if (slot < TILED_LIGHTING_MAX_LIGHTS_PER_TILE)
+                    s_LightIndices[slot] = lightIndex;
+            }
+        }
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    if (!insideViewport)
+        return;
+
+    if (background)
+    {
+        u_Output[pixelPosition] = 0;
+        return;
+    }
+
+    float4 gbufferChannels[4];
+    gbufferChannels[0] = t_GBuffer0[pixelPosition];
+    gbufferChannels[1] = t_GBuffer1[pixelPosition];
+    gbufferChannels[2] = t_GBuffer2[pixelPosition];
+    gbufferChannels[3] = t_GBuffer3[pixelPosition];
+    MaterialSample surfaceMaterial = DecodeSurfaceFromGBuffer(gbufferChannels);
+
+    float4 worldPosition = mul(float4(clipPosition, deviceDepth, 1.0), g_Tiled.clipToWorld);
+    float3 surfaceWorldPos = worldPosition.xyz / worldPosition.w;
+    float3 viewIncident = GetViewIncident(g_Tiled.cameraDirectionOrPosition, surfaceWorldPos);
+
+    float3 diffuseTerm = 0;
+    float3 specularTerm = 0;
+
+    uint tileLightCount = min(s_LightCount, TILED_LIGHTING_MAX_LIGHTS_PER_TILE);
+
+    [loop]
+    for (uint index = 0; index < tileLightCount; index++)
+    {
+        LightConstants light = t_Lights[s_LightIndices[index]];
+
+        float3 diffuseRadiance, specularRadiance;
+        ShadeSurface(light, surfaceMaterial, surfaceWorldPos, viewIncident, diffuseRadiance, specularRadiance);
+
+        float shadow = light.shadowCascades[0] >= 0 ? EvaluateLightShadow(light, surfaceWorldPos) : 1;
+        diffuseTerm += diffuseRadiance * light.color * shadow;
+        specularTerm += specularRadiance * light.color * shadow;
+    }
+
+    float3 ambientColor = lerp(g_Tiled.ambientColorBottom.rgb, g_Tiled.ambientColorTop.rgb, surfaceMaterial.shadingNormal.y * 0.5 + 0.5);
+    diffuseTerm += ambientColor * surfaceMaterial.diffuseAlbedo * surfaceMaterial.occlusion;
+    specularTerm += ambientColor * surfaceMaterial.specularF0 * surfaceMaterial.occlusion;
+
+    u_Output[pixelPosition] = float4(diffuseTerm + specularTerm + surfaceMaterial.emissiveColor, 0);
+}
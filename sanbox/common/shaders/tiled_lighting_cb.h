@@ -0,0 +1,27 @@
+#ifndef TILED_LIGHTING_CB_H
+#define TILED_LIGHTING_CB_H
+
+// One thread group shades one TILED_LIGHTING_TILE_SIZE x TILED_LIGHTING_TILE_SIZE tile of the view.
+#define TILED_LIGHTING_TILE_SIZE 16
+// Lights beyond this many in one tile are dropped from it.
+#define TILED_LIGHTING_MAX_LIGHTS_PER_TILE 1024
+// Shadow map cascades of all lights together; lights past the limit are unshadowed.
+#define TILED_LIGHTING_MAX_SHADOWS 16
+
+struct TiledLightingConstants {
+    float4x4 clipToWorld;
+    float4x4 clipToView;
+    float4 cameraDirectionOrPosition;
+    float4 ambientColorTop;
+    float4 ambientColorBottom;
+    float2 viewportOrigin;
+    float2 viewportSizeInv;
+    uint2 viewportSize;
+    uint reverseDepth;
+    uint lightCount;
+    float2 shadowMapTextureSize;
+    float2 padding;
+    ShadowConstants shadows[TILED_LIGHTING_MAX_SHADOWS];
+};
+
+#endif // TILED_LIGHTING_CB_H
@@ -0,0 +1,178 @@
+#include <donut/app/Camera.h>
+#include <donut/core/log.h>
+#include <donut/core/math/math.h>
+#include <donut/engine/View.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include "FrustumCuller.h"
+
+using namespace donut;
+using namespace donut::math;
+
+namespace {
+
+struct CullingResult {
+    uint32_t instanceCount = 0;
+    double buildMs = 0.0;
+    double refitMs = 0.0;
+    double bvhCullMs = 0.0;
+    double bruteForceCullMs = 0.0;
+    double visibleFraction = 0.0;
+    double nodesVisited = 0.0;
+    double blocksTested = 0.0;
+};
+
+template <typename Function>
+double MeasureMs(Function&& function) {
+    auto start = std::chrono::high_resolution_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+double Median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Instances of 0.5 to 4 units scattered through a cube that grows with the count, so the density
+// and with it the visible fraction stay roughly constant across sizes.
+std::vector<box3> GenerateInstances(uint32_t count, std::mt19937& rng) {
+    const float worldExtent = 20.f * std::cbrt(float(count));
+    std::uniform_real_distribution<float> position(-worldExtent, worldExtent);
+    std::uniform_real_distribution<float> size(0.25f, 2.f);
+
+    std::vector<box3> bounds(count);
+    for (box3& box : bounds) {
+        float3 center(position(rng), position(rng), position(rng));
+        float3 halfSize(size(rng), size(rng), size(rng));
+        box = box3(center - halfSize, center + halfSize);
+    }
+    return bounds;
+}
+
+CullingResult RunCase(uint32_t instanceCount, uint32_t iterations, std::mt19937& rng) {
+    CullingResult result;
+    result.instanceCount = instanceCount;
+
+    std::vector<box3> bounds = GenerateInstances(instanceCount, rng);
+
+    sanbox::FrustumCuller culler;
+    result.buildMs = MeasureMs([&] { culler.Build(bounds); });
+
+    app::FirstPersonCamera camera;
+    engine::PlanarView view;
+    view.SetViewport(nvrhi::Viewport(1920.f, 1080.f));
+
+    std::uniform_int_distribution<uint32_t> pickInstance(0, instanceCount - 1);
+    std::uniform_real_distribution<float> jitter(-1.f, 1.f);
+
+    std::vector<uint32_t> visible;
+    visible.reserve(instanceCount);
+
+    std::vector<double> refitTimes, bvhTimes, bruteForceTimes;
+    double visibleSum = 0.0, nodesSum = 0.0, blocksSum = 0.0;
+
+    for (uint32_t iteration = 0; iteration < iterations; iteration++) {
+        float angle = 2.f * dm::PI_f * float(iteration) / float(iterations);
+        camera.LookAt(float3(0.f), float3(std::cos(angle), 0.1f, std::sin(angle)));
+        view.SetMatrices(camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f / 3.f, 1920.f / 1080.f, 0.1f));
+        view.UpdateCache();
+        const frustum& viewFrustum = view.GetViewFrustum();
+
+        // Move 1% of the instances to exercise the incremental refit.
+        refitTimes.push_back(MeasureMs([&] {
+            for (uint32_t i = 0; i < std::max(instanceCount / 100, 1u); i++) {
+                uint32_t instance = pickInstance(rng);
+                float3 offset(jitter(rng), jitter(rng), jitter(rng));
+                bounds[instance] = box3(bounds[instance].m_mins + offset, bounds[instance].m_maxs + offset);
+                culler.UpdateBounds(instance, bounds[instance]);
+            }
+            culler.Refit();
+        }));
+
+        visible.clear();
+        bvhTimes.push_back(MeasureMs([&] { culler.Cull(viewFrustum, visible); }));
+
+        size_t bruteForceVisible = 0;
+        bruteForceTimes.push_back(MeasureMs([&] {
+            for (const box3& box : bounds) {
+                bruteForceVisible += viewFrustum.intersectsWith(box) ? 1 : 0;
+            }
+        }));
+
+        if (bruteForceVisible != visible.size()) {
+            log::warning("%u instances: BVH culling found %u visible, brute force %u", instanceCount, uint32_t(visible.size()),
+                uint32_t(bruteForceVisible));
+        }
+
+        const sanbox::FrustumCullStatistics& stats = culler.GetStatistics();
+        visibleSum += double(stats.visibleInstances) / double(stats.totalInstances);
+        nodesSum += stats.nodesVisited;
+        blocksSum += stats.blocksTested;
+    }
+
+    result.refitMs = Median(refitTimes);
+    result.bvhCullMs = Median(bvhTimes);
+    result.bruteForceCullMs = Median(bruteForceTimes);
+    result.visibleFraction = visibleSum / iterations;
+    result.nodesVisited = nodesSum / iterations;
+    result.blocksTested = blocksSum / iterations;
+    return result;
+}
+
+} // namespace
+
+// Measures FrustumCuller against a per-instance dm::frustum test for 1k to 1M instances.
+// Options: --iterations N --max-instances N --csv FILE
+int main(int argc, const char** argv) {
+    uint32_t iterations = 64;
+    uint32_t maxInstances = 1000000;
+    const char* csvFileName = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = uint32_t(std::max(1, atoi(argv[++i])));
+        } else if (!strcmp(argv[i], "--max-instances") && i + 1 < argc) {
+            maxInstances = uint32_t(std::max(1, atoi(argv[++i])));
+        } else if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csvFileName = argv[++i];
+        }
+    }
+
+    log::info("Culling kernel: %s, %u iterations per case", sanbox::FrustumCuller::GetKernelName(), iterations);
+
+    std::mt19937 rng(1234);
+    std::vector<CullingResult> results;
+    for (uint32_t instanceCount = 1000; instanceCount <= maxInstances; instanceCount *= 10) {
+        results.push_back(RunCase(instanceCount, iterations, rng));
+
+        const CullingResult& r = results.back();
+        log::info("%8u instances: build %8.3f ms, refit %7.3f ms, BVH cull %7.3f ms, brute force %8.3f ms (%.1fx), "
+                  "%.1f%% visible, %.0f nodes, %.0f blocks",
+            r.instanceCount, r.buildMs, r.refitMs, r.bvhCullMs, r.bruteForceCullMs, r.bruteForceCullMs / std::max(r.bvhCullMs, 1e-6),
+            r.visibleFraction * 100.0, r.nodesVisited, r.blocksTested);
+    }
+
+    if (csvFileName) {
+        std::ofstream file(csvFileName);
+        if (!file.is_open()) {
+            log::error("Cannot write '%s'", csvFileName);
+            return 1;
+        }
+
+        file << "instances,buildMs,refitMs,bvhCullMs,bruteForceCullMs,visibleFraction,nodesVisited,blocksTested\n";
+        for (const CullingResult& r : results) {
+            file << r.instanceCount << ',' << r.buildMs << ',' << r.refitMs << ',' << r.bvhCullMs << ',' << r.bruteForceCullMs << ','
+                 << r.visibleFraction << ',' << r.nodesVisited << ',' << r.blocksTested << '\n';
+        }
+    }
+
+    return 0;
+}
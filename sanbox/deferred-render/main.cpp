@@ -14,7 +14,41 @@
 #include <donut/engine/TextureCache.h>
 #include <donut/engine/View.h>
 
+#include <donut/core/log.h>
 #include <donut/core/math/vector.h>
+#include <donut/shaders/light_types.h>
+
+#include <nvrhi/utils.h>
+
+#include "Benchmark.h"
+#include "BindlessMaterialTable.h"
+#include "CachedScene.h"
+#include "CachedShadowMap.h"
+#include "CulledDrawStrategy.h"
+#include "DrawSubmission.h"
+#include "DynamicResolution.h"
+#include "FramePipeline.h"
+#include "GBufferLayout.h"
+#include "GpuDrivenRenderer.h"
+#include "HiZPyramid.h"
+#include "JobSystem.h"
+#include "MeshLods.h"
+#include "MeshOptimizer.h"
+#include "ParallelDrawRecorder.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "ProgressiveSceneLoader.h"
+#include "QuantizedGBufferFillPass.h"
+#include "RenderGraph.h"
+#include "SceneApplication.h"
+#include "SharpenUpscalePass.h"
+#include "SimulationThread.h"
+#include "StressScene.h"
+#include "TextureStreamer.h"
+#include "TransformHierarchy.h"
+#include "TiledDeferredLightingPass.h"
+#include "VertexQuantizer.h"
 
 using namespace donut::render;
 using namespace donut::math;
@@ -23,107 +57,424 @@ using namespace donut;
 #define _STRINGIFY(s) #s
 #define STRINGIFY(s)  _STRINGIFY(s)
 
+// The G-buffer, the lit image and, with occlusion culling, the Hi-Z pyramid as render graph textures in the
+// formats of the layout, with the passes of a frame that use them. The pyramid is dead by the time the lit
+// image is written, so the two share memory.
 class RenderTargets : public GBufferRenderTargets {
 public:
-    nvrhi::TextureHandle shadedColor;
+    struct Passes {
+        sanbox::RenderGraph::PassId clear = sanbox::RenderGraph::c_Invalid;
+        sanbox::RenderGraph::PassId gbuffer = sanbox::RenderGraph::c_Invalid;
+        sanbox::RenderGraph::PassId hiZ = sanbox::RenderGraph::c_Invalid;
+        sanbox::RenderGraph::PassId occlusionLate = sanbox::RenderGraph::c_Invalid;
+        sanbox::RenderGraph::PassId lighting = sanbox::RenderGraph::c_Invalid;
+        sanbox::RenderGraph::PassId blit = sanbox::RenderGraph::c_Invalid;
+    };
 
-    void Init(nvrhi::IDevice* device, dm::uint2 size, dm::uint sampleCount, bool enableMotionVectors, bool useReverseProjection) override {
-        GBufferRenderTargets::Init(device, size, sampleCount, enableMotionVectors, useReverseProjection);
+    nvrhi::TextureHandle shadedColor;
+    nvrhi::TextureHandle hiZPyramid;
+    Passes passes;
 
+    void Create(nvrhi::IDevice* device, sanbox::RenderGraph& graph, dm::uint2 size, const sanbox::GBufferLayout& layout, bool occlusionCulling) {
         nvrhi::TextureDesc textureDesc;
         textureDesc.dimension = nvrhi::TextureDimension::Texture2D;
-        textureDesc.initialState = nvrhi::ResourceStates::UnorderedAccess;
-        textureDesc.keepInitialState = true;
-        textureDesc.debugName = "ShadedColor";
-        textureDesc.isUAV = true;
-        textureDesc.format = nvrhi::Format::RGBA16_FLOAT;
         textureDesc.width = size.x;
         textureDesc.height = size.y;
-        textureDesc.sampleCount = sampleCount;
-        shadedColor = device->createTexture(textureDesc);
+        textureDesc.isRenderTarget = true;
+        textureDesc.setClearValue(nvrhi::Color(0.f));
+
+        graph.Reset();
+        // The compact channels keep donut's names for the slots they take, though not what is in them.
+        const auto depth = graph.CreateTexture(textureDesc.setFormat(layout.depth).setDebugName("GBufferDepth"));
+        const auto diffuse = graph.CreateTexture(textureDesc.setFormat(layout.channels[0]).setDebugName("GBufferDiffuse"));
+        const auto specular = graph.CreateTexture(textureDesc.setFormat(layout.channels[1]).setDebugName("GBufferSpecular"));
+        const auto normals = graph.CreateTexture(textureDesc.setFormat(layout.channels[2]).setDebugName("GBufferNormals"));
+        const auto emissive = graph.CreateTexture(textureDesc.setFormat(layout.channels[3]).setDebugName("GBufferEmissive"));
+        const auto shaded = graph.CreateTexture(
+            textureDesc.setFormat(layout.shadedColor).setIsRenderTarget(false).setIsUAV(true).setDebugName("ShadedColor"));
+        const auto hiZ = occlusionCulling ? graph.CreateTexture(sanbox::HiZPyramid::GetTextureDesc(size)) : sanbox::RenderGraph::c_Invalid;
+
+        const auto writeGBuffer = [&](sanbox::RenderGraph::PassBuilder pass) {
+            return pass.Write(diffuse, nvrhi::ResourceStates::RenderTarget)
+                .Write(specular, nvrhi::ResourceStates::RenderTarget)
+                .Write(normals, nvrhi::ResourceStates::RenderTarget)
+                .Write(emissive, nvrhi::ResourceStates::RenderTarget)
+                .Write(depth, nvrhi::ResourceStates::DepthWrite)
+                .GetId();
+        };
+        passes = Passes();
+        passes.clear = writeGBuffer(graph.AddPass("Clear"));
+        passes.gbuffer = writeGBuffer(graph.AddPass("GBufferPass"));
+        if (occlusionCulling) {
+            passes.hiZ = graph.AddPass("HiZ").Read(depth).Write(hiZ, nvrhi::ResourceStates::UnorderedAccess).GetId();
+            passes.occlusionLate = writeGBuffer(graph.AddPass("OcclusionLate").Read(hiZ));
+        }
+        passes.lighting = graph.AddPass("DeferredLighting")
+                              .Read(diffuse)
+                              .Read(specular)
+                              .Read(normals)
+                              .Read(emissive)
+                              .Read(depth)
+                              .Write(shaded, nvrhi::ResourceStates::UnorderedAccess)
+                              .GetId();
+        passes.blit = graph.AddPass("Blit").Read(shaded).GetId();
+        graph.Compile();
+
+        Depth = graph.GetTexture(depth);
+        GBufferDiffuse = graph.GetTexture(diffuse);
+        GBufferSpecular = graph.GetTexture(specular);
+        GBufferNormals = graph.GetTexture(normals);
+        GBufferEmissive = graph.GetTexture(emissive);
+        shadedColor = graph.GetTexture(shaded);
+        hiZPyramid = occlusionCulling ? graph.GetTexture(hiZ) : nullptr;
+
+        GBufferFramebuffer = std::make_shared<engine::FramebufferFactory>(device);
+        GBufferFramebuffer->RenderTargets = {GBufferDiffuse, GBufferSpecular, GBufferNormals, GBufferEmissive};
+        GBufferFramebuffer->DepthTarget = Depth;
+
+        m_Size = size;
+        m_SampleCount = 1;
+        m_UseReverseProjection = true;
     }
 };
 
-class DeferredRendering : public app::ApplicationBase {
+class DeferredRendering : public sanbox::SceneApplication {
 private:
     std::shared_ptr<vfs::RootFileSystem> m_RootFS;
-    nvrhi::CommandListHandle m_CommandList;
 
-    std::unique_ptr<engine::Scene> m_Scene;
-    std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
+    float m_GridTime = 0.f;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
-
+    std::unique_ptr<sanbox::BindlessMaterialTable> m_MaterialTable;
+    // Set when the scene has materials that the table has not seen yet.
+    bool m_MaterialTableStale = false;
+    sanbox::DrawSubmissionStatistics m_DrawStatistics;
+    sanbox::BindingSetTracker m_BindingSets;
+    std::unique_ptr<sanbox::PipelineCache> m_PipelineCache;
+    bool m_PipelinesPrecreated = false;
+
+    sanbox::GBufferLayout m_GBufferLayout;
     std::shared_ptr<RenderTargets> m_RenderTargets;
-    std::unique_ptr<GBufferFillPass> m_GBufferFillPass;
+    std::unique_ptr<sanbox::RenderTargetHeapPool> m_RenderTargetHeaps;
+    std::unique_ptr<sanbox::RenderGraph> m_RenderGraph;
+    std::unique_ptr<sanbox::QuantizedGBufferFillPass> m_GBufferFillPass;
     std::unique_ptr<DeferredLightingPass> m_DeferredLightingPass;
+    std::unique_ptr<sanbox::TiledDeferredLightingPass> m_TiledLightingPass;
+    bool m_TiledLighting = false;
+    // With a target frame time, frames render into the top left of the targets and are upscaled to the window.
+    std::unique_ptr<sanbox::DynamicResolution> m_DynamicResolution;
+    std::unique_ptr<sanbox::SharpenUpscalePass> m_UpscalePass;
 
-    std::shared_ptr<InstancedOpaqueDrawStrategy> m_OpaqueDrawStrategy;
+    std::shared_ptr<IDrawStrategy> m_OpaqueDrawStrategy;
 
     app::FirstPersonCamera m_Camera;
     engine::PlanarView m_View;
+    // When Animate last moved the camera, as the input time of the frame without decoupled updates.
+    std::chrono::high_resolution_clock::time_point m_InputTime;
+
+    std::unique_ptr<sanbox::FrameTimer> m_FrameTimer;
+    std::unique_ptr<sanbox::CameraPathRecorder> m_CameraPathRecorder;
+
+    std::unique_ptr<sanbox::ParallelDrawRecorder> m_DrawRecorder;
+    std::unique_ptr<sanbox::HiZPyramid> m_HiZPyramid;
+
+    // Last, so that the thread stops before the state it simulates goes away.
+    std::unique_ptr<sanbox::SimulationThread> m_SimulationThread;
+    // What the current frame draws; the simulation thread does not touch it until the next one is taken.
+    const sanbox::SimulationSnapshot* m_Snapshot = nullptr;
 
 public:
-    using ApplicationBase::ApplicationBase;
+    DeferredRendering(app::DeviceManager* deviceManager, const sanbox::BenchmarkParameters& benchmarkParams)
+        : SceneApplication(deviceManager, benchmarkParams) {
+    }
 
     bool Init() {
         std::filesystem::path sceneFileName
             = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Assets/Models/Sponza/glTF/Sponza.gltf";
         std::filesystem::path frameworkShaderPath
             = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+        std::filesystem::path sanboxShaderPath
+            = app::GetDirectoryWithExecutable() / "shaders/sanbox-common" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
 
         m_RootFS = std::make_shared<vfs::RootFileSystem>();
         m_RootFS->mount("/shaders/donut", frameworkShaderPath);
+        m_RootFS->mount("/shaders/sanbox", sanboxShaderPath);
 
         m_ShaderFactory = std::make_shared<engine::ShaderFactory>(GetDevice(), m_RootFS, "/shaders");
         m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(GetDevice(), m_ShaderFactory);
         m_BindingCache = std::make_unique<engine::BindingCache>(GetDevice());
+        m_RenderTargetHeaps = std::make_unique<sanbox::RenderTargetHeapPool>(GetDevice());
+        m_RenderGraph = std::make_unique<sanbox::RenderGraph>(GetDevice(), *m_RenderTargetHeaps);
+        std::filesystem::path pipelineCacheFileName;
+        if (m_BenchmarkParams.pipelineCache) {
+            pipelineCacheFileName = app::GetDirectoryWithExecutable() / "pipeline-cache"
+                                  / (std::string(STRINGIFY(PROJECT_NAME)) + "-" + app::GetShaderTypeName(GetDevice()->getGraphicsAPI()) + ".bin");
+        }
+        m_PipelineCache = std::make_unique<sanbox::PipelineCache>(pipelineCacheFileName);
+        if (m_BenchmarkParams.bindlessMaterials) {
+            if (m_BenchmarkParams.gpuDriven) {
+                log::warning("Bindless materials only apply to the CPU draw paths");
+            } else {
+                m_MaterialTable = std::make_unique<sanbox::BindlessMaterialTable>(GetDevice(), m_CommonPasses->m_AnisotropicWrapSampler);
+            }
+        }
+
+        // Before the scene, which SceneReady hands to the simulation thread and the shadow map when it is
+        // loaded synchronously.
+        if (m_BenchmarkParams.decoupledUpdate) {
+            m_SimulationThread = std::make_unique<sanbox::SimulationThread>(m_BenchmarkParams.updateRate);
+        }
+        if (m_BenchmarkParams.shadows) {
+            if (m_BenchmarkParams.vertexQuantization) {
+                log::warning("Shadow maps are not drawn from quantized vertices");
+            } else {
+                m_ShadowMap = std::make_unique<sanbox::CachedShadowMap>(GetDevice(), m_CommonPasses, m_BenchmarkParams.shadowMapSize);
+                m_ShadowMap->Init(*m_ShaderFactory, sanbox::FramePipeline::c_MaxFramesInFlight);
+                m_ShadowMap->SetCachingEnabled(m_BenchmarkParams.shadowCache);
+            }
+        }
 
         auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
         m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), nativeFS, nullptr);
+        if (m_BenchmarkParams.textureStreaming) {
+            m_TextureStreamer = std::make_unique<sanbox::TextureStreamer>(GetDevice(), nativeFS, uint64_t(m_BenchmarkParams.textureBudgetMB) << 20);
+        }
 
-        SetAsynchronousLoadingEnabled(false);
-        BeginLoadingScene(nativeFS, sceneFileName);
-
-        m_Scene->FinishedLoading(GetFrameIndex());
+        if (m_BenchmarkParams.asyncLoading) {
+            m_SceneLoader = std::make_unique<sanbox::ProgressiveSceneLoader>(m_TextureCache, 0, m_BenchmarkParams.textureUploadBudgetMs);
+            m_SceneLoader->Start(CreateScene(nativeFS), sceneFileName);
+        } else {
+            SetAsynchronousLoadingEnabled(false);
+            BeginLoadingScene(nativeFS, sceneFileName);
+            if (!m_Scene) {
+                return false;
+            }
+            SceneReady();
+        }
 
         m_Camera.LookAt(dm::float3(0.f, 1.8f, 0.f), dm::float3(1.f, 1.8f, 0.f));
         m_Camera.SetMoveSpeed(3.f);
 
-        m_CommandList = GetDevice()->createCommandList();
+        m_FramePipeline = std::make_unique<sanbox::FramePipeline>(GetDevice(), m_BenchmarkParams.framesInFlight);
+        m_FrameTimer = std::make_unique<sanbox::FrameTimer>(GetDevice(), m_FramePipeline->GetFramesInFlight() + 2);
+        m_Profiler = std::make_unique<sanbox::Profiler>(GetDevice(), m_FramePipeline->GetFramesInFlight() + 2);
+        m_Profiler->SetTraceCaptureEnabled(!m_BenchmarkParams.traceOutput.empty());
+
+        if (!m_BenchmarkParams.recordCameraPath.empty()) {
+            m_CameraPathRecorder = std::make_unique<sanbox::CameraPathRecorder>(m_BenchmarkParams.recordCameraPath);
+        }
+
+        m_GBufferLayout = sanbox::GBufferLayout::Create(GetDevice(), m_BenchmarkParams.compactGBuffer);
 
         m_DeferredLightingPass = std::make_unique<DeferredLightingPass>(GetDevice(), m_CommonPasses);
         m_DeferredLightingPass->Init(m_ShaderFactory);
 
+        m_TiledLightingPass = std::make_unique<sanbox::TiledDeferredLightingPass>(GetDevice(), m_ShaderFactory, m_CommonPasses);
+        m_TiledLightingPass->SetCompactGBuffer(m_GBufferLayout.compact);
+        if (!m_TiledLightingPass->Init()) {
+            return false;
+        }
+        m_TiledLighting = m_BenchmarkParams.tiledLighting;
+        // donut's lighting pass decodes its own layout only.
+        if (m_GBufferLayout.compact && !m_TiledLighting) {
+            log::warning("The compact G-buffer is lit with tiled lighting");
+            m_TiledLighting = true;
+        }
+
+        if (m_BenchmarkParams.targetFrameMs > 0.f) {
+            sanbox::DynamicResolutionParameters resolutionParams;
+            resolutionParams.targetFrameMs = m_BenchmarkParams.targetFrameMs;
+            resolutionParams.minScale = m_BenchmarkParams.minRenderScale;
+            resolutionParams.maxScale = m_BenchmarkParams.maxRenderScale;
+            m_DynamicResolution = std::make_unique<sanbox::DynamicResolution>(resolutionParams);
+            m_UpscalePass = std::make_unique<sanbox::SharpenUpscalePass>(GetDevice(), m_ShaderFactory, m_CommonPasses);
+            if (!m_UpscalePass->Init()) {
+                return false;
+            }
+        }
+
+        uint32_t constantBufferVersionsPerFrame = sanbox::FramePipeline::c_ConstantBufferVersionsPerFrame;
+        if (m_BenchmarkParams.gpuDriven) {
+            m_GpuDrivenRenderer = std::make_unique<sanbox::GpuDrivenRenderer>(GetDevice(), m_ShaderFactory);
+            if (!m_GpuDrivenRenderer->Init()) {
+                return false;
+            }
+            if (m_BenchmarkParams.occlusionCulling) {
+                m_HiZPyramid = std::make_unique<sanbox::HiZPyramid>(GetDevice(), m_ShaderFactory);
+                if (!m_HiZPyramid->Init()) {
+                    return false;
+                }
+            }
+        } else if (m_BenchmarkParams.recordingThreads != 1) {
+            m_JobSystem = std::make_unique<sanbox::JobSystem>(m_BenchmarkParams.recordingThreads ? m_BenchmarkParams.recordingThreads - 1 : 0);
+            m_DrawRecorder = std::make_unique<sanbox::ParallelDrawRecorder>(GetDevice(), m_JobSystem.get(), m_FramePipeline->GetFramesInFlight());
+            constantBufferVersionsPerFrame += m_DrawRecorder->GetMaxCommandListsPerFrame();
+        }
+
         GBufferFillPass::CreateParameters GBufferParams;
-        m_GBufferFillPass = std::make_unique<GBufferFillPass>(GetDevice(), m_CommonPasses);
+        GBufferParams.numConstantBufferVersions = m_FramePipeline->GetFramesInFlight() * constantBufferVersionsPerFrame;
+        GBufferParams.useInputAssembler = m_BenchmarkParams.gpuDriven;
+        m_GBufferFillPass = std::make_unique<sanbox::QuantizedGBufferFillPass>(GetDevice(), m_CommonPasses);
+        m_GBufferFillPass->SetVertexQuantization(m_BenchmarkParams.vertexQuantization);
+        m_GBufferFillPass->SetBindlessMaterials(m_MaterialTable != nullptr);
+        m_GBufferFillPass->SetCompactLayout(m_GBufferLayout.compact);
+        m_GBufferFillPass->SetPipelineCache(m_PipelineCache.get());
         m_GBufferFillPass->Init(*m_ShaderFactory, GBufferParams);
+        if (m_VertexQuantizer) {
+            m_GBufferFillPass->SetQuantizedMeshBuffer(m_VertexQuantizer->GetMeshDataBuffer());
+        }
 
-        m_OpaqueDrawStrategy = std::make_shared<InstancedOpaqueDrawStrategy>();
+        if (m_BenchmarkParams.bvhCulling) {
+            m_CulledDrawStrategy = std::make_shared<sanbox::CulledDrawStrategy>();
+            m_OpaqueDrawStrategy = m_CulledDrawStrategy;
+            if (m_MeshLods) {
+                m_CulledDrawStrategy->SetLods(m_MeshLods.get(), m_BenchmarkParams.lodErrorPixels);
+            }
+            m_CulledDrawStrategy->SetTransformHierarchy(m_TransformHierarchy.get());
+            log::info("Frustum culling kernel: %s", sanbox::FrustumCuller::GetKernelName());
+        } else {
+            m_OpaqueDrawStrategy = std::make_shared<InstancedOpaqueDrawStrategy>();
+        }
 
         CreateRenderTargets();
 
         return true;
     }
 
+    // A resize places the new targets in the heap of the old ones.
     void CreateRenderTargets() {
         m_RenderTargets = std::make_shared<RenderTargets>();
         int w, h;
         GetDeviceManager()->GetWindowDimensions(w, h);
-        m_RenderTargets->Init(GetDevice(), {(uint)w, (uint)h}, 1, false, true);
+        m_RenderTargets->Create(GetDevice(), *m_RenderGraph, {(uint)w, (uint)h}, m_GBufferLayout, m_HiZPyramid != nullptr);
+
+        // Both layouts, to compare the one in use with the other.
+        sanbox::LogGBufferTraffic(sanbox::GBufferLayout::Create(GetDevice(), false), {(uint)w, (uint)h});
+        sanbox::LogGBufferTraffic(sanbox::GBufferLayout::Create(GetDevice(), true), {(uint)w, (uint)h});
+    }
+
+    void ScenePrepared() override {
+        m_MaterialTableStale = m_MaterialTable != nullptr;
+        // With synchronous loading the pass does not exist yet; Init hands it the buffer then.
+        if (m_VertexQuantizer && m_GBufferFillPass) {
+            m_GBufferFillPass->SetQuantizedMeshBuffer(m_VertexQuantizer->GetMeshDataBuffer());
+        }
     }
 
-    bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override {
-        std::unique_ptr<engine::Scene> scene = std::make_unique<engine::Scene>(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
+    void UpdateTextureStreaming(nvrhi::ICommandList* commandList) {
+        sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "TextureStreaming");
+        if (m_TextureStreamer->Update(commandList, m_View)) {
+            MaterialTexturesChanged(commandList);
+        }
+        const sanbox::TextureStreamingStatistics& stats = m_TextureStreamer->GetStatistics();
+        m_Profiler->SetCounter("textureResidentMB", double(stats.residentBytes) / double(1 << 20));
+        m_Profiler->SetCounter("textureRequestedMB", double(stats.requestedBytes) / double(1 << 20));
+        m_Profiler->SetCounter("textureUploadedMB", double(stats.uploadedBytes) / double(1 << 20));
+        m_Profiler->SetCounter("textureEvictedMB", double(stats.evictedBytes) / double(1 << 20));
+        m_Profiler->SetCounter("texturePendingRequests", stats.pendingRequests);
+        m_Profiler->SetCounter("textureDeniedRequests", stats.deniedRequests);
+        m_Profiler->SetCounter("textureBudgetPressure", stats.GetBudgetPressure());
+    }
 
-        if (scene->Load(sceneFileName)) {
-            m_Scene = std::move(scene);
-            return true;
+    // Moves the grid and brings the instance buffer and the culling bounds along, each step in a scope of
+    // its own so that the transform backends can be compared apart from the draw.
+    void UpdateInstanceGrid(nvrhi::ICommandList* commandList) {
+        const bool animate = m_BenchmarkParams.animateGrid;
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), nullptr, "TransformUpdate");
+            if (m_SimulationTransforms) {
+                m_TransformHierarchy->ApplyInstances(m_Snapshot->instances);
+            } else if (m_TransformHierarchy) {
+                if (animate) {
+                    m_InstanceGrid->Animate(m_GridTime, *m_TransformHierarchy);
+                }
+                m_TransformHierarchy->Update(m_JobSystem.get());
+            } else {
+                if (animate) {
+                    m_InstanceGrid->Animate(m_GridTime);
+                }
+                m_Scene->RefreshSceneGraph(GetFrameIndex());
+            }
+        }
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "InstanceUpload");
+            if (m_TransformHierarchy) {
+                m_TransformHierarchy->UploadInstances(commandList, m_Scene->GetInstanceBuffer());
+            } else {
+                m_Scene->RefreshBuffers(commandList, GetFrameIndex());
+            }
+        }
+        if (m_CulledDrawStrategy) {
+            sanbox::ProfilerScope scope(m_Profiler.get(), nullptr, "BoundsRefit");
+            m_CulledDrawStrategy->SyncInstances(*m_Scene->GetSceneGraph());
+        }
+
+        m_Profiler->SetCounter("gridInstances", double(m_Scene->GetSceneGraph()->GetMeshInstances().size()));
+        if (m_TransformHierarchy) {
+            const sanbox::TransformUpdateStatistics& stats = m_TransformHierarchy->GetStatistics();
+            m_Profiler->SetCounter("transformUpdatedNodes", stats.updatedNodes);
+            m_Profiler->SetCounter("movedInstances", stats.movedInstances);
+            m_Profiler->SetCounter("instanceUploadKB", double(stats.uploadedBytes) / 1024.0);
+        }
+    }
+
+    // Material constants and binding sets refer to the texture objects, which loading and streaming replace.
+    // The bindless table only has its descriptors rewritten, and the pass's binding sets stay valid. The shadow
+    // depth pass always binds the textures of alpha-tested materials itself.
+    void MaterialTexturesChanged(nvrhi::ICommandList* commandList) override {
+        m_Scene->RefreshBuffers(commandList, GetFrameIndex());
+        if (m_TransformHierarchy) {
+            m_TransformHierarchy->InvalidateInstanceBuffer();
+        }
+        if (m_ShadowMap) {
+            m_ShadowMap->ResetBindingCache();
+        }
+        if (m_MaterialTable) {
+            UpdateMaterialTable(commandList);
+        } else {
+            ResetPassCaches();
+        }
+    }
+
+    void UpdateMaterialTable(nvrhi::ICommandList* commandList) {
+        m_MaterialTable->Update(commandList, *m_Scene->GetSceneGraph(), GetFrameIndex());
+        m_GBufferFillPass->SetMaterialTable(m_MaterialTable.get());
+        m_MaterialTableStale = false;
+    }
+
+    void ResetPassCaches() {
+        m_GBufferFillPass->ResetBindingCache();
+        if (m_DrawRecorder) {
+            m_DrawRecorder->ResetPassCaches();
+        }
+        m_BindingSets.Reset();
+    }
+
+    // Camera input runs on the simulation thread when that animates the camera.
+    void UpdateCamera(std::function<void()> update) {
+        if (m_SimulationThread) {
+            m_SimulationThread->Post(std::move(update));
+        } else {
+            update();
         }
-        return false;
     }
 
     bool KeyboardUpdate(int key, int scancode, int action, int mods) override {
-        m_Camera.KeyboardUpdate(key, scancode, action, mods);
+        UpdateCamera([this, key, scancode, action, mods] { m_Camera.KeyboardUpdate(key, scancode, action, mods); });
+
+        if (key == GLFW_KEY_L && action == GLFW_PRESS && m_MeshLods && m_CulledDrawStrategy) {
+            const bool enable = !m_CulledDrawStrategy->GetLods();
+            m_CulledDrawStrategy->SetLods(enable ? m_MeshLods.get() : nullptr, m_BenchmarkParams.lodErrorPixels);
+            log::info("Mesh LODs: %s", enable ? "on" : "off");
+        }
+
+        if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+            if (m_GBufferLayout.compact) {
+                log::info("Deferred lighting: tiled, the only lighting that reads the compact G-buffer");
+            } else {
+                m_TiledLighting = !m_TiledLighting;
+                log::info("Deferred lighting: %s", m_TiledLighting ? "tiled" : "all lights per pixel");
+            }
+        }
 
         return true;
     }
@@ -133,23 +484,246 @@ public:
     }
 
     bool MousePosUpdate(double xpos, double ypos) override {
-        m_Camera.MousePosUpdate(xpos, ypos);
+        UpdateCamera([this, xpos, ypos] { m_Camera.MousePosUpdate(xpos, ypos); });
         return true;
     }
 
     bool MouseButtonUpdate(int button, int action, int mods) override {
-        m_Camera.MouseButtonUpdate(button, action, mods);
+        UpdateCamera([this, button, action, mods] { m_Camera.MouseButtonUpdate(button, action, mods); });
         return true;
     }
 
     void Animate(float fElapsedTimeSeconds) override {
-        m_Camera.Animate(fElapsedTimeSeconds);
+        if (!m_SimulationThread) {
+            m_Camera.Animate(fElapsedTimeSeconds);
+            m_InputTime = std::chrono::high_resolution_clock::now();
+            if (m_CameraPathRecorder) {
+                m_CameraPathRecorder->Animate(fElapsedTimeSeconds, m_Camera);
+            }
+        }
+        if (m_InstanceGrid && m_BenchmarkParams.animateGrid) {
+            m_GridTime += fElapsedTimeSeconds;
+        }
+    }
+
+    // One update of the simulation thread: the camera, and the grid when the SoA hierarchy moves it.
+    void Simulate(float elapsedTimeSeconds, sanbox::SimulationSnapshot& snapshot) {
+        m_Camera.Animate(elapsedTimeSeconds);
+        if (m_CameraPathRecorder) {
+            m_CameraPathRecorder->Animate(elapsedTimeSeconds, m_Camera);
+        }
+        snapshot.cameraPosition = m_Camera.GetPosition();
+        snapshot.cameraDirection = m_Camera.GetDir();
+        snapshot.worldToView = m_Camera.GetWorldToViewMatrix();
+
+        if (m_SimulationTransforms) {
+            if (m_BenchmarkParams.animateGrid) {
+                m_InstanceGrid->Animate(float(snapshot.time), *m_SimulationTransforms);
+            }
+            // On this thread alone: the job system belongs to the render thread.
+            m_SimulationTransforms->Update(nullptr);
+            m_SimulationTransforms->CaptureInstances(snapshot.instances);
+        }
+    }
+
+    void SetCameraPose(const dm::float3& position, const dm::float3& target) override {
+        UpdateCamera([this, position, target] { m_Camera.LookAt(position, target); });
+    }
+
+    sanbox::FrameTimer* GetFrameTimer() override {
+        return m_FrameTimer.get();
+    }
+
+    void ReportMetrics(sanbox::BenchmarkRecorder& recorder) override {
+        m_Profiler->ResolveAll();
+        sanbox::ReportProfilerMetrics(*m_Profiler, recorder);
+
+        recorder.SetMetric("sceneLoadMs", m_SceneLoadStatistics.loadMs);
+        recorder.SetMetric("sceneLoadFromCache", m_SceneLoadStatistics.fromCache ? 1.0 : 0.0);
+        if (m_SceneLoader) {
+            const sanbox::SceneLoadingTimeline& timeline = m_SceneLoader->GetTimeline();
+            recorder.SetMetric("timeToFirstFrameMs", timeline.firstFrameMs);
+            recorder.SetMetric("timeToSceneMs", timeline.sceneMs);
+            recorder.SetMetric("timeToTexturesMs", timeline.texturesMs);
+        }
+        if (m_TextureStreamer) {
+            const sanbox::TextureStreamingStatistics& stats = m_TextureStreamer->GetStatistics();
+            recorder.SetMetric("textureBudgetMB", double(stats.budgetBytes) / double(1 << 20));
+            recorder.SetMetric("textureResidentMB", double(stats.residentBytes) / double(1 << 20));
+            recorder.SetMetric("textureRequestedMB", double(stats.requestedBytes) / double(1 << 20));
+            recorder.SetMetric("textureBudgetPressure", stats.GetBudgetPressure());
+            recorder.SetMetric("texturePendingRequests", stats.pendingRequests);
+        }
+        if (m_BenchmarkParams.meshOptimization || m_BenchmarkParams.vertexQuantization) {
+            recorder.SetMetric("meshAcmrBefore", m_MeshProcessing.acmrBefore);
+            recorder.SetMetric("meshAcmrAfter", m_MeshProcessing.acmrAfter);
+            recorder.SetMetric("meshVertexMBBefore", double(m_MeshProcessing.vertexBytesBefore) / double(1 << 20));
+            recorder.SetMetric("meshVertexMBAfter", double(m_MeshProcessing.vertexBytesAfter) / double(1 << 20));
+        }
+        if (m_MeshLods) {
+            const sanbox::MeshLodStatistics& stats = m_MeshLods->GetStatistics();
+            recorder.SetMetric("lodBuildMs", stats.buildMs);
+            recorder.SetMetric("lodFromCache", stats.fromCache ? 1.0 : 0.0);
+            recorder.SetMetric("lodLevels", stats.levels);
+            recorder.SetMetric("lodIndexMB", double(stats.lodTriangles * 3 * sizeof(uint32_t)) / double(1 << 20));
+        }
+        if (m_InstanceGrid) {
+            recorder.SetMetric("gridCells", m_InstanceGrid->GetCellCount());
+            recorder.SetMetric("gridInstances", double(m_Scene->GetSceneGraph()->GetMeshInstances().size()));
+        }
+        if (m_TransformHierarchy) {
+            const sanbox::TransformUpdateStatistics& stats = m_TransformHierarchy->GetStatistics();
+            recorder.SetMetric("transformNodes", stats.nodes);
+            recorder.SetMetric("transformLevels", stats.levels);
+        }
+        const sanbox::RenderGraphStatistics& graphStats = m_RenderGraph->GetStatistics();
+        recorder.SetMetric("renderTargetDedicatedMB", double(graphStats.dedicatedBytes) / double(1 << 20));
+        recorder.SetMetric("renderTargetPeakMB", double(graphStats.peakBytes) / double(1 << 20));
+        recorder.SetMetric("renderTargetHeapMB", double(graphStats.heapBytes) / double(1 << 20));
+        recorder.SetMetric("renderTargetHeapsCreated", m_RenderTargetHeaps->GetCreatedHeaps());
+        recorder.SetMetric("renderGraphCompiles", graphStats.compiles);
+        const sanbox::GBufferTraffic traffic = sanbox::EstimateGBufferTraffic(m_GBufferLayout, m_RenderTargets->GetSize());
+        recorder.SetMetric("compactGBuffer", m_GBufferLayout.compact ? 1.0 : 0.0);
+        recorder.SetMetric("gbufferBytesPerPixel", traffic.gbufferBytesPerPixel);
+        recorder.SetMetric("gbufferWriteMBPerFrame", double(traffic.bytesWritten) / double(1 << 20));
+        recorder.SetMetric("gbufferReadMBPerFrame", double(traffic.bytesRead) / double(1 << 20));
+        recorder.SetMetric("recordingThreads", m_DrawRecorder ? double(m_DrawRecorder->GetThreadCount()) : 1.0);
+        if (m_DrawRecorder) {
+            recorder.SetMetric("drawItems", double(m_DrawRecorder->GetDrawCount()));
+            recorder.SetMetric("recordingCommandLists", double(m_DrawRecorder->GetCommandLists().size()));
+        }
+        const sanbox::PipelineCacheStatistics pipelineStats = m_PipelineCache->GetStatistics();
+        recorder.SetMetric("pipelineCacheEntries", pipelineStats.loadedEntries);
+        recorder.SetMetric("pipelinesCreated", pipelineStats.created);
+        recorder.SetMetric("pipelinesPrecreated", pipelineStats.precreated);
+        recorder.SetMetric("pipelineShaderChanges", pipelineStats.changedShaders);
+        recorder.SetMetric("pipelineCreateMs", pipelineStats.createMs);
+        recorder.SetMetric("pipelinePrecreateMs", pipelineStats.precreateMs);
+        recorder.SetMetric("bindlessMaterials", m_MaterialTable ? 1.0 : 0.0);
+        if (m_MaterialTable) {
+            const sanbox::BindlessMaterialStatistics& stats = m_MaterialTable->GetStatistics();
+            recorder.SetMetric("bindlessMaterialCount", stats.materials);
+            recorder.SetMetric("bindlessTextures", stats.textures);
+        }
+        if (m_DynamicResolution) {
+            const sanbox::DynamicResolutionStatistics& stats = m_DynamicResolution->GetStatistics();
+            recorder.SetMetric("renderScaleMean", stats.meanScale);
+            recorder.SetMetric("renderScaleLowest", stats.lowestScale);
+            recorder.SetMetric("renderScaleChanges", stats.scaleChanges);
+            recorder.SetMetric("framesOverTarget", stats.framesOverTarget);
+        }
+        if (m_ShadowMap) {
+            const sanbox::ShadowStatistics& stats = m_ShadowMap->GetStatistics();
+            recorder.SetMetric("shadowMapSize", m_BenchmarkParams.shadowMapSize);
+            recorder.SetMetric("shadowCache", m_BenchmarkParams.shadowCache ? 1.0 : 0.0);
+            recorder.SetMetric("shadowStaticCasters", stats.staticCasters);
+            recorder.SetMetric("shadowDynamicCasters", stats.dynamicCasters);
+        }
+        recorder.SetMetric("decoupledUpdate", m_SimulationThread ? 1.0 : 0.0);
+        if (m_SimulationThread) {
+            const sanbox::SimulationStatistics stats = m_SimulationThread->GetStatistics();
+            recorder.SetMetric("updateRate", m_BenchmarkParams.updateRate);
+            recorder.SetMetric("simulationUpdates", double(stats.updates));
+            recorder.SetMetric("skippedSnapshots", double(stats.skippedSnapshots));
+            recorder.SetMetric("repeatedSnapshots", double(stats.repeatedSnapshots));
+        }
+    }
+
+    const sanbox::Profiler* GetProfiler() const {
+        return m_Profiler.get();
+    }
+
+    std::shared_ptr<engine::ShaderFactory> GetShaderFactory() const {
+        return m_ShaderFactory;
+    }
+
+    void WriteProfilerTrace(const std::filesystem::path& fileName) {
+        m_FramePipeline->WaitForIdle();
+        m_Profiler->ResolveAll();
+        m_Profiler->WriteChromeTrace(fileName);
     }
 
     void BackBufferResizing() override {
     }
 
+    // Draws the static casters of the cascades whose projection changed and the dynamic casters of all of
+    // them, in scopes of their own so that the cached part shows apart from the part drawn every frame.
+    void RenderShadows(nvrhi::ICommandList* commandList) {
+        sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "Shadows");
+        m_ShadowMap->Update(*m_Scene->GetSceneGraph(), *m_SunLight, m_View);
+        {
+            sanbox::ProfilerScope staticScope(m_Profiler.get(), commandList, "ShadowStatic");
+            m_ShadowMap->RenderStatic(commandList);
+        }
+        {
+            sanbox::ProfilerScope dynamicScope(m_Profiler.get(), commandList, "ShadowDynamic");
+            m_ShadowMap->RenderDynamic(commandList);
+        }
+
+        const sanbox::ShadowStatistics& stats = m_ShadowMap->GetStatistics();
+        m_Profiler->SetCounter("shadowStaticCascades", stats.staticCascadesRendered);
+        m_Profiler->SetCounter("shadowStaticDraws", stats.staticDraws);
+        m_Profiler->SetCounter("shadowDynamicDraws", stats.dynamicDraws);
+        m_Profiler->SetCounter("shadowCascadeCopies", stats.cascadeCopies);
+    }
+
+    // Leaves the "GBufferPass" scope open; it is closed on the post command list after the worker lists.
+    void RecordGBufferPassParallel(sanbox::FrameContext& frame) {
+        nvrhi::ICommandList* commandList = frame.commandList;
+        m_Profiler->BeginScope(commandList, "GBufferPass", false);
+        // The workers record on lists of their own, which find the targets in the states committed here.
+        m_RenderGraph->BeginPass(commandList, m_RenderTargets->passes.gbuffer);
+        m_RenderGraph->EndPass(commandList, m_RenderTargets->passes.gbuffer);
+
+        m_DrawRecorder->Gather(m_Scene->GetSceneGraph()->GetRootNode(), *m_OpaqueDrawStrategy, m_View);
+
+        using Context = sanbox::QuantizedGBufferFillPass::Context;
+        m_DrawRecorder->Record<Context>(uint32_t(frame.frameNumber), commandList, *m_GBufferFillPass, &m_View, &m_View,
+            m_RenderTargets->GBufferFramebuffer->GetFramebuffer(m_View), [](nvrhi::ICommandList*, Context&) {});
+    }
+
+    // Draws what was visible last frame, builds the Hi-Z pyramid from that depth, then draws whatever
+    // the pyramid shows to have become visible.
+    void RenderGBufferPassOcclusionCulled(nvrhi::ICommandList* commandList) {
+        sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "GBufferPass");
+
+        nvrhi::IFramebuffer* framebuffer = m_RenderTargets->GBufferFramebuffer->GetFramebuffer(m_View);
+        m_GpuDrivenRenderer->Update(commandList, *m_Scene->GetSceneGraph(), m_Scene->GetInstanceBuffer());
+
+        {
+            sanbox::ProfilerScope phaseScope(m_Profiler.get(), commandList, "OcclusionEarly");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.gbuffer);
+            m_GpuDrivenRenderer->Cull(commandList, m_View, sanbox::GpuDrivenRenderer::CullPhase::Early);
+
+            GBufferFillPass::Context context;
+            m_GpuDrivenRenderer->Render(commandList, &m_View, &m_View, framebuffer, *m_GBufferFillPass, context);
+        }
+
+        {
+            sanbox::ProfilerScope phaseScope(m_Profiler.get(), commandList, "HiZ");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.hiZ);
+            m_HiZPyramid->Build(commandList, m_RenderTargets->Depth, m_View.IsReverseDepth(), m_RenderTargets->hiZPyramid);
+        }
+
+        {
+            sanbox::ProfilerScope phaseScope(m_Profiler.get(), commandList, "OcclusionLate");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.occlusionLate);
+            m_GpuDrivenRenderer->Cull(commandList, m_View, sanbox::GpuDrivenRenderer::CullPhase::Late, m_HiZPyramid.get());
+
+            GBufferFillPass::Context context;
+            m_GpuDrivenRenderer->Render(commandList, &m_View, &m_View, framebuffer, *m_GBufferFillPass, context);
+        }
+    }
+
     void Render(nvrhi::IFramebuffer* framebuffer) override {
+        if (!TakeLoadedScene(framebuffer)) {
+            return;
+        }
+        if (m_SimulationThread && !m_SimulationThread->IsRunning()) {
+            m_SimulationThread->Start(
+                [this](float elapsedTimeSeconds, sanbox::SimulationSnapshot& snapshot) { Simulate(elapsedTimeSeconds, snapshot); });
+        }
+
         const nvrhi::FramebufferInfoEx& fbinfo = framebuffer->getFramebufferInfo();
 
         uint2 size = uint2(fbinfo.width, fbinfo.height);
@@ -157,39 +731,206 @@ public:
         if (!m_RenderTargets || any(m_RenderTargets->GetSize() != size)) {
             m_BindingCache->Clear();
             m_DeferredLightingPass->ResetBindingCache();
-
-            m_GBufferFillPass->ResetBindingCache();
+            m_TiledLightingPass->ResetBindingCache();
+            if (m_UpscalePass) {
+                m_UpscalePass->ResetBindingCache();
+            }
+            ResetPassCaches();
 
             CreateRenderTargets();
         }
 
+        m_Profiler->BeginFrame();
+
+        // The targets keep the window's size; the G-buffer and the lit image are rendered into the part of
+        // them that the view's viewport covers.
+        uint2 renderSize = size;
+        if (m_DynamicResolution) {
+            if (const uint64_t resolvedFrames = m_Profiler->GetResolvedFrameCount()) {
+                m_DynamicResolution->ReportGpuTime(resolvedFrames - 1, m_Profiler->GetGpuFrameHistory().back());
+            }
+            m_DynamicResolution->BeginFrame(m_Profiler->GetFrameNumber());
+            renderSize = m_DynamicResolution->GetRenderSize(size);
+        }
+
+        m_FrameTimer->BeginFenceWait();
+        sanbox::FrameContext& frame = m_FramePipeline->BeginFrame();
+        m_FrameTimer->EndFenceWait();
+
+        // Taken once the frame slot is free, so that the frame shows the newest update there is.
+        if (m_SimulationThread) {
+            m_Snapshot = m_SimulationThread->AcquireLatest();
+        }
         nvrhi::Viewport windowViewport(float(fbinfo.width), float(fbinfo.height));
-        m_View.SetViewport(windowViewport);
-        m_View.SetMatrices(
-            m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
+        m_View.SetViewport(nvrhi::Viewport(float(renderSize.x), float(renderSize.y)));
+        const affine3 worldToView = m_Snapshot ? m_Snapshot->worldToView : m_Camera.GetWorldToViewMatrix();
+        m_View.SetMatrices(worldToView, perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
         m_View.UpdateCache();
 
-        m_CommandList->open();
+        nvrhi::ICommandList* commandList = frame.commandList;
+        commandList->open();
+        m_FrameTimer->BeginFrame(commandList);
+        if (m_Snapshot) {
+            m_FrameTimer->SetInputTime(m_Snapshot->inputTime);
+            const auto snapshotAge = std::chrono::high_resolution_clock::now() - m_Snapshot->publishTime;
+            m_Profiler->SetCounter("snapshotAgeMs", std::chrono::duration<double, std::milli>(snapshotAge).count());
+        } else {
+            m_FrameTimer->SetInputTime(m_InputTime);
+        }
 
-        m_RenderTargets->Clear(m_CommandList);
+        if (m_SceneLoader && !m_SceneLoader->IsComplete()) {
+            UpdateSceneTextures(commandList);
+        }
+        if (m_TextureStreamer) {
+            UpdateTextureStreaming(commandList);
+        }
+        // The grid grew the instance buffer, which the binding sets refer to as well.
+        if (m_SceneBuffersStale) {
+            MaterialTexturesChanged(commandList);
+            ResetPassCaches();
+            m_SceneBuffersStale = false;
+        }
+        if (m_MaterialTableStale) {
+            UpdateMaterialTable(commandList);
+        }
+        // The formats stay when the window is resized, and so do the pipelines.
+        if (!m_PipelinesPrecreated) {
+            m_GBufferFillPass->PrecreatePipelines(m_RenderTargets->GBufferFramebuffer->GetFramebuffer(m_View));
+            m_PipelinesPrecreated = true;
+        }
+        if (m_InstanceGrid) {
+            UpdateInstanceGrid(commandList);
+        }
 
-        GBufferFillPass::Context context;
-        RenderCompositeView(m_CommandList, &m_View, &m_View, *m_RenderTargets->GBufferFramebuffer, m_Scene->GetSceneGraph()->GetRootNode(),
-            *(m_OpaqueDrawStrategy.get()), *m_GBufferFillPass, context, "GBufferPass", false);
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "Clear");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.clear);
+            m_RenderTargets->Clear(commandList);
+        }
 
-        DeferredLightingPass::Inputs deferredInputs;
-        deferredInputs.SetGBuffer(*m_RenderTargets);
-        deferredInputs.lights = &m_Scene->GetSceneGraph()->GetLights();
-        deferredInputs.ambientColorTop = 1.0f;
-        deferredInputs.ambientColorBottom = deferredInputs.ambientColorTop * float3(0.3f, 0.4f, 0.3f);
-        deferredInputs.output = m_RenderTargets->shadedColor;
+        if (m_ShadowMap) {
+            RenderShadows(commandList);
+        }
 
-        m_DeferredLightingPass->Render(m_CommandList, m_View, deferredInputs);
+        if (m_HiZPyramid) {
+            RenderGBufferPassOcclusionCulled(commandList);
+        } else if (m_GpuDrivenRenderer) {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "GBufferPass");
+            {
+                sanbox::ProfilerScope cullingScope(m_Profiler.get(), commandList, "GpuCulling");
+                m_GpuDrivenRenderer->Update(commandList, *m_Scene->GetSceneGraph(), m_Scene->GetInstanceBuffer());
+                m_GpuDrivenRenderer->Cull(commandList, m_View);
+            }
+
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.gbuffer);
+            GBufferFillPass::Context context;
+            m_GpuDrivenRenderer->Render(
+                commandList, &m_View, &m_View, m_RenderTargets->GBufferFramebuffer->GetFramebuffer(m_View), *m_GBufferFillPass, context);
+        } else if (m_DrawRecorder) {
+            RecordGBufferPassParallel(frame);
+            commandList->close();
+            commandList = frame.postCommandList;
+            commandList->open();
+            m_Profiler->EndScope(commandList);
+        } else {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "GBufferPass");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.gbuffer);
+            sanbox::QuantizedGBufferFillPass::Context context;
+            m_DrawStatistics = {};
+            m_OpaqueDrawStrategy->PrepareForView(m_Scene->GetSceneGraph()->GetRootNode(), m_View);
+            sanbox::RenderDrawItems(commandList, &m_View, &m_View, m_RenderTargets->GBufferFramebuffer->GetFramebuffer(m_View), *m_OpaqueDrawStrategy,
+                *m_GBufferFillPass, context, m_DrawStatistics, &m_BindingSets);
+        }
 
-        m_CommonPasses->BlitTexture(m_CommandList, framebuffer, m_RenderTargets->shadedColor, m_BindingCache.get());
-        m_CommandList->close();
+        {
+            // The two paths are timed under different scopes so that they can be compared in one trace.
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, m_TiledLighting ? "TiledDeferredLighting" : "DeferredLighting");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.lighting);
+
+            DeferredLightingPass::Inputs deferredInputs;
+            deferredInputs.SetGBuffer(*m_RenderTargets);
+            deferredInputs.lights = &m_Scene->GetSceneGraph()->GetLights();
+            deferredInputs.ambientColorTop = 1.0f;
+            deferredInputs.ambientColorBottom = deferredInputs.ambientColorTop * float3(0.3f, 0.4f, 0.3f);
+            deferredInputs.output = m_RenderTargets->shadedColor;
+
+            if (m_TiledLighting) {
+                m_TiledLightingPass->Render(commandList, m_View, deferredInputs);
+            } else {
+                m_DeferredLightingPass->Render(commandList, m_View, deferredInputs);
+            }
+        }
+
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "Blit");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_RenderTargets->passes.blit);
+            if (m_UpscalePass) {
+                m_UpscalePass->Render(
+                    commandList, framebuffer, m_RenderTargets->shadedColor, m_View.GetViewExtent(), m_BenchmarkParams.upscaleSharpness);
+            } else {
+                m_CommonPasses->BlitTexture(commandList, framebuffer, m_RenderTargets->shadedColor, m_BindingCache.get());
+            }
+        }
+
+        m_FrameTimer->EndFrame(commandList);
+        commandList->close();
+
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), nullptr, "Submit");
+            m_FrameTimer->BeginSubmit();
+            if (m_DrawRecorder) {
+                m_FramePipeline->Submit(frame, m_DrawRecorder->GetCommandLists());
+            } else {
+                m_FramePipeline->Submit(frame);
+            }
+            m_FrameTimer->EndSubmit();
+        }
+
+        if (m_SceneLoader) {
+            m_SceneLoader->FrameRendered();
+        }
+
+        if (m_GpuDrivenRenderer) {
+            m_Profiler->SetCounter("indirectDraws", m_GpuDrivenRenderer->GetDrawCount());
+            m_Profiler->SetCounter("indirectBatches", m_GpuDrivenRenderer->GetBatchCount());
+            if (m_HiZPyramid) {
+                // Counts are per geometry record and lag a few frames behind, see GpuDrivenRenderer::ReadBackStatistics.
+                const sanbox::GpuCullStatistics& cullStats = m_GpuDrivenRenderer->GetCullStatistics();
+                m_Profiler->SetCounter("visibleInstances", cullStats.visible);
+                m_Profiler->SetCounter("occludedInstances", cullStats.occluded);
+                m_Profiler->SetCounter("frustumCulledInstances", cullStats.frustumCulled);
+                m_Profiler->SetCounter("drawnEarly", cullStats.drawnEarly);
+                m_Profiler->SetCounter("drawnLate", cullStats.drawnLate);
+            }
+        } else if (m_CulledDrawStrategy) {
+            const sanbox::FrustumCullStatistics& cullStats = m_CulledDrawStrategy->GetStatistics();
+            m_Profiler->SetCounter("visibleInstances", cullStats.visibleInstances);
+            m_Profiler->SetCounter("totalInstances", cullStats.totalInstances);
+
+            const sanbox::LodSelectionStatistics& lodStats = m_CulledDrawStrategy->GetLodStatistics();
+            m_Profiler->SetCounter("drawnTriangles", double(lodStats.drawnTriangles));
+            m_Profiler->SetCounter("fullDetailTriangles", double(lodStats.fullDetailTriangles));
+            if (m_CulledDrawStrategy->GetLods()) {
+                m_Profiler->SetCounter("coarseLodInstances", lodStats.coarseInstances);
+                m_Profiler->SetCounter("lodSwitches", lodStats.lodSwitches);
+            }
+        }
 
-        GetDevice()->executeCommandList(m_CommandList);
+        if (!m_GpuDrivenRenderer) {
+            const sanbox::DrawSubmissionStatistics& drawStats = m_DrawRecorder ? m_DrawRecorder->GetStatistics() : m_DrawStatistics;
+            m_Profiler->SetCounter("draws", drawStats.draws);
+            m_Profiler->SetCounter("materialChanges", drawStats.materialChanges);
+            m_Profiler->SetCounter("graphicsStateCalls", drawStats.graphicsStateCalls);
+            m_Profiler->SetCounter("bindingSetCreations", drawStats.bindingSetCreations);
+        }
+
+        m_Profiler->SetCounter("lights", uint32_t(m_Scene->GetSceneGraph()->GetLights().size()));
+        m_Profiler->SetCounter("tiledLighting", m_TiledLighting ? 1 : 0);
+        if (m_DynamicResolution) {
+            m_Profiler->SetCounter("renderScale", m_DynamicResolution->GetScale());
+        }
+
+        m_Profiler->EndFrame();
     }
 };
 
@@ -205,11 +946,15 @@ int main(int __argc, const char** __argv)
         return 1;
     }
 
+    sanbox::BenchmarkParameters benchmarkParams = sanbox::ParseBenchmarkCommandLine(__argc, __argv);
+
     app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
     app::DeviceCreationParameters deviceParams;
-    deviceParams.backBufferWidth = 1024;
-    deviceParams.backBufferHeight = 1024;
+    deviceParams.backBufferWidth = benchmarkParams.width;
+    deviceParams.backBufferHeight = benchmarkParams.height;
+    deviceParams.maxFramesInFlight = benchmarkParams.framesInFlight;
+    deviceParams.adapterNameSubstring = std::wstring(benchmarkParams.adapterName.begin(), benchmarkParams.adapterName.end());
 #ifdef _DEBUG
     deviceParams.enableDebugRuntime = true;
     deviceParams.enableNvrhiValidationLayer = true;
@@ -217,17 +962,43 @@ int main(int __argc, const char** __argv)
 
     std::string windowTitle = STRINGIFY(PROJECT_NAME);
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str())) {
+    bool deviceCreated = benchmarkParams.headless ? deviceManager->CreateHeadlessDevice(deviceParams)
+                                                  : deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str());
+    if (!deviceCreated) {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
         return 1;
     }
 
+    int exitCode = 0;
     {
-        DeferredRendering example(deviceManager);
-        if (example.Init()) {
+        DeferredRendering example(deviceManager, benchmarkParams);
+        if (!example.Init()) {
+            exitCode = 1;
+        } else if (benchmarkParams.headless) {
+            exitCode = sanbox::RunHeadlessBenchmark(deviceManager, example, example, benchmarkParams, windowTitle.c_str());
+        } else {
+            std::unique_ptr<sanbox::ProfilerOverlay> overlay;
+            if (benchmarkParams.profilerOverlay) {
+                overlay = std::make_unique<sanbox::ProfilerOverlay>(deviceManager, example.GetProfiler());
+                overlay->Init(example.GetShaderFactory());
+            }
+
             deviceManager->AddRenderPassToBack(&example);
+            if (overlay) {
+                deviceManager->AddRenderPassToBack(overlay.get());
+            }
             deviceManager->RunMessageLoop();
+            if (overlay) {
+                deviceManager->RemoveRenderPass(overlay.get());
+            }
             deviceManager->RemoveRenderPass(&example);
+            if (example.HasLoadingFailed()) {
+                exitCode = 1;
+            }
+        }
+
+        if (exitCode == 0 && !benchmarkParams.traceOutput.empty()) {
+            example.WriteProfilerTrace(benchmarkParams.traceOutput);
         }
     }
 
@@ -235,5 +1006,5 @@ int main(int __argc, const char** __argv)
 
     delete deviceManager;
 
-    return 0;
+    return exitCode;
 }
\ No newline at end of file
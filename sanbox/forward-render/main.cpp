@@ -12,6 +12,36 @@
 #include <donut/engine/TextureCache.h>
 #include <donut/render/DrawStrategy.h>
 #include <donut/render/ForwardShadingPass.h>
+#include <donut/shaders/light_types.h>
+
+#include <nvrhi/utils.h>
+
+#include "Benchmark.h"
+#include "BindlessMaterialTable.h"
+#include "CachedScene.h"
+#include "CachedShadowMap.h"
+#include "ClusteredForwardShadingPass.h"
+#include "CulledDrawStrategy.h"
+#include "DrawSubmission.h"
+#include "DynamicResolution.h"
+#include "FramePipeline.h"
+#include "GpuDrivenRenderer.h"
+#include "JobSystem.h"
+#include "MeshLods.h"
+#include "MeshOptimizer.h"
+#include "ParallelDrawRecorder.h"
+#include "PipelineCache.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "ProgressiveSceneLoader.h"
+#include "RenderGraph.h"
+#include "SceneApplication.h"
+#include "SharpenUpscalePass.h"
+#include "SimulationThread.h"
+#include "StressScene.h"
+#include "TextureStreamer.h"
+#include "TransformHierarchy.h"
+#include "VertexQuantizer.h"
 
 using namespace donut;
 using namespace donut::math;
@@ -19,62 +49,188 @@ using namespace donut::math;
 #define _STRINGIFY(s) #s
 #define STRINGIFY(s)  _STRINGIFY(s)
 
-class ForwardRendering : public app::ApplicationBase {
+class ForwardRendering : public sanbox::SceneApplication {
 public:
     std::shared_ptr<vfs::RootFileSystem> m_RootFS;
-    nvrhi::CommandListHandle m_CommandList;
 
     nvrhi::TextureHandle m_DepthBuffer;
     nvrhi::TextureHandle m_ColorBuffer;
+    std::unique_ptr<sanbox::RenderTargetHeapPool> m_RenderTargetHeaps;
+    std::unique_ptr<sanbox::RenderGraph> m_RenderGraph;
+    sanbox::RenderGraph::PassId m_ClearPass = sanbox::RenderGraph::c_Invalid;
+    sanbox::RenderGraph::PassId m_ForwardPass = sanbox::RenderGraph::c_Invalid;
+    sanbox::RenderGraph::PassId m_BlitPass = sanbox::RenderGraph::c_Invalid;
     std::unique_ptr<engine::FramebufferFactory> m_Framebuffer;
-
-    std::unique_ptr<render::ForwardShadingPass> m_ForwardShadingPass;
-    std::shared_ptr<engine::ShaderFactory> m_ShaderFactory;
-    std::unique_ptr<engine::Scene> m_Scene;
+    // With a target frame time, frames render into the top left of the targets and are upscaled to the window.
+    std::unique_ptr<sanbox::DynamicResolution> m_DynamicResolution;
+    std::unique_ptr<sanbox::SharpenUpscalePass> m_UpscalePass;
+
+    std::unique_ptr<sanbox::ClusteredForwardShadingPass> m_ForwardShadingPass;
+    // Lights without a position are shaded at every pixel; the others go through the light clusters.
+    std::vector<std::shared_ptr<engine::Light>> m_DirectionalLights;
+    std::shared_ptr<render::IDrawStrategy> m_OpaqueDrawStrategy;
+    float m_GridTime = 0.f;
     std::unique_ptr<engine::BindingCache> m_BindingCache;
+    std::unique_ptr<sanbox::BindlessMaterialTable> m_MaterialTable;
+    // Set when the scene has materials that the table has not seen yet.
+    bool m_MaterialTableStale = false;
+    sanbox::DrawSubmissionStatistics m_DrawStatistics;
+    sanbox::BindingSetTracker m_BindingSets;
+    std::unique_ptr<sanbox::PipelineCache> m_PipelineCache;
+    bool m_PipelinesPrecreated = false;
 
     app::FirstPersonCamera m_Camera;
     engine::PlanarView m_View;
+    // When Animate last moved the camera, as the input time of the frame without decoupled updates.
+    std::chrono::high_resolution_clock::time_point m_InputTime;
+
+    std::unique_ptr<sanbox::FrameTimer> m_FrameTimer;
+    std::unique_ptr<sanbox::CameraPathRecorder> m_CameraPathRecorder;
+
+    std::unique_ptr<sanbox::ParallelDrawRecorder> m_DrawRecorder;
+
+    // Last, so that the thread stops before the state it simulates goes away.
+    std::unique_ptr<sanbox::SimulationThread> m_SimulationThread;
+    // What the current frame draws; the simulation thread does not touch it until the next one is taken.
+    const sanbox::SimulationSnapshot* m_Snapshot = nullptr;
 
 public:
-    using ApplicationBase::ApplicationBase;
+    ForwardRendering(app::DeviceManager* deviceManager, const sanbox::BenchmarkParameters& benchmarkParams)
+        : SceneApplication(deviceManager, benchmarkParams) {
+    }
 
     bool Init() {
         std::filesystem::path sceneFileName
             = app::GetDirectoryWithExecutable().parent_path() / "media/glTF-Sample-Assets/Models/Sponza/glTF/Sponza.gltf";
         std::filesystem::path frameworkShaderPath
             = app::GetDirectoryWithExecutable() / "shaders/framework" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
+        std::filesystem::path sanboxShaderPath
+            = app::GetDirectoryWithExecutable() / "shaders/sanbox-common" / app::GetShaderTypeName(GetDevice()->getGraphicsAPI());
 
         m_RootFS = std::make_shared<vfs::RootFileSystem>();
         m_RootFS->mount("/shaders/donut", frameworkShaderPath);
+        m_RootFS->mount("/shaders/sanbox", sanboxShaderPath);
 
         m_ShaderFactory = std::make_shared<engine::ShaderFactory>(GetDevice(), m_RootFS, "/shaders");
         m_CommonPasses = std::make_shared<engine::CommonRenderPasses>(GetDevice(), m_ShaderFactory);
         m_BindingCache = std::make_unique<engine::BindingCache>(GetDevice());
+        m_RenderTargetHeaps = std::make_unique<sanbox::RenderTargetHeapPool>(GetDevice());
+        m_RenderGraph = std::make_unique<sanbox::RenderGraph>(GetDevice(), *m_RenderTargetHeaps);
+        std::filesystem::path pipelineCacheFileName;
+        if (m_BenchmarkParams.pipelineCache) {
+            pipelineCacheFileName = app::GetDirectoryWithExecutable() / "pipeline-cache"
+                                  / (std::string(STRINGIFY(PROJECT_NAME)) + "-" + app::GetShaderTypeName(GetDevice()->getGraphicsAPI()) + ".bin");
+        }
+        m_PipelineCache = std::make_unique<sanbox::PipelineCache>(pipelineCacheFileName);
+        if (m_BenchmarkParams.bindlessMaterials) {
+            if (m_BenchmarkParams.gpuDriven) {
+                log::warning("Bindless materials only apply to the CPU draw paths");
+            } else {
+                m_MaterialTable = std::make_unique<sanbox::BindlessMaterialTable>(GetDevice(), m_CommonPasses->m_AnisotropicWrapSampler);
+            }
+        }
+
+        // Before the scene, which SceneReady hands to the simulation thread and the shadow map when it is
+        // loaded synchronously.
+        if (m_BenchmarkParams.decoupledUpdate) {
+            m_SimulationThread = std::make_unique<sanbox::SimulationThread>(m_BenchmarkParams.updateRate);
+        }
+        if (m_BenchmarkParams.shadows) {
+            if (m_BenchmarkParams.vertexQuantization) {
+                log::warning("Shadow maps are not drawn from quantized vertices");
+            } else {
+                m_ShadowMap = std::make_unique<sanbox::CachedShadowMap>(GetDevice(), m_CommonPasses, m_BenchmarkParams.shadowMapSize);
+                m_ShadowMap->Init(*m_ShaderFactory, sanbox::FramePipeline::c_MaxFramesInFlight);
+                m_ShadowMap->SetCachingEnabled(m_BenchmarkParams.shadowCache);
+            }
+        }
 
         auto nativeFS = std::make_shared<vfs::NativeFileSystem>();
         m_TextureCache = std::make_shared<engine::TextureCache>(GetDevice(), nativeFS, nullptr);
+        if (m_BenchmarkParams.textureStreaming) {
+            m_TextureStreamer = std::make_unique<sanbox::TextureStreamer>(GetDevice(), nativeFS, uint64_t(m_BenchmarkParams.textureBudgetMB) << 20);
+        }
 
-        SetAsynchronousLoadingEnabled(false);
-        BeginLoadingScene(nativeFS, sceneFileName);
-
-        m_Scene->FinishedLoading(GetFrameIndex());
+        if (m_BenchmarkParams.asyncLoading) {
+            m_SceneLoader = std::make_unique<sanbox::ProgressiveSceneLoader>(m_TextureCache, 0, m_BenchmarkParams.textureUploadBudgetMs);
+            m_SceneLoader->Start(CreateScene(nativeFS), sceneFileName);
+        } else {
+            SetAsynchronousLoadingEnabled(false);
+            BeginLoadingScene(nativeFS, sceneFileName);
+            if (!m_Scene) {
+                return false;
+            }
+            SceneReady();
+        }
 
         m_Camera.LookAt(dm::float3(0.f, 1.8f, 0.f), dm::float3(1.f, 1.8f, 0.f));
         m_Camera.SetMoveSpeed(3.f);
 
-        m_CommandList = GetDevice()->createCommandList();
+        m_FramePipeline = std::make_unique<sanbox::FramePipeline>(GetDevice(), m_BenchmarkParams.framesInFlight);
+        m_FrameTimer = std::make_unique<sanbox::FrameTimer>(GetDevice(), m_FramePipeline->GetFramesInFlight() + 2);
+        m_Profiler = std::make_unique<sanbox::Profiler>(GetDevice(), m_FramePipeline->GetFramesInFlight() + 2);
+        m_Profiler->SetTraceCaptureEnabled(!m_BenchmarkParams.traceOutput.empty());
+
+        if (!m_BenchmarkParams.recordCameraPath.empty()) {
+            m_CameraPathRecorder = std::make_unique<sanbox::CameraPathRecorder>(m_BenchmarkParams.recordCameraPath);
+        }
 
-        m_ForwardShadingPass = std::make_unique<render::ForwardShadingPass>(GetDevice(), m_CommonPasses);
+        if (m_BenchmarkParams.targetFrameMs > 0.f) {
+            sanbox::DynamicResolutionParameters resolutionParams;
+            resolutionParams.targetFrameMs = m_BenchmarkParams.targetFrameMs;
+            resolutionParams.minScale = m_BenchmarkParams.minRenderScale;
+            resolutionParams.maxScale = m_BenchmarkParams.maxRenderScale;
+            m_DynamicResolution = std::make_unique<sanbox::DynamicResolution>(resolutionParams);
+            m_UpscalePass = std::make_unique<sanbox::SharpenUpscalePass>(GetDevice(), m_ShaderFactory, m_CommonPasses);
+            if (!m_UpscalePass->Init()) {
+                return false;
+            }
+        }
+
+        uint32_t constantBufferVersionsPerFrame = sanbox::FramePipeline::c_ConstantBufferVersionsPerFrame;
+        if (m_BenchmarkParams.gpuDriven) {
+            m_GpuDrivenRenderer = std::make_unique<sanbox::GpuDrivenRenderer>(GetDevice(), m_ShaderFactory);
+            if (!m_GpuDrivenRenderer->Init()) {
+                return false;
+            }
+        } else if (m_BenchmarkParams.recordingThreads != 1) {
+            m_JobSystem = std::make_unique<sanbox::JobSystem>(m_BenchmarkParams.recordingThreads ? m_BenchmarkParams.recordingThreads - 1 : 0);
+            m_DrawRecorder = std::make_unique<sanbox::ParallelDrawRecorder>(GetDevice(), m_JobSystem.get(), m_FramePipeline->GetFramesInFlight());
+            constantBufferVersionsPerFrame += m_DrawRecorder->GetMaxCommandListsPerFrame();
+        }
+
+        m_ForwardShadingPass = std::make_unique<sanbox::ClusteredForwardShadingPass>(GetDevice(), m_CommonPasses);
+        m_ForwardShadingPass->SetNaiveLightLoop(m_BenchmarkParams.naiveLightLoop);
+        m_ForwardShadingPass->SetVertexQuantization(m_BenchmarkParams.vertexQuantization);
+        m_ForwardShadingPass->SetBindlessMaterials(m_MaterialTable != nullptr);
+        m_ForwardShadingPass->SetPipelineCache(m_PipelineCache.get());
         render::ForwardShadingPass::CreateParameters forwardParams;
-        forwardParams.numConstantBufferVersions = 128;
+        forwardParams.numConstantBufferVersions = m_FramePipeline->GetFramesInFlight() * constantBufferVersionsPerFrame;
+        forwardParams.useInputAssembler = m_BenchmarkParams.gpuDriven;
         m_ForwardShadingPass->Init(*m_ShaderFactory, forwardParams);
+        if (m_VertexQuantizer) {
+            m_ForwardShadingPass->SetQuantizedMeshBuffer(m_VertexQuantizer->GetMeshDataBuffer());
+        }
+        log::info("Light clustering kernel: %s", sanbox::LightClusterGrid::GetKernelName());
+
+        if (m_BenchmarkParams.bvhCulling) {
+            m_CulledDrawStrategy = std::make_shared<sanbox::CulledDrawStrategy>();
+            m_OpaqueDrawStrategy = m_CulledDrawStrategy;
+            if (m_MeshLods) {
+                m_CulledDrawStrategy->SetLods(m_MeshLods.get(), m_BenchmarkParams.lodErrorPixels);
+            }
+            m_CulledDrawStrategy->SetTransformHierarchy(m_TransformHierarchy.get());
+            log::info("Frustum culling kernel: %s", sanbox::FrustumCuller::GetKernelName());
+        } else {
+            m_OpaqueDrawStrategy = std::make_shared<render::InstancedOpaqueDrawStrategy>();
+        }
 
         CreateRenderTargets();
 
         return true;
     }
 
+    // Declares the targets and passes of a frame; a resize places the new targets in the heap of the old ones.
     void CreateRenderTargets() {
         int w, h;
         GetDeviceManager()->GetWindowDimensions(w, h);
@@ -85,106 +241,553 @@ public:
                                .setWidth(uint32_t(w))
                                .setHeight(uint32_t(h))
                                .setClearValue(nvrhi::Color(0.f))
-                               .setIsRenderTarget(true)
-                               .setKeepInitialState(true);
-
-        m_ColorBuffer = GetDevice()->createTexture(
-            textureDesc.setDebugName("ColorBuffer").setFormat(nvrhi::Format::SRGBA8_UNORM).setInitialState(nvrhi::ResourceStates::RenderTarget));
-
-        m_DepthBuffer = GetDevice()->createTexture(
-            textureDesc.setDebugName("DepthBuffer").setFormat(nvrhi::Format::D32).setInitialState(nvrhi::ResourceStates::DepthWrite));
+                               .setIsRenderTarget(true);
+
+        m_RenderGraph->Reset();
+        const auto color = m_RenderGraph->CreateTexture(textureDesc.setDebugName("ColorBuffer").setFormat(nvrhi::Format::SRGBA8_UNORM));
+        const auto depth = m_RenderGraph->CreateTexture(textureDesc.setDebugName("DepthBuffer").setFormat(nvrhi::Format::D32));
+
+        m_ClearPass = m_RenderGraph->AddPass("Clear")
+                          .Write(color, nvrhi::ResourceStates::RenderTarget)
+                          .Write(depth, nvrhi::ResourceStates::DepthWrite)
+                          .GetId();
+        m_ForwardPass = m_RenderGraph->AddPass("ForwardPass")
+                            .Write(color, nvrhi::ResourceStates::RenderTarget)
+                            .Write(depth, nvrhi::ResourceStates::DepthWrite)
+                            .SkipAutomaticBarriers()
+                            .GetId();
+        m_BlitPass = m_RenderGraph->AddPass("Blit").Read(color).GetId();
+        m_RenderGraph->Compile();
+
+        m_ColorBuffer = m_RenderGraph->GetTexture(color);
+        m_DepthBuffer = m_RenderGraph->GetTexture(depth);
 
         m_Framebuffer = std::make_unique<engine::FramebufferFactory>(GetDevice());
         m_Framebuffer->RenderTargets.push_back(m_ColorBuffer);
         m_Framebuffer->DepthTarget = m_DepthBuffer;
     }
 
-    bool LoadScene(std::shared_ptr<vfs::IFileSystem> fs, const std::filesystem::path& sceneFileName) override {
-        std::unique_ptr<engine::Scene> scene = std::make_unique<engine::Scene>(GetDevice(), *m_ShaderFactory, fs, m_TextureCache, nullptr, nullptr);
+    void ScenePrepared() override {
+        m_MaterialTableStale = m_MaterialTable != nullptr;
+        // With synchronous loading the pass does not exist yet; Init hands it the buffer then.
+        if (m_VertexQuantizer && m_ForwardShadingPass) {
+            m_ForwardShadingPass->SetQuantizedMeshBuffer(m_VertexQuantizer->GetMeshDataBuffer());
+        }
+        m_DirectionalLights.clear();
+        for (const auto& light : m_Scene->GetSceneGraph()->GetLights()) {
+            if (light->GetLightType() == LightType_Directional) {
+                m_DirectionalLights.push_back(light);
+            }
+        }
+    }
 
-        if (scene->Load(sceneFileName)) {
-            m_Scene = std::move(scene);
-            return true;
+    void UpdateTextureStreaming(nvrhi::ICommandList* commandList) {
+        sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "TextureStreaming");
+        if (m_TextureStreamer->Update(commandList, m_View)) {
+            MaterialTexturesChanged(commandList);
+        }
+        const sanbox::TextureStreamingStatistics& stats = m_TextureStreamer->GetStatistics();
+        m_Profiler->SetCounter("textureResidentMB", double(stats.residentBytes) / double(1 << 20));
+        m_Profiler->SetCounter("textureRequestedMB", double(stats.requestedBytes) / double(1 << 20));
+        m_Profiler->SetCounter("textureUploadedMB", double(stats.uploadedBytes) / double(1 << 20));
+        m_Profiler->SetCounter("textureEvictedMB", double(stats.evictedBytes) / double(1 << 20));
+        m_Profiler->SetCounter("texturePendingRequests", stats.pendingRequests);
+        m_Profiler->SetCounter("textureDeniedRequests", stats.deniedRequests);
+        m_Profiler->SetCounter("textureBudgetPressure", stats.GetBudgetPressure());
+    }
+
+    // Moves the grid and brings the instance buffer and the culling bounds along, each step in a scope of
+    // its own so that the transform backends can be compared apart from the draw.
+    void UpdateInstanceGrid(nvrhi::ICommandList* commandList) {
+        const bool animate = m_BenchmarkParams.animateGrid;
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), nullptr, "TransformUpdate");
+            if (m_SimulationTransforms) {
+                m_TransformHierarchy->ApplyInstances(m_Snapshot->instances);
+            } else if (m_TransformHierarchy) {
+                if (animate) {
+                    m_InstanceGrid->Animate(m_GridTime, *m_TransformHierarchy);
+                }
+                m_TransformHierarchy->Update(m_JobSystem.get());
+            } else {
+                if (animate) {
+                    m_InstanceGrid->Animate(m_GridTime);
+                }
+                m_Scene->RefreshSceneGraph(GetFrameIndex());
+            }
+        }
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "InstanceUpload");
+            if (m_TransformHierarchy) {
+                m_TransformHierarchy->UploadInstances(commandList, m_Scene->GetInstanceBuffer());
+            } else {
+                m_Scene->RefreshBuffers(commandList, GetFrameIndex());
+            }
+        }
+        if (m_CulledDrawStrategy) {
+            sanbox::ProfilerScope scope(m_Profiler.get(), nullptr, "BoundsRefit");
+            m_CulledDrawStrategy->SyncInstances(*m_Scene->GetSceneGraph());
+        }
+
+        m_Profiler->SetCounter("gridInstances", double(m_Scene->GetSceneGraph()->GetMeshInstances().size()));
+        if (m_TransformHierarchy) {
+            const sanbox::TransformUpdateStatistics& stats = m_TransformHierarchy->GetStatistics();
+            m_Profiler->SetCounter("transformUpdatedNodes", stats.updatedNodes);
+            m_Profiler->SetCounter("movedInstances", stats.movedInstances);
+            m_Profiler->SetCounter("instanceUploadKB", double(stats.uploadedBytes) / 1024.0);
+        }
+    }
+
+    // Material constants and binding sets refer to the texture objects, which loading and streaming replace.
+    // The bindless table only has its descriptors rewritten, and the pass's binding sets stay valid. The shadow
+    // depth pass always binds the textures of alpha-tested materials itself.
+    void MaterialTexturesChanged(nvrhi::ICommandList* commandList) override {
+        m_Scene->RefreshBuffers(commandList, GetFrameIndex());
+        if (m_TransformHierarchy) {
+            m_TransformHierarchy->InvalidateInstanceBuffer();
+        }
+        if (m_ShadowMap) {
+            m_ShadowMap->ResetBindingCache();
+        }
+        if (m_MaterialTable) {
+            UpdateMaterialTable(commandList);
+        } else {
+            ResetPassCaches();
+        }
+    }
+
+    void UpdateMaterialTable(nvrhi::ICommandList* commandList) {
+        m_MaterialTable->Update(commandList, *m_Scene->GetSceneGraph(), GetFrameIndex());
+        m_ForwardShadingPass->SetMaterialTable(m_MaterialTable.get());
+        m_MaterialTableStale = false;
+    }
+
+    void ResetPassCaches() {
+        m_ForwardShadingPass->ResetBindingCache();
+        if (m_DrawRecorder) {
+            m_DrawRecorder->ResetPassCaches();
+        }
+        m_BindingSets.Reset();
+    }
+
+    // Camera input runs on the simulation thread when that animates the camera.
+    void UpdateCamera(std::function<void()> update) {
+        if (m_SimulationThread) {
+            m_SimulationThread->Post(std::move(update));
+        } else {
+            update();
         }
-        return false;
     }
 
     bool KeyboardUpdate(int key, int scancode, int action, int mods) override {
-        m_Camera.KeyboardUpdate(key, scancode, action, mods);
+        UpdateCamera([this, key, scancode, action, mods] { m_Camera.KeyboardUpdate(key, scancode, action, mods); });
+
+        if (key == GLFW_KEY_L && action == GLFW_PRESS && m_MeshLods && m_CulledDrawStrategy) {
+            const bool enable = !m_CulledDrawStrategy->GetLods();
+            m_CulledDrawStrategy->SetLods(enable ? m_MeshLods.get() : nullptr, m_BenchmarkParams.lodErrorPixels);
+            log::info("Mesh LODs: %s", enable ? "on" : "off");
+        }
 
         return true;
     }
 
     bool MousePosUpdate(double xpos, double ypos) override {
-        m_Camera.MousePosUpdate(xpos, ypos);
+        UpdateCamera([this, xpos, ypos] { m_Camera.MousePosUpdate(xpos, ypos); });
         return true;
     }
 
     bool MouseButtonUpdate(int button, int action, int mods) override {
-        m_Camera.MouseButtonUpdate(button, action, mods);
+        UpdateCamera([this, button, action, mods] { m_Camera.MouseButtonUpdate(button, action, mods); });
         return true;
     }
 
     void Animate(float fElapsedTimeSeconds) override {
-        m_Camera.Animate(fElapsedTimeSeconds);
+        if (!m_SimulationThread) {
+            m_Camera.Animate(fElapsedTimeSeconds);
+            m_InputTime = std::chrono::high_resolution_clock::now();
+            if (m_CameraPathRecorder) {
+                m_CameraPathRecorder->Animate(fElapsedTimeSeconds, m_Camera);
+            }
+        }
+        if (m_InstanceGrid && m_BenchmarkParams.animateGrid) {
+            m_GridTime += fElapsedTimeSeconds;
+        }
+    }
+
+    // One update of the simulation thread: the camera, and the grid when the SoA hierarchy moves it.
+    void Simulate(float elapsedTimeSeconds, sanbox::SimulationSnapshot& snapshot) {
+        m_Camera.Animate(elapsedTimeSeconds);
+        if (m_CameraPathRecorder) {
+            m_CameraPathRecorder->Animate(elapsedTimeSeconds, m_Camera);
+        }
+        snapshot.cameraPosition = m_Camera.GetPosition();
+        snapshot.cameraDirection = m_Camera.GetDir();
+        snapshot.worldToView = m_Camera.GetWorldToViewMatrix();
+
+        if (m_SimulationTransforms) {
+            if (m_BenchmarkParams.animateGrid) {
+                m_InstanceGrid->Animate(float(snapshot.time), *m_SimulationTransforms);
+            }
+            // On this thread alone: the job system belongs to the render thread.
+            m_SimulationTransforms->Update(nullptr);
+            m_SimulationTransforms->CaptureInstances(snapshot.instances);
+        }
+    }
+
+    void SetCameraPose(const dm::float3& position, const dm::float3& target) override {
+        UpdateCamera([this, position, target] { m_Camera.LookAt(position, target); });
+    }
+
+    sanbox::FrameTimer* GetFrameTimer() override {
+        return m_FrameTimer.get();
+    }
+
+    void ReportMetrics(sanbox::BenchmarkRecorder& recorder) override {
+        m_Profiler->ResolveAll();
+        sanbox::ReportProfilerMetrics(*m_Profiler, recorder);
+
+        recorder.SetMetric("sceneLoadMs", m_SceneLoadStatistics.loadMs);
+        recorder.SetMetric("sceneLoadFromCache", m_SceneLoadStatistics.fromCache ? 1.0 : 0.0);
+        if (m_SceneLoader) {
+            const sanbox::SceneLoadingTimeline& timeline = m_SceneLoader->GetTimeline();
+            recorder.SetMetric("timeToFirstFrameMs", timeline.firstFrameMs);
+            recorder.SetMetric("timeToSceneMs", timeline.sceneMs);
+            recorder.SetMetric("timeToTexturesMs", timeline.texturesMs);
+        }
+        if (m_TextureStreamer) {
+            const sanbox::TextureStreamingStatistics& stats = m_TextureStreamer->GetStatistics();
+            recorder.SetMetric("textureBudgetMB", double(stats.budgetBytes) / double(1 << 20));
+            recorder.SetMetric("textureResidentMB", double(stats.residentBytes) / double(1 << 20));
+            recorder.SetMetric("textureRequestedMB", double(stats.requestedBytes) / double(1 << 20));
+            recorder.SetMetric("textureBudgetPressure", stats.GetBudgetPressure());
+            recorder.SetMetric("texturePendingRequests", stats.pendingRequests);
+        }
+        if (m_BenchmarkParams.meshOptimization || m_BenchmarkParams.vertexQuantization) {
+            recorder.SetMetric("meshAcmrBefore", m_MeshProcessing.acmrBefore);
+            recorder.SetMetric("meshAcmrAfter", m_MeshProcessing.acmrAfter);
+            recorder.SetMetric("meshVertexMBBefore", double(m_MeshProcessing.vertexBytesBefore) / double(1 << 20));
+            recorder.SetMetric("meshVertexMBAfter", double(m_MeshProcessing.vertexBytesAfter) / double(1 << 20));
+        }
+        if (m_MeshLods) {
+            const sanbox::MeshLodStatistics& stats = m_MeshLods->GetStatistics();
+            recorder.SetMetric("lodBuildMs", stats.buildMs);
+            recorder.SetMetric("lodFromCache", stats.fromCache ? 1.0 : 0.0);
+            recorder.SetMetric("lodLevels", stats.levels);
+            recorder.SetMetric("lodIndexMB", double(stats.lodTriangles * 3 * sizeof(uint32_t)) / double(1 << 20));
+        }
+        if (m_InstanceGrid) {
+            recorder.SetMetric("gridCells", m_InstanceGrid->GetCellCount());
+            recorder.SetMetric("gridInstances", double(m_Scene->GetSceneGraph()->GetMeshInstances().size()));
+        }
+        if (m_TransformHierarchy) {
+            const sanbox::TransformUpdateStatistics& stats = m_TransformHierarchy->GetStatistics();
+            recorder.SetMetric("transformNodes", stats.nodes);
+            recorder.SetMetric("transformLevels", stats.levels);
+        }
+        const sanbox::RenderGraphStatistics& graphStats = m_RenderGraph->GetStatistics();
+        recorder.SetMetric("renderTargetDedicatedMB", double(graphStats.dedicatedBytes) / double(1 << 20));
+        recorder.SetMetric("renderTargetPeakMB", double(graphStats.peakBytes) / double(1 << 20));
+        recorder.SetMetric("renderTargetHeapMB", double(graphStats.heapBytes) / double(1 << 20));
+        recorder.SetMetric("renderTargetHeapsCreated", m_RenderTargetHeaps->GetCreatedHeaps());
+        recorder.SetMetric("renderGraphCompiles", graphStats.compiles);
+        recorder.SetMetric("recordingThreads", m_DrawRecorder ? double(m_DrawRecorder->GetThreadCount()) : 1.0);
+        if (m_DrawRecorder) {
+            recorder.SetMetric("drawItems", double(m_DrawRecorder->GetDrawCount()));
+            recorder.SetMetric("recordingCommandLists", double(m_DrawRecorder->GetCommandLists().size()));
+        }
+        const sanbox::PipelineCacheStatistics pipelineStats = m_PipelineCache->GetStatistics();
+        recorder.SetMetric("pipelineCacheEntries", pipelineStats.loadedEntries);
+        recorder.SetMetric("pipelinesCreated", pipelineStats.created);
+        recorder.SetMetric("pipelinesPrecreated", pipelineStats.precreated);
+        recorder.SetMetric("pipelineShaderChanges", pipelineStats.changedShaders);
+        recorder.SetMetric("pipelineCreateMs", pipelineStats.createMs);
+        recorder.SetMetric("pipelinePrecreateMs", pipelineStats.precreateMs);
+        recorder.SetMetric("bindlessMaterials", m_MaterialTable ? 1.0 : 0.0);
+        if (m_MaterialTable) {
+            const sanbox::BindlessMaterialStatistics& stats = m_MaterialTable->GetStatistics();
+            recorder.SetMetric("bindlessMaterialCount", stats.materials);
+            recorder.SetMetric("bindlessTextures", stats.textures);
+        }
+        if (m_DynamicResolution) {
+            const sanbox::DynamicResolutionStatistics& stats = m_DynamicResolution->GetStatistics();
+            recorder.SetMetric("renderScaleMean", stats.meanScale);
+            recorder.SetMetric("renderScaleLowest", stats.lowestScale);
+            recorder.SetMetric("renderScaleChanges", stats.scaleChanges);
+            recorder.SetMetric("framesOverTarget", stats.framesOverTarget);
+        }
+        if (m_ShadowMap) {
+            const sanbox::ShadowStatistics& stats = m_ShadowMap->GetStatistics();
+            recorder.SetMetric("shadowMapSize", m_BenchmarkParams.shadowMapSize);
+            recorder.SetMetric("shadowCache", m_BenchmarkParams.shadowCache ? 1.0 : 0.0);
+            recorder.SetMetric("shadowStaticCasters", stats.staticCasters);
+            recorder.SetMetric("shadowDynamicCasters", stats.dynamicCasters);
+        }
+        recorder.SetMetric("decoupledUpdate", m_SimulationThread ? 1.0 : 0.0);
+        if (m_SimulationThread) {
+            const sanbox::SimulationStatistics stats = m_SimulationThread->GetStatistics();
+            recorder.SetMetric("updateRate", m_BenchmarkParams.updateRate);
+            recorder.SetMetric("simulationUpdates", double(stats.updates));
+            recorder.SetMetric("skippedSnapshots", double(stats.skippedSnapshots));
+            recorder.SetMetric("repeatedSnapshots", double(stats.repeatedSnapshots));
+        }
+    }
+
+    const sanbox::Profiler* GetProfiler() const {
+        return m_Profiler.get();
+    }
+
+    std::shared_ptr<engine::ShaderFactory> GetShaderFactory() const {
+        return m_ShaderFactory;
+    }
+
+    void WriteProfilerTrace(const std::filesystem::path& fileName) {
+        m_FramePipeline->WaitForIdle();
+        m_Profiler->ResolveAll();
+        m_Profiler->WriteChromeTrace(fileName);
     }
 
     void BackBufferResizing() override {
     }
 
+    // Draws the static casters of the cascades whose projection changed and the dynamic casters of all of
+    // them, in scopes of their own so that the cached part shows apart from the part drawn every frame.
+    void RenderShadows(nvrhi::ICommandList* commandList) {
+        sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "Shadows");
+        m_ShadowMap->Update(*m_Scene->GetSceneGraph(), *m_SunLight, m_View);
+        {
+            sanbox::ProfilerScope staticScope(m_Profiler.get(), commandList, "ShadowStatic");
+            m_ShadowMap->RenderStatic(commandList);
+        }
+        {
+            sanbox::ProfilerScope dynamicScope(m_Profiler.get(), commandList, "ShadowDynamic");
+            m_ShadowMap->RenderDynamic(commandList);
+        }
+
+        const sanbox::ShadowStatistics& stats = m_ShadowMap->GetStatistics();
+        m_Profiler->SetCounter("shadowStaticCascades", stats.staticCascadesRendered);
+        m_Profiler->SetCounter("shadowStaticDraws", stats.staticDraws);
+        m_Profiler->SetCounter("shadowDynamicDraws", stats.dynamicDraws);
+        m_Profiler->SetCounter("shadowCascadeCopies", stats.cascadeCopies);
+    }
+
+    // Leaves the "ForwardPass" scope open; it is closed on the post command list after the worker lists.
+    void RecordForwardPassParallel(sanbox::FrameContext& frame) {
+        nvrhi::ICommandList* commandList = frame.commandList;
+        m_Profiler->BeginScope(commandList, "ForwardPass", false);
+        // The workers record on lists of their own, which find the targets in the states committed here.
+        m_RenderGraph->BeginPass(commandList, m_ForwardPass);
+        m_RenderGraph->EndPass(commandList, m_ForwardPass);
+
+        m_DrawRecorder->Gather(m_Scene->GetSceneGraph()->GetRootNode(), *m_OpaqueDrawStrategy, m_View);
+
+        using Context = sanbox::ClusteredForwardShadingPass::Context;
+        m_DrawRecorder->Record<Context>(uint32_t(frame.frameNumber), commandList, *m_ForwardShadingPass, &m_View, &m_View,
+            m_Framebuffer->GetFramebuffer(m_View), [this](nvrhi::ICommandList* list, Context& context) {
+                m_ForwardShadingPass->PrepareLights(context, list, m_DirectionalLights, 1.0f, 0.3f, {});
+            });
+    }
+
     void Render(nvrhi::IFramebuffer* framebuffer) override {
-        if (!m_Scene) {
+        if (!TakeLoadedScene(framebuffer)) {
             return;
         }
+        if (m_SimulationThread && !m_SimulationThread->IsRunning()) {
+            m_SimulationThread->Start(
+                [this](float elapsedTimeSeconds, sanbox::SimulationSnapshot& snapshot) { Simulate(elapsedTimeSeconds, snapshot); });
+        }
 
         const auto& fbinfo = framebuffer->getFramebufferInfo();
+        const uint2 size = uint2(fbinfo.width, fbinfo.height);
         {
-            uint2 size = uint2(fbinfo.width, fbinfo.height);
             uint2 size2 = uint2(m_ColorBuffer->getDesc().width, m_ColorBuffer->getDesc().height);
 
             if (!m_ColorBuffer || any(size2 != size)) {
                 m_BindingCache->Clear();
-                m_ForwardShadingPass->ResetBindingCache();
+                if (m_UpscalePass) {
+                    m_UpscalePass->ResetBindingCache();
+                }
+                ResetPassCaches();
                 CreateRenderTargets();
             }
         }
 
+        m_Profiler->BeginFrame();
+
+        // The targets keep the window's size; the forward pass renders into the part of them that the view's
+        // viewport covers.
+        uint2 renderSize = size;
+        if (m_DynamicResolution) {
+            if (const uint64_t resolvedFrames = m_Profiler->GetResolvedFrameCount()) {
+                m_DynamicResolution->ReportGpuTime(resolvedFrames - 1, m_Profiler->GetGpuFrameHistory().back());
+            }
+            m_DynamicResolution->BeginFrame(m_Profiler->GetFrameNumber());
+            renderSize = m_DynamicResolution->GetRenderSize(size);
+        }
+
+        m_FrameTimer->BeginFenceWait();
+        sanbox::FrameContext& frame = m_FramePipeline->BeginFrame();
+        m_FrameTimer->EndFenceWait();
+
+        // Taken once the frame slot is free, so that the frame shows the newest update there is.
+        if (m_SimulationThread) {
+            m_Snapshot = m_SimulationThread->AcquireLatest();
+        }
         nvrhi::Viewport windowViewport(float(fbinfo.width), float(fbinfo.height));
-        m_View.SetViewport(windowViewport);
-        m_View.SetMatrices(
-            m_Camera.GetWorldToViewMatrix(), perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
+        m_View.SetViewport(nvrhi::Viewport(float(renderSize.x), float(renderSize.y)));
+        const affine3 worldToView = m_Snapshot ? m_Snapshot->worldToView : m_Camera.GetWorldToViewMatrix();
+        m_View.SetMatrices(worldToView, perspProjD3DStyleReverse(dm::PI_f * 0.25f, windowViewport.width() / windowViewport.height(), 0.1f));
         m_View.UpdateCache();
 
-        m_CommandList->open();
+        nvrhi::ICommandList* commandList = frame.commandList;
+        commandList->open();
+        m_FrameTimer->BeginFrame(commandList);
+        if (m_Snapshot) {
+            m_FrameTimer->SetInputTime(m_Snapshot->inputTime);
+            const auto snapshotAge = std::chrono::high_resolution_clock::now() - m_Snapshot->publishTime;
+            m_Profiler->SetCounter("snapshotAgeMs", std::chrono::duration<double, std::milli>(snapshotAge).count());
+        } else {
+            m_FrameTimer->SetInputTime(m_InputTime);
+        }
+
+        if (m_SceneLoader && !m_SceneLoader->IsComplete()) {
+            UpdateSceneTextures(commandList);
+        }
+        if (m_TextureStreamer) {
+            UpdateTextureStreaming(commandList);
+        }
+        // The grid grew the instance buffer, which the binding sets refer to as well.
+        if (m_SceneBuffersStale) {
+            MaterialTexturesChanged(commandList);
+            ResetPassCaches();
+            m_SceneBuffersStale = false;
+        }
+        if (m_MaterialTableStale) {
+            UpdateMaterialTable(commandList);
+        }
+        // The formats stay when the window is resized, and so do the pipelines.
+        if (!m_PipelinesPrecreated) {
+            m_ForwardShadingPass->PrecreatePipelines(m_Framebuffer->GetFramebuffer(m_View));
+            m_PipelinesPrecreated = true;
+        }
+        if (m_InstanceGrid) {
+            UpdateInstanceGrid(commandList);
+        }
+
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "Clear");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_ClearPass);
+            commandList->clearTextureFloat(m_ColorBuffer, nvrhi::AllSubresources, nvrhi::Color(0.0f));
+            commandList->clearDepthStencilTexture(m_DepthBuffer, nvrhi::AllSubresources, true, 0.f, false, 0);
+        }
+
+        if (m_ShadowMap) {
+            RenderShadows(commandList);
+        }
 
-        m_CommandList->clearTextureFloat(m_ColorBuffer, nvrhi::AllSubresources, nvrhi::Color(0.0f));
-        m_CommandList->clearDepthStencilTexture(m_DepthBuffer, nvrhi::AllSubresources, true, 0.f, false, 0);
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "LightClustering");
+            m_ForwardShadingPass->PrepareClusters(commandList, m_View, m_Scene->GetSceneGraph()->GetLights());
+        }
 
-        render::ForwardShadingPass::Context context;
-        m_ForwardShadingPass->PrepareLights(context, m_CommandList, {}, 1.0f, 0.3f, {});
+        if (m_GpuDrivenRenderer) {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "ForwardPass");
+            {
+                sanbox::ProfilerScope cullingScope(m_Profiler.get(), commandList, "GpuCulling");
+                m_GpuDrivenRenderer->Update(commandList, *m_Scene->GetSceneGraph(), m_Scene->GetInstanceBuffer());
+                m_GpuDrivenRenderer->Cull(commandList, m_View);
+            }
 
-        m_CommandList->setEnableAutomaticBarriers(false);
-        m_CommandList->setResourceStatesForFramebuffer(m_Framebuffer->GetFramebuffer(m_View));
-        m_CommandList->commitBarriers();
+            render::ForwardShadingPass::Context context;
+            m_ForwardShadingPass->PrepareLights(context, commandList, m_DirectionalLights, 1.0f, 0.3f, {});
+
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_ForwardPass);
+            m_GpuDrivenRenderer->Render(commandList, &m_View, &m_View, m_Framebuffer->GetFramebuffer(m_View), *m_ForwardShadingPass, context);
+        } else if (m_DrawRecorder) {
+            RecordForwardPassParallel(frame);
+            commandList->close();
+            commandList = frame.postCommandList;
+            commandList->open();
+            m_Profiler->EndScope(commandList);
+        } else {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "ForwardPass");
+
+            sanbox::ClusteredForwardShadingPass::Context context;
+            m_ForwardShadingPass->PrepareLights(context, commandList, m_DirectionalLights, 1.0f, 0.3f, {});
+
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_ForwardPass);
+            m_DrawStatistics = {};
+            m_OpaqueDrawStrategy->PrepareForView(m_Scene->GetSceneGraph()->GetRootNode(), m_View);
+            sanbox::RenderDrawItems(commandList, &m_View, &m_View, m_Framebuffer->GetFramebuffer(m_View), *m_OpaqueDrawStrategy,
+                *m_ForwardShadingPass, context, m_DrawStatistics, &m_BindingSets);
+        }
 
-        render::InstancedOpaqueDrawStrategy strategy;
-        render::RenderCompositeView(
-            m_CommandList, &m_View, &m_View, *m_Framebuffer, m_Scene->GetSceneGraph()->GetRootNode(), strategy, *m_ForwardShadingPass, context);
+        {
+            sanbox::ProfilerScope scope(m_Profiler.get(), commandList, "Blit");
+            sanbox::RenderGraphPassScope pass(*m_RenderGraph, commandList, m_BlitPass);
+            if (m_UpscalePass) {
+                m_UpscalePass->Render(commandList, framebuffer, m_ColorBuffer, m_View.GetViewExtent(), m_BenchmarkParams.upscaleSharpness);
+            } else {
+                engine::BlitParameters bp;
+                bp.targetFramebuffer = framebuffer;
+                bp.targetViewport = windowViewport;
+                bp.sourceTexture = m_ColorBuffer;
+                bp.sourceMip = 0;
+                m_CommonPasses->BlitTexture(commandList, bp, m_BindingCache.get());
+            }
+        }
 
-        m_CommandList->setEnableAutomaticBarriers(true);
+        m_FrameTimer->EndFrame(commandList);
+        commandList->close();
 
         {
-            engine::BlitParameters bp;
-            bp.targetFramebuffer = framebuffer;
-            bp.targetViewport = windowViewport;
-            bp.sourceTexture = m_ColorBuffer;
-            bp.sourceMip = 0;
-            m_CommonPasses->BlitTexture(m_CommandList, bp, m_BindingCache.get());
+            sanbox::ProfilerScope scope(m_Profiler.get(), nullptr, "Submit");
+            m_FrameTimer->BeginSubmit();
+            if (m_DrawRecorder) {
+                m_FramePipeline->Submit(frame, m_DrawRecorder->GetCommandLists());
+            } else {
+                m_FramePipeline->Submit(frame);
+            }
+            m_FrameTimer->EndSubmit();
+        }
+
+        if (m_SceneLoader) {
+            m_SceneLoader->FrameRendered();
+        }
+
+        if (m_GpuDrivenRenderer) {
+            m_Profiler->SetCounter("indirectDraws", m_GpuDrivenRenderer->GetDrawCount());
+            m_Profiler->SetCounter("indirectBatches", m_GpuDrivenRenderer->GetBatchCount());
+        } else if (m_CulledDrawStrategy) {
+            const sanbox::FrustumCullStatistics& cullStats = m_CulledDrawStrategy->GetStatistics();
+            m_Profiler->SetCounter("visibleInstances", cullStats.visibleInstances);
+            m_Profiler->SetCounter("totalInstances", cullStats.totalInstances);
+
+            const sanbox::LodSelectionStatistics& lodStats = m_CulledDrawStrategy->GetLodStatistics();
+            m_Profiler->SetCounter("drawnTriangles", double(lodStats.drawnTriangles));
+            m_Profiler->SetCounter("fullDetailTriangles", double(lodStats.fullDetailTriangles));
+            if (m_CulledDrawStrategy->GetLods()) {
+                m_Profiler->SetCounter("coarseLodInstances", lodStats.coarseInstances);
+                m_Profiler->SetCounter("lodSwitches", lodStats.lodSwitches);
+            }
+        }
+
+        if (!m_GpuDrivenRenderer) {
+            const sanbox::DrawSubmissionStatistics& drawStats = m_DrawRecorder ? m_DrawRecorder->GetStatistics() : m_DrawStatistics;
+            m_Profiler->SetCounter("draws", drawStats.draws);
+            m_Profiler->SetCounter("materialChanges", drawStats.materialChanges);
+            m_Profiler->SetCounter("graphicsStateCalls", drawStats.graphicsStateCalls);
+            m_Profiler->SetCounter("bindingSetCreations", drawStats.bindingSetCreations);
         }
 
-        m_CommandList->close();
+        const sanbox::LightClusterStatistics& lightStats = m_ForwardShadingPass->GetStatistics();
+        m_Profiler->SetCounter("clusteredLights", lightStats.lights - lightStats.culledLights);
+        m_Profiler->SetCounter("clusterLightIndices", lightStats.lightIndices);
+        m_Profiler->SetCounter("maxLightsPerCluster", lightStats.maxLightsPerCluster);
+        if (m_DynamicResolution) {
+            m_Profiler->SetCounter("renderScale", m_DynamicResolution->GetScale());
+        }
 
-        GetDevice()->executeCommandList(m_CommandList);
+        m_Profiler->EndFrame();
     }
 };
 
@@ -200,11 +803,15 @@ int main(int __argc, const char** __argv)
         return 1;
     }
 
+    sanbox::BenchmarkParameters benchmarkParams = sanbox::ParseBenchmarkCommandLine(__argc, __argv);
+
     app::DeviceManager* deviceManager = app::DeviceManager::Create(api);
 
     app::DeviceCreationParameters deviceParams;
-    deviceParams.backBufferWidth = 1024;
-    deviceParams.backBufferHeight = 1024;
+    deviceParams.backBufferWidth = benchmarkParams.width;
+    deviceParams.backBufferHeight = benchmarkParams.height;
+    deviceParams.maxFramesInFlight = benchmarkParams.framesInFlight;
+    deviceParams.adapterNameSubstring = std::wstring(benchmarkParams.adapterName.begin(), benchmarkParams.adapterName.end());
 #ifdef _DEBUG
     deviceParams.enableDebugRuntime = true;
     deviceParams.enableNvrhiValidationLayer = true;
@@ -212,17 +819,43 @@ int main(int __argc, const char** __argv)
 
     std::string windowTitle = STRINGIFY(PROJECT_NAME);
 
-    if (!deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str())) {
+    bool deviceCreated = benchmarkParams.headless ? deviceManager->CreateHeadlessDevice(deviceParams)
+                                                  : deviceManager->CreateWindowDeviceAndSwapChain(deviceParams, windowTitle.c_str());
+    if (!deviceCreated) {
         log::fatal("Cannot initialize a graphics device with the requested parameters");
         return 1;
     }
 
+    int exitCode = 0;
     {
-        ForwardRendering example(deviceManager);
-        if (example.Init()) {
+        ForwardRendering example(deviceManager, benchmarkParams);
+        if (!example.Init()) {
+            exitCode = 1;
+        } else if (benchmarkParams.headless) {
+            exitCode = sanbox::RunHeadlessBenchmark(deviceManager, example, example, benchmarkParams, windowTitle.c_str());
+        } else {
+            std::unique_ptr<sanbox::ProfilerOverlay> overlay;
+            if (benchmarkParams.profilerOverlay) {
+                overlay = std::make_unique<sanbox::ProfilerOverlay>(deviceManager, example.GetProfiler());
+                overlay->Init(example.GetShaderFactory());
+            }
+
             deviceManager->AddRenderPassToBack(&example);
+            if (overlay) {
+                deviceManager->AddRenderPassToBack(overlay.get());
+            }
             deviceManager->RunMessageLoop();
+            if (overlay) {
+                deviceManager->RemoveRenderPass(overlay.get());
+            }
             deviceManager->RemoveRenderPass(&example);
+            if (example.HasLoadingFailed()) {
+                exitCode = 1;
+            }
+        }
+
+        if (exitCode == 0 && !benchmarkParams.traceOutput.empty()) {
+            example.WriteProfilerTrace(benchmarkParams.traceOutput);
         }
     }
 
@@ -230,5 +863,5 @@ int main(int __argc, const char** __argv)
 
     delete deviceManager;
 
-    return 0;
+    return exitCode;
 }
\ No newline at end of file
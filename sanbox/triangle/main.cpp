@@ -40,16 +40,13 @@ public:
         return true;
     }
 
-    void BackBufferResizing() override {
-        m_Pipeline = nullptr;
-    }
-
     void Animate(float fElapsedTimeSeconds) override {
         GetDeviceManager()->SetInformativeWindowTitle(g_WindowTitle);
     }
 
     void Render(nvrhi::IFramebuffer* framebuffer) override {
-        if (!m_Pipeline) {
+        // The pipeline depends on the formats of the framebuffer, which a resize keeps.
+        if (!m_Pipeline || m_Pipeline->getFramebufferInfo() != framebuffer->getFramebufferInfo()) {
             nvrhi::GraphicsPipelineDesc psoDesc;
             psoDesc.VS = m_VertexShader;
             psoDesc.PS = m_PixelShader;